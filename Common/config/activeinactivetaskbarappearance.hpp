@@ -22,24 +22,20 @@ struct ActiveInactiveTaskbarAppearance : TaskbarAppearance {
 		rjh::Serialize(writer, Inactive, INACTIVE_KEY);
 	}
 
-	inline void Deserialize(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	inline void Deserialize(Value &obj, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			const auto key = rjh::ValueToStringView(it->name);
 			if (key == INACTIVE_KEY)
 			{
-				rjh::Deserialize(it->value, Inactive, key, unknownKeyCallback);
+				rjh::Deserialize(val, Inactive, key, unknownKeyCallback);
 			}
 			else
 			{
-				InnerDeserialize(key, it->value, unknownKeyCallback);
+				InnerDeserialize(key, val, unknownKeyCallback);
 			}
-		}
+		});
 	}
 
 private:
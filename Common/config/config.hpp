@@ -10,6 +10,9 @@
 #include "rapidjsonhelper.hpp"
 #include "ruledtaskbarappearance.hpp"
 #include "taskbarappearance.hpp"
+#include "../util/binary_log.hpp"
+#include "../util/record_queue.hpp"
+#include "../util/rotating_log.hpp"
 #include "../win32.hpp"
 #include "windowfilter.hpp"
 
@@ -36,6 +39,14 @@ public:
 		spdlog::level::warn;
 #endif
 
+	static constexpr unsigned int DEFAULT_LOG_MAX_FILE_SIZE = 16; // MiB, 0 for no limit
+	static constexpr unsigned int DEFAULT_LOG_RETAINED_FILES = 10; // 0 for no limit
+
+	static constexpr Util::rotation_settings GetLogRotation(unsigned int maxFileSize, unsigned int retainedFiles) noexcept
+	{
+		return { static_cast<std::uint64_t>(maxFileSize) * 1024 * 1024, retainedFiles };
+	}
+
 	// Appearances
 	TaskbarAppearance DesktopAppearance = { ACCENT_ENABLE_TRANSPARENTGRADIENT, { 0, 0, 0, 0 }, false, false, 9.0f };
 	RuledTaskbarAppearance VisibleWindowAppearance = { {}, {}, {}, false, ACCENT_ENABLE_TRANSPARENTGRADIENT, { 0, 0, 0, 0 }, true, false, 9.0f };
@@ -50,6 +61,10 @@ public:
 	std::optional<bool> HideTray;
 	bool DisableSaving = false;
 	spdlog::level::level_enum LogVerbosity = DEFAULT_LOG_VERBOSITY;
+	Util::backpressure LogOverflow = Util::backpressure::block;
+	Util::log_format LogFormat = Util::log_format::text;
+	unsigned int LogMaxFileSize = DEFAULT_LOG_MAX_FILE_SIZE;
+	unsigned int LogRetainedFiles = DEFAULT_LOG_RETAINED_FILES;
 	std::wstring Language;
 	std::optional<bool> UseXamlContextMenu;
 	std::optional<bool> CopyDlls;
@@ -68,6 +83,10 @@ public:
 		rjh::Serialize(writer, HideTray, TRAY_KEY);
 		rjh::Serialize(writer, DisableSaving, SAVING_KEY);
 		rjh::Serialize(writer, LogVerbosity, LOG_KEY, LOG_MAP);
+		rjh::Serialize(writer, LogOverflow, LOG_OVERFLOW_KEY, LOG_OVERFLOW_MAP);
+		rjh::Serialize(writer, LogFormat, LOG_FORMAT_KEY, LOG_FORMAT_MAP);
+		rjh::Serialize(writer, LogMaxFileSize, LOG_MAX_FILE_SIZE_KEY);
+		rjh::Serialize(writer, LogRetainedFiles, LOG_RETAINED_FILES_KEY);
 		if (!Language.empty())
 		{
 			rjh::Serialize(writer, Language, LANGUAGE_KEY);
@@ -76,64 +95,77 @@ public:
 		rjh::Serialize(writer, CopyDlls, COPY_DLLS_KEY);
 	}
 
-	inline void Deserialize(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view) = nullptr)
+	// Value is either a rjh::value_t or a rjh::StreamReader.
+	template<typename Value>
+	inline void Deserialize(Value &obj, void (*unknownKeyCallback)(std::wstring_view) = nullptr)
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			const auto key = rjh::ValueToStringView(it->name);
 			if (key == DESKTOP_KEY)
 			{
-				rjh::Deserialize(it->value, DesktopAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, DesktopAppearance, key, unknownKeyCallback);
 			}
 			else if (key == VISIBLE_KEY)
 			{
-				rjh::Deserialize(it->value, VisibleWindowAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, VisibleWindowAppearance, key, unknownKeyCallback);
 			}
 			else if (key == MAXIMISED_KEY)
 			{
-				rjh::Deserialize(it->value, MaximisedWindowAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, MaximisedWindowAppearance, key, unknownKeyCallback);
 			}
 			else if (key == START_KEY)
 			{
-				rjh::Deserialize(it->value, StartOpenedAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, StartOpenedAppearance, key, unknownKeyCallback);
 			}
 			else if (key == SEARCH_KEY)
 			{
-				rjh::Deserialize(it->value, SearchOpenedAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, SearchOpenedAppearance, key, unknownKeyCallback);
 			}
 			else if (key == TASKVIEW_KEY)
 			{
-				rjh::Deserialize(it->value, TaskViewOpenedAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, TaskViewOpenedAppearance, key, unknownKeyCallback);
 			}
 			else if (key == BATTERYSAVER_KEY)
 			{
-				rjh::Deserialize(it->value, BatterySaverAppearance, key, unknownKeyCallback);
+				rjh::Deserialize(val, BatterySaverAppearance, key, unknownKeyCallback);
 			}
 			else if (key == IGNORED_WINDOWS_KEY)
 			{
-				rjh::Deserialize(it->value, IgnoredWindows, key, unknownKeyCallback);
+				rjh::Deserialize(val, IgnoredWindows, key, unknownKeyCallback);
 			}
 			else if (key == TRAY_KEY)
 			{
-				rjh::Deserialize(it->value, HideTray, key);
+				rjh::Deserialize(val, HideTray, key);
 			}
 			else if (key == SAVING_KEY)
 			{
-				rjh::Deserialize(it->value, DisableSaving, key);
+				rjh::Deserialize(val, DisableSaving, key);
 			}
 			else if (key == LOG_KEY)
 			{
-				rjh::Deserialize(it->value, LogVerbosity, key, LOG_MAP);
+				rjh::Deserialize(val, LogVerbosity, key, LOG_MAP);
+			}
+			else if (key == LOG_OVERFLOW_KEY)
+			{
+				rjh::Deserialize(val, LogOverflow, key, LOG_OVERFLOW_MAP);
+			}
+			else if (key == LOG_FORMAT_KEY)
+			{
+				rjh::Deserialize(val, LogFormat, key, LOG_FORMAT_MAP);
+			}
+			else if (key == LOG_MAX_FILE_SIZE_KEY)
+			{
+				rjh::Deserialize(val, LogMaxFileSize, key);
+			}
+			else if (key == LOG_RETAINED_FILES_KEY)
+			{
+				rjh::Deserialize(val, LogRetainedFiles, key);
 			}
 			else if (key == LANGUAGE_KEY)
 			{
-				rjh::EnsureType(rj::Type::kStringType, it->value.GetType(), key);
+				rjh::EnsureType(rj::Type::kStringType, val.GetType(), key);
 
-				const auto languageStr = rjh::ValueToStringView(it->value);
+				const auto languageStr = rjh::ValueToStringView(val);
 				if (languageStr.empty() || std::regex_match(languageStr.begin(), languageStr.end(), LanguageRegex()))
 				{
 					Language = languageStr;
@@ -147,17 +179,17 @@ public:
 			}
 			else if (key == USE_XAML_CONTEXT_MENU_KEY)
 			{
-				rjh::Deserialize(it->value, UseXamlContextMenu, key);
+				rjh::Deserialize(val, UseXamlContextMenu, key);
 			}
 			else if (key == COPY_DLLS_KEY)
 			{
-				rjh::Deserialize(it->value, CopyDlls, key);
+				rjh::Deserialize(val, CopyDlls, key);
 			}
 			else if (unknownKeyCallback)
 			{
 				unknownKeyCallback(key);
 			}
-		}
+		});
 	}
 
 private:
@@ -171,6 +203,17 @@ private:
 		L"off"
 	};
 
+	static constexpr std::array<std::wstring_view, 3> LOG_OVERFLOW_MAP = {
+		L"block",
+		L"drop_oldest",
+		L"drop_newest"
+	};
+
+	static constexpr std::array<std::wstring_view, 2> LOG_FORMAT_MAP = {
+		L"text",
+		L"binary"
+	};
+
 	static constexpr std::wstring_view DESKTOP_KEY = L"desktop_appearance";
 	static constexpr std::wstring_view VISIBLE_KEY = L"visible_window_appearance";
 	static constexpr std::wstring_view MAXIMISED_KEY = L"maximized_window_appearance";
@@ -182,6 +225,10 @@ private:
 	static constexpr std::wstring_view TRAY_KEY = L"hide_tray";
 	static constexpr std::wstring_view SAVING_KEY = L"disable_saving";
 	static constexpr std::wstring_view LOG_KEY = L"verbosity";
+	static constexpr std::wstring_view LOG_OVERFLOW_KEY = L"log_overflow";
+	static constexpr std::wstring_view LOG_FORMAT_KEY = L"log_format";
+	static constexpr std::wstring_view LOG_MAX_FILE_SIZE_KEY = L"log_max_file_size";
+	static constexpr std::wstring_view LOG_RETAINED_FILES_KEY = L"log_retained_files";
 	static constexpr std::wstring_view LANGUAGE_KEY = L"language";
 	static constexpr std::wstring_view USE_XAML_CONTEXT_MENU_KEY = L"use_xaml_context_menu";
 	static constexpr std::wstring_view COPY_DLLS_KEY = L"copy_dlls";
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "activeinactivetaskbarappearance.hpp"
+#include "config.hpp"
+#include "optionaltaskbarappearance.hpp"
+#include "ruledtaskbarappearance.hpp"
+#include "taskbarappearance.hpp"
+#include "windowfilter.hpp"
+
+// What differs between two configs, so that a reload only redoes the work that depends on it.
+struct ConfigDiff {
+	// Bit n is set when the appearance used for TaskbarState n changed, rules excluded.
+	std::uint8_t Appearances = 0;
+
+	// An optional appearance got enabled or disabled, which changes what taskbars resolve to.
+	bool EnabledStates = false;
+
+	bool VisibleRules = false;
+	bool MaximisedRules = false;
+	bool IgnoredWindows = false;
+
+	bool Tray = false; // tray icon visibility and context menu style
+	bool Logging = false; // verbosity, overflow, format and rotation
+	bool Other = false; // only read when used, like the language or saving being disabled
+
+	static constexpr std::uint8_t AppearanceBit(std::size_t state) noexcept
+	{
+		return static_cast<std::uint8_t>(1u << state);
+	}
+
+	static constexpr ConfigDiff OfAppearance(std::size_t state, bool enabledChanged = false) noexcept
+	{
+		ConfigDiff diff;
+		diff.Appearances = AppearanceBit(state);
+		diff.EnabledStates = enabledChanged;
+		return diff;
+	}
+
+	constexpr bool AppearanceChanged(std::size_t state) const noexcept
+	{
+		return (Appearances & AppearanceBit(state)) != 0;
+	}
+
+	constexpr bool RulesChanged() const noexcept
+	{
+		return VisibleRules || MaximisedRules;
+	}
+
+	// Rules and the window filter are what the worker memoizes per window.
+	constexpr bool InvalidatesWindowCaches() const noexcept
+	{
+		return RulesChanged() || IgnoredWindows;
+	}
+
+	constexpr bool AffectsTaskbars() const noexcept
+	{
+		return Appearances != 0 || EnabledStates || InvalidatesWindowCaches();
+	}
+
+	constexpr bool empty() const noexcept
+	{
+		return !AffectsTaskbars() && !Tray && !Logging && !Other;
+	}
+
+	static ConfigDiff Compute(const Config &before, const Config &after)
+	{
+		ConfigDiff diff;
+
+		diff.CompareAppearance(0, before.DesktopAppearance, after.DesktopAppearance);
+		diff.CompareAppearance(1, before.VisibleWindowAppearance, after.VisibleWindowAppearance);
+		diff.CompareAppearance(2, before.MaximisedWindowAppearance, after.MaximisedWindowAppearance);
+		diff.CompareAppearance(3, before.StartOpenedAppearance, after.StartOpenedAppearance);
+		diff.CompareAppearance(4, before.SearchOpenedAppearance, after.SearchOpenedAppearance);
+		diff.CompareAppearance(5, before.TaskViewOpenedAppearance, after.TaskViewOpenedAppearance);
+		diff.CompareAppearance(6, before.BatterySaverAppearance, after.BatterySaverAppearance);
+
+		diff.VisibleRules = !SameRules(before.VisibleWindowAppearance, after.VisibleWindowAppearance);
+		diff.MaximisedRules = !SameRules(before.MaximisedWindowAppearance, after.MaximisedWindowAppearance);
+
+		const auto &ignoredBefore = before.IgnoredWindows, &ignoredAfter = after.IgnoredWindows;
+		diff.IgnoredWindows =
+			!SameKeys(ignoredBefore.ClassList, ignoredAfter.ClassList) ||
+			!SameKeys(ignoredBefore.TitleList(), ignoredAfter.TitleList()) ||
+			!SameKeys(ignoredBefore.FileList, ignoredAfter.FileList);
+
+		diff.Tray =
+			before.HideTray != after.HideTray ||
+			before.UseXamlContextMenu != after.UseXamlContextMenu;
+
+		diff.Logging =
+			before.LogVerbosity != after.LogVerbosity ||
+			before.LogOverflow != after.LogOverflow ||
+			before.LogFormat != after.LogFormat ||
+			before.LogMaxFileSize != after.LogMaxFileSize ||
+			before.LogRetainedFiles != after.LogRetainedFiles;
+
+		diff.Other =
+			before.DisableSaving != after.DisableSaving ||
+			before.Language != after.Language ||
+			before.CopyDlls != after.CopyDlls;
+
+		return diff;
+	}
+
+	ConfigDiff &operator |=(const ConfigDiff &other) noexcept
+	{
+		Appearances |= other.Appearances;
+		EnabledStates |= other.EnabledStates;
+		VisibleRules |= other.VisibleRules;
+		MaximisedRules |= other.MaximisedRules;
+		IgnoredWindows |= other.IgnoredWindows;
+		Tray |= other.Tray;
+		Logging |= other.Logging;
+		Other |= other.Other;
+		return *this;
+	}
+
+private:
+	void CompareAppearance(std::size_t state, const TaskbarAppearance &before, const TaskbarAppearance &after) noexcept
+	{
+		if (before != after)
+		{
+			Appearances |= AppearanceBit(state);
+		}
+	}
+
+	void CompareAppearance(std::size_t state, const OptionalTaskbarAppearance &before, const OptionalTaskbarAppearance &after) noexcept
+	{
+		CompareAppearance(state, static_cast<const TaskbarAppearance &>(before), after);
+		EnabledStates |= before.Enabled != after.Enabled;
+	}
+
+	// Lookups go through the container's own key equality, so that file names stay case insensitive.
+	template<typename Set>
+	static bool SameKeys(const Set &before, const Set &after)
+	{
+		if (before.size() != after.size())
+		{
+			return false;
+		}
+
+		for (const auto &key : before)
+		{
+			if (!after.contains(key))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	static bool SameRule(const ActiveInactiveTaskbarAppearance &before, const ActiveInactiveTaskbarAppearance &after) noexcept
+	{
+		return static_cast<const TaskbarAppearance &>(before) == after && before.Inactive == after.Inactive;
+	}
+
+	template<typename Map>
+	static bool SameRuleMap(const Map &before, const Map &after)
+	{
+		if (before.size() != after.size())
+		{
+			return false;
+		}
+
+		for (const auto &[key, rule] : before)
+		{
+			const auto it = after.find(key);
+			if (it == after.end() || !SameRule(rule, it->second))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	static bool SameRules(const RuledTaskbarAppearance &before, const RuledTaskbarAppearance &after)
+	{
+		return SameRuleMap(before.ClassRules, after.ClassRules) &&
+			SameRuleMap(before.TitleRules(), after.TitleRules()) &&
+			SameRuleMap(before.FileRules, after.FileRules);
+	}
+};
@@ -0,0 +1,611 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "activeinactivetaskbarappearance.hpp"
+#include "config.hpp"
+#include "optionaltaskbarappearance.hpp"
+#include "ruledtaskbarappearance.hpp"
+#include "taskbarappearance.hpp"
+#include "windowfilter.hpp"
+#include "../util/hash.hpp"
+#include "../util/substring_matcher.hpp"
+
+// A compiled copy of the config, kept next to the settings file so that startup doesn't
+// have to parse it: appearances are flattened, strings are interned in a single table,
+// and the title matchers are stored already built.
+//
+// It's stored under a key made from the bytes of the settings file and from the default
+// config, so it stops being used as soon as the file or the defaults change. Everything
+// is little endian, and parts refer to each other by index instead of by address, so it
+// can be read straight from a view of the file mapped anywhere.
+namespace ConfigSnapshot {
+	static_assert(std::endian::native == std::endian::little, "config snapshots are stored in little endian");
+
+	// Every snapshot starts with this. The last byte is the format version.
+	inline constexpr std::string_view MAGIC { "TTBCONF\x01", 8 };
+
+	// Magic, key, checksum of what follows the header, and size of the whole snapshot.
+	inline constexpr std::size_t HEADER_SIZE = MAGIC.size() + sizeof(std::uint64_t) * 2 + sizeof(std::uint32_t);
+
+	namespace impl {
+		enum appearance_flags : std::uint8_t {
+			show_peek = 1 << 0,
+			show_line = 1 << 1,
+			enabled = 1 << 2,
+			has_inactive = 1 << 3
+		};
+
+		inline std::uint64_t hash(std::string_view bytes, std::size_t h = Util::INITIAL_HASH_VALUE) noexcept
+		{
+			for (const char b : bytes)
+			{
+				Util::HashByte(h, static_cast<std::uint8_t>(b));
+			}
+
+			return h;
+		}
+
+		template<typename T>
+		inline void put(std::string &out, T value)
+		{
+			char bytes[sizeof(T)];
+			std::memcpy(bytes, &value, sizeof(T));
+			out.append(bytes, sizeof(T));
+		}
+
+		inline void put_optional(std::string &out, const std::optional<bool> &value)
+		{
+			put(out, static_cast<std::uint8_t>(value ? (*value ? 2 : 1) : 0));
+		}
+
+		class writer {
+			std::string m_Body;
+			std::unordered_map<std::wstring_view, std::uint32_t> m_StringIndices;
+			std::vector<std::wstring_view> m_Strings;
+
+			void appearance(const TaskbarAppearance &appearance, std::uint8_t flags)
+			{
+				if (appearance.ShowPeek)
+				{
+					flags |= show_peek;
+				}
+
+				if (appearance.ShowLine)
+				{
+					flags |= show_line;
+				}
+
+				put(m_Body, static_cast<std::uint32_t>(appearance.Accent));
+				put(m_Body, appearance.Color.ToRGBA());
+				put(m_Body, appearance.BlurRadius);
+				put(m_Body, flags);
+			}
+
+			template<typename Map>
+			void rule_map(const Map &rules)
+			{
+				put(m_Body, static_cast<std::uint32_t>(rules.size()));
+				for (const auto &[key, rule] : rules)
+				{
+					string(key);
+					appearance(rule, rule.Inactive ? has_inactive : 0);
+					if (rule.Inactive)
+					{
+						appearance(*rule.Inactive, 0);
+					}
+				}
+			}
+
+			template<typename Set>
+			void string_set(const Set &set)
+			{
+				put(m_Body, static_cast<std::uint32_t>(set.size()));
+				for (const auto &str : set)
+				{
+					string(str);
+				}
+			}
+
+			void matcher(const Util::substring_matcher &matcher)
+			{
+				string_set(matcher.patterns());
+
+				put(m_Body, static_cast<std::uint32_t>(matcher.nodes().size()));
+				for (const auto &n : matcher.nodes())
+				{
+					put(m_Body, n.first_edge);
+					put(m_Body, n.edge_count);
+					put(m_Body, n.fail);
+					put(m_Body, n.pattern);
+					put(m_Body, n.longest);
+					put(m_Body, n.next_output);
+				}
+
+				put(m_Body, static_cast<std::uint32_t>(matcher.edges().size()));
+				for (const auto &e : matcher.edges())
+				{
+					put(m_Body, static_cast<std::uint32_t>(e.character));
+					put(m_Body, e.target);
+				}
+			}
+
+		public:
+			void string(std::wstring_view str)
+			{
+				const auto [it, inserted] = m_StringIndices.try_emplace(str, static_cast<std::uint32_t>(m_Strings.size()));
+				if (inserted)
+				{
+					m_Strings.push_back(str);
+				}
+
+				put(m_Body, it->second);
+			}
+
+			void appearance(const TaskbarAppearance &appearance)
+			{
+				this->appearance(appearance, 0);
+			}
+
+			void appearance(const OptionalTaskbarAppearance &appearance)
+			{
+				this->appearance(appearance, appearance.Enabled ? enabled : 0);
+			}
+
+			void ruled_appearance(const RuledTaskbarAppearance &appearance)
+			{
+				this->appearance(appearance);
+				rule_map(appearance.ClassRules);
+				rule_map(appearance.TitleRules());
+				rule_map(appearance.FileRules);
+				matcher(appearance.TitleMatcher());
+			}
+
+			void filter(const WindowFilter &filter)
+			{
+				string_set(filter.ClassList);
+				string_set(filter.TitleList());
+				string_set(filter.FileList);
+				matcher(filter.TitleMatcher());
+			}
+
+			template<typename T>
+			void value(T value)
+			{
+				put(m_Body, value);
+			}
+
+			void value(const std::optional<bool> &value)
+			{
+				put_optional(m_Body, value);
+			}
+
+			// The string table comes first, so that readers can look strings up as they go.
+			std::string finish(std::uint64_t key) const
+			{
+				std::string contents;
+				put(contents, static_cast<std::uint32_t>(m_Strings.size()));
+
+				std::uint32_t offset = 0;
+				put(contents, offset);
+				for (const auto str : m_Strings)
+				{
+					offset += static_cast<std::uint32_t>(str.size());
+					put(contents, offset);
+				}
+
+				for (const auto str : m_Strings)
+				{
+					for (const wchar_t c : str)
+					{
+						put(contents, static_cast<char16_t>(c));
+					}
+				}
+
+				contents += m_Body;
+
+				std::string snapshot;
+				snapshot.reserve(HEADER_SIZE + contents.size());
+				snapshot += MAGIC;
+				put(snapshot, key);
+				put(snapshot, hash(contents));
+				put(snapshot, static_cast<std::uint32_t>(HEADER_SIZE + contents.size()));
+				snapshot += contents;
+				return snapshot;
+			}
+		};
+
+		class reader {
+			std::string_view m_Data;
+			std::size_t m_Position = 0;
+			bool m_Failed = false;
+
+			std::uint32_t m_StringCount = 0;
+			std::size_t m_StringOffsets = 0;
+			std::size_t m_StringData = 0;
+
+			template<typename T>
+			T get_at(std::size_t position) const noexcept
+			{
+				T value;
+				std::memcpy(&value, m_Data.data() + position, sizeof(T));
+				return value;
+			}
+
+			// Whether count elements of at least elementSize bytes are left, before allocating for them.
+			bool fits(std::uint32_t count, std::size_t elementSize) noexcept
+			{
+				if (m_Failed || count > (m_Data.size() - m_Position) / elementSize)
+				{
+					m_Failed = true;
+				}
+
+				return !m_Failed;
+			}
+
+			std::wstring string_at(std::uint32_t index)
+			{
+				if (m_Failed || index >= m_StringCount)
+				{
+					m_Failed = true;
+					return { };
+				}
+
+				const auto begin = get_at<std::uint32_t>(m_StringOffsets + index * sizeof(std::uint32_t));
+				const auto end = get_at<std::uint32_t>(m_StringOffsets + (index + 1) * sizeof(std::uint32_t));
+
+				std::wstring str(end - begin, L'\0');
+				for (std::uint32_t i = 0; i < str.size(); ++i)
+				{
+					str[i] = static_cast<wchar_t>(get_at<char16_t>(m_StringData + (begin + i) * sizeof(char16_t)));
+				}
+
+				return str;
+			}
+
+			void appearance(TaskbarAppearance &appearance, std::uint8_t &flags)
+			{
+				const auto accent = get<std::uint32_t>();
+				const auto color = get<std::uint32_t>();
+				appearance.BlurRadius = get<float>();
+				flags = get<std::uint8_t>();
+
+				if (accent > ACCENT_INVALID_STATE)
+				{
+					m_Failed = true;
+				}
+
+				appearance.Accent = static_cast<ACCENT_STATE>(accent);
+				appearance.Color = Util::Color::FromRGBA(color);
+				appearance.ShowPeek = flags & show_peek;
+				appearance.ShowLine = flags & show_line;
+			}
+
+			template<typename Map>
+			void rule_map(Map &rules)
+			{
+				const auto count = get<std::uint32_t>();
+				if (!fits(count, 2 * sizeof(std::uint32_t)))
+				{
+					return;
+				}
+
+				rules.reserve(count);
+				for (std::uint32_t i = 0; i < count && !m_Failed; ++i)
+				{
+					auto key = string();
+
+					ActiveInactiveTaskbarAppearance rule;
+					std::uint8_t flags;
+					appearance(rule, flags);
+					if (flags & has_inactive)
+					{
+						appearance(rule.Inactive.emplace(), flags);
+					}
+
+					rules.insert_or_assign(std::move(key), std::move(rule));
+				}
+			}
+
+			template<typename Set>
+			void string_set(Set &set)
+			{
+				const auto count = get<std::uint32_t>();
+				if (!fits(count, sizeof(std::uint32_t)))
+				{
+					return;
+				}
+
+				set.reserve(count);
+				for (std::uint32_t i = 0; i < count && !m_Failed; ++i)
+				{
+					set.insert(string());
+				}
+			}
+
+			std::optional<Util::substring_matcher> matcher()
+			{
+				const auto patternCount = get<std::uint32_t>();
+				if (!fits(patternCount, sizeof(std::uint32_t)))
+				{
+					return std::nullopt;
+				}
+
+				std::vector<std::wstring> patterns;
+				patterns.reserve(patternCount);
+				for (std::uint32_t i = 0; i < patternCount; ++i)
+				{
+					patterns.push_back(string());
+				}
+
+				std::vector<Util::substring_matcher::node> nodes;
+				const auto nodeCount = get<std::uint32_t>();
+				if (!fits(nodeCount, 6 * sizeof(std::uint32_t)))
+				{
+					return std::nullopt;
+				}
+
+				nodes.resize(nodeCount);
+				for (auto &n : nodes)
+				{
+					n.first_edge = get<std::uint32_t>();
+					n.edge_count = get<std::uint32_t>();
+					n.fail = get<std::uint32_t>();
+					n.pattern = get<std::uint32_t>();
+					n.longest = get<std::uint32_t>();
+					n.next_output = get<std::uint32_t>();
+				}
+
+				std::vector<Util::substring_matcher::edge> edges;
+				const auto edgeCount = get<std::uint32_t>();
+				if (!fits(edgeCount, 2 * sizeof(std::uint32_t)))
+				{
+					return std::nullopt;
+				}
+
+				edges.resize(edgeCount);
+				for (auto &e : edges)
+				{
+					e.character = static_cast<wchar_t>(get<std::uint32_t>());
+					e.target = get<std::uint32_t>();
+				}
+
+				// the patterns are enough to build it again, and following broken links could loop forever.
+				return Util::substring_matcher::restore_or_build(std::move(patterns), std::move(nodes), std::move(edges));
+			}
+
+		public:
+			explicit reader(std::string_view data) noexcept : m_Data(data), m_Position(HEADER_SIZE)
+			{
+				m_StringCount = get<std::uint32_t>();
+				if (!fits(m_StringCount, sizeof(std::uint32_t)))
+				{
+					return;
+				}
+
+				m_StringOffsets = m_Position;
+				m_Position += (static_cast<std::size_t>(m_StringCount) + 1) * sizeof(std::uint32_t);
+				if (m_Position > m_Data.size())
+				{
+					m_Failed = true;
+					return;
+				}
+
+				// offsets have to go up, and the last one is where the characters end.
+				std::uint32_t previous = 0;
+				for (std::uint32_t i = 0; i <= m_StringCount; ++i)
+				{
+					const auto offset = get_at<std::uint32_t>(m_StringOffsets + i * sizeof(std::uint32_t));
+					if (offset < previous)
+					{
+						m_Failed = true;
+						return;
+					}
+
+					previous = offset;
+				}
+
+				m_StringData = m_Position;
+				if (previous > (m_Data.size() - m_Position) / sizeof(char16_t))
+				{
+					m_Failed = true;
+					return;
+				}
+
+				m_Position += previous * sizeof(char16_t);
+			}
+
+			template<typename T>
+			T get() noexcept
+			{
+				if (m_Failed || sizeof(T) > m_Data.size() - m_Position)
+				{
+					m_Failed = true;
+					return { };
+				}
+
+				const auto value = get_at<T>(m_Position);
+				m_Position += sizeof(T);
+				return value;
+			}
+
+			std::optional<bool> get_optional() noexcept
+			{
+				switch (get<std::uint8_t>())
+				{
+				case 0: return std::nullopt;
+				case 1: return false;
+				case 2: return true;
+				default:
+					m_Failed = true;
+					return std::nullopt;
+				}
+			}
+
+			std::wstring string()
+			{
+				return string_at(get<std::uint32_t>());
+			}
+
+			void appearance(TaskbarAppearance &appearance)
+			{
+				std::uint8_t flags;
+				this->appearance(appearance, flags);
+			}
+
+			void appearance(OptionalTaskbarAppearance &appearance)
+			{
+				std::uint8_t flags;
+				this->appearance(appearance, flags);
+				appearance.Enabled = flags & enabled;
+			}
+
+			void ruled_appearance(RuledTaskbarAppearance &appearance)
+			{
+				this->appearance(static_cast<OptionalTaskbarAppearance &>(appearance));
+				RuledTaskbarAppearance::title_rules_t titleRules;
+				rule_map(appearance.ClassRules);
+				rule_map(titleRules);
+				rule_map(appearance.FileRules);
+
+				if (auto titleMatcher = matcher(); titleMatcher && !appearance.SetTitleRules(std::move(titleRules), std::move(*titleMatcher)))
+				{
+					m_Failed = true;
+				}
+			}
+
+			void filter(WindowFilter &filter)
+			{
+				std::unordered_set<std::wstring> titleList;
+				string_set(filter.ClassList);
+				string_set(titleList);
+				string_set(filter.FileList);
+
+				if (auto titleMatcher = matcher(); titleMatcher && !filter.SetTitleList(std::move(titleList), std::move(*titleMatcher)))
+				{
+					m_Failed = true;
+				}
+			}
+
+			void fail() noexcept
+			{
+				m_Failed = true;
+			}
+
+			// Whether everything was read, and nothing more was there.
+			bool succeeded() const noexcept
+			{
+				return !m_Failed && m_Position == m_Data.size();
+			}
+		};
+
+		inline std::string write(const Config &config, std::uint64_t key)
+		{
+			writer w;
+			w.appearance(config.DesktopAppearance);
+			w.ruled_appearance(config.VisibleWindowAppearance);
+			w.ruled_appearance(config.MaximisedWindowAppearance);
+			w.appearance(config.StartOpenedAppearance);
+			w.appearance(config.SearchOpenedAppearance);
+			w.appearance(config.TaskViewOpenedAppearance);
+			w.appearance(config.BatterySaverAppearance);
+			w.filter(config.IgnoredWindows);
+
+			w.value(config.HideTray);
+			w.value(static_cast<std::uint8_t>(config.DisableSaving));
+			w.value(static_cast<std::uint8_t>(config.LogVerbosity));
+			w.value(static_cast<std::uint8_t>(config.LogOverflow));
+			w.value(static_cast<std::uint8_t>(config.LogFormat));
+			w.value(static_cast<std::uint32_t>(config.LogMaxFileSize));
+			w.value(static_cast<std::uint32_t>(config.LogRetainedFiles));
+			w.string(config.Language);
+			w.value(config.UseXamlContextMenu);
+			w.value(config.CopyDlls);
+
+			return w.finish(key);
+		}
+	}
+
+	// The key to store the config of a settings file under, from the raw bytes of that file.
+	inline std::uint64_t Key(std::string_view settingsFile)
+	{
+		// the defaults fill in whatever the file doesn't have, and they change between
+		// versions (and on Windows 11), so they're part of the key.
+		static const std::uint64_t defaults = impl::hash(impl::write(Config { }, 0));
+		return impl::hash(settingsFile, static_cast<std::size_t>(defaults));
+	}
+
+	inline std::string Write(const Config &config, std::uint64_t key)
+	{
+		return impl::write(config, key);
+	}
+
+	// Replaces config with what the snapshot has, if it's intact and was stored under key.
+	// Leaves config as it was otherwise.
+	inline bool Read(std::string_view snapshot, std::uint64_t key, Config &config)
+	{
+		if (snapshot.size() < HEADER_SIZE || !snapshot.starts_with(MAGIC))
+		{
+			return false;
+		}
+
+		std::uint64_t storedKey, checksum;
+		std::uint32_t size;
+		std::memcpy(&storedKey, snapshot.data() + MAGIC.size(), sizeof(storedKey));
+		std::memcpy(&checksum, snapshot.data() + MAGIC.size() + sizeof(storedKey), sizeof(checksum));
+		std::memcpy(&size, snapshot.data() + MAGIC.size() + sizeof(storedKey) + sizeof(checksum), sizeof(size));
+		if (storedKey != key || size != snapshot.size() || checksum != impl::hash(snapshot.substr(HEADER_SIZE)))
+		{
+			return false;
+		}
+
+		impl::reader r(snapshot);
+		Config result;
+		r.appearance(result.DesktopAppearance);
+		r.ruled_appearance(result.VisibleWindowAppearance);
+		r.ruled_appearance(result.MaximisedWindowAppearance);
+		r.appearance(result.StartOpenedAppearance);
+		r.appearance(result.SearchOpenedAppearance);
+		r.appearance(result.TaskViewOpenedAppearance);
+		r.appearance(result.BatterySaverAppearance);
+		r.filter(result.IgnoredWindows);
+
+		result.HideTray = r.get_optional();
+		result.DisableSaving = r.get<std::uint8_t>() != 0;
+
+		const auto verbosity = r.get<std::uint8_t>();
+		const auto overflow = r.get<std::uint8_t>();
+		const auto format = r.get<std::uint8_t>();
+		if (verbosity >= spdlog::level::n_levels ||
+			overflow > static_cast<std::uint8_t>(Util::backpressure::drop_newest) ||
+			format > static_cast<std::uint8_t>(Util::log_format::binary))
+		{
+			r.fail();
+		}
+
+		result.LogVerbosity = static_cast<spdlog::level::level_enum>(verbosity);
+		result.LogOverflow = static_cast<Util::backpressure>(overflow);
+		result.LogFormat = static_cast<Util::log_format>(format);
+		result.LogMaxFileSize = r.get<std::uint32_t>();
+		result.LogRetainedFiles = r.get<std::uint32_t>();
+		result.Language = r.string();
+		result.UseXamlContextMenu = r.get_optional();
+		result.CopyDlls = r.get_optional();
+
+		if (!r.succeeded())
+		{
+			return false;
+		}
+
+		config = std::move(result);
+		return true;
+	}
+}
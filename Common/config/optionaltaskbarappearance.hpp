@@ -20,16 +20,13 @@ struct OptionalTaskbarAppearance : TaskbarAppearance {
 		TaskbarAppearance::Serialize(writer);
 	}
 
-	void Deserialize(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	void Deserialize(Value &obj, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			OptionalInnerDeserialize(rjh::ValueToStringView(it->name), it->value, unknownKeyCallback);
-		}
+			OptionalInnerDeserialize(key, val, unknownKeyCallback);
+		});
 	}
 
 #ifdef HAS_WINRT_CONFIG
@@ -45,7 +42,8 @@ struct OptionalTaskbarAppearance : TaskbarAppearance {
 #endif
 
 protected:
-	void OptionalInnerDeserialize(std::wstring_view key, const rjh::value_t &val, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	void OptionalInnerDeserialize(std::wstring_view key, Value &val, void (*unknownKeyCallback)(std::wstring_view))
 	{
 		if (key == ENABLED_KEY)
 		{
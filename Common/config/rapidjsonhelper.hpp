@@ -3,10 +3,15 @@
 #include <array>
 #include <cassert>
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <format>
+#include <limits>
 #include <optional>
 #include <rapidjson/document.h>
 #include <rapidjson/encodings.h>
+#include <rapidjson/error/error.h>
+#include <rapidjson/reader.h>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -23,6 +28,10 @@ namespace rjh {
 		const std::wstring what;
 	};
 
+	struct ParseError {
+		const rj::ParseErrorCode code;
+	};
+
 	static constexpr std::array<std::wstring_view, 7> TYPE_NAMES = {
 		L"null",
 		L"bool",
@@ -97,6 +106,13 @@ namespace rjh {
 		writer.Double(value);
 	}
 
+	template<class Writer>
+	inline void Serialize(Writer &writer, unsigned int value, std::wstring_view key)
+	{
+		WriteKey(writer, key);
+		writer.Uint(value);
+	}
+
 	template<class Writer>
 	inline void Serialize(Writer &writer, std::wstring_view value, std::wstring_view key)
 	{
@@ -135,23 +151,383 @@ namespace rjh {
 		}
 	}
 
-	inline void Deserialize(const value_t &obj, bool &member, std::wstring_view key)
+	// Reads a JSON document one token at a time, so that it can be deserialized without
+	// building a DOM of it first. Strings get transcoded into a single buffer, which the
+	// next token reuses. Everything that deserializes from a value_t also deserializes
+	// from this, reading the value the reader is positioned on.
+	template<class InputStream, class SourceEncoding = rj::UTF8<>, unsigned int parseFlags = rj::kParseDefaultFlags, class StackAllocator = rj::CrtAllocator>
+	class StreamReader {
+		static_assert(!(parseFlags & (rj::kParseInsituFlag | rj::kParseNumbersAsStringsFlag)), "Unsupported parse flags");
+
+		using Ch = value_t::Ch;
+
+		enum class Token {
+			None, // not read yet
+			Value, // or the start of an object or array
+			Key,
+			EndObject,
+			EndArray
+		};
+
+		struct Handler {
+			StreamReader &reader;
+
+			bool Null() noexcept { return reader.SetToken(Token::Value, rj::Type::kNullType); }
+			bool Bool(bool b) noexcept
+			{
+				reader.m_Bool = b;
+				return reader.SetToken(Token::Value, b ? rj::Type::kTrueType : rj::Type::kFalseType);
+			}
+
+			// same conversions as value_t
+			bool Int(int i) noexcept { return reader.SetNumber(i, i >= 0, static_cast<unsigned int>(i)); }
+			bool Uint(unsigned int u) noexcept { return reader.SetNumber(u, true, u); }
+			bool Int64(std::int64_t i) noexcept { return reader.SetNumber(static_cast<double>(i), i >= 0 && i <= std::numeric_limits<unsigned int>::max(), static_cast<unsigned int>(i)); }
+			bool Uint64(std::uint64_t u) noexcept { return reader.SetNumber(static_cast<double>(u), u <= std::numeric_limits<unsigned int>::max(), static_cast<unsigned int>(u)); }
+			bool Double(double d) noexcept { return reader.SetNumber(d, false, 0); }
+			bool RawNumber(const Ch *, rj::SizeType, bool) noexcept { return false; }
+
+			bool String(const Ch *str, rj::SizeType length, bool)
+			{
+				reader.m_String.assign(str, length);
+				return reader.SetToken(Token::Value, rj::Type::kStringType);
+			}
+
+			bool StartObject() noexcept { return reader.SetToken(Token::Value, rj::Type::kObjectType); }
+			bool Key(const Ch *str, rj::SizeType length, bool)
+			{
+				reader.m_String.assign(str, length);
+				return reader.SetToken(Token::Key);
+			}
+			bool EndObject(rj::SizeType) noexcept { return reader.SetToken(Token::EndObject); }
+			bool StartArray() noexcept { return reader.SetToken(Token::Value, rj::Type::kArrayType); }
+			bool EndArray(rj::SizeType) noexcept { return reader.SetToken(Token::EndArray); }
+		};
+
+		rj::GenericReader<SourceEncoding, rj::UTF16LE<>, StackAllocator> m_Reader;
+		InputStream &m_Input;
+		Handler m_Handler;
+
+		Token m_Token = Token::None;
+		rj::Type m_Type = rj::Type::kNullType;
+		bool m_Bool = false;
+		bool m_IsUint = false;
+		unsigned int m_Uint = 0;
+		double m_Number = 0.0;
+		std::wstring m_String;
+		std::uint64_t m_Position = 0;
+
+		bool SetToken(Token token, rj::Type type = rj::Type::kNullType) noexcept
+		{
+			m_Token = token;
+			m_Type = type;
+			return true;
+		}
+
+		bool SetNumber(double number, bool isUint, unsigned int uint) noexcept
+		{
+			m_Number = number;
+			m_IsUint = isUint;
+			m_Uint = uint;
+			return SetToken(Token::Value, rj::Type::kNumberType);
+		}
+
+		// The iterative parser only notices a document is empty if there's nothing at all in
+		// it, and takes whitespace or comments alone for an invalid value.
+		void EnsureNotEmpty()
+		{
+			while (true)
+			{
+				rj::SkipWhitespace(m_Input);
+				if (!(parseFlags & rj::kParseCommentsFlag) || m_Input.Peek() != '/')
+				{
+					break;
+				}
+
+				m_Input.Take();
+				if (m_Input.Peek() == '/')
+				{
+					while (m_Input.Peek() != '\0' && m_Input.Take() != '\n') { }
+				}
+				else if (m_Input.Peek() == '*')
+				{
+					m_Input.Take();
+					for (bool star = false; ; )
+					{
+						const auto c = m_Input.Peek();
+						if (c == '\0')
+						{
+							throw ParseError { rj::kParseErrorUnspecificSyntaxError };
+						}
+
+						m_Input.Take();
+						if (star && c == '/')
+						{
+							break;
+						}
+
+						star = c == '*';
+					}
+				}
+				else
+				{
+					throw ParseError { rj::kParseErrorUnspecificSyntaxError };
+				}
+			}
+
+			if (m_Input.Peek() == '\0')
+			{
+				throw ParseError { rj::kParseErrorDocumentEmpty };
+			}
+		}
+
+		void Read()
+		{
+			if (m_Token == Token::None)
+			{
+				if (m_Position == 0)
+				{
+					EnsureNotEmpty();
+				}
+
+				if (!m_Reader.template IterativeParseNext<parseFlags>(m_Input, m_Handler) || m_Reader.HasParseError()) [[unlikely]]
+				{
+					throw ParseError { m_Reader.GetParseErrorCode() };
+				}
+
+				assert(m_Token != Token::None); // read past the end of the document
+			}
+		}
+
+		void Consume() noexcept
+		{
+			m_Token = Token::None;
+			++m_Position;
+		}
+
+	public:
+		explicit StreamReader(InputStream &in) : m_Input(in), m_Handler { *this }
+		{
+			m_Reader.IterativeParseInit();
+		}
+
+		StreamReader(const StreamReader &) = delete;
+		StreamReader &operator =(const StreamReader &) = delete;
+
+		// The type of the value the reader is positioned on.
+		rj::Type GetType()
+		{
+			Read();
+			assert(m_Token == Token::Value); // the grammar only allows a value here
+			return m_Type;
+		}
+
+		// The getters move past the value, and are only valid on a value of the matching type.
+		bool GetBool() noexcept
+		{
+			assert(m_Token == Token::Value && (m_Type == rj::Type::kFalseType || m_Type == rj::Type::kTrueType));
+			Consume();
+			return m_Bool;
+		}
+
+		float GetFloat() noexcept
+		{
+			assert(m_Token == Token::Value && m_Type == rj::Type::kNumberType);
+			Consume();
+			return static_cast<float>(m_Number);
+		}
+
+		bool IsUint() const noexcept
+		{
+			assert(m_Token == Token::Value && m_Type == rj::Type::kNumberType);
+			return m_IsUint;
+		}
+
+		unsigned int GetUint() noexcept
+		{
+			assert(m_Token == Token::Value && m_IsUint);
+			Consume();
+			return m_Uint;
+		}
+
+		// Only valid until the next token is read.
+		std::wstring_view GetString() noexcept
+		{
+			assert(m_Token == Token::Value && m_Type == rj::Type::kStringType);
+			Consume();
+			return m_String;
+		}
+
+		// Moves into the object or array the reader is positioned on.
+		void Enter() noexcept
+		{
+			assert(m_Token == Token::Value && (m_Type == rj::Type::kObjectType || m_Type == rj::Type::kArrayType));
+			Consume();
+		}
+
+		// Moves to the value of the next member of the current object, or out of the object
+		// when there are no members left.
+		bool NextMember(std::wstring &key)
+		{
+			Read();
+			const bool hasMember = m_Token == Token::Key;
+			if (hasMember)
+			{
+				key.assign(m_String);
+			}
+
+			Consume();
+			return hasMember;
+		}
+
+		// Moves out of the current array when there are no elements left.
+		bool NextElement()
+		{
+			Read();
+			if (m_Token == Token::EndArray)
+			{
+				Consume();
+				return false;
+			}
+
+			return true;
+		}
+
+		// Moves past the value the reader is positioned on, including everything it contains.
+		void Skip()
+		{
+			std::size_t depth = 0;
+			do
+			{
+				Read();
+				if (m_Token == Token::Value && (m_Type == rj::Type::kObjectType || m_Type == rj::Type::kArrayType))
+				{
+					++depth;
+				}
+				else if (m_Token == Token::EndObject || m_Token == Token::EndArray)
+				{
+					--depth;
+				}
+
+				Consume();
+			} while (depth != 0);
+		}
+
+		// Tokens read so far, to tell if something read a value.
+		std::uint64_t Position() const noexcept
+		{
+			return m_Position;
+		}
+	};
+
+	template<class T>
+	inline constexpr bool is_stream_reader_v = false;
+
+	template<class InputStream, class SourceEncoding, unsigned int parseFlags, class StackAllocator>
+	inline constexpr bool is_stream_reader_v<StreamReader<InputStream, SourceEncoding, parseFlags, StackAllocator>> = true;
+
+	template<class Reader>
+	requires is_stream_reader_v<Reader>
+	inline std::wstring_view ValueToStringView(Reader &reader)
+	{
+		return reader.GetString();
+	}
+
+	// Calls callback(key, value) for each member of an object.
+	template<class Callback>
+	inline void ForEachMember(const value_t &obj, std::wstring_view name, Callback &&callback)
+	{
+		EnsureType(rj::Type::kObjectType, obj.GetType(), name);
+
+		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		{
+			EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
+
+			callback(ValueToStringView(it->name), it->value);
+		}
+	}
+
+	template<class Reader, class Callback>
+	requires is_stream_reader_v<Reader>
+	inline void ForEachMember(Reader &reader, std::wstring_view name, Callback &&callback)
+	{
+		EnsureType(rj::Type::kObjectType, reader.GetType(), name);
+		reader.Enter();
+
+		// member names are always strings in a stream
+		std::wstring key;
+		while (reader.NextMember(key))
+		{
+			const auto position = reader.Position();
+			callback(std::wstring_view(key), reader);
+
+			// unknown keys are left unread
+			if (reader.Position() == position)
+			{
+				reader.Skip();
+			}
+		}
+	}
+
+	// Calls callback(element) for each element of an array.
+	template<class Callback>
+	inline void ForEachElement(const value_t &arr, std::wstring_view name, Callback &&callback)
+	{
+		EnsureType(rj::Type::kArrayType, arr.GetType(), name);
+
+		for (const auto &elem : arr.GetArray())
+		{
+			callback(elem);
+		}
+	}
+
+	template<class Reader, class Callback>
+	requires is_stream_reader_v<Reader>
+	inline void ForEachElement(Reader &reader, std::wstring_view name, Callback &&callback)
+	{
+		EnsureType(rj::Type::kArrayType, reader.GetType(), name);
+		reader.Enter();
+
+		while (reader.NextElement())
+		{
+			callback(reader);
+		}
+	}
+
+	template<class Value>
+	inline void Deserialize(Value &obj, bool &member, std::wstring_view key)
 	{
 		EnsureType(rj::Type::kFalseType, obj.GetType(), key);
 
 		member = obj.GetBool();
 	}
 
-	inline void Deserialize(const value_t& obj, float& member, std::wstring_view key)
+	template<class Value>
+	inline void Deserialize(Value &obj, float &member, std::wstring_view key)
 	{
 		EnsureType(rj::Type::kNumberType, obj.GetType(), key);
 
 		member = obj.GetFloat();
 	}
 
-	template<typename T, std::size_t size>
+	template<class Value>
+	inline void Deserialize(Value &obj, unsigned int &member, std::wstring_view key)
+	{
+		EnsureType(rj::Type::kNumberType, obj.GetType(), key);
+
+		if (!obj.IsUint())
+		{
+			throw DeserializationError {
+				std::format(L"Found number that isn't a non-negative integer while deserializing key \"{}\"", key)
+			};
+		}
+
+		member = obj.GetUint();
+	}
+
+	template<class Value, typename T, std::size_t size>
 	requires std::is_enum_v<T>
-	inline void Deserialize(const value_t &obj, T &member, std::wstring_view key, const std::array<std::wstring_view, size> &arr)
+	inline void Deserialize(Value &obj, T &member, std::wstring_view key, const std::array<std::wstring_view, size> &arr)
 	{
 		EnsureType(rj::Type::kStringType, obj.GetType(), key);
 
@@ -168,18 +544,18 @@ namespace rjh {
 		}
 	}
 
-	template<class T>
+	template<class Value, class T>
 	// prevent ambiguous overload errors
 	requires (std::is_class_v<T> && !Util::is_optional_v<T>)
-	inline void Deserialize(const value_t &obj, T &member, std::wstring_view key, void (*unknownKeyCallback)(std::wstring_view))
+	inline void Deserialize(Value &obj, T &member, std::wstring_view key, void (*unknownKeyCallback)(std::wstring_view))
 	{
 		EnsureType(rj::Type::kObjectType, obj.GetType(), key);
 
 		member.Deserialize(obj, unknownKeyCallback);
 	}
 
-	template<typename T, typename... Args>
-	void Deserialize(const value_t &obj, std::optional<T> &member, std::wstring_view key, Args &&...args)
+	template<class Value, typename T, typename... Args>
+	void Deserialize(Value &obj, std::optional<T> &member, std::wstring_view key, Args &&...args)
 	{
 		Deserialize(obj, member.emplace(), key, std::forward<Args>(args)...);
 	}
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <format>
 #include <string_view>
 #include <vector>
@@ -8,25 +9,28 @@
 #include "rapidjsonhelper.hpp"
 #include "taskbarappearance.hpp"
 #include "../constants.hpp"
+#include "../util/substring_matcher.hpp"
 #include "../win32.hpp"
 
 #ifdef _TRANSLUCENTTB_EXE
 #include "../../TranslucentTB/windows/window.hpp"
-#include "../../ProgramLog/error/std.hpp"
 #endif
 
 struct RuledTaskbarAppearance : OptionalTaskbarAppearance {
+	using title_rules_t = std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance>;
+
 	std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance> ClassRules;
-	std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance> TitleRules;
 	win32::FilenameMap<ActiveInactiveTaskbarAppearance> FileRules;
 
 	RuledTaskbarAppearance() = default;
-	RuledTaskbarAppearance(std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance> classRules, std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance> titleRules, win32::FilenameMap<ActiveInactiveTaskbarAppearance> fileRules, bool enabled, ACCENT_STATE accent, Util::Color color, bool showPeek, bool showLine, float blurRadius) :
+	RuledTaskbarAppearance(std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance> classRules, title_rules_t titleRules, win32::FilenameMap<ActiveInactiveTaskbarAppearance> fileRules, bool enabled, ACCENT_STATE accent, Util::Color color, bool showPeek, bool showLine, float blurRadius) :
 		OptionalTaskbarAppearance(enabled, accent, color, showPeek, showLine, blurRadius),
 		ClassRules(std::move(classRules)),
-		TitleRules(std::move(titleRules)),
-		FileRules(std::move(fileRules))
-	{ }
+		FileRules(std::move(fileRules)),
+		m_TitleRules(std::move(titleRules))
+	{
+		CompileTitleRules();
+	}
 
 	template<typename Writer>
 	inline void Serialize(Writer &writer) const
@@ -35,35 +39,88 @@ struct RuledTaskbarAppearance : OptionalTaskbarAppearance {
 		rjh::WriteKey(writer, RULES_KEY);
 		writer.StartObject();
 		SerializeRulesMap(writer, ClassRules, CLASS_KEY);
-		SerializeRulesMap(writer, TitleRules, TITLE_KEY);
+		SerializeRulesMap(writer, m_TitleRules, TITLE_KEY);
 		SerializeRulesMap(writer, FileRules, FILE_KEY);
 		writer.EndObject();
 	}
 
-	inline void Deserialize(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	inline void Deserialize(Value &obj, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
+		{
+			if (key == RULES_KEY)
+			{
+				DeserializeRulesMap(val, unknownKeyCallback);
+			}
+			else
+			{
+				OptionalInnerDeserialize(key, val, unknownKeyCallback);
+			}
+		});
 
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		CompileTitleRules();
+	}
+
+	// Title rules are only changed through these, which keep the matcher in sync.
+	inline const title_rules_t &TitleRules() const noexcept
+	{
+		return m_TitleRules;
+	}
+
+	inline void SetTitleRules(title_rules_t rules)
+	{
+		m_TitleRules = std::move(rules);
+		CompileTitleRules();
+	}
+
+	// Instead of compiling the rules, takes what TitleMatcher returned for the same rules.
+	// Returns false and leaves the rules alone if the matcher doesn't fit them.
+	inline bool SetTitleRules(title_rules_t rules, Util::substring_matcher matcher)
+	{
+		if (matcher.size() != rules.size())
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
+			return false;
+		}
 
-			const auto key = rjh::ValueToStringView(it->name);
-			if (key == RULES_KEY)
+		std::vector<ActiveInactiveTaskbarAppearance> byPattern;
+		byPattern.reserve(matcher.size());
+		for (const auto &pattern : matcher.patterns())
+		{
+			if (const auto it = rules.find(pattern); it != rules.end())
 			{
-				DeserializeRulesMap(it->value, unknownKeyCallback);
+				byPattern.push_back(it->second);
 			}
 			else
 			{
-				OptionalInnerDeserialize(key, it->value, unknownKeyCallback);
+				return false;
 			}
 		}
+
+		m_TitleRules = std::move(rules);
+		m_TitleMatcher = std::move(matcher);
+		m_TitleRulesByPattern = std::move(byPattern);
+		return true;
+	}
+
+	inline const Util::substring_matcher &TitleMatcher() const noexcept
+	{
+		return m_TitleMatcher;
 	}
 
 #ifdef _TRANSLUCENTTB_EXE
-	inline std::optional<TaskbarAppearance> FindRule(const Window window) const
+	// T is either a Window or a cached view of one.
+	template<typename T>
+	inline std::optional<TaskbarAppearance> FindRule(const T &window) const
+	{
+		return SelectRule(MatchRule(window), window);
+	}
+
+	// Picks the appearance to use out of a rule returned by MatchRule, depending on if the window is active.
+	template<typename T>
+	inline static std::optional<TaskbarAppearance> SelectRule(const std::optional<ActiveInactiveTaskbarAppearance> &rule, const T &window)
 	{
-		if (const auto rule = FindRuleInner(window))
+		if (rule)
 		{
 			if (!window.active() && rule->Inactive)
 			{
@@ -71,7 +128,7 @@ struct RuledTaskbarAppearance : OptionalTaskbarAppearance {
 			}
 			else
 			{
-				return rule;
+				return *rule;
 			}
 		}
 		else
@@ -80,8 +137,10 @@ struct RuledTaskbarAppearance : OptionalTaskbarAppearance {
 		}
 	}
 
-private:
-	inline std::optional<ActiveInactiveTaskbarAppearance> FindRuleInner(const Window window) const
+	// Finds the rule matching a window. Unlike FindRule, the result doesn't depend on the
+	// window being active, only on its class, file and title.
+	template<typename T>
+	inline std::optional<ActiveInactiveTaskbarAppearance> MatchRule(const T &window) const
 	{
 		// This is the fastest because we do the less string manipulation, so always try it first
 		if (!ClassRules.empty())
@@ -101,16 +160,12 @@ private:
 
 		if (!FileRules.empty())
 		{
-			if (const auto file = window.file())
+			if (const auto fileName = window.filename())
 			{
-				try
+				if (const auto it = FileRules.find(*fileName); it != FileRules.end())
 				{
-					if (const auto it = FileRules.find(file->filename().native()); it != FileRules.end())
-					{
-						return it->second;
-					}
+					return it->second;
 				}
-				StdSystemErrorCatch(spdlog::level::warn, L"Failed to check if window process is part of window filter");
 			}
 			else
 			{
@@ -119,16 +174,13 @@ private:
 		}
 
 		// Do it last because titles can change, so it's less reliable.
-		if (!TitleRules.empty())
+		if (!m_TitleRules.empty())
 		{
 			if (const auto title = window.title())
 			{
-				for (const auto &[key, value] : TitleRules)
+				if (const auto match = m_TitleMatcher.find(*title))
 				{
-					if (title->find(key) != std::wstring::npos)
-					{
-						return value;
-					}
+					return m_TitleRulesByPattern[*match];
 				}
 			}
 		}
@@ -140,10 +192,42 @@ private:
 public:
 	inline bool HasRules() const noexcept
 	{
-		return !(ClassRules.empty() && FileRules.empty() && TitleRules.empty());
+		return !(ClassRules.empty() && FileRules.empty() && m_TitleRules.empty());
 	}
 
 private:
+	title_rules_t m_TitleRules;
+	Util::substring_matcher m_TitleMatcher;
+	std::vector<ActiveInactiveTaskbarAppearance> m_TitleRulesByPattern; // copies, so that copying this stays simple
+
+	// When several titles match, the longest wins, and equally long ones go by ordinal order.
+	inline void CompileTitleRules()
+	{
+		std::vector<const title_rules_t::value_type *> rules;
+		rules.reserve(m_TitleRules.size());
+		for (const auto &rule : m_TitleRules)
+		{
+			rules.push_back(&rule);
+		}
+
+		std::ranges::sort(rules, { }, [](const title_rules_t::value_type *rule) -> const std::wstring &
+		{
+			return rule->first;
+		});
+
+		std::vector<std::wstring_view> titles;
+		titles.reserve(rules.size());
+		m_TitleRulesByPattern.clear();
+		m_TitleRulesByPattern.reserve(rules.size());
+		for (const auto rule : rules)
+		{
+			titles.push_back(rule->first);
+			m_TitleRulesByPattern.push_back(rule->second);
+		}
+
+		m_TitleMatcher = Util::substring_matcher(titles);
+	}
+
 	template<typename Writer, typename Hash, typename Equal, typename Alloc>
 	inline static void SerializeRulesMap(Writer &writer, const std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance, Hash, Equal, Alloc> &map, std::wstring_view mapKey)
 	{
@@ -156,50 +240,40 @@ private:
 		writer.EndObject();
 	}
 
-	inline void DeserializeRulesMap(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	inline void DeserializeRulesMap(Value &obj, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			const auto key = rjh::ValueToStringView(it->name);
 			if (key == CLASS_KEY)
 			{
-				DeserializeMap(it->value, ClassRules, unknownKeyCallback);
+				DeserializeMap(val, ClassRules, unknownKeyCallback);
 			}
 			else if (key == TITLE_KEY)
 			{
-				DeserializeMap(it->value, TitleRules, unknownKeyCallback);
+				DeserializeMap(val, m_TitleRules, unknownKeyCallback);
 			}
 			else if (key == FILE_KEY)
 			{
-				DeserializeMap(it->value, FileRules, unknownKeyCallback);
+				DeserializeMap(val, FileRules, unknownKeyCallback);
 			}
 			else
 			{
 				unknownKeyCallback(key);
 			}
-		}
+		});
 	}
 
-	template<typename Hash, typename Equal, typename Alloc>
-	inline static void DeserializeMap(const rjh::value_t &obj, std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance, Hash, Equal, Alloc> &map, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value, typename Hash, typename Equal, typename Alloc>
+	inline static void DeserializeMap(Value &obj, std::unordered_map<std::wstring, ActiveInactiveTaskbarAppearance, Hash, Equal, Alloc> &map, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [&map, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			const auto key = rjh::ValueToStringView(it->name);
-
 			ActiveInactiveTaskbarAppearance rule;
-			rjh::Deserialize(it->value, rule, key, unknownKeyCallback);
+			rjh::Deserialize(val, rule, key, unknownKeyCallback);
 
 			map[std::wstring(key)] = rule;
-		}
+		});
 	}
 
 	static constexpr std::wstring_view RULES_KEY = L"rules";
@@ -37,6 +37,8 @@ struct TaskbarAppearance {
 		BlurRadius(blurRadius)
 	{ }
 
+	constexpr bool operator ==(const TaskbarAppearance &) const noexcept = default;
+
 #ifdef HAS_RAPIDJSON
 	template<class Writer>
 	inline void Serialize(Writer &writer) const
@@ -48,20 +50,19 @@ struct TaskbarAppearance {
 		rjh::Serialize(writer, BlurRadius, RADIUS_KEY);
 	}
 
-	void Deserialize(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view))
+	// Value is either a rjh::value_t or a rjh::StreamReader.
+	template<typename Value>
+	void Deserialize(Value &obj, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			InnerDeserialize(rjh::ValueToStringView(it->name), it->value, unknownKeyCallback);
-		}
+			InnerDeserialize(key, val, unknownKeyCallback);
+		});
 	}
 
 protected:
-	void InnerDeserialize(std::wstring_view key, const rjh::value_t &val, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	void InnerDeserialize(std::wstring_view key, Value &val, void (*unknownKeyCallback)(std::wstring_view))
 	{
 		if (key == ACCENT_KEY)
 		{
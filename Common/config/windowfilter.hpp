@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <rapidjson/document.h>
 #include <rapidjson/encodings.h>
 #include <string>
@@ -8,62 +9,94 @@
 #include "rapidjsonhelper.hpp"
 #include "../win32.hpp"
 #include "../constants.hpp"
+#include "../util/substring_matcher.hpp"
 
 #ifdef _TRANSLUCENTTB_EXE
 #include "../../TranslucentTB/windows/window.hpp"
-#include "../../ProgramLog/error/std.hpp"
 #endif
 
 struct WindowFilter {
 	std::unordered_set<std::wstring> ClassList;
-	std::unordered_set<std::wstring> TitleList;
 	win32::FilenameSet FileList;
 
 	WindowFilter() = default;
 	WindowFilter(std::unordered_set<std::wstring> classList, std::unordered_set<std::wstring> titleList, win32::FilenameSet fileList) :
 		ClassList(std::move(classList)),
-		TitleList(std::move(titleList)),
-		FileList(std::move(fileList))
-	{ }
+		FileList(std::move(fileList)),
+		m_TitleList(std::move(titleList))
+	{
+		CompileTitleList();
+	}
 
 	template<class Writer>
 	inline void Serialize(Writer &writer) const
 	{
 		SerializeStringSet(writer, ClassList, CLASS_KEY);
-		SerializeStringSet(writer, TitleList, TITLE_KEY);
+		SerializeStringSet(writer, m_TitleList, TITLE_KEY);
 		SerializeStringSet(writer, FileList, FILE_KEY);
 	}
 
-	inline void Deserialize(const rjh::value_t &obj, void (*unknownKeyCallback)(std::wstring_view))
+	template<typename Value>
+	inline void Deserialize(Value &obj, void (*unknownKeyCallback)(std::wstring_view))
 	{
-		rjh::EnsureType(rj::Type::kObjectType, obj.GetType(), L"root node");
-
-		for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it)
+		rjh::ForEachMember(obj, L"root node", [this, unknownKeyCallback](std::wstring_view key, auto &val)
 		{
-			rjh::EnsureType(rj::Type::kStringType, it->name.GetType(), L"member name");
-
-			const auto key = rjh::ValueToStringView(it->name);
 			if (key == CLASS_KEY)
 			{
-				DeserializeStringSet(it->value, ClassList, key);
+				DeserializeStringSet(val, ClassList, key);
 			}
 			else if (key == TITLE_KEY)
 			{
-				DeserializeStringSet(it->value, TitleList, key);
+				DeserializeStringSet(val, m_TitleList, key);
 			}
 			else if (key == FILE_KEY)
 			{
-				DeserializeStringSet(it->value, FileList, key);
+				DeserializeStringSet(val, FileList, key);
 			}
 			else if (unknownKeyCallback)
 			{
 				unknownKeyCallback(key);
 			}
+		});
+
+		CompileTitleList();
+	}
+
+	// The title list is only changed through these, which keep the matcher in sync.
+	inline const std::unordered_set<std::wstring> &TitleList() const noexcept
+	{
+		return m_TitleList;
+	}
+
+	inline void SetTitleList(std::unordered_set<std::wstring> titles)
+	{
+		m_TitleList = std::move(titles);
+		CompileTitleList();
+	}
+
+	// Instead of compiling the list, takes what TitleMatcher returned for the same list.
+	// Returns false and leaves the list alone if the matcher doesn't fit it.
+	inline bool SetTitleList(std::unordered_set<std::wstring> titles, Util::substring_matcher matcher)
+	{
+		if (matcher.size() != titles.size() || !std::ranges::all_of(matcher.patterns(), [&titles](const std::wstring &pattern) { return titles.contains(pattern); }))
+		{
+			return false;
 		}
+
+		m_TitleList = std::move(titles);
+		m_TitleMatcher = std::move(matcher);
+		return true;
+	}
+
+	inline const Util::substring_matcher &TitleMatcher() const noexcept
+	{
+		return m_TitleMatcher;
 	}
 
 #ifdef _TRANSLUCENTTB_EXE
-	inline bool IsFiltered(Window window) const
+	// T is either a Window or a cached view of one.
+	template<typename T>
+	inline bool IsFiltered(const T &window) const
 	{
 		// TODO: add logging
 		// This is the fastest because we do the less string manipulation, so always try it first
@@ -84,16 +117,12 @@ struct WindowFilter {
 
 		if (!FileList.empty())
 		{
-			if (const auto file = window.file())
+			if (const auto fileName = window.filename())
 			{
-				try
+				if (FileList.contains(*fileName))
 				{
-					if (FileList.contains(file->filename().native()))
-					{
-						return true;
-					}
+					return true;
 				}
-				StdSystemErrorCatch(spdlog::level::warn, L"Failed to check if window process is part of window filter");
 			}
 			else
 			{
@@ -102,17 +131,11 @@ struct WindowFilter {
 		}
 
 		// Do it last because titles can change, so it's less reliable.
-		if (!TitleList.empty())
+		if (!m_TitleList.empty())
 		{
 			if (const auto title = window.title())
 			{
-				for (const auto &value : TitleList)
-				{
-					if (title->find(value) != std::wstring::npos)
-					{
-						return true;
-					}
-				}
+				return m_TitleMatcher.matches(*title);
 			}
 		}
 
@@ -121,6 +144,14 @@ struct WindowFilter {
 #endif
 
 private:
+	std::unordered_set<std::wstring> m_TitleList;
+	Util::substring_matcher m_TitleMatcher;
+
+	inline void CompileTitleList()
+	{
+		m_TitleMatcher = Util::substring_matcher(m_TitleList);
+	}
+
 	template<typename Writer, typename Hash, typename Equal, typename Alloc>
 	inline static void SerializeStringSet(Writer &writer, const std::unordered_set<std::wstring, Hash, Equal, Alloc> &set, std::wstring_view key)
 	{
@@ -133,15 +164,13 @@ private:
 		writer.EndArray();
 	}
 
-	template<typename Hash, typename Equal, typename Alloc>
-	inline static void DeserializeStringSet(const rjh::value_t &arr, std::unordered_set<std::wstring, Hash, Equal, Alloc> &set, std::wstring_view key)
+	template<typename Value, typename Hash, typename Equal, typename Alloc>
+	inline static void DeserializeStringSet(Value &arr, std::unordered_set<std::wstring, Hash, Equal, Alloc> &set, std::wstring_view key)
 	{
-		rjh::EnsureType(rj::Type::kArrayType, arr.GetType(), key);
-
-		for (const auto &elem : arr.GetArray())
+		rjh::ForEachElement(arr, key, [&set](auto &elem)
 		{
 			rjh::EnsureType(rj::Type::kStringType, elem.GetType(), L"array element");
 			set.emplace(rjh::ValueToStringView(elem));
-		}
+		});
 	}
 };
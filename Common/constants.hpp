@@ -50,6 +50,12 @@ static constexpr Util::null_terminated_wstring_view WM_TTBFINDINSTARTVISIBILITYC
 // Sent to the worker to force the taskbar to toggle to normal and back to the expected appearance
 static constexpr Util::null_terminated_wstring_view WM_TTBFORCEREFRESHTASKBAR = L"TTB_ForceRefreshTaskbar";
 
+// Posted by TaskbarAttributeWorker to itself to apply the refreshes batched during the current message pump turn
+static constexpr Util::null_terminated_wstring_view WM_TTBFLUSHATTRIBUTEREFRESH = L"TTB_FlushAttributeRefresh";
+
+// Posted by TaskbarAttributeWorker to itself to process the window events queued by its hooks
+static constexpr Util::null_terminated_wstring_view WM_TTBDRAINWINDOWEVENTS = L"TTB_DrainWindowEvents";
+
 // Sent by another instance of TranslucentTB to signal that it was started while this instance is running.
 static constexpr Util::null_terminated_wstring_view WM_TTBNEWINSTANCESTARTED = L"TTB_NewInstanceStarted";
 
@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+namespace Util {
+	// Decides how long to wait after a file change before acting on it, learning from the
+	// way the file gets written. Editors save in bursts of changes (temporary file, rename,
+	// timestamp touch) whose pauses depend on the editor, so a fixed delay is either too
+	// slow for the ones that write once or too quick for the ones that take their time.
+	//
+	// The delay is twice the longest pause expected within a burst. That estimate is a moving
+	// average of the longest pause seen in each burst, and jumps up to a pause that got missed
+	// whenever a change comes in shortly after a burst was thought to be over.
+	class adaptive_debounce {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		static constexpr clock::duration MIN_DELAY = std::chrono::milliseconds(25);
+		static constexpr clock::duration MAX_DELAY = std::chrono::seconds(1);
+		static constexpr clock::duration INITIAL_PAUSE = std::chrono::milliseconds(100);
+
+	private:
+		clock::duration m_Pause = INITIAL_PAUSE; // longest pause expected within a burst
+		clock::duration m_BurstPause { }; // longest pause seen in the current burst
+		clock::time_point m_BurstStart { };
+		clock::time_point m_LastChange { };
+		clock::time_point m_LastSettled { };
+		bool m_InBurst = false;
+		bool m_Settled = false;
+
+		static constexpr clock::duration clamp_pause(clock::duration pause) noexcept
+		{
+			return std::clamp(pause, MIN_DELAY / 2, MAX_DELAY / 2);
+		}
+
+	public:
+		// How long to wait for the burst to be over.
+		constexpr clock::duration delay() const noexcept
+		{
+			return std::clamp(2 * m_Pause, MIN_DELAY, MAX_DELAY);
+		}
+
+		constexpr bool in_burst() const noexcept
+		{
+			return m_InBurst;
+		}
+
+		// Records a change, and returns how long to wait from now on before acting on it.
+		constexpr clock::duration change(clock::time_point now) noexcept
+		{
+			if (m_InBurst)
+			{
+				m_BurstPause = std::max(m_BurstPause, now - m_LastChange);
+			}
+			else
+			{
+				if (m_Settled && now - m_LastSettled < delay())
+				{
+					// the previous burst wasn't over yet, don't miss that pause again
+					m_Pause = clamp_pause(std::max(m_Pause, now - m_LastChange));
+				}
+
+				m_InBurst = true;
+				m_BurstStart = now;
+				m_BurstPause = { };
+			}
+
+			m_LastChange = now;
+			return delay();
+		}
+
+		// Ends the current burst, and returns when it started.
+		constexpr clock::time_point settle(clock::time_point now) noexcept
+		{
+			if (m_InBurst)
+			{
+				m_Pause = clamp_pause((3 * m_Pause + m_BurstPause) / 4);
+				m_InBurst = false;
+				m_Settled = true;
+				m_LastSettled = now;
+			}
+
+			return m_BurstStart;
+		}
+	};
+}
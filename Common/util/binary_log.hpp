@@ -0,0 +1,699 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+namespace Util {
+	enum class log_format {
+		text,
+		binary // see binary_log below
+	};
+}
+
+// Compact log format where a message is stored as the id of its (static) format string
+// and its raw arguments, rendered to text only when the log gets read. Definitions of
+// the format strings are written to the file the first time they are used.
+//
+// This only uses the standard library so that logs can be decoded anywhere.
+namespace Util::binary_log {
+	static_assert(std::endian::native == std::endian::little, "binary logs are written in little endian");
+
+	// Every file starts with this. The last byte is the format version.
+	inline constexpr std::string_view MAGIC { "TTBBLOG\x01", 8 };
+
+	// Each record is a kind byte, its size as a 32-bit integer, and then its contents.
+	enum class record_kind : std::uint8_t {
+		define = 1, // id, level, line, file, format string
+		entry = 2,  // id, timestamp, thread, arguments
+		text = 3    // level, line, timestamp, thread, file, text
+	};
+
+	enum class arg_type : std::uint8_t {
+		unsigned_integer = 1,
+		signed_integer = 2,
+		boolean = 3,
+		pointer = 4,
+		hresult = 5,
+		utf8 = 6,
+		utf16 = 7
+	};
+
+	// Same values as spdlog's levels.
+	inline constexpr std::array<std::string_view, 7> LEVEL_NAMES = {
+		"trace", "debug", "info", "warning", "error", "critical", "off"
+	};
+
+	// Makes an HRESULT get rendered as one instead of as an integer.
+	struct hresult {
+		std::int32_t Value;
+	};
+
+	// Where a message comes from. Its address is what identifies it, so it has to
+	// outlive the log: it's meant to be a static at the call site.
+	struct call_site {
+		std::string_view Format; // UTF-8, with {} placeholders
+		std::string_view File;
+		std::uint32_t Line;
+		std::uint8_t Level;
+	};
+
+	namespace impl {
+		// strings are limited to what fits in their 16-bit length, anything longer is cut off.
+		inline constexpr std::size_t MAX_STRING_LENGTH = UINT16_MAX;
+
+		template<typename T>
+		inline void put(std::string &out, T value)
+		{
+			char bytes[sizeof(T)];
+			std::memcpy(bytes, &value, sizeof(T));
+			out.append(bytes, sizeof(T));
+		}
+
+		inline void put_string(std::string &out, std::string_view str)
+		{
+			str = str.substr(0, MAX_STRING_LENGTH);
+			put(out, static_cast<std::uint16_t>(str.size()));
+			out += str;
+		}
+
+		inline void put_string(std::string &out, std::wstring_view str)
+		{
+			if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+			{
+				str = str.substr(0, MAX_STRING_LENGTH);
+				put(out, static_cast<std::uint16_t>(str.size()));
+				out.append(reinterpret_cast<const char *>(str.data()), str.size() * sizeof(wchar_t));
+			}
+			else
+			{
+				// wchar_t is UTF-32, convert it.
+				const auto lengthOffset = out.size();
+				put(out, std::uint16_t { 0 });
+
+				std::size_t units = 0;
+				for (const wchar_t ch : str)
+				{
+					const auto codepoint = static_cast<std::uint32_t>(ch);
+					const std::size_t needed = codepoint > 0xFFFF ? 2 : 1;
+					if (units + needed > MAX_STRING_LENGTH)
+					{
+						break;
+					}
+
+					if (needed == 2)
+					{
+						put(out, static_cast<char16_t>(0xD800 + ((codepoint - 0x10000) >> 10)));
+						put(out, static_cast<char16_t>(0xDC00 + ((codepoint - 0x10000) & 0x3FF)));
+					}
+					else
+					{
+						put(out, static_cast<char16_t>(codepoint));
+					}
+
+					units += needed;
+				}
+
+				const auto length = static_cast<std::uint16_t>(units);
+				std::memcpy(out.data() + lengthOffset, &length, sizeof(length));
+			}
+		}
+
+		inline std::size_t begin_record(std::string &out, record_kind kind)
+		{
+			out += static_cast<char>(kind);
+			const auto offset = out.size();
+			put(out, std::uint32_t { 0 });
+			return offset;
+		}
+
+		inline void end_record(std::string &out, std::size_t offset)
+		{
+			const auto size = static_cast<std::uint32_t>(out.size() - offset - sizeof(std::uint32_t));
+			std::memcpy(out.data() + offset, &size, sizeof(size));
+		}
+
+		inline void put_tag(std::string &out, arg_type type)
+		{
+			out += static_cast<char>(type);
+		}
+
+		template<typename T>
+		concept character = std::same_as<std::remove_cv_t<T>, char> || std::same_as<std::remove_cv_t<T>, wchar_t>;
+	}
+
+	inline void append_arg(std::string &out, bool value)
+	{
+		impl::put_tag(out, arg_type::boolean);
+		out += static_cast<char>(value);
+	}
+
+	template<std::unsigned_integral T>
+	inline void append_arg(std::string &out, T value)
+	{
+		impl::put_tag(out, arg_type::unsigned_integer);
+		impl::put(out, static_cast<std::uint64_t>(value));
+	}
+
+	template<std::signed_integral T>
+	inline void append_arg(std::string &out, T value)
+	{
+		impl::put_tag(out, arg_type::signed_integer);
+		impl::put(out, static_cast<std::int64_t>(value));
+	}
+
+	inline void append_arg(std::string &out, hresult value)
+	{
+		impl::put_tag(out, arg_type::hresult);
+		impl::put(out, value.Value);
+	}
+
+	// Handles (HWND, HMONITOR, ...) and other pointers, but not strings.
+	template<typename T>
+		requires (!impl::character<T>)
+	inline void append_arg(std::string &out, T *value)
+	{
+		impl::put_tag(out, arg_type::pointer);
+		impl::put(out, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(value)));
+	}
+
+	inline void append_arg(std::string &out, std::string_view value)
+	{
+		impl::put_tag(out, arg_type::utf8);
+		impl::put_string(out, value);
+	}
+
+	inline void append_arg(std::string &out, std::wstring_view value)
+	{
+		impl::put_tag(out, arg_type::utf16);
+		impl::put_string(out, value);
+	}
+
+	inline void append_arg(std::string &out, const char *value)
+	{
+		append_arg(out, std::string_view(value));
+	}
+
+	inline void append_arg(std::string &out, const wchar_t *value)
+	{
+		append_arg(out, std::wstring_view(value));
+	}
+
+	// The arguments of a message, as they get stored in an entry.
+	template<typename... Args>
+	inline void encode_args(std::string &out, const Args &...args)
+	{
+		static_assert(sizeof...(Args) <= UINT8_MAX, "Too many arguments");
+
+		out += static_cast<char>(sizeof...(Args));
+		(append_arg(out, args), ...);
+	}
+
+	inline void encode_define(std::string &out, std::uint32_t id, const call_site &site)
+	{
+		const auto record = impl::begin_record(out, record_kind::define);
+		impl::put(out, id);
+		impl::put(out, site.Level);
+		impl::put(out, site.Line);
+		impl::put_string(out, site.File);
+		impl::put_string(out, site.Format);
+		impl::end_record(out, record);
+	}
+
+	// timestamp is in nanoseconds since the Unix epoch, and args comes from encode_args.
+	inline void encode_entry(std::string &out, std::uint32_t id, std::uint64_t timestamp, std::uint32_t thread, std::string_view args)
+	{
+		const auto record = impl::begin_record(out, record_kind::entry);
+		impl::put(out, id);
+		impl::put(out, timestamp);
+		impl::put(out, thread);
+		out += args;
+		impl::end_record(out, record);
+	}
+
+	// For messages that were already formatted, like those that don't go through a call site.
+	inline void encode_text(std::string &out, std::uint8_t level, std::string_view file, std::uint32_t line, std::uint64_t timestamp, std::uint32_t thread, std::string_view text)
+	{
+		const auto record = impl::begin_record(out, record_kind::text);
+		impl::put(out, level);
+		impl::put(out, line);
+		impl::put(out, timestamp);
+		impl::put(out, thread);
+		impl::put_string(out, file);
+		impl::put(out, static_cast<std::uint32_t>(text.size()));
+		out += text;
+		impl::end_record(out, record);
+	}
+
+	// Gives ids to call sites, in the order they are first seen in a file.
+	// Not thread safe, the log sink uses it under its lock.
+	class writer {
+		std::unordered_map<const call_site *, std::uint32_t> m_Ids;
+
+	public:
+		// Returns the id of the call site, appending its definition to out if it wasn't written yet.
+		std::uint32_t define(std::string &out, const call_site &site)
+		{
+			const auto [it, inserted] = m_Ids.try_emplace(&site, static_cast<std::uint32_t>(m_Ids.size() + 1));
+			if (inserted)
+			{
+				encode_define(out, it->second, site);
+			}
+
+			return it->second;
+		}
+
+		void clear() noexcept
+		{
+			m_Ids.clear();
+		}
+	};
+
+	namespace impl {
+		class cursor {
+			std::string_view m_Data;
+			bool m_Failed = false;
+
+		public:
+			explicit cursor(std::string_view data) noexcept : m_Data(data) { }
+
+			bool failed() const noexcept { return m_Failed; }
+			bool empty() const noexcept { return m_Data.empty(); }
+			std::uint8_t peek() const noexcept { return m_Data.empty() ? 0 : static_cast<std::uint8_t>(m_Data.front()); }
+
+			std::string_view take(std::size_t size) noexcept
+			{
+				if (m_Failed || size > m_Data.size())
+				{
+					m_Failed = true;
+					return { };
+				}
+
+				const auto bytes = m_Data.substr(0, size);
+				m_Data.remove_prefix(size);
+				return bytes;
+			}
+
+			template<typename T>
+			T get() noexcept
+			{
+				T value { };
+				if (const auto bytes = take(sizeof(T)); !m_Failed)
+				{
+					std::memcpy(&value, bytes.data(), sizeof(T));
+				}
+
+				return value;
+			}
+
+			std::string_view get_string() noexcept
+			{
+				return take(get<std::uint16_t>());
+			}
+		};
+
+		inline void append_hex(std::string &out, std::uint64_t value, int minDigits, bool upper)
+		{
+			const char *const digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+			char buf[16];
+			int count = 0;
+			do
+			{
+				buf[count++] = digits[value & 0xF];
+				value >>= 4;
+			} while (value != 0 || count < minDigits);
+
+			out += "0x";
+			while (count > 0)
+			{
+				out += buf[--count];
+			}
+		}
+
+		inline void append_utf8(std::string &out, std::uint32_t codepoint)
+		{
+			if (codepoint < 0x80)
+			{
+				out += static_cast<char>(codepoint);
+			}
+			else if (codepoint < 0x800)
+			{
+				out += static_cast<char>(0xC0 | (codepoint >> 6));
+				out += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+			else if (codepoint < 0x10000)
+			{
+				out += static_cast<char>(0xE0 | (codepoint >> 12));
+				out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+			else
+			{
+				out += static_cast<char>(0xF0 | (codepoint >> 18));
+				out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+				out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+		}
+
+		inline void append_utf16(std::string &out, std::string_view bytes)
+		{
+			constexpr std::uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+			const auto unit = [bytes](std::size_t i)
+			{
+				char16_t value;
+				std::memcpy(&value, bytes.data() + i * sizeof(value), sizeof(value));
+				return static_cast<std::uint32_t>(value);
+			};
+
+			const std::size_t count = bytes.size() / sizeof(char16_t);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const auto first = unit(i);
+				if (first >= 0xD800 && first <= 0xDBFF && i + 1 < count && unit(i + 1) >= 0xDC00 && unit(i + 1) <= 0xDFFF)
+				{
+					append_utf8(out, 0x10000 + ((first - 0xD800) << 10) + (unit(i + 1) - 0xDC00));
+					++i;
+				}
+				else if (first >= 0xD800 && first <= 0xDFFF)
+				{
+					append_utf8(out, REPLACEMENT_CHARACTER);
+				}
+				else
+				{
+					append_utf8(out, first);
+				}
+			}
+		}
+
+		inline bool append_arg_text(std::string &out, cursor &args)
+		{
+			switch (static_cast<arg_type>(args.get<std::uint8_t>()))
+			{
+			case arg_type::unsigned_integer:
+				out += std::to_string(args.get<std::uint64_t>());
+				break;
+
+			case arg_type::signed_integer:
+				out += std::to_string(args.get<std::int64_t>());
+				break;
+
+			case arg_type::boolean:
+				out += args.get<std::uint8_t>() ? "true" : "false";
+				break;
+
+			case arg_type::pointer:
+				// like std::format does
+				append_hex(out, args.get<std::uint64_t>(), 1, false);
+				break;
+
+			case arg_type::hresult:
+				append_hex(out, static_cast<std::uint32_t>(args.get<std::int32_t>()), 8, true);
+				break;
+
+			case arg_type::utf8:
+				out += args.get_string();
+				break;
+
+			case arg_type::utf16:
+				append_utf16(out, args.take(std::size_t { args.get<std::uint16_t>() } * sizeof(char16_t)));
+				break;
+
+			default:
+				return false;
+			}
+
+			return !args.failed();
+		}
+	}
+
+	// Substitutes the encoded arguments (as produced by encode_args) in the {} placeholders
+	// of format, {{ and }} being literal braces. Placeholders can't have format specifications,
+	// those are ignored. Returns false if the arguments are malformed.
+	inline bool render(std::string &out, std::string_view format, std::string_view args)
+	{
+		impl::cursor cursor(args);
+		std::size_t remaining = cursor.get<std::uint8_t>();
+		if (cursor.failed())
+		{
+			return false;
+		}
+
+		for (std::size_t i = 0; i < format.size(); ++i)
+		{
+			const char ch = format[i];
+			if ((ch == '{' || ch == '}') && i + 1 < format.size() && format[i + 1] == ch)
+			{
+				out += ch;
+				++i;
+			}
+			else if (ch == '{')
+			{
+				const auto end = format.find('}', i);
+				if (end == std::string_view::npos)
+				{
+					out += format.substr(i);
+					break;
+				}
+
+				if (remaining != 0)
+				{
+					--remaining;
+					if (!impl::append_arg_text(out, cursor))
+					{
+						return false;
+					}
+				}
+				else
+				{
+					out += "{?}";
+				}
+
+				i = end;
+			}
+			else
+			{
+				out += ch;
+			}
+		}
+
+		return true;
+	}
+
+	// A decoded message.
+	struct message {
+		std::uint8_t Level = 0;
+		std::string_view File;
+		std::uint32_t Line = 0;
+		std::uint64_t Timestamp = 0; // nanoseconds since the Unix epoch
+		std::uint32_t Thread = 0;
+		std::string Text;
+	};
+
+	// Reads the messages of a whole file, kept in memory by the caller.
+	class reader {
+		struct definition {
+			std::string_view Format;
+			std::string_view File;
+			std::uint32_t Line;
+			std::uint8_t Level;
+		};
+
+		impl::cursor m_Data;
+		bool m_Valid;
+		bool m_Corrupt = false;
+		std::unordered_map<std::uint32_t, definition> m_Definitions;
+
+	public:
+		explicit reader(std::string_view data) :
+			m_Data(data.substr(std::min(data.size(), MAGIC.size()))),
+			m_Valid(data.starts_with(MAGIC))
+		{ }
+
+		// Whether this looks like a binary log at all.
+		bool valid() const noexcept { return m_Valid; }
+
+		// Whether reading stopped because of a truncated or malformed record.
+		bool corrupt() const noexcept { return m_Corrupt; }
+
+		// Returns false once there are no more messages.
+		bool next(message &msg)
+		{
+			if (!m_Valid)
+			{
+				return false;
+			}
+
+			while (!m_Data.empty() && !m_Corrupt)
+			{
+				// no record kind is 0: this is the zero padding past the end of a log still being written.
+				if (m_Data.peek() == 0)
+				{
+					m_Data = impl::cursor({ });
+					break;
+				}
+
+				const auto kind = static_cast<record_kind>(m_Data.get<std::uint8_t>());
+				const auto size = m_Data.get<std::uint32_t>();
+				const auto contents = m_Data.take(size);
+				if (m_Data.failed())
+				{
+					// most likely the end of the file didn't get written.
+					m_Corrupt = true;
+					break;
+				}
+
+				impl::cursor record(contents);
+				if (kind == record_kind::define)
+				{
+					definition def;
+					const auto id = record.get<std::uint32_t>();
+					def.Level = record.get<std::uint8_t>();
+					def.Line = record.get<std::uint32_t>();
+					def.File = record.get_string();
+					def.Format = record.get_string();
+					if (record.failed())
+					{
+						m_Corrupt = true;
+						break;
+					}
+
+					m_Definitions.insert_or_assign(id, def);
+				}
+				else if (kind == record_kind::entry)
+				{
+					const auto id = record.get<std::uint32_t>();
+					msg.Timestamp = record.get<std::uint64_t>();
+					msg.Thread = record.get<std::uint32_t>();
+					if (record.failed())
+					{
+						m_Corrupt = true;
+						break;
+					}
+
+					const auto args = contents.substr(sizeof(std::uint32_t) + sizeof(std::uint64_t) + sizeof(std::uint32_t));
+					msg.Text.clear();
+					if (const auto it = m_Definitions.find(id); it != m_Definitions.end())
+					{
+						msg.Level = it->second.Level;
+						msg.File = it->second.File;
+						msg.Line = it->second.Line;
+						if (!render(msg.Text, it->second.Format, args))
+						{
+							m_Corrupt = true;
+							break;
+						}
+					}
+					else
+					{
+						// the definition got lost, the arguments are still worth something.
+						msg.Level = static_cast<std::uint8_t>(LEVEL_NAMES.size() - 1);
+						msg.File = { };
+						msg.Line = 0;
+						msg.Text = "[undefined message " + std::to_string(id) + "]";
+
+						std::string placeholders;
+						for (std::size_t i = 0, count = args.empty() ? 0 : static_cast<std::uint8_t>(args[0]); i < count; ++i)
+						{
+							placeholders += " {}";
+						}
+
+						if (!render(msg.Text, placeholders, args))
+						{
+							m_Corrupt = true;
+							break;
+						}
+					}
+
+					return true;
+				}
+				else if (kind == record_kind::text)
+				{
+					msg.Level = record.get<std::uint8_t>();
+					msg.Line = record.get<std::uint32_t>();
+					msg.Timestamp = record.get<std::uint64_t>();
+					msg.Thread = record.get<std::uint32_t>();
+					msg.File = record.get_string();
+					const auto text = record.take(record.get<std::uint32_t>());
+					if (record.failed())
+					{
+						m_Corrupt = true;
+						break;
+					}
+
+					msg.Text = text;
+					return true;
+				}
+
+				// unknown records are skipped, they come from a newer version.
+			}
+
+			return false;
+		}
+	};
+
+	// Renders a message like the text log does: [2024-01-01 12:34:56.789] [debug] [file.cpp:123] text
+	inline std::string format_line(const message &msg)
+	{
+		using namespace std::chrono;
+
+		const sys_time<nanoseconds> time { nanoseconds { msg.Timestamp } };
+		const auto day = floor<days>(time);
+		const year_month_day date { day };
+		const hh_mm_ss clock { floor<milliseconds>(time - day) };
+
+		const auto pad = [](std::string &out, long long value, std::size_t width)
+		{
+			const auto str = std::to_string(value);
+			if (str.size() < width)
+			{
+				out.append(width - str.size(), '0');
+			}
+
+			out += str;
+		};
+
+		std::string line;
+		line.reserve(48 + msg.File.size() + msg.Text.size());
+		line += '[';
+		pad(line, static_cast<int>(date.year()), 4);
+		line += '-';
+		pad(line, static_cast<unsigned int>(date.month()), 2);
+		line += '-';
+		pad(line, static_cast<unsigned int>(date.day()), 2);
+		line += ' ';
+		pad(line, clock.hours().count(), 2);
+		line += ':';
+		pad(line, clock.minutes().count(), 2);
+		line += ':';
+		pad(line, clock.seconds().count(), 2);
+		line += '.';
+		pad(line, clock.subseconds().count(), 3);
+		line += "] [";
+		line += msg.Level < LEVEL_NAMES.size() ? LEVEL_NAMES[msg.Level] : "unknown";
+		line += "] ";
+
+		if (!msg.File.empty())
+		{
+			// only the file name, like spdlog
+			const auto separator = msg.File.find_last_of("\\/");
+			line += '[';
+			line += separator != std::string_view::npos ? msg.File.substr(separator + 1) : msg.File;
+			line += ':';
+			line += std::to_string(msg.Line);
+			line += "] ";
+		}
+
+		line += msg.Text;
+		return line;
+	}
+}
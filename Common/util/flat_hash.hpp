@@ -0,0 +1,380 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Util {
+	namespace impl {
+		template<typename Key, typename Slot, typename KeyOf, typename Hash, typename KeyEqual>
+		class flat_hash_table {
+			static constexpr std::int8_t EMPTY = -128;
+			static constexpr std::size_t MIN_CAPACITY = 8;
+
+			// control byte per slot: EMPTY, or the low 7 bits of the hash of the key it holds.
+			// this lets probing skip most key comparisons without touching the slots.
+			std::vector<std::int8_t> m_Control;
+			std::vector<Slot> m_Slots;
+			std::size_t m_Size = 0;
+			unsigned int m_Shift = 0;
+
+			static std::size_t mix(const Key &key) noexcept
+			{
+				// pointer-like keys often hash to themselves, with the low bits always clear.
+				// spread them out (Fibonacci hashing) and index with the high bits.
+				if constexpr (sizeof(std::size_t) == 8)
+				{
+					return static_cast<std::size_t>(Hash { }(key)) * static_cast<std::size_t>(0x9E3779B97F4A7C15);
+				}
+				else
+				{
+					return static_cast<std::size_t>(Hash { }(key)) * static_cast<std::size_t>(0x9E3779B9);
+				}
+			}
+
+			std::size_t home(std::size_t hash) const noexcept
+			{
+				return hash >> m_Shift;
+			}
+
+			static std::int8_t fingerprint(std::size_t hash) noexcept
+			{
+				return static_cast<std::int8_t>(hash & 0x7F);
+			}
+
+			std::size_t mask() const noexcept
+			{
+				return m_Control.size() - 1;
+			}
+
+			// index of the slot holding key, or of the empty slot where it would go.
+			std::size_t probe(const Key &key, std::size_t hash) const
+			{
+				const auto print = fingerprint(hash);
+				for (std::size_t i = home(hash); ; i = (i + 1) & mask())
+				{
+					if (m_Control[i] == EMPTY || (m_Control[i] == print && KeyEqual { }(KeyOf { }(m_Slots[i]), key)))
+					{
+						return i;
+					}
+				}
+			}
+
+			void rehash(std::size_t capacity)
+			{
+				std::vector<std::int8_t> control(capacity, EMPTY);
+				std::vector<Slot> slots(capacity);
+				std::swap(control, m_Control);
+				std::swap(slots, m_Slots);
+				m_Shift = static_cast<unsigned int>(sizeof(std::size_t) * 8 - std::countr_zero(capacity));
+
+				for (std::size_t i = 0; i < control.size(); ++i)
+				{
+					if (control[i] != EMPTY)
+					{
+						const auto hash = mix(KeyOf { }(slots[i]));
+						auto j = home(hash);
+						while (m_Control[j] != EMPTY)
+						{
+							j = (j + 1) & mask();
+						}
+
+						m_Control[j] = fingerprint(hash);
+						m_Slots[j] = std::move(slots[i]);
+					}
+				}
+			}
+
+			void grow_if_needed()
+			{
+				// keep the load factor under 7/8
+				if (m_Control.empty())
+				{
+					rehash(MIN_CAPACITY);
+				}
+				else if ((m_Size + 1) * 8 > m_Control.size() * 7)
+				{
+					rehash(m_Control.size() * 2);
+				}
+			}
+
+			// backward shift deletion, so that there are no tombstones and probe
+			// sequences stay as short as if the element never was there.
+			void erase_at(std::size_t hole)
+			{
+				for (std::size_t i = (hole + 1) & mask(); m_Control[i] != EMPTY; i = (i + 1) & mask())
+				{
+					const auto desired = home(mix(KeyOf { }(m_Slots[i])));
+
+					// move i into the hole unless its home lies cyclically in (hole, i]
+					if (((i - desired) & mask()) >= ((i - hole) & mask()))
+					{
+						m_Control[hole] = m_Control[i];
+						m_Slots[hole] = std::move(m_Slots[i]);
+						hole = i;
+					}
+				}
+
+				m_Control[hole] = EMPTY;
+				m_Slots[hole] = Slot { };
+				--m_Size;
+			}
+
+		public:
+			template<bool is_const>
+			class basic_iterator {
+				using table_t = std::conditional_t<is_const, const flat_hash_table, flat_hash_table>;
+
+				table_t *m_Table = nullptr;
+				std::size_t m_Index = 0;
+
+				void skip_empty() noexcept
+				{
+					while (m_Index < m_Table->m_Control.size() && m_Table->m_Control[m_Index] == EMPTY)
+					{
+						++m_Index;
+					}
+				}
+
+				friend class flat_hash_table;
+
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = Slot;
+				using difference_type = std::ptrdiff_t;
+				using pointer = std::conditional_t<is_const, const Slot *, Slot *>;
+				using reference = std::conditional_t<is_const, const Slot &, Slot &>;
+
+				basic_iterator() noexcept = default;
+				basic_iterator(table_t *table, std::size_t index) noexcept : m_Table(table), m_Index(index) { }
+
+				operator basic_iterator<true>() const noexcept requires (!is_const)
+				{
+					return { m_Table, m_Index };
+				}
+
+				reference operator *() const noexcept { return m_Table->m_Slots[m_Index]; }
+				pointer operator ->() const noexcept { return &m_Table->m_Slots[m_Index]; }
+
+				basic_iterator &operator ++() noexcept
+				{
+					++m_Index;
+					skip_empty();
+					return *this;
+				}
+
+				basic_iterator operator ++(int) noexcept
+				{
+					auto copy = *this;
+					++*this;
+					return copy;
+				}
+
+				bool operator ==(const basic_iterator &right) const noexcept
+				{
+					return m_Index == right.m_Index;
+				}
+			};
+
+			using iterator = basic_iterator<false>;
+			using const_iterator = basic_iterator<true>;
+
+			iterator begin() noexcept
+			{
+				iterator it(this, 0);
+				it.skip_empty();
+				return it;
+			}
+
+			const_iterator begin() const noexcept
+			{
+				const_iterator it(this, 0);
+				it.skip_empty();
+				return it;
+			}
+
+			iterator end() noexcept { return { this, m_Control.size() }; }
+			const_iterator end() const noexcept { return { this, m_Control.size() }; }
+
+			std::size_t size() const noexcept { return m_Size; }
+			bool empty() const noexcept { return m_Size == 0; }
+			std::size_t capacity() const noexcept { return m_Control.size(); }
+
+			void clear() noexcept
+			{
+				m_Control.clear();
+				m_Slots.clear();
+				m_Size = 0;
+			}
+
+			void reserve(std::size_t count)
+			{
+				std::size_t capacity = MIN_CAPACITY;
+				while (count * 8 > capacity * 7)
+				{
+					capacity *= 2;
+				}
+
+				if (capacity > m_Control.size())
+				{
+					rehash(capacity);
+				}
+			}
+
+			iterator find(const Key &key) noexcept
+			{
+				if (!m_Control.empty())
+				{
+					if (const auto i = probe(key, mix(key)); m_Control[i] != EMPTY)
+					{
+						return { this, i };
+					}
+				}
+
+				return end();
+			}
+
+			const_iterator find(const Key &key) const noexcept
+			{
+				return const_cast<flat_hash_table &>(*this).find(key);
+			}
+
+			bool contains(const Key &key) const noexcept
+			{
+				return find(key) != end();
+			}
+
+			std::size_t count(const Key &key) const noexcept
+			{
+				return contains(key) ? 1 : 0;
+			}
+
+			template<typename Make>
+			std::pair<iterator, bool> emplace_with(const Key &key, Make &&make)
+			{
+				const auto hash = mix(key);
+				if (const auto it = find(key); it != end())
+				{
+					return { it, false };
+				}
+
+				grow_if_needed();
+				const auto i = probe(key, hash);
+
+				m_Control[i] = fingerprint(hash);
+				m_Slots[i] = std::forward<Make>(make)();
+				++m_Size;
+				return { iterator(this, i), true };
+			}
+
+			std::size_t erase(const Key &key)
+			{
+				if (const auto it = find(key); it != end())
+				{
+					erase_at(it.m_Index);
+					return 1;
+				}
+				else
+				{
+					return 0;
+				}
+			}
+		};
+
+		template<typename Key>
+		struct identity_key {
+			const Key &operator()(const Key &key) const noexcept { return key; }
+		};
+
+		template<typename Key, typename Value>
+		struct first_key {
+			const Key &operator()(const std::pair<Key, Value> &slot) const noexcept { return slot.first; }
+		};
+	}
+
+	// Open addressing hash set for small, cheap to copy keys like handles and pointers.
+	// Elements live in a single array, so inserting doesn't allocate (except when growing)
+	// and lookups don't chase pointers.
+	// Unlike std::unordered_set, any insertion or erasure invalidates every iterator.
+	template<typename Key, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+	class flat_hash_set : public impl::flat_hash_table<Key, Key, impl::identity_key<Key>, Hash, KeyEqual> {
+		using base = impl::flat_hash_table<Key, Key, impl::identity_key<Key>, Hash, KeyEqual>;
+
+	public:
+		using value_type = Key;
+		using iterator = typename base::const_iterator;
+		using const_iterator = typename base::const_iterator;
+
+		iterator begin() const noexcept { return base::begin(); }
+		iterator end() const noexcept { return base::end(); }
+		iterator find(const Key &key) const noexcept { return base::find(key); }
+
+		std::pair<iterator, bool> insert(const Key &key)
+		{
+			return base::emplace_with(key, [&key] { return key; });
+		}
+
+		bool operator ==(const flat_hash_set &right) const noexcept
+		{
+			if (this->size() != right.size())
+			{
+				return false;
+			}
+
+			for (const auto &key : *this)
+			{
+				if (!right.contains(key))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+	};
+
+	// Open addressing hash map, see flat_hash_set.
+	// The key of an element must not be modified through an iterator.
+	template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+	class flat_hash_map : public impl::flat_hash_table<Key, std::pair<Key, Value>, impl::first_key<Key, Value>, Hash, KeyEqual> {
+		using base = impl::flat_hash_table<Key, std::pair<Key, Value>, impl::first_key<Key, Value>, Hash, KeyEqual>;
+
+	public:
+		using key_type = Key;
+		using mapped_type = Value;
+		using value_type = std::pair<Key, Value>;
+		using typename base::iterator;
+		using typename base::const_iterator;
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args)
+		{
+			return base::emplace_with(key, [&]
+			{
+				return value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+			});
+		}
+
+		template<typename V>
+		std::pair<iterator, bool> insert_or_assign(const Key &key, V &&value)
+		{
+			auto result = try_emplace(key, std::forward<V>(value));
+			if (!result.second)
+			{
+				result.first->second = std::forward<V>(value);
+			}
+
+			return result;
+		}
+
+		Value &operator [](const Key &key)
+		{
+			return try_emplace(key).first->second;
+		}
+	};
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace Util {
+	// Map stored as a vector sorted by key, for the handful of elements case (like one
+	// entry per monitor) where a binary search over contiguous memory beats hashing.
+	// Iterators stay valid until the next insertion or erasure.
+	template<typename Key, typename Value, typename Compare = std::less<Key>>
+	class flat_map {
+	public:
+		using key_type = Key;
+		using mapped_type = Value;
+		using value_type = std::pair<Key, Value>;
+		using container_type = std::vector<value_type>;
+		using iterator = typename container_type::iterator;
+		using const_iterator = typename container_type::const_iterator;
+
+	private:
+		container_type m_Elements;
+
+		template<typename Self>
+		static auto lower_bound(Self &self, const Key &key)
+		{
+			return std::lower_bound(self.m_Elements.begin(), self.m_Elements.end(), key, [](const value_type &element, const Key &value)
+			{
+				return Compare { }(element.first, value);
+			});
+		}
+
+		bool matches(const_iterator it, const Key &key) const
+		{
+			return it != m_Elements.end() && !Compare { }(key, it->first);
+		}
+
+	public:
+		iterator begin() noexcept { return m_Elements.begin(); }
+		iterator end() noexcept { return m_Elements.end(); }
+		const_iterator begin() const noexcept { return m_Elements.begin(); }
+		const_iterator end() const noexcept { return m_Elements.end(); }
+
+		std::size_t size() const noexcept { return m_Elements.size(); }
+		bool empty() const noexcept { return m_Elements.empty(); }
+
+		void clear() noexcept { m_Elements.clear(); }
+		void reserve(std::size_t count) { m_Elements.reserve(count); }
+
+		iterator find(const Key &key)
+		{
+			const auto it = lower_bound(*this, key);
+			return matches(it, key) ? it : m_Elements.end();
+		}
+
+		const_iterator find(const Key &key) const
+		{
+			const auto it = lower_bound(*this, key);
+			return matches(it, key) ? it : m_Elements.end();
+		}
+
+		bool contains(const Key &key) const
+		{
+			return find(key) != end();
+		}
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args)
+		{
+			const auto it = lower_bound(*this, key);
+			if (matches(it, key))
+			{
+				return { it, false };
+			}
+
+			return { m_Elements.emplace(it, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)), true };
+		}
+
+		template<typename V>
+		std::pair<iterator, bool> insert_or_assign(const Key &key, V &&value)
+		{
+			auto result = try_emplace(key, std::forward<V>(value));
+			if (!result.second)
+			{
+				result.first->second = std::forward<V>(value);
+			}
+
+			return result;
+		}
+
+		Value &operator [](const Key &key)
+		{
+			return try_emplace(key).first->second;
+		}
+
+		std::size_t erase(const Key &key)
+		{
+			if (const auto it = find(key); it != end())
+			{
+				m_Elements.erase(it);
+				return 1;
+			}
+			else
+			{
+				return 0;
+			}
+		}
+	};
+}
@@ -0,0 +1,320 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "binary_log.hpp"
+
+namespace Util {
+	// Keeps the latest messages that were too verbose to be written to the log in memory,
+	// so that they can be written out when something goes wrong.
+	//
+	// Any thread can record, and recording never locks nor allocates: messages are copied
+	// in the fixed-size slots of a ring, cut if they don't fit, and the oldest ones get
+	// overwritten. File names and call sites are not copied, and so must be static.
+	class flight_recorder {
+	public:
+		static constexpr std::size_t DEFAULT_CAPACITY = 1024;
+		static constexpr std::size_t PAYLOAD_SIZE = 216; // bytes of text or arguments in a message
+
+		struct dump {
+			std::vector<binary_log::message> Messages; // oldest first
+			std::uint64_t Lost = 0; // overwritten before being taken
+		};
+
+	private:
+		enum class kind : std::uint8_t {
+			text,
+			deferred
+		};
+
+		static constexpr std::size_t PAYLOAD_WORDS = PAYLOAD_SIZE / sizeof(std::uint64_t);
+		static_assert(PAYLOAD_SIZE % sizeof(std::uint64_t) == 0);
+
+		// written by whichever thread claimed it, but read at the same time when taking,
+		// hence the relaxed atomics and the version to detect torn reads.
+		struct slot {
+			std::atomic<std::uint32_t> Version = 0; // odd while being written
+			std::atomic<std::uint64_t> Sequence = 0;
+			std::atomic<std::uint64_t> Timestamp = 0;
+			std::atomic<const void *> Source = nullptr; // call site for deferred messages, file name otherwise
+			std::atomic<std::uint32_t> Line = 0;
+			std::atomic<std::uint32_t> Thread = 0;
+			std::atomic<std::uint8_t> Level = 0;
+			std::atomic<kind> Kind = kind::text;
+			std::atomic<bool> Truncated = false;
+			std::atomic<std::uint16_t> Size = 0;
+			std::array<std::atomic<std::uint64_t>, PAYLOAD_WORDS> Payload { };
+		};
+
+		// Fills a fixed buffer, and remembers if something didn't fit.
+		class bounded_buffer {
+			char m_Data[PAYLOAD_SIZE];
+			std::size_t m_Size = 0;
+			bool m_Truncated = false;
+
+		public:
+			const char *data() const noexcept { return m_Data; }
+			std::size_t size() const noexcept { return m_Size; }
+			bool truncated() const noexcept { return m_Truncated; }
+
+			void append(std::string_view str) noexcept
+			{
+				const auto count = std::min(str.size(), PAYLOAD_SIZE - m_Size);
+				std::memcpy(m_Data + m_Size, str.data(), count);
+				m_Size += count;
+				m_Truncated |= count != str.size();
+			}
+
+			// only whole code points, so that the text stays valid UTF-8.
+			void append_utf8(std::uint32_t codepoint) noexcept
+			{
+				const std::size_t length = codepoint < 0x80 ? 1 : codepoint < 0x800 ? 2 : codepoint < 0x10000 ? 3 : 4;
+				if (m_Truncated || length > PAYLOAD_SIZE - m_Size)
+				{
+					m_Truncated = true;
+					return;
+				}
+
+				if (length == 1)
+				{
+					m_Data[m_Size++] = static_cast<char>(codepoint);
+				}
+				else
+				{
+					constexpr std::uint8_t PREFIXES[] = { 0, 0, 0xC0, 0xE0, 0xF0 };
+					for (std::size_t i = length - 1; i > 0; --i)
+					{
+						m_Data[m_Size + i] = static_cast<char>(0x80 | (codepoint & 0x3F));
+						codepoint >>= 6;
+					}
+
+					m_Data[m_Size] = static_cast<char>(PREFIXES[length] | codepoint);
+					m_Size += length;
+				}
+			}
+
+			void append(std::wstring_view str) noexcept
+			{
+				constexpr std::uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+				for (std::size_t i = 0; i < str.size() && !m_Truncated; ++i)
+				{
+					auto codepoint = static_cast<std::uint32_t>(str[i]);
+					if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+					{
+						if (codepoint >= 0xD800 && codepoint <= 0xDBFF && i + 1 < str.size() && str[i + 1] >= 0xDC00 && str[i + 1] <= 0xDFFF)
+						{
+							codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (static_cast<std::uint32_t>(str[i + 1]) - 0xDC00);
+							++i;
+						}
+						else if (codepoint >= 0xD800 && codepoint <= 0xDFFF)
+						{
+							codepoint = REPLACEMENT_CHARACTER;
+						}
+					}
+
+					append_utf8(codepoint);
+				}
+			}
+
+			void set_truncated() noexcept
+			{
+				m_Truncated = true;
+			}
+		};
+
+		std::unique_ptr<slot[]> m_Slots;
+		std::size_t m_Mask;
+		std::atomic<std::uint64_t> m_Next = 0;
+
+		std::mutex m_TakeLock;
+		std::uint64_t m_Taken = 0;
+
+		void write(kind k, const void *source, std::uint32_t line, std::uint8_t level, std::uint64_t timestamp, std::uint32_t thread, const bounded_buffer &payload) noexcept
+		{
+			const auto sequence = m_Next.fetch_add(1, std::memory_order_relaxed);
+			auto &s = m_Slots[sequence & m_Mask];
+
+			// another writer still being on this slot means that the ring wrapped around
+			// during its write. it's so far behind that it doesn't matter which one wins.
+			auto version = s.Version.load(std::memory_order_relaxed);
+			if ((version & 1) || !s.Version.compare_exchange_strong(version, version + 1, std::memory_order_relaxed))
+			{
+				return;
+			}
+
+			std::atomic_thread_fence(std::memory_order_release);
+
+			s.Sequence.store(sequence, std::memory_order_relaxed);
+			s.Timestamp.store(timestamp, std::memory_order_relaxed);
+			s.Source.store(source, std::memory_order_relaxed);
+			s.Line.store(line, std::memory_order_relaxed);
+			s.Thread.store(thread, std::memory_order_relaxed);
+			s.Level.store(level, std::memory_order_relaxed);
+			s.Kind.store(k, std::memory_order_relaxed);
+			s.Truncated.store(payload.truncated(), std::memory_order_relaxed);
+			s.Size.store(static_cast<std::uint16_t>(payload.size()), std::memory_order_relaxed);
+
+			for (std::size_t i = 0; i * sizeof(std::uint64_t) < payload.size(); ++i)
+			{
+				std::uint64_t word = 0;
+				std::memcpy(&word, payload.data() + i * sizeof(word), std::min(sizeof(word), payload.size() - i * sizeof(word)));
+				s.Payload[i].store(word, std::memory_order_relaxed);
+			}
+
+			s.Version.store(version + 2, std::memory_order_release);
+		}
+
+		// Returns false if the slot was never written, is being written, or got overwritten while copying it.
+		static bool read(const slot &s, std::uint64_t &sequence, binary_log::message &msg)
+		{
+			const auto version = s.Version.load(std::memory_order_acquire);
+			if (version == 0 || (version & 1))
+			{
+				return false;
+			}
+
+			sequence = s.Sequence.load(std::memory_order_relaxed);
+			msg.Timestamp = s.Timestamp.load(std::memory_order_relaxed);
+			msg.Thread = s.Thread.load(std::memory_order_relaxed);
+			const auto source = s.Source.load(std::memory_order_relaxed);
+			const auto line = s.Line.load(std::memory_order_relaxed);
+			const auto level = s.Level.load(std::memory_order_relaxed);
+			const auto k = s.Kind.load(std::memory_order_relaxed);
+			const bool truncated = s.Truncated.load(std::memory_order_relaxed);
+			const auto size = std::min<std::size_t>(s.Size.load(std::memory_order_relaxed), PAYLOAD_SIZE);
+
+			char payload[PAYLOAD_SIZE];
+			for (std::size_t i = 0; i * sizeof(std::uint64_t) < size; ++i)
+			{
+				const auto word = s.Payload[i].load(std::memory_order_relaxed);
+				std::memcpy(payload + i * sizeof(word), &word, sizeof(word));
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (s.Version.load(std::memory_order_relaxed) != version)
+			{
+				return false;
+			}
+
+			msg.Text.clear();
+			if (k == kind::deferred)
+			{
+				const auto &site = *static_cast<const binary_log::call_site *>(source);
+				msg.Level = site.Level;
+				msg.File = site.File;
+				msg.Line = site.Line;
+
+				// arguments that didn't fit aren't there at all
+				const std::string_view args = truncated ? std::string_view("\0", 1) : std::string_view(payload, size);
+				binary_log::render(msg.Text, site.Format, args);
+			}
+			else
+			{
+				msg.Level = level;
+				msg.File = source ? static_cast<const char *>(source) : std::string_view { };
+				msg.Line = line;
+				msg.Text.assign(payload, size);
+			}
+
+			if (truncated)
+			{
+				msg.Text += " [...]";
+			}
+
+			return true;
+		}
+
+	public:
+		explicit flight_recorder(std::size_t capacity = DEFAULT_CAPACITY) :
+			m_Slots(std::make_unique<slot[]>(std::bit_ceil(std::max<std::size_t>(capacity, 1)))),
+			m_Mask(std::bit_ceil(std::max<std::size_t>(capacity, 1)) - 1)
+		{ }
+
+		flight_recorder(const flight_recorder &) = delete;
+		flight_recorder &operator =(const flight_recorder &) = delete;
+
+		// A message from DeferredPrint. args is as produced by binary_log::encode_args.
+		void record(const binary_log::call_site &site, std::uint64_t timestamp, std::uint32_t thread, std::string_view args) noexcept
+		{
+			bounded_buffer payload;
+			if (args.size() <= PAYLOAD_SIZE)
+			{
+				payload.append(args);
+			}
+			else
+			{
+				payload.set_truncated();
+			}
+
+			write(kind::deferred, &site, site.Line, site.Level, timestamp, thread, payload);
+		}
+
+		// Recorded as "message (detail)", like logged errors.
+		void record(std::uint8_t level, const char *file, std::uint32_t line, std::uint64_t timestamp, std::uint32_t thread, std::wstring_view message, std::wstring_view detail = { }) noexcept
+		{
+			bounded_buffer payload;
+			payload.append(message);
+			if (!detail.empty())
+			{
+				payload.append(std::string_view(" ("));
+				payload.append(detail);
+				payload.append(std::string_view(")"));
+			}
+
+			write(kind::text, file, line, level, timestamp, thread, payload);
+		}
+
+		void record(std::uint8_t level, const char *file, std::uint32_t line, std::uint64_t timestamp, std::uint32_t thread, std::string_view text) noexcept
+		{
+			bounded_buffer payload;
+			payload.append(text);
+			write(kind::text, file, line, level, timestamp, thread, payload);
+		}
+
+		// Everything recorded since the last time.
+		dump take()
+		{
+			std::scoped_lock guard(m_TakeLock);
+			const auto next = m_Next.load(std::memory_order_acquire);
+
+			std::vector<std::pair<std::uint64_t, binary_log::message>> found;
+			for (std::size_t i = 0; i <= m_Mask; ++i)
+			{
+				std::uint64_t sequence;
+				binary_log::message msg;
+				if (read(m_Slots[i], sequence, msg) && sequence >= m_Taken && sequence < next)
+				{
+					found.emplace_back(sequence, std::move(msg));
+				}
+			}
+
+			std::sort(found.begin(), found.end(), [](const auto &a, const auto &b)
+			{
+				return a.first < b.first;
+			});
+
+			dump result;
+			result.Lost = next - m_Taken - found.size();
+			result.Messages.reserve(found.size());
+			for (auto &[sequence, msg] : found)
+			{
+				result.Messages.push_back(std::move(msg));
+			}
+
+			m_Taken = next;
+			return result;
+		}
+	};
+}
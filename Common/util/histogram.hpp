@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace Util {
+	// Counts values in log-linear buckets: every power of two range is split in 2^SubBucketBits
+	// equally sized buckets, and values under 2^SubBucketBits get a bucket each. Bucket bounds
+	// are thus within 1/2^SubBucketBits of the values in it.
+	// Recording is a couple of instructions and never allocates, which makes it cheap enough
+	// for latencies measured on every event. Percentiles are only precise up to the bucket,
+	// which is plenty to tell 50 µs from 5 ms.
+	template<unsigned int SubBucketBits>
+	class log_linear_histogram {
+		static_assert(SubBucketBits < 16, "Too many sub-buckets");
+		static constexpr std::uint64_t SUB_BUCKETS = std::uint64_t { 1 } << SubBucketBits;
+
+	public:
+		static constexpr std::size_t BUCKETS = (std::numeric_limits<std::uint64_t>::digits - SubBucketBits + 1) * SUB_BUCKETS;
+
+	private:
+		std::array<std::uint64_t, BUCKETS> m_Buckets { };
+		std::uint64_t m_Count = 0;
+		std::uint64_t m_Sum = 0;
+		std::uint64_t m_Min = std::numeric_limits<std::uint64_t>::max();
+		std::uint64_t m_Max = 0;
+
+	public:
+		static constexpr std::size_t bucket_of(std::uint64_t value) noexcept
+		{
+			if (value < SUB_BUCKETS)
+			{
+				return static_cast<std::size_t>(value);
+			}
+
+			// the top SubBucketBits bits under the highest set bit pick the sub-bucket
+			const auto exponent = static_cast<unsigned int>(std::bit_width(value)) - 1;
+			const auto shift = exponent - SubBucketBits;
+			return static_cast<std::size_t>((static_cast<std::uint64_t>(shift + 1) << SubBucketBits) + ((value >> shift) - SUB_BUCKETS));
+		}
+
+		// Largest value that goes in the bucket.
+		static constexpr std::uint64_t bucket_upper_bound(std::size_t bucket) noexcept
+		{
+			if (bucket < SUB_BUCKETS)
+			{
+				return bucket;
+			}
+
+			const auto shift = static_cast<unsigned int>(bucket >> SubBucketBits) - 1;
+			const auto lower = (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+			return lower + ((std::uint64_t { 1 } << shift) - 1);
+		}
+
+		constexpr void record(std::uint64_t value) noexcept
+		{
+			++m_Buckets[bucket_of(value)];
+			++m_Count;
+			m_Sum += value;
+			m_Min = std::min(m_Min, value);
+			m_Max = std::max(m_Max, value);
+		}
+
+		constexpr void merge(const log_linear_histogram &other) noexcept
+		{
+			for (std::size_t i = 0; i < BUCKETS; ++i)
+			{
+				m_Buckets[i] += other.m_Buckets[i];
+			}
+
+			m_Count += other.m_Count;
+			m_Sum += other.m_Sum;
+			m_Min = std::min(m_Min, other.m_Min);
+			m_Max = std::max(m_Max, other.m_Max);
+		}
+
+		constexpr void clear() noexcept
+		{
+			*this = { };
+		}
+
+		constexpr std::uint64_t count() const noexcept { return m_Count; }
+		constexpr std::uint64_t count(std::size_t bucket) const noexcept { return m_Buckets.at(bucket); }
+		constexpr std::uint64_t min() const noexcept { return m_Count ? m_Min : 0; }
+		constexpr std::uint64_t max() const noexcept { return m_Max; }
+
+		constexpr double mean() const noexcept
+		{
+			return m_Count ? static_cast<double>(m_Sum) / m_Count : 0.0;
+		}
+
+		// An upper bound of the value below which fraction (between 0 and 1) of the recorded
+		// values are. Never more than the largest recorded value.
+		constexpr std::uint64_t percentile(double fraction) const noexcept
+		{
+			if (m_Count == 0)
+			{
+				return 0;
+			}
+
+			const auto rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(std::clamp(fraction, 0.0, 1.0) * m_Count + 0.5), 1);
+			std::uint64_t seen = 0;
+			for (std::size_t i = 0; i < BUCKETS; ++i)
+			{
+				seen += m_Buckets[i];
+				if (seen >= rank)
+				{
+					return std::min(bucket_upper_bound(i), m_Max);
+				}
+			}
+
+			return m_Max;
+		}
+	};
+
+	// Power of two buckets: bucket 0 holds 0, and bucket i holds values in [2^(i-1), 2^i).
+	using log2_histogram = log_linear_histogram<0>;
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace Util {
+	// What a producer does when the queue is full.
+	enum class backpressure {
+		block,       // wait for the consumer to make room
+		drop_oldest, // make room by discarding the oldest records
+		drop_newest  // discard the record being pushed
+	};
+
+	// Bounded queue of byte records, for any number of producers and one consumer that takes
+	// everything queued at once, so that it can be handled in one go (like one big file write).
+	//
+	// Records are copied in a preallocated ring, so pushing never allocates. The lock is only
+	// held to copy records in and out: whatever the consumer does with them happens outside.
+	class record_queue {
+	public:
+		struct stats {
+			std::uint64_t Pushed = 0;
+			std::uint64_t Dropped = 0;
+			std::uint64_t Batches = 0;
+			std::size_t MaxBytes = 0;
+		};
+
+	private:
+		using header_t = std::uint32_t;
+
+		mutable std::mutex m_Lock;
+		std::condition_variable m_Ready; // consumer waits on this
+		std::condition_variable m_Space; // producers wait on this
+
+		const std::unique_ptr<char[]> m_Ring;
+		const std::size_t m_Capacity;
+		std::size_t m_Head = 0; // offset of the oldest record
+		std::size_t m_Used = 0; // bytes, headers included
+		backpressure m_Policy;
+		bool m_Urgent = false;
+		bool m_Closed = false;
+
+		// sequence numbers of records, to know when something pushed has been handled
+		std::uint64_t m_Accepted = 0;
+		std::uint64_t m_Handled = 0;
+
+		stats m_Stats;
+
+		void copy_in(std::size_t offset, const void *data, std::size_t size) noexcept
+		{
+			offset %= m_Capacity;
+			const auto first = std::min(size, m_Capacity - offset);
+			std::memcpy(m_Ring.get() + offset, data, first);
+			std::memcpy(m_Ring.get(), static_cast<const char *>(data) + first, size - first);
+		}
+
+		void copy_out(std::size_t offset, void *data, std::size_t size) const noexcept
+		{
+			offset %= m_Capacity;
+			const auto first = std::min(size, m_Capacity - offset);
+			std::memcpy(data, m_Ring.get() + offset, first);
+			std::memcpy(static_cast<char *>(data) + first, m_Ring.get(), size - first);
+		}
+
+		std::size_t front_size() const noexcept
+		{
+			header_t size;
+			copy_out(m_Head, &size, sizeof(size));
+			return sizeof(size) + size;
+		}
+
+		void pop_front() noexcept
+		{
+			const auto size = front_size();
+			m_Head = (m_Head + size) % m_Capacity;
+			m_Used -= size;
+		}
+
+	public:
+		explicit record_queue(std::size_t capacity, backpressure policy = backpressure::block) :
+			m_Ring(std::make_unique<char[]>(capacity)),
+			m_Capacity(capacity),
+			m_Policy(policy)
+		{ }
+
+		record_queue(const record_queue &) = delete;
+		record_queue &operator =(const record_queue &) = delete;
+
+		void set_policy(backpressure policy)
+		{
+			{
+				std::scoped_lock guard(m_Lock);
+				m_Policy = policy;
+			}
+
+			// blocked producers might have to drop now
+			m_Space.notify_all();
+		}
+
+		// Returns the sequence number of the record, or 0 if it got dropped.
+		// An urgent record wakes the consumer right away.
+		std::uint64_t push(std::string_view record, bool urgent = false)
+		{
+			const auto needed = sizeof(header_t) + record.size();
+
+			std::unique_lock guard(m_Lock);
+			++m_Stats.Pushed;
+			if (needed > m_Capacity || m_Closed)
+			{
+				++m_Stats.Dropped;
+				return 0;
+			}
+
+			while (m_Used + needed > m_Capacity)
+			{
+				if (m_Policy == backpressure::block)
+				{
+					m_Ready.notify_one();
+					m_Space.wait(guard);
+					if (m_Closed)
+					{
+						++m_Stats.Dropped;
+						return 0;
+					}
+				}
+				else if (m_Policy == backpressure::drop_oldest)
+				{
+					pop_front();
+					++m_Stats.Dropped;
+				}
+				else
+				{
+					++m_Stats.Dropped;
+					return 0;
+				}
+			}
+
+			const auto size = static_cast<header_t>(record.size());
+			const auto tail = m_Head + m_Used;
+			copy_in(tail, &size, sizeof(size));
+			copy_in(tail + sizeof(size), record.data(), record.size());
+			m_Used += needed;
+			m_Stats.MaxBytes = std::max(m_Stats.MaxBytes, m_Used);
+
+			const auto sequence = ++m_Accepted;
+			if (urgent)
+			{
+				m_Urgent = true;
+				guard.unlock();
+				m_Ready.notify_one();
+			}
+
+			return sequence;
+		}
+
+		// Consumer side. Waits until there are at least batchBytes queued, something urgent
+		// got pushed, the queue got closed, or the timeout elapsed, then appends every queued
+		// record to out. Returns the sequence number to pass to mark_handled once done with
+		// them, or 0 if the queue got closed and there is nothing left.
+		std::uint64_t take(std::string &out, std::size_t batchBytes, std::chrono::milliseconds timeout)
+		{
+			std::unique_lock guard(m_Lock);
+			m_Ready.wait_for(guard, timeout, [this, batchBytes]
+			{
+				return m_Urgent || m_Closed || m_Used >= batchBytes;
+			});
+
+			m_Urgent = false;
+			const auto sequence = m_Accepted;
+			if (m_Used != 0)
+			{
+				++m_Stats.Batches;
+				out.reserve(out.size() + m_Used);
+				while (m_Used != 0)
+				{
+					const auto size = front_size();
+					const auto start = out.size();
+					out.resize(start + size - sizeof(header_t));
+					copy_out(m_Head + sizeof(header_t), out.data() + start, size - sizeof(header_t));
+					pop_front();
+				}
+
+				guard.unlock();
+				m_Space.notify_all();
+			}
+			else if (m_Closed)
+			{
+				return 0;
+			}
+
+			return sequence;
+		}
+
+		// Consumer side.
+		void mark_handled(std::uint64_t sequence)
+		{
+			{
+				std::scoped_lock guard(m_Lock);
+				m_Handled = std::max(m_Handled, sequence);
+			}
+
+			m_Space.notify_all();
+		}
+
+		// Wakes the consumer, and waits until it handled everything pushed so far.
+		// Returns false if the queue got closed before that.
+		bool flush()
+		{
+			std::unique_lock guard(m_Lock);
+			const auto target = m_Accepted;
+			m_Urgent = true;
+			m_Ready.notify_one();
+
+			m_Space.wait(guard, [this, target]
+			{
+				return m_Handled >= target || m_Closed;
+			});
+
+			return m_Handled >= target;
+		}
+
+		// Wakes everyone. Pushes get dropped from now on, and the consumer gets what's left
+		// before take returns 0.
+		void close()
+		{
+			{
+				std::scoped_lock guard(m_Lock);
+				m_Closed = true;
+			}
+
+			m_Ready.notify_all();
+			m_Space.notify_all();
+		}
+
+		stats statistics() const
+		{
+			std::scoped_lock guard(m_Lock);
+			return m_Stats;
+		}
+	};
+}
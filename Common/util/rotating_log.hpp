@@ -0,0 +1,196 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Util {
+	struct rotation_settings {
+		std::uint64_t MaxFileSize = 0; // bytes, 0 for no limit
+		std::size_t MaxFiles = 0; // log files kept in the folder, the one being written included. 0 for no limit
+	};
+
+	struct stored_log_file {
+		std::filesystem::path Path;
+		std::uint64_t LastWrite; // any unit, only used to sort
+	};
+
+	// Writes a log in parts of bounded size: <name>.log, then <name>.1.log, <name>.2.log...
+	// and deletes the oldest log files of the folder so that only so many of them are kept.
+	// Rotation happens between writes, so a write is never split across parts.
+	//
+	// Storage abstracts the file system, so that this can be tested without one. It provides:
+	//   file_type create(const std::filesystem::path &): creates or truncates a file. The file
+	//     converts to false if that failed, and has bool append(std::string_view) and bool flush().
+	//   std::vector<stored_log_file> list(const std::filesystem::path &folder): the log files in a folder.
+	//   bool remove(const std::filesystem::path &)
+	//
+	// Not thread-safe.
+	template<typename Storage>
+	class rotating_log {
+		using file_t = typename Storage::file_type;
+
+		Storage m_Storage;
+		file_t m_File;
+		std::filesystem::path m_FirstPath;
+		std::filesystem::path m_Path;
+		rotation_settings m_Settings;
+
+		std::string m_Preamble;
+		std::uint64_t m_Size = 0;
+		std::uint64_t m_RotateAt = std::numeric_limits<std::uint64_t>::max();
+		unsigned int m_Part = 0;
+
+		std::filesystem::path part_path(unsigned int part) const
+		{
+			if (part == 0)
+			{
+				return m_FirstPath;
+			}
+
+			auto name = m_FirstPath.stem();
+			name += ".";
+			name += std::to_string(part);
+			name += m_FirstPath.extension();
+			return m_FirstPath.parent_path() / name;
+		}
+
+		void reset_threshold() noexcept
+		{
+			m_RotateAt = m_Settings.MaxFileSize != 0 ? m_Settings.MaxFileSize : std::numeric_limits<std::uint64_t>::max();
+		}
+
+		bool start_part(unsigned int part)
+		{
+			auto path = part_path(part);
+			auto file = m_Storage.create(path);
+			if (!file || !file.append(m_Preamble))
+			{
+				return false;
+			}
+
+			m_File = std::move(file);
+			m_Path = std::move(path);
+			m_Part = part;
+			m_Size = m_Preamble.size();
+			reset_threshold();
+			cleanup();
+			return true;
+		}
+
+	public:
+		rotating_log(Storage storage, std::filesystem::path path, rotation_settings settings = { }) :
+			m_Storage(std::move(storage)),
+			m_FirstPath(std::move(path)),
+			m_Path(m_FirstPath),
+			m_Settings(settings)
+		{ }
+
+		rotating_log(const rotating_log &) = delete;
+		rotating_log &operator =(const rotating_log &) = delete;
+
+		// Creates the first part, which starts with the preamble, and deletes stale log files.
+		bool open(std::string preamble)
+		{
+			m_Preamble = std::move(preamble);
+			return start_part(0);
+		}
+
+		bool is_open() const noexcept { return static_cast<bool>(m_File); }
+
+		// The part being written.
+		const std::filesystem::path &path() const noexcept { return m_Path; }
+		unsigned int part() const noexcept { return m_Part; }
+		std::uint64_t size() const noexcept { return m_Size; }
+
+		Storage &storage() noexcept { return m_Storage; }
+
+		// Starts the next parts, but isn't written to the current one. For data that later writes
+		// depend on to be understood, like the definitions of a binary log.
+		void add_to_preamble(std::string_view data)
+		{
+			m_Preamble += data;
+		}
+
+		void set_settings(rotation_settings settings) noexcept
+		{
+			m_Settings = settings;
+			reset_threshold();
+		}
+
+		bool write(std::string_view data)
+		{
+			if (!m_File)
+			{
+				return false;
+			}
+
+			// a part gets at least one write, no matter how big.
+			if (m_Size > m_Preamble.size() && data.size() > m_RotateAt - std::min(m_Size, m_RotateAt))
+			{
+				if (!start_part(m_Part + 1))
+				{
+					// better to go over the size limit than to lose entries. try again later.
+					m_RotateAt = m_Size + data.size() + m_Settings.MaxFileSize;
+				}
+			}
+
+			if (m_File.append(data))
+			{
+				m_Size += data.size();
+				return true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		bool flush()
+		{
+			return m_File && m_File.flush();
+		}
+
+		// Deletes the oldest log files of the folder, so that there are at most MaxFiles of them
+		// counting the one being written. Returns how many got deleted.
+		std::size_t cleanup()
+		{
+			if (m_Settings.MaxFiles == 0)
+			{
+				return 0;
+			}
+
+			auto files = m_Storage.list(m_FirstPath.parent_path());
+			std::erase_if(files, [this](const stored_log_file &file)
+			{
+				return file.Path == m_Path;
+			});
+
+			if (files.size() < m_Settings.MaxFiles)
+			{
+				return 0;
+			}
+
+			std::sort(files.begin(), files.end(), [](const stored_log_file &a, const stored_log_file &b)
+			{
+				return a.LastWrite != b.LastWrite ? a.LastWrite > b.LastWrite : a.Path > b.Path;
+			});
+
+			std::size_t removed = 0;
+			for (std::size_t i = m_Settings.MaxFiles - 1; i < files.size(); ++i)
+			{
+				if (m_Storage.remove(files[i].Path))
+				{
+					++removed;
+				}
+			}
+
+			return removed;
+		}
+	};
+}
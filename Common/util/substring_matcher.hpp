@@ -0,0 +1,374 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Util {
+	// Finds which of a set of patterns occur in a text, in a single pass over the text
+	// regardless of the number of patterns (Aho-Corasick).
+	// Patterns are numbered in the order they were given, duplicates keep their first index.
+	class substring_matcher {
+	public:
+		static constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+		struct node {
+			std::uint32_t first_edge = 0;
+			std::uint32_t edge_count = 0;
+			std::uint32_t fail = 0;
+			std::uint32_t pattern = NONE; // pattern ending exactly here
+			std::uint32_t longest = NONE; // longest pattern that is a suffix of this node
+			std::uint32_t next_output = NONE; // closest node down the fail chain that ends a pattern
+		};
+
+		struct edge {
+			wchar_t character;
+			std::uint32_t target;
+		};
+
+	private:
+		std::vector<node> m_Nodes;
+		std::vector<edge> m_Edges; // sorted by character within each node
+		std::vector<std::wstring> m_Patterns;
+
+		std::uint32_t child(std::uint32_t n, wchar_t c) const noexcept
+		{
+			const auto begin = m_Edges.begin() + m_Nodes[n].first_edge;
+			const auto end = begin + m_Nodes[n].edge_count;
+			const auto it = std::lower_bound(begin, end, c, [](const edge &e, wchar_t value)
+			{
+				return e.character < value;
+			});
+
+			return it != end && it->character == c ? it->target : NONE;
+		}
+
+		std::uint32_t step(std::uint32_t n, wchar_t c) const noexcept
+		{
+			while (true)
+			{
+				if (const auto next = child(n, c); next != NONE)
+				{
+					return next;
+				}
+				else if (n == 0)
+				{
+					return 0;
+				}
+
+				n = m_Nodes[n].fail;
+			}
+		}
+
+		bool is_better(std::uint32_t candidate, std::uint32_t current) const noexcept
+		{
+			return current == NONE ||
+				m_Patterns[candidate].length() > m_Patterns[current].length() ||
+				(m_Patterns[candidate].length() == m_Patterns[current].length() && candidate < current);
+		}
+
+		void build()
+		{
+			// build the trie with temporary per-node edge lists
+			std::vector<std::vector<edge>> children(1);
+			std::vector<std::uint32_t> terminal(1, NONE);
+			for (std::uint32_t i = 0; i < m_Patterns.size(); ++i)
+			{
+				std::uint32_t n = 0;
+				for (const wchar_t c : m_Patterns[i])
+				{
+					auto &edges = children[n];
+					auto it = std::lower_bound(edges.begin(), edges.end(), c, [](const edge &e, wchar_t value)
+					{
+						return e.character < value;
+					});
+
+					if (it == edges.end() || it->character != c)
+					{
+						const auto target = static_cast<std::uint32_t>(children.size());
+						edges.insert(it, { c, target });
+						children.emplace_back();
+						terminal.push_back(NONE);
+						n = target;
+					}
+					else
+					{
+						n = it->target;
+					}
+				}
+
+				if (terminal[n] == NONE)
+				{
+					terminal[n] = i;
+				}
+			}
+
+			// flatten it
+			m_Nodes.assign(children.size(), { });
+			for (std::size_t n = 0; n < children.size(); ++n)
+			{
+				m_Nodes[n].first_edge = static_cast<std::uint32_t>(m_Edges.size());
+				m_Nodes[n].edge_count = static_cast<std::uint32_t>(children[n].size());
+				m_Nodes[n].pattern = terminal[n];
+				m_Edges.insert(m_Edges.end(), children[n].begin(), children[n].end());
+			}
+
+			// breadth first, so that the fail target of a node is always done before the node
+			m_Nodes[0].longest = m_Nodes[0].pattern;
+			std::queue<std::uint32_t> queue;
+			queue.push(0);
+			while (!queue.empty())
+			{
+				const std::uint32_t n = queue.front();
+				queue.pop();
+
+				for (std::uint32_t e = m_Nodes[n].first_edge; e < m_Nodes[n].first_edge + m_Nodes[n].edge_count; ++e)
+				{
+					const auto [c, target] = m_Edges[e];
+					auto &t = m_Nodes[target];
+
+					t.fail = n == 0 ? 0 : step(m_Nodes[n].fail, c);
+
+					const auto &fail = m_Nodes[t.fail];
+					t.next_output = fail.pattern != NONE ? t.fail : fail.next_output;
+					t.longest = t.pattern != NONE ? t.pattern : fail.longest;
+
+					queue.push(target);
+				}
+			}
+		}
+
+		// Whether what patterns(), nodes() and edges() returned fits together. The edges have to
+		// form a tree, and links down the fail chain have to lead to shallower nodes, so that
+		// following them always ends.
+		static bool fits(const std::vector<std::wstring> &patterns, const std::vector<node> &nodes, const std::vector<edge> &edges)
+		{
+			if (patterns.empty())
+			{
+				// never looked at
+				return true;
+			}
+			else if (nodes.empty() || patterns.size() >= NONE || nodes.size() >= NONE)
+			{
+				return false;
+			}
+
+			const auto optionalIndex = [](std::uint32_t index, std::size_t size)
+			{
+				return index == NONE || index < size;
+			};
+
+			for (const node &n : nodes)
+			{
+				if (n.first_edge > edges.size() || n.edge_count > edges.size() - n.first_edge ||
+					n.fail >= nodes.size() ||
+					!optionalIndex(n.pattern, patterns.size()) ||
+					!optionalIndex(n.longest, patterns.size()) ||
+					!optionalIndex(n.next_output, nodes.size()))
+				{
+					return false;
+				}
+			}
+
+			// walk the trie from the root, every node but the root has to be reached exactly once.
+			std::vector<std::uint32_t> depth(nodes.size(), NONE);
+			depth[0] = 0;
+			std::queue<std::uint32_t> queue;
+			queue.push(0);
+			std::size_t reached = 1;
+			while (!queue.empty())
+			{
+				const auto &n = nodes[queue.front()];
+				const auto childDepth = depth[queue.front()] + 1;
+				queue.pop();
+
+				for (std::uint32_t e = n.first_edge; e < n.first_edge + n.edge_count; ++e)
+				{
+					const auto [c, target] = edges[e];
+					if (target >= nodes.size() || depth[target] != NONE ||
+						(e != n.first_edge && edges[e - 1].character >= c))
+					{
+						return false;
+					}
+
+					depth[target] = childDepth;
+					queue.push(target);
+					++reached;
+				}
+			}
+
+			if (reached != nodes.size())
+			{
+				return false;
+			}
+
+			for (std::size_t i = 1; i < nodes.size(); ++i)
+			{
+				const auto &n = nodes[i];
+				if (depth[n.fail] >= depth[i] || (n.next_output != NONE && depth[n.next_output] >= depth[i]))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+	public:
+		substring_matcher() = default;
+
+		template<typename Range>
+		explicit substring_matcher(const Range &patterns)
+		{
+			for (const auto &pattern : patterns)
+			{
+				m_Patterns.emplace_back(pattern);
+			}
+
+			build();
+		}
+
+		// Takes back what patterns(), nodes() and edges() returned, without building anything.
+		// Returns nothing if they don't fit together, like when they come from a damaged file.
+		static std::optional<substring_matcher> restore(std::vector<std::wstring> patterns, std::vector<node> nodes, std::vector<edge> edges)
+		{
+			if (!fits(patterns, nodes, edges))
+			{
+				return std::nullopt;
+			}
+
+			substring_matcher matcher;
+			matcher.m_Patterns = std::move(patterns);
+			matcher.m_Nodes = std::move(nodes);
+			matcher.m_Edges = std::move(edges);
+			return matcher;
+		}
+
+		// Like restore, but builds the matcher from the patterns if the rest doesn't fit them.
+		static substring_matcher restore_or_build(std::vector<std::wstring> patterns, std::vector<node> nodes, std::vector<edge> edges)
+		{
+			substring_matcher matcher;
+			matcher.m_Patterns = std::move(patterns);
+			if (fits(matcher.m_Patterns, nodes, edges))
+			{
+				matcher.m_Nodes = std::move(nodes);
+				matcher.m_Edges = std::move(edges);
+			}
+			else
+			{
+				matcher.build();
+			}
+
+			return matcher;
+		}
+
+		const std::vector<std::wstring> &patterns() const noexcept
+		{
+			return m_Patterns;
+		}
+
+		const std::vector<node> &nodes() const noexcept
+		{
+			return m_Nodes;
+		}
+
+		const std::vector<edge> &edges() const noexcept
+		{
+			return m_Edges;
+		}
+
+		std::size_t size() const noexcept
+		{
+			return m_Patterns.size();
+		}
+
+		bool empty() const noexcept
+		{
+			return m_Patterns.empty();
+		}
+
+		std::wstring_view pattern(std::size_t index) const noexcept
+		{
+			return m_Patterns[index];
+		}
+
+		// Whether any pattern occurs in the text. Stops at the first match.
+		bool matches(std::wstring_view text) const noexcept
+		{
+			if (m_Patterns.empty())
+			{
+				return false;
+			}
+			else if (m_Nodes[0].pattern != NONE)
+			{
+				return true;
+			}
+
+			std::uint32_t n = 0;
+			for (const wchar_t c : text)
+			{
+				n = step(n, c);
+				if (m_Nodes[n].longest != NONE)
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// The longest pattern occuring in the text, with ties going to the lowest index.
+		std::optional<std::size_t> find(std::wstring_view text) const noexcept
+		{
+			if (m_Patterns.empty())
+			{
+				return std::nullopt;
+			}
+
+			std::uint32_t best = m_Nodes[0].longest;
+			std::uint32_t n = 0;
+			for (const wchar_t c : text)
+			{
+				n = step(n, c);
+				if (const auto candidate = m_Nodes[n].longest; candidate != NONE && is_better(candidate, best))
+				{
+					best = candidate;
+				}
+			}
+
+			return best != NONE ? std::make_optional<std::size_t>(best) : std::nullopt;
+		}
+
+		// Calls callback(index, end) for every occurence of every pattern, where end is the
+		// position right after the occurence in the text.
+		template<typename Callback>
+		void find_all(std::wstring_view text, Callback &&callback) const
+		{
+			if (m_Patterns.empty())
+			{
+				return;
+			}
+
+			if (m_Nodes[0].pattern != NONE)
+			{
+				callback(static_cast<std::size_t>(m_Nodes[0].pattern), std::size_t { 0 });
+			}
+
+			std::uint32_t n = 0;
+			for (std::size_t i = 0; i < text.length(); ++i)
+			{
+				n = step(n, text[i]);
+				for (std::uint32_t out = m_Nodes[n].pattern != NONE ? n : m_Nodes[n].next_output; out != NONE && out != 0; out = m_Nodes[out].next_output)
+				{
+					callback(static_cast<std::size_t>(m_Nodes[out].pattern), i + 1);
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,478 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Util {
+	// Records scoped and flow events into a preallocated ring buffer per thread, and writes
+	// them out as Chrome trace event JSON, which chrome://tracing and Perfetto can open.
+	//
+	// Recording never locks nor allocates, except for the first event of a thread, which
+	// allocates its buffer. When a buffer is full, the oldest events of that thread get
+	// overwritten. Everything is a no-op while disabled, down to not reading the clock.
+	//
+	// Names and categories are not copied, and so must be string literals or otherwise
+	// outlive the recorder.
+	class trace_recorder {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		static constexpr std::size_t DEFAULT_CAPACITY = 8192;
+
+		enum class phase : char {
+			complete = 'X',
+			instant = 'i',
+			flow_start = 's',
+			flow_end = 'f'
+		};
+
+		struct event {
+			const char *Name;
+			const char *Category;
+			phase Phase;
+			std::uint64_t Timestamp; // nanoseconds since the recorder was created
+			std::uint64_t Value;     // duration in nanoseconds for complete events, flow id for flows
+		};
+
+		// Records a complete event spanning its lifetime.
+		class scope {
+			trace_recorder *m_Recorder;
+			const char *m_Name;
+			const char *m_Category;
+			clock::time_point m_Start;
+
+		public:
+			scope(trace_recorder *recorder, const char *name, const char *category) noexcept :
+				m_Recorder(recorder),
+				m_Name(name),
+				m_Category(category),
+				m_Start(recorder ? clock::now() : clock::time_point { })
+			{ }
+
+			scope(const scope &) = delete;
+			scope &operator =(const scope &) = delete;
+
+			~scope()
+			{
+				if (m_Recorder)
+				{
+					m_Recorder->complete(m_Name, m_Category, m_Start, clock::now());
+				}
+			}
+		};
+
+	private:
+		// only written by the thread that owns the buffer, but read when serializing,
+		// hence the relaxed atomics.
+		struct slot {
+			std::atomic<const char *> Name;
+			std::atomic<const char *> Category;
+			std::atomic<phase> Phase;
+			std::atomic<std::uint64_t> Timestamp;
+			std::atomic<std::uint64_t> Value;
+		};
+
+		class buffer {
+			std::unique_ptr<slot[]> m_Slots;
+			std::size_t m_Mask;
+
+			// m_Claimed is bumped before a slot gets overwritten and m_Written after, so that
+			// a reader can tell which of the slots it copied were overwritten in the meantime.
+			std::atomic<std::uint64_t> m_Claimed = 0;
+			std::atomic<std::uint64_t> m_Written = 0;
+			std::atomic<std::uint64_t> m_Cleared = 0;
+
+		public:
+			const std::uint32_t ThreadId;
+			std::atomic<const char *> ThreadName;
+			std::atomic<bool> Retired = false; // the thread exited
+
+			buffer(std::size_t capacity, std::uint32_t tid, const char *name) :
+				m_Slots(std::make_unique<slot[]>(capacity)),
+				m_Mask(capacity - 1),
+				ThreadId(tid),
+				ThreadName(name)
+			{ }
+
+			// Owning thread only.
+			void push(const char *name, const char *category, phase ph, std::uint64_t timestamp, std::uint64_t value) noexcept
+			{
+				const auto index = m_Written.load(std::memory_order_relaxed);
+				m_Claimed.store(index + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+
+				auto &s = m_Slots[index & m_Mask];
+				s.Name.store(name, std::memory_order_relaxed);
+				s.Category.store(category, std::memory_order_relaxed);
+				s.Phase.store(ph, std::memory_order_relaxed);
+				s.Timestamp.store(timestamp, std::memory_order_relaxed);
+				s.Value.store(value, std::memory_order_relaxed);
+
+				m_Written.store(index + 1, std::memory_order_release);
+			}
+
+			// Any thread. Appends the events still in the buffer to out, oldest first,
+			// and returns how many were lost to the ring wrapping around.
+			std::uint64_t snapshot(std::vector<event> &out) const
+			{
+				const auto capacity = m_Mask + 1;
+				const auto written = m_Written.load(std::memory_order_acquire);
+				const auto cleared = m_Cleared.load(std::memory_order_relaxed);
+				const auto begin = std::max(cleared, written > capacity ? written - capacity : 0);
+
+				const auto start = out.size();
+				for (auto i = begin; i != written; ++i)
+				{
+					const auto &s = m_Slots[i & m_Mask];
+					out.push_back({
+						s.Name.load(std::memory_order_relaxed),
+						s.Category.load(std::memory_order_relaxed),
+						s.Phase.load(std::memory_order_relaxed),
+						s.Timestamp.load(std::memory_order_relaxed),
+						s.Value.load(std::memory_order_relaxed)
+					});
+				}
+
+				// drop whatever the owner started overwriting while we were copying
+				std::atomic_thread_fence(std::memory_order_acquire);
+				const auto claimed = m_Claimed.load(std::memory_order_relaxed);
+				const auto valid = std::max(begin, claimed > capacity ? claimed - capacity : 0);
+				if (valid > begin)
+				{
+					const auto torn = static_cast<std::size_t>(std::min(valid, written) - begin);
+					out.erase(out.begin() + start, out.begin() + start + torn);
+				}
+
+				return valid - cleared;
+			}
+
+			// Any thread.
+			void clear() noexcept
+			{
+				m_Cleared.store(m_Written.load(std::memory_order_acquire), std::memory_order_relaxed);
+			}
+		};
+
+		struct thread_state {
+			const char *Name = nullptr;
+			std::uint64_t Owner = 0;
+			std::shared_ptr<buffer> Buffer;
+
+			~thread_state()
+			{
+				if (Buffer)
+				{
+					Buffer->Retired.store(true, std::memory_order_relaxed);
+				}
+			}
+		};
+
+		static inline std::atomic<std::uint64_t> s_NextRecorderId = 1;
+
+		static thread_state &this_thread() noexcept
+		{
+			static thread_local thread_state state;
+			return state;
+		}
+
+		const std::uint64_t m_Id;
+		const std::size_t m_Capacity;
+		const clock::time_point m_Epoch;
+		std::atomic<bool> m_Enabled = false;
+		std::atomic<std::uint64_t> m_NextFlow = 1;
+
+		mutable std::mutex m_Lock;
+		std::vector<std::shared_ptr<buffer>> m_Buffers;
+		std::uint32_t m_NextThreadId = 1;
+
+		buffer &thread_buffer()
+		{
+			auto &thread = this_thread();
+			if (thread.Owner != m_Id)
+			{
+				std::scoped_lock guard(m_Lock);
+				auto buf = std::make_shared<buffer>(m_Capacity, m_NextThreadId++, thread.Name);
+				m_Buffers.push_back(buf);
+
+				if (thread.Buffer)
+				{
+					thread.Buffer->Retired.store(true, std::memory_order_relaxed);
+				}
+
+				thread.Buffer = std::move(buf);
+				thread.Owner = m_Id;
+			}
+
+			return *thread.Buffer;
+		}
+
+		std::uint64_t since_epoch(clock::time_point time) const noexcept
+		{
+			const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_Epoch).count();
+			return ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+		}
+
+		void push(const char *name, const char *category, phase ph, std::uint64_t timestamp, std::uint64_t value)
+		{
+			thread_buffer().push(name, category, ph, timestamp, value);
+		}
+
+		static void append_string(std::string &out, std::string_view str)
+		{
+			out += '"';
+			for (const char c : str)
+			{
+				if (c == '"' || c == '\\')
+				{
+					out += '\\';
+					out += c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20)
+				{
+					constexpr std::string_view digits = "0123456789abcdef";
+					out += "\\u00";
+					out += digits[(c >> 4) & 0xF];
+					out += digits[c & 0xF];
+				}
+				else
+				{
+					out += c;
+				}
+			}
+			out += '"';
+		}
+
+		// trace timestamps are in microseconds, keep the nanoseconds as decimals
+		static void append_microseconds(std::string &out, std::uint64_t ns)
+		{
+			out += std::to_string(ns / 1000);
+			out += '.';
+
+			const auto fraction = std::to_string(ns % 1000);
+			out.append(3 - fraction.size(), '0');
+			out += fraction;
+		}
+
+	public:
+		explicit trace_recorder(std::size_t capacity = DEFAULT_CAPACITY) :
+			m_Id(s_NextRecorderId.fetch_add(1, std::memory_order_relaxed)),
+			m_Capacity(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+			m_Epoch(clock::now())
+		{ }
+
+		trace_recorder(const trace_recorder &) = delete;
+		trace_recorder &operator =(const trace_recorder &) = delete;
+
+		// The recorder used by the app.
+		static trace_recorder &global()
+		{
+			static trace_recorder recorder;
+			return recorder;
+		}
+
+		bool enabled() const noexcept
+		{
+			return m_Enabled.load(std::memory_order_relaxed);
+		}
+
+		// Doesn't clear what was recorded, so that it can still be written out.
+		void enable(bool enabled) noexcept
+		{
+			m_Enabled.store(enabled, std::memory_order_relaxed);
+		}
+
+		// Forgets everything recorded, and the buffers of threads that exited.
+		void clear()
+		{
+			std::scoped_lock guard(m_Lock);
+			std::erase_if(m_Buffers, [](const std::shared_ptr<buffer> &buf)
+			{
+				return buf->Retired.load(std::memory_order_relaxed);
+			});
+
+			for (const auto &buf : m_Buffers)
+			{
+				buf->clear();
+			}
+		}
+
+		// Names the calling thread in the trace. Doesn't allocate a buffer for it.
+		void name_thread(const char *name)
+		{
+			auto &thread = this_thread();
+			thread.Name = name;
+			if (thread.Owner == m_Id)
+			{
+				thread.Buffer->ThreadName.store(name, std::memory_order_relaxed);
+			}
+		}
+
+		[[nodiscard]] scope trace(const char *name, const char *category) noexcept
+		{
+			return { enabled() ? this : nullptr, name, category };
+		}
+
+		void complete(const char *name, const char *category, clock::time_point start, clock::time_point end)
+		{
+			const auto begin = since_epoch(start);
+			push(name, category, phase::complete, begin, std::max(since_epoch(end), begin) - begin);
+		}
+
+		void instant(const char *name, const char *category)
+		{
+			if (enabled())
+			{
+				push(name, category, phase::instant, since_epoch(clock::now()), 0);
+			}
+		}
+
+		// Ids link the events of a flow together, even across threads.
+		std::uint64_t new_flow() noexcept
+		{
+			return m_NextFlow.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// A flow starts in the scope enclosing this, and ends in the scope enclosing
+		// the matching end_flow.
+		void begin_flow(const char *name, const char *category, std::uint64_t id)
+		{
+			if (enabled())
+			{
+				push(name, category, phase::flow_start, since_epoch(clock::now()), id);
+			}
+		}
+
+		void end_flow(const char *name, const char *category, std::uint64_t id)
+		{
+			if (enabled())
+			{
+				push(name, category, phase::flow_end, since_epoch(clock::now()), id);
+			}
+		}
+
+		struct thread_events {
+			std::uint32_t ThreadId = 0;
+			const char *ThreadName = nullptr;
+			std::uint64_t Lost = 0; // overwritten because the buffer was full
+			std::vector<event> Events;
+		};
+
+		// Can be called from any thread, while other threads record.
+		std::vector<thread_events> snapshot() const
+		{
+			std::scoped_lock guard(m_Lock);
+
+			std::vector<thread_events> threads;
+			threads.reserve(m_Buffers.size());
+			for (const auto &buf : m_Buffers)
+			{
+				auto &thread = threads.emplace_back();
+				thread.ThreadId = buf->ThreadId;
+				thread.ThreadName = buf->ThreadName.load(std::memory_order_relaxed);
+				thread.Lost = buf->snapshot(thread.Events);
+			}
+
+			return threads;
+		}
+
+		// Everything recorded, in the Chrome trace event format.
+		std::string to_chrome_json(std::uint32_t pid) const
+		{
+			const auto pidStr = std::to_string(pid);
+			std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			bool first = true;
+			const auto next = [&out, &first]
+			{
+				if (!first)
+				{
+					out += ',';
+				}
+
+				first = false;
+				out += '{';
+			};
+
+			for (const auto &thread : snapshot())
+			{
+				const auto tidStr = std::to_string(thread.ThreadId);
+				if (thread.ThreadName)
+				{
+					next();
+					out += "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":";
+					out += pidStr;
+					out += ",\"tid\":";
+					out += tidStr;
+					out += ",\"args\":{\"name\":";
+					append_string(out, thread.ThreadName);
+					out += "}}";
+				}
+
+				for (const auto &e : thread.Events)
+				{
+					next();
+					out += "\"name\":";
+					append_string(out, e.Name ? e.Name : "");
+					out += ",\"cat\":";
+					append_string(out, e.Category ? e.Category : "");
+					out += ",\"ph\":\"";
+					out += static_cast<char>(e.Phase);
+					out += "\",\"pid\":";
+					out += pidStr;
+					out += ",\"tid\":";
+					out += tidStr;
+					out += ",\"ts\":";
+					append_microseconds(out, e.Timestamp);
+
+					switch (e.Phase)
+					{
+					case phase::complete:
+						out += ",\"dur\":";
+						append_microseconds(out, e.Value);
+						break;
+
+					case phase::instant:
+						out += ",\"s\":\"t\"";
+						break;
+
+					case phase::flow_start:
+						out += ",\"id\":";
+						out += std::to_string(e.Value);
+						break;
+
+					case phase::flow_end:
+						// bind to the enclosing slice rather than the next one
+						out += ",\"id\":";
+						out += std::to_string(e.Value);
+						out += ",\"bp\":\"e\"";
+						break;
+					}
+
+					out += '}';
+				}
+
+				if (thread.Lost != 0)
+				{
+					next();
+					out += "\"name\":\"events_lost\",\"ph\":\"M\",\"pid\":";
+					out += pidStr;
+					out += ",\"tid\":";
+					out += tidStr;
+					out += ",\"args\":{\"count\":";
+					out += std::to_string(thread.Lost);
+					out += "}}";
+				}
+			}
+
+			out += "]}";
+			return out;
+		}
+	};
+}
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "util/binary_log.hpp"
+
+// Renders a binary log as text, like the text log would have been.
+//
+// Usage: LogDecoder <binary log> [output file]
+// Without an output file, the text goes to the standard output.
+
+namespace {
+	enum ExitCode {
+		Success = 0,
+		BadArguments = 1,
+		ReadFailed = 2,
+		NotBinaryLog = 3,
+		Truncated = 4,
+		WriteFailed = 5
+	};
+
+	template<typename Char>
+	int Decode(int argc, Char **argv)
+	{
+		if (argc != 2 && argc != 3)
+		{
+			std::cerr << "Usage: LogDecoder <binary log> [output file]\n";
+			return BadArguments;
+		}
+
+		const std::filesystem::path input = argv[1];
+		std::ifstream file(input, std::ios::binary);
+		const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!file && !file.eof())
+		{
+			std::cerr << "Failed to read " << input.string() << '\n';
+			return ReadFailed;
+		}
+
+		Util::binary_log::reader reader(contents);
+		if (!reader.valid())
+		{
+			std::cerr << input.string() << " is not a binary log\n";
+			return NotBinaryLog;
+		}
+
+		std::ofstream outputFile;
+		if (argc == 3)
+		{
+			const std::filesystem::path output = argv[2];
+			outputFile.open(output, std::ios::binary);
+			if (!outputFile)
+			{
+				std::cerr << "Failed to open " << output.string() << '\n';
+				return WriteFailed;
+			}
+		}
+
+		std::ostream &out = outputFile.is_open() ? outputFile : std::cout;
+		Util::binary_log::message message;
+		while (reader.next(message))
+		{
+			out << Util::binary_log::format_line(message) << '\n';
+		}
+
+		out.flush();
+		if (!out)
+		{
+			std::cerr << "Failed to write the decoded log\n";
+			return WriteFailed;
+		}
+
+		if (reader.corrupt())
+		{
+			std::cerr << "The log ends with a truncated or malformed record, it was probably still being written\n";
+			return Truncated;
+		}
+
+		return Success;
+	}
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t **argv)
+{
+	return Decode(argc, argv);
+}
+#else
+int main(int argc, char **argv)
+{
+	return Decode(argc, argv);
+}
+#endif
@@ -1,11 +1,13 @@
 #include "error.hpp"
+#include <chrono>
+#include <cstdint>
 #include <debugapi.h>
+#include <format>
 #include <intrin.h>
+#include <iterator>
+#include <processthreadsapi.h>
 #include <spdlog/spdlog.h>
 #include <string>
-#ifdef _DEBUG
-#include <processthreadsapi.h>
-#endif
 #include <wil/resource.h>
 #include <winnt.h>
 
@@ -14,6 +16,14 @@
 #include "util/string_macros.hpp"
 #include "win32.hpp"
 
+namespace {
+	std::uint64_t RecorderTimestamp() noexcept
+	{
+		using namespace std::chrono;
+		return static_cast<std::uint64_t>(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+	}
+}
+
 bool Error::impl::ShouldLogInternal(spdlog::level::level_enum level)
 {
 	// implicitly checks if logging is initialized.
@@ -25,11 +35,66 @@ bool Error::impl::ShouldLogInternal(spdlog::level::level_enum level)
 	return false;
 }
 
+bool Error::impl::ShouldRecordInternal() noexcept
+{
+	return Log::IsInitialized();
+}
+
+void Error::impl::Record(std::wstring_view message, spdlog::level::level_enum level, std::source_location location) noexcept
+{
+	Log::GetFlightRecorder().record(static_cast<std::uint8_t>(level), location.file_name(), location.line(), RecorderTimestamp(), GetCurrentThreadId(), message);
+}
+
+void Error::impl::RecordHresult(std::wstring_view message, std::int32_t result, spdlog::level::level_enum level, std::source_location location) noexcept
+{
+	wchar_t code[16];
+	const auto formatted = std::format_to_n(code, std::size(code), L"0x{:08X}", static_cast<std::uint32_t>(result));
+	Log::GetFlightRecorder().record(static_cast<std::uint8_t>(level), location.file_name(), location.line(), RecorderTimestamp(), GetCurrentThreadId(), message, { code, formatted.out });
+}
+
 void Error::impl::Log(std::wstring_view msg, spdlog::level::level_enum level, std::source_location location)
 {
 	spdlog::log({ location.file_name(), static_cast<int>(location.line()), location.function_name() }, level, msg);
 }
 
+void Error::impl::LogOrRecord(std::wstring_view message, std::wstring_view error_message, spdlog::level::level_enum level, std::source_location location)
+{
+	const auto sink = Log::GetSink();
+	const bool written = sink && sink->should_log(level);
+	if (!written)
+	{
+		Log::GetFlightRecorder().record(static_cast<std::uint8_t>(level), location.file_name(), location.line(), RecorderTimestamp(), GetCurrentThreadId(), message, error_message);
+	}
+
+	if (written || IsDebuggerPresent())
+	{
+		Log(GetLogMessage(message, error_message), level, location);
+	}
+}
+
+void Error::impl::LogDeferred(const Util::binary_log::call_site &site, std::string_view args)
+{
+	const auto level = static_cast<spdlog::level::level_enum>(site.Level);
+	const auto sink = Log::GetSink();
+	if (!sink || !sink->should_log(level))
+	{
+		Log::GetFlightRecorder().record(site, RecorderTimestamp(), GetCurrentThreadId(), args);
+		if (!IsDebuggerPresent())
+		{
+			return;
+		}
+	}
+	else if (sink->log_deferred(site, args))
+	{
+		return;
+	}
+
+	// the arguments come from HandleDeferred, they can't be malformed.
+	std::string message;
+	Util::binary_log::render(message, site.Format, args);
+	spdlog::log({ site.File.data(), static_cast<int>(site.Line), "" }, level, message);
+}
+
 std::wstring Error::impl::GetLogMessage(std::wstring_view message, std::wstring_view error_message)
 {
 	if (!error_message.empty())
@@ -75,6 +140,8 @@ std::thread Error::impl::HandleCommon(spdlog::level::level_enum level, std::wstr
 	// allow calls to err handling without needing to initialize logging
 	if (Log::IsInitialized())
 	{
+		// what led to the error first.
+		Log::DumpFlightRecorder(level == spdlog::level::critical ? L"critical error" : L"error");
 		Log(GetLogMessage(message, error_message), level, location);
 	}
 
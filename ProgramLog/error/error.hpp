@@ -1,12 +1,15 @@
 #pragma once
 #include "arch.h"
 #include <spdlog/common.h>
+#include <cstdint>
 #include <source_location>
+#include <string>
 #include <string_view>
 #include <thread>
 
 #include "../api.h"
 #include "appinfo.hpp"
+#include "util/binary_log.hpp"
 #include "util/null_terminated_string_view.hpp"
 
 #define UTF8_ERROR_TITLE UTF8_APP_NAME " - Error"
@@ -14,16 +17,25 @@
 namespace Error {
 	namespace impl {
 		PROGRAMLOG_API bool ShouldLogInternal(spdlog::level::level_enum level);
+		PROGRAMLOG_API bool ShouldRecordInternal() noexcept;
 
 		// Needs to be in DLL because spdlog log registry is per-module.
 		PROGRAMLOG_API void Log(std::wstring_view msg, spdlog::level::level_enum level, std::source_location location);
 
 		PROGRAMLOG_API std::wstring GetLogMessage(std::wstring_view message, std::wstring_view error_message);
 
+		// Logs the message if the log takes its level, records it in the flight recorder otherwise.
+		PROGRAMLOG_API void LogOrRecord(std::wstring_view message, std::wstring_view error_message, spdlog::level::level_enum level, std::source_location location);
+
+		// Only records the message in the flight recorder. The error is kept as its code, without
+		// looking up its description.
+		PROGRAMLOG_API void Record(std::wstring_view message, spdlog::level::level_enum level, std::source_location location) noexcept;
+		PROGRAMLOG_API void RecordHresult(std::wstring_view message, std::int32_t result, spdlog::level::level_enum level, std::source_location location) noexcept;
+
 		template<spdlog::level::level_enum level>
 		inline void Handle(std::wstring_view message, std::wstring_view error_message, std::source_location location)
 		{
-			Log(GetLogMessage(message, error_message), level, location);
+			LogOrRecord(message, error_message, level, location);
 		}
 
 		template<>
@@ -32,6 +44,19 @@ namespace Error {
 		template<>
 		[[noreturn]] PROGRAMLOG_API void Handle<spdlog::level::critical>(std::wstring_view message, std::wstring_view error_message, std::source_location location);
 
+		// Written as is when the log is binary, formatted and logged like the rest otherwise.
+		// Recorded in the flight recorder without being formatted if the log doesn't take its level.
+		PROGRAMLOG_API void LogDeferred(const Util::binary_log::call_site &site, std::string_view args);
+
+		template<typename... Args>
+		inline void HandleDeferred(const Util::binary_log::call_site &site, const Args &...args)
+		{
+			thread_local std::string encoded;
+			encoded.clear();
+			Util::binary_log::encode_args(encoded, args...);
+			LogDeferred(site, encoded);
+		}
+
 		std::thread HandleCommon(spdlog::level::level_enum level, std::wstring_view message, std::wstring_view error_message, std::source_location location, Util::null_terminated_wstring_view title, std::wstring_view description, unsigned int type);
 		void HandleCriticalCommon(std::wstring_view message, std::wstring_view error_message, std::source_location location);
 	}
@@ -53,11 +78,32 @@ namespace Error {
 	{
 		return true;
 	}
+
+	// Whether the message is kept at all, either in the log or in the flight recorder.
+	// Cheaper than ShouldLog, but also true for messages that won't be written: what it
+	// guards must only use values at hand, anything that needs lookups or formatting
+	// goes behind ShouldLog.
+	template<spdlog::level::level_enum level>
+	inline bool ShouldRecord()
+	{
+		return impl::ShouldRecordInternal();
+	}
 };
 
 #define PROGRAMLOG_ERROR_LOCATION std::source_location::current()
 #define MessagePrint(level_, message_) Error::impl::Handle<(level_)>((message_), std::wstring_view { }, PROGRAMLOG_ERROR_LOCATION)
-#define ErrorHandleCommonMacro(level_, message_, error_message_) do { \
+
+// Like MessagePrint, but with a static UTF-8 format string whose arguments only get formatted
+// when reading the log, if it is binary. Arguments can be integers, booleans, handles and
+// other pointers, Util::binary_log::hresult, and strings. Not for errors, those go through
+// the usual error handling.
+#define DeferredPrint(level_, format_, ...) do { \
+	static_assert((level_) < spdlog::level::err, "Errors can't be deferred"); \
+	static constexpr Util::binary_log::call_site site_ { (format_), __FILE__, __LINE__, static_cast<std::uint8_t>(level_) }; \
+	Error::impl::HandleDeferred(site_ __VA_OPT__(,) __VA_ARGS__); \
+} while (0)
+
+#define ErrorHandleOrRecordMacro(level_, message_, error_message_, record_) do { \
 	if constexpr ((level_) == spdlog::level::critical || (level_) == spdlog::level::err) \
 	{ \
 		Error::impl::Handle<(level_)>((message_), (error_message_), PROGRAMLOG_ERROR_LOCATION); \
@@ -66,4 +112,10 @@ namespace Error {
 	{ \
 		Error::impl::Handle<(level_)>((message_), (error_message_), PROGRAMLOG_ERROR_LOCATION); \
 	} \
+	else if (Error::ShouldRecord<(level_)>()) \
+	{ \
+		record_; \
+	} \
 } while (0)
+
+#define ErrorHandleCommonMacro(level_, message_, error_message_) ErrorHandleOrRecordMacro((level_), (message_), (error_message_), Error::impl::Record((message_), (level_), PROGRAMLOG_ERROR_LOCATION))
@@ -16,7 +16,10 @@ namespace Error {
 	PROGRAMLOG_API std::wstring MessageFromHRESULT(HRESULT result);
 }
 
-#define HresultHandle(hresult_, level_, message_) ErrorHandleCommonMacro((level_), (message_), Error::MessageFromHRESULT((hresult_)))
+#define HresultHandle(hresult_, level_, message_) do { \
+	const HRESULT hresultHandle_ = (hresult_); \
+	ErrorHandleOrRecordMacro((level_), (message_), Error::MessageFromHRESULT(hresultHandle_), Error::impl::RecordHresult((message_), hresultHandle_, (level_), PROGRAMLOG_ERROR_LOCATION)); \
+} while (0)
 
 #define HresultVerify(hresult_, level_, message_) do { \
 	if (const HRESULT hr_ = (hresult_); FAILED(hr_)) [[unlikely]] \
@@ -28,6 +28,10 @@ namespace Error {
 	{ \
 		Error::impl::Handle<(level_)>((message_), Error::MessageFromHresultError(hresultError_), PROGRAMLOG_ERROR_LOCATION); \
 	} \
+	else if (Error::ShouldRecord<(level_)>()) \
+	{ \
+		Error::impl::RecordHresult((message_), hresultError_.code(), (level_), PROGRAMLOG_ERROR_LOCATION); \
+	} \
 } while (0)
 
 #define HresultErrorCatch(level_, message_) catch (const winrt::hresult_error &exception_) { HresultErrorHandle(exception_, (level_), (message_)); }
@@ -1,7 +1,10 @@
 #include "lazyfilesink.hpp"
+#include <chrono>
 #include <fileapi.h>
+#include <processthreadsapi.h>
+#include <string>
+#include <system_error>
 #include <utility>
-#include <wil/safecast.h>
 #include "winrt.hpp"
 
 #include "appinfo.hpp"
@@ -11,6 +14,28 @@
 #include "error/win32.hpp"
 #include "error/winrt.hpp"
 
+template<typename Mutex>
+lazy_file_sink<Mutex>::lazy_file_sink(std::filesystem::path path, bool async) :
+	m_Tried(false),
+	m_Opened(false),
+	m_Log(log_storage { }, std::move(path)),
+	m_Queue(async ? std::make_unique<Util::record_queue>(ASYNC_BUFFER_SIZE) : nullptr),
+	m_Binary(false)
+{ }
+
+template<typename Mutex>
+lazy_file_sink<Mutex>::~lazy_file_sink()
+{
+	if (m_Writer.joinable())
+	{
+		// the writer writes what's left before exiting. It uses the queue and the log, so it has
+		// to be gone before they are. If the process is exiting, it already got terminated and
+		// this returns right away.
+		m_Queue->close();
+		m_Writer.join();
+	}
+}
+
 template<typename Mutex>
 lazy_sink_state lazy_file_sink<Mutex>::state()
 {
@@ -18,7 +43,7 @@ lazy_sink_state lazy_file_sink<Mutex>::state()
 
 	if (m_Tried)
 	{
-		return m_Handle
+		return m_Opened
 			? lazy_sink_state::opened
 			: lazy_sink_state::failed;
 	}
@@ -28,26 +53,154 @@ lazy_sink_state lazy_file_sink<Mutex>::state()
 	}
 }
 
+template<typename Mutex>
+void lazy_file_sink<Mutex>::set_backpressure(Util::backpressure policy)
+{
+	if (m_Queue)
+	{
+		m_Queue->set_policy(policy);
+	}
+}
+
+template<typename Mutex>
+void lazy_file_sink<Mutex>::set_rotation(Util::rotation_settings settings)
+{
+	std::scoped_lock guard(m_LogLock);
+	m_Log.set_settings(settings);
+}
+
+template<typename Mutex>
+void lazy_file_sink<Mutex>::remove_stale_logs()
+{
+	std::scoped_lock guard(m_LogLock);
+	m_Log.cleanup();
+}
+
+template<typename Mutex>
+void lazy_file_sink<Mutex>::set_format(Util::log_format format)
+{
+	std::scoped_lock guard(this->mutex_);
+
+	if (!m_Tried)
+	{
+		m_Binary = format == Util::log_format::binary;
+	}
+}
+
+template<typename Mutex>
+Util::log_format lazy_file_sink<Mutex>::format()
+{
+	std::scoped_lock guard(this->mutex_);
+
+	return m_Binary ? Util::log_format::binary : Util::log_format::text;
+}
+
+template<typename Mutex>
+bool lazy_file_sink<Mutex>::log_deferred(const Util::binary_log::call_site &site, std::string_view args)
+{
+	const auto level = static_cast<spdlog::level::level_enum>(site.Level);
+	const auto timestamp = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	const auto thread = GetCurrentThreadId();
+
+	std::scoped_lock guard(this->mutex_);
+	if (!m_Binary)
+	{
+		return false;
+	}
+
+	if (this->should_log(level))
+	{
+		open();
+
+		if (m_Opened)
+		{
+			m_Record.clear();
+			const auto id = m_BinaryWriter.define(m_Record, site);
+			if (!m_Record.empty())
+			{
+				// so that the next parts can be read on their own.
+				std::scoped_lock logGuard(m_LogLock);
+				m_Log.add_to_preamble(m_Record);
+			}
+
+			Util::binary_log::encode_entry(m_Record, id, timestamp, thread, args);
+			deliver(m_Record, level >= spdlog::level::err);
+		}
+	}
+
+	return true;
+}
+
+template<typename Mutex>
+void lazy_file_sink<Mutex>::write_recorded(std::span<const Util::binary_log::message> messages)
+{
+	std::scoped_lock guard(this->mutex_);
+	open();
+
+	if (m_Opened)
+	{
+		for (const auto &msg : messages)
+		{
+			if (m_Binary)
+			{
+				m_Record.clear();
+				Util::binary_log::encode_text(m_Record, msg.Level, msg.File, msg.Line, msg.Timestamp, msg.Thread, msg.Text);
+			}
+			else
+			{
+				m_Record = Util::binary_log::format_line(msg);
+				m_Record += spdlog::details::os::default_eol;
+			}
+
+			deliver(m_Record, false);
+		}
+	}
+}
+
 template<typename Mutex>
 void lazy_file_sink<Mutex>::sink_it_(const spdlog::details::log_msg &msg)
 {
 	open();
 
-	if (m_Handle)
+	if (m_Opened)
 	{
-		spdlog::memory_buf_t formatted;
-		this->formatter_->format(msg, formatted);
+		const bool urgent = msg.level >= spdlog::level::err;
+		if (m_Binary)
+		{
+			m_Record.clear();
+			Util::binary_log::encode_text(m_Record, static_cast<std::uint8_t>(msg.level),
+				msg.source.filename ? msg.source.filename : "", static_cast<std::uint32_t>(msg.source.line),
+				static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch()).count()),
+				static_cast<std::uint32_t>(msg.thread_id), { msg.payload.data(), msg.payload.size() });
 
-		write(formatted);
+			deliver(m_Record, urgent);
+		}
+		else
+		{
+			spdlog::memory_buf_t formatted;
+			this->formatter_->format(msg, formatted);
+			deliver({ formatted.data(), formatted.size() }, urgent);
+		}
 	}
 }
 
 template<typename Mutex>
 void lazy_file_sink<Mutex>::flush_()
 {
-	if (m_Handle)
+	if (m_Opened)
 	{
-		if (!FlushFileBuffers(m_Handle.get()))
+		if (m_Writer.joinable())
+		{
+			m_Queue->flush();
+		}
+
+		bool flushed;
+		{
+			std::scoped_lock guard(m_LogLock);
+			flushed = m_Log.flush();
+		}
+
+		if (!flushed)
 		{
 			LastErrorHandle(spdlog::level::trace, L"Failed to flush log file.");
 		}
@@ -60,13 +213,28 @@ void lazy_file_sink<Mutex>::open()
 	if (!std::exchange(m_Tried, true))
 	{
 		std::error_code err;
-		std::filesystem::create_directories(m_File.parent_path(), err);
+		std::filesystem::create_directories(file().parent_path(), err);
 		if (!err)
 		{
-			m_Handle.reset(CreateFile(m_File.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
-			if (m_Handle)
 			{
-				write(UTF8_BOM);
+				// this also deletes stale logs.
+				std::scoped_lock guard(m_LogLock);
+				m_Opened = m_Log.open(m_Binary ? std::string(Util::binary_log::MAGIC) : std::string(UTF8_BOM));
+			}
+
+			if (m_Opened)
+			{
+				if (m_Queue)
+				{
+					try
+					{
+						m_Writer = std::thread(&lazy_file_sink::writer_loop, this);
+					}
+					catch (const std::system_error &)
+					{
+						// can't log this: we're holding the sink lock. just write synchronously.
+					}
+				}
 			}
 			else
 			{
@@ -81,18 +249,51 @@ void lazy_file_sink<Mutex>::open()
 }
 
 template<typename Mutex>
-template<typename T>
-void lazy_file_sink<Mutex>::write(const T &thing)
+void lazy_file_sink<Mutex>::deliver(std::string_view entry, bool urgent)
 {
-	DWORD bytesWritten;
-	if (WriteFile(m_Handle.get(), thing.data(), wil::safe_cast<DWORD>(thing.size()), &bytesWritten, nullptr))
+	if (m_Writer.joinable())
 	{
-		if (bytesWritten != thing.size()) [[unlikely]]
+		m_Queue->push(entry, urgent);
+		if (urgent)
 		{
-			MessagePrint(spdlog::level::trace, L"Wrote less characters than there is in log entry?");
+			m_Queue->flush();
 		}
 	}
 	else
+	{
+		write_or_log(entry);
+	}
+}
+
+template<typename Mutex>
+void lazy_file_sink<Mutex>::writer_loop() noexcept
+{
+	std::string batch;
+	while (const auto sequence = m_Queue->take(batch, ASYNC_BATCH_SIZE, ASYNC_FLUSH_INTERVAL))
+	{
+		if (!batch.empty())
+		{
+			// don't log failures from here: a producer waiting for room in the queue
+			// holds the sink lock, and logging would need it.
+			static_cast<void>(write(batch));
+			batch.clear();
+		}
+
+		m_Queue->mark_handled(sequence);
+	}
+}
+
+template<typename Mutex>
+bool lazy_file_sink<Mutex>::write(std::string_view data) noexcept
+{
+	std::scoped_lock guard(m_LogLock);
+	return m_Log.write(data);
+}
+
+template<typename Mutex>
+void lazy_file_sink<Mutex>::write_or_log(std::string_view data)
+{
+	if (!write(data))
 	{
 		LastErrorHandle(spdlog::level::trace, L"Failed to write log entry to file.");
 	}
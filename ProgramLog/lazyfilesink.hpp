@@ -1,14 +1,22 @@
 #pragma once
 #include "arch.h"
+#include <chrono>
 #include <filesystem>
+#include <memory>
 #include <mutex>
+#include <span>
 #include <spdlog/details/null_mutex.h>
 #include <spdlog/sinks/base_sink.h>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
-#include <wil/resource.h>
 
 #include "api.h"
+#include "logstorage.hpp"
+#include "util/binary_log.hpp"
+#include "util/record_queue.hpp"
+#include "util/rotating_log.hpp"
 
 enum class lazy_sink_state {
 	opened = 0,
@@ -21,25 +29,73 @@ class lazy_file_sink final : public spdlog::sinks::base_sink<Mutex> {
 	using path_getter_t = std::add_pointer_t<std::filesystem::path()>;
 
 public:
-	explicit lazy_file_sink(std::filesystem::path path) : m_File(std::move(path)), m_Tried(false) { }
+	// When async, entries are written in batches by a separate thread, so that logging
+	// doesn't wait on disk I/O. Errors and critical errors are still written before
+	// returning, since the process might not be around for long after those.
+	//
+	// The log is split in parts once they reach the maximum size, and the oldest logs
+	// of the folder get deleted when creating a part. See Util::rotating_log.
+	explicit lazy_file_sink(std::filesystem::path path, bool async = false);
+	~lazy_file_sink();
 
-	const std::filesystem::path &file() const noexcept { return m_File; }
+	// The part being written.
+	std::filesystem::path file() const
+	{
+		std::scoped_lock guard(m_LogLock);
+		return m_Log.path();
+	}
 
 	PROGRAMLOG_API lazy_sink_state state();
 
+	// What to do with new entries when the writer thread can't keep up. No-op if not async.
+	PROGRAMLOG_API void set_backpressure(Util::backpressure policy);
+
+	PROGRAMLOG_API void set_rotation(Util::rotation_settings settings);
+
+	// Deletes the oldest logs of the folder, like creating the file does. The file only gets
+	// created with the first entry, so this lets old logs go without waiting for one.
+	PROGRAMLOG_API void remove_stale_logs();
+
+	// The file is in one format from start to end, so this does nothing once it got created.
+	PROGRAMLOG_API void set_format(Util::log_format format);
+	PROGRAMLOG_API Util::log_format format();
+
+	// Writes a message from DeferredPrint as is. Returns false if the log isn't binary,
+	// in which case the caller has to format the message and log it normally.
+	PROGRAMLOG_API bool log_deferred(const Util::binary_log::call_site &site, std::string_view args);
+
+	// Writes messages taken from the flight recorder, whatever their level.
+	PROGRAMLOG_API void write_recorded(std::span<const Util::binary_log::message> messages);
+
 protected:
 	void sink_it_(const spdlog::details::log_msg &msg) override;
 	void flush_() override;
 
 private:
+	static constexpr std::size_t ASYNC_BUFFER_SIZE = 1024 * 1024;
+	static constexpr std::size_t ASYNC_BATCH_SIZE = 64 * 1024;
+	static constexpr std::chrono::milliseconds ASYNC_FLUSH_INTERVAL = std::chrono::seconds(1);
+
 	bool m_Tried;
-	wil::unique_hfile m_Handle;
-	std::filesystem::path m_File;
+	bool m_Opened;
+
+	// the writer thread uses the log without holding the sink lock.
+	mutable std::mutex m_LogLock;
+	Util::rotating_log<log_storage> m_Log;
+
+	std::unique_ptr<Util::record_queue> m_Queue;
+	std::thread m_Writer;
+
+	bool m_Binary;
+	Util::binary_log::writer m_BinaryWriter;
+	std::string m_Record;
 
 	void open();
+	void deliver(std::string_view entry, bool urgent);
+	void writer_loop() noexcept;
 
-	template<typename T>
-	void write(const T &thing);
+	bool write(std::string_view data) noexcept;
+	void write_or_log(std::string_view data);
 };
 
 using lazy_file_sink_mt = lazy_file_sink<std::mutex>;
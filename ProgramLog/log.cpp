@@ -14,6 +14,7 @@
 
 std::atomic<Log::InitStatus> Log::s_LogInitStatus = Log::InitStatus::NotInitialized;
 std::weak_ptr<lazy_file_sink_mt> Log::s_LogSink;
+Util::flight_recorder Log::s_FlightRecorder;
 
 std::time_t Log::GetProcessCreationTime() noexcept
 {
@@ -93,8 +94,9 @@ void Log::Initialize(const std::optional<std::filesystem::path> &storageFolder)
 
 		if (auto path = GetPath(storageFolder); !path.empty())
 		{
-			auto fileLog = std::make_shared<lazy_file_sink_mt>(std::move(path));
+			auto fileLog = std::make_shared<lazy_file_sink_mt>(std::move(path), true);
 			fileLog->set_level(Config::DEFAULT_LOG_VERBOSITY);
+			fileLog->set_rotation(Config::GetLogRotation(Config::DEFAULT_LOG_MAX_FILE_SIZE, Config::DEFAULT_LOG_RETAINED_FILES));
 			s_LogSink = fileLog;
 
 			defaultLogger->sinks().push_back(std::move(fileLog));
@@ -114,3 +116,25 @@ void Log::Initialize(const std::optional<std::filesystem::path> &storageFolder)
 		throw std::logic_error("Log::Initialize should only be called once");
 	}
 }
+
+Util::flight_recorder &Log::GetFlightRecorder() noexcept
+{
+	return s_FlightRecorder;
+}
+
+void Log::DumpFlightRecorder(std::wstring_view reason)
+{
+	const auto dump = s_FlightRecorder.take();
+	if (dump.Messages.empty() && dump.Lost == 0)
+	{
+		return;
+	}
+
+	if (const auto sink = GetSink())
+	{
+		MessagePrint(spdlog::level::off, std::format(L"===== Begin flight recorder dump ({}): {} messages, {} lost =====", reason, dump.Messages.size(), dump.Lost));
+		sink->write_recorded(dump.Messages);
+		MessagePrint(spdlog::level::off, L"===== End flight recorder dump =====");
+		sink->flush();
+	}
+}
@@ -9,6 +9,7 @@
 
 #include "api.h"
 #include "lazyfilesink.hpp"
+#include "util/flight_recorder.hpp"
 
 class Log {
 private:
@@ -20,6 +21,7 @@ private:
 
 	static std::atomic<InitStatus> s_LogInitStatus;
 	static std::weak_ptr<lazy_file_sink_mt> s_LogSink;
+	static Util::flight_recorder s_FlightRecorder;
 
 	static std::time_t GetProcessCreationTime() noexcept;
 	static std::filesystem::path GetPath(const std::optional<std::filesystem::path> &storageFolder);
@@ -29,4 +31,8 @@ public:
 	PROGRAMLOG_API static bool IsInitialized() noexcept;
 	PROGRAMLOG_API static std::shared_ptr<lazy_file_sink_mt> GetSink() noexcept;
 	PROGRAMLOG_API static void Initialize(const std::optional<std::filesystem::path> &storageFolder);
+
+	// Holds what was too verbose to be written to the log, until it gets dumped.
+	PROGRAMLOG_API static Util::flight_recorder &GetFlightRecorder() noexcept;
+	PROGRAMLOG_API static void DumpFlightRecorder(std::wstring_view reason);
 };
@@ -0,0 +1,145 @@
+#include "logstorage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fileapi.h>
+#include <memoryapi.h>
+#include <system_error>
+#include <utility>
+
+mapped_log_file::mapped_log_file(wil::unique_hfile file) noexcept :
+	m_File(std::move(file))
+{ }
+
+mapped_log_file::mapped_log_file(mapped_log_file &&other) noexcept :
+	m_File(std::move(other.m_File)),
+	m_View(std::move(other.m_View)),
+	m_ViewOffset(std::exchange(other.m_ViewOffset, 0)),
+	m_Size(std::exchange(other.m_Size, 0))
+{ }
+
+mapped_log_file &mapped_log_file::operator =(mapped_log_file &&other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+
+		m_File = std::move(other.m_File);
+		m_View = std::move(other.m_View);
+		m_ViewOffset = std::exchange(other.m_ViewOffset, 0);
+		m_Size = std::exchange(other.m_Size, 0);
+	}
+
+	return *this;
+}
+
+mapped_log_file::~mapped_log_file()
+{
+	close();
+}
+
+bool mapped_log_file::map_chunk(std::uint64_t offset) noexcept
+{
+	m_View.reset();
+
+	// mapping past the end of the file extends it. the view keeps the mapping alive.
+	const std::uint64_t end = offset + CHUNK_SIZE;
+	const wil::unique_handle mapping(CreateFileMapping(m_File.get(), nullptr, PAGE_READWRITE, static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr));
+	if (!mapping)
+	{
+		return false;
+	}
+
+	m_View.reset(static_cast<char *>(MapViewOfFile(mapping.get(), FILE_MAP_WRITE, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), CHUNK_SIZE)));
+	if (!m_View)
+	{
+		return false;
+	}
+
+	m_ViewOffset = offset;
+	return true;
+}
+
+bool mapped_log_file::trim() noexcept
+{
+	// drop the padding past what got written. the file can't shrink while it's mapped,
+	// the next append maps the chunk again.
+	m_View.reset();
+
+	FILE_END_OF_FILE_INFO info;
+	info.EndOfFile.QuadPart = static_cast<LONGLONG>(m_Size);
+	return SetFileInformationByHandle(m_File.get(), FileEndOfFileInfo, &info, sizeof(info));
+}
+
+void mapped_log_file::close() noexcept
+{
+	if (m_File)
+	{
+		trim();
+		m_File.reset();
+	}
+}
+
+bool mapped_log_file::append(std::string_view data) noexcept
+{
+	while (!data.empty())
+	{
+		if (!m_View || m_Size == m_ViewOffset + CHUNK_SIZE)
+		{
+			if (!map_chunk(m_Size - m_Size % CHUNK_SIZE))
+			{
+				return false;
+			}
+		}
+
+		const auto position = m_Size - m_ViewOffset;
+		const auto count = static_cast<std::size_t>(std::min<std::uint64_t>(data.size(), CHUNK_SIZE - position));
+		std::memcpy(m_View.get() + position, data.data(), count);
+
+		m_Size += count;
+		data.remove_prefix(count);
+	}
+
+	return true;
+}
+
+bool mapped_log_file::flush() noexcept
+{
+	if (m_View && !FlushViewOfFile(m_View.get(), 0))
+	{
+		return false;
+	}
+
+	return trim() && FlushFileBuffers(m_File.get());
+}
+
+mapped_log_file log_storage::create(const std::filesystem::path &path) noexcept
+{
+	// mapping the file needs read access too.
+	return mapped_log_file(wil::unique_hfile(CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)));
+}
+
+std::vector<Util::stored_log_file> log_storage::list(const std::filesystem::path &folder)
+{
+	std::vector<Util::stored_log_file> files;
+
+	std::error_code err;
+	for (std::filesystem::directory_iterator it(folder, err), end; !err && it != end; it.increment(err))
+	{
+		std::error_code entryErr;
+		if (const auto &path = it->path(); it->is_regular_file(entryErr) && path.extension() == L".log" && path.stem().extension() != L".decoded")
+		{
+			if (const auto lastWrite = it->last_write_time(entryErr); !entryErr)
+			{
+				files.push_back({ path, static_cast<std::uint64_t>(lastWrite.time_since_epoch().count()) });
+			}
+		}
+	}
+
+	return files;
+}
+
+bool log_storage::remove(const std::filesystem::path &path) noexcept
+{
+	std::error_code err;
+	return std::filesystem::remove(path, err);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "arch.h"
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+#include <wil/resource.h>
+
+#include "util/rotating_log.hpp"
+
+// A log file written through a view of it mapped in memory, moved along the file in large
+// chunks: appending is a copy, and the file only gets extended once per chunk. Until it gets
+// flushed or closed, the file is padded with zeros up to the end of the current chunk.
+// The process might not get to close it, so flushing it drops the padding too.
+class mapped_log_file {
+	// has to be a multiple of the allocation granularity, which is 64 KiB.
+	static constexpr std::uint64_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+	wil::unique_hfile m_File;
+	wil::unique_mapview_ptr<char> m_View;
+	std::uint64_t m_ViewOffset = 0;
+	std::uint64_t m_Size = 0;
+
+	bool map_chunk(std::uint64_t offset) noexcept;
+	bool trim() noexcept;
+	void close() noexcept;
+
+public:
+	mapped_log_file() noexcept = default;
+	explicit mapped_log_file(wil::unique_hfile file) noexcept;
+
+	mapped_log_file(mapped_log_file &&other) noexcept;
+	mapped_log_file &operator =(mapped_log_file &&other) noexcept;
+
+	~mapped_log_file();
+
+	explicit operator bool() const noexcept { return m_File.is_valid(); }
+
+	bool append(std::string_view data) noexcept;
+	bool flush() noexcept;
+};
+
+// File system access for Util::rotating_log. Doesn't log anything, because it's used
+// by the log writer. Failures leave the reason in the last error.
+//
+// Decoded copies of binary logs sit next to them, but aren't logs of their own: they
+// neither count towards the files kept nor get deleted.
+class log_storage {
+public:
+	using file_type = mapped_log_file;
+
+	file_type create(const std::filesystem::path &path) noexcept;
+	std::vector<Util::stored_log_file> list(const std::filesystem::path &folder);
+	bool remove(const std::filesystem::path &path) noexcept;
+};
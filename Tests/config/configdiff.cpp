@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <utility>
+
+#include "config/configdiff.hpp"
+
+namespace {
+	constexpr std::size_t DESKTOP = 0;
+	constexpr std::size_t VISIBLE = 1;
+	constexpr std::size_t MAXIMISED = 2;
+	constexpr std::size_t BATTERY_SAVER = 6;
+
+	ActiveInactiveTaskbarAppearance MakeRule(ACCENT_STATE accent)
+	{
+		ActiveInactiveTaskbarAppearance rule;
+		rule.Accent = accent;
+		return rule;
+	}
+}
+
+TEST(ConfigDiff_Compute, SameConfigIsEmpty)
+{
+	Config config;
+	config.VisibleWindowAppearance.ClassRules.emplace(L"Notepad", MakeRule(ACCENT_ENABLE_BLURBEHIND));
+	config.IgnoredWindows.FileList.emplace(L"explorer.exe");
+
+	const auto diff = ConfigDiff::Compute(config, config);
+	ASSERT_TRUE(diff.empty());
+	ASSERT_FALSE(diff.AffectsTaskbars());
+}
+
+TEST(ConfigDiff_Compute, FlagsOnlyTheChangedAppearance)
+{
+	const Config before;
+	Config after;
+	after.DesktopAppearance.Color = { 0xFF, 0, 0, 0xFF };
+
+	const auto diff = ConfigDiff::Compute(before, after);
+	ASSERT_EQ(diff.Appearances, ConfigDiff::AppearanceBit(DESKTOP));
+	ASSERT_FALSE(diff.EnabledStates);
+	ASSERT_FALSE(diff.InvalidatesWindowCaches());
+	ASSERT_FALSE(diff.Tray || diff.Logging || diff.Other);
+}
+
+TEST(ConfigDiff_Compute, FlagsEnablingAnAppearance)
+{
+	const Config before;
+	Config after;
+	after.BatterySaverAppearance.Enabled = !before.BatterySaverAppearance.Enabled;
+
+	const auto diff = ConfigDiff::Compute(before, after);
+	ASSERT_TRUE(diff.EnabledStates);
+	ASSERT_FALSE(diff.AppearanceChanged(BATTERY_SAVER));
+	ASSERT_TRUE(diff.AffectsTaskbars());
+}
+
+TEST(ConfigDiff_Compute, RulesAreSeparateFromTheirAppearance)
+{
+	Config before;
+	before.MaximisedWindowAppearance.SetTitleRules({ { L"YouTube", MakeRule(ACCENT_ENABLE_ACRYLICBLURBEHIND) } });
+
+	auto rules = before.MaximisedWindowAppearance.TitleRules();
+	rules.at(L"YouTube").Inactive = TaskbarAppearance { };
+
+	Config after = before;
+	after.MaximisedWindowAppearance.SetTitleRules(std::move(rules));
+
+	const auto diff = ConfigDiff::Compute(before, after);
+	ASSERT_TRUE(diff.MaximisedRules);
+	ASSERT_FALSE(diff.VisibleRules);
+	ASSERT_FALSE(diff.AppearanceChanged(MAXIMISED));
+	ASSERT_TRUE(diff.InvalidatesWindowCaches());
+}
+
+TEST(ConfigDiff_Compute, FileNamesCompareCaseInsensitively)
+{
+	Config before;
+	before.VisibleWindowAppearance.FileRules.emplace(L"Code.exe", MakeRule(ACCENT_ENABLE_BLURBEHIND));
+	before.IgnoredWindows.FileList.emplace(L"Explorer.EXE");
+
+	Config after;
+	after.VisibleWindowAppearance.FileRules.emplace(L"code.exe", MakeRule(ACCENT_ENABLE_BLURBEHIND));
+	after.IgnoredWindows.FileList.emplace(L"explorer.exe");
+
+	const auto diff = ConfigDiff::Compute(before, after);
+	ASSERT_TRUE(diff.empty());
+}
+
+TEST(ConfigDiff_Compute, FlagsIgnoredWindows)
+{
+	const Config before;
+	Config after;
+	after.IgnoredWindows.ClassList.emplace(L"Shell_TrayWnd");
+
+	const auto diff = ConfigDiff::Compute(before, after);
+	ASSERT_TRUE(diff.IgnoredWindows);
+	ASSERT_EQ(diff.Appearances, 0u);
+	ASSERT_FALSE(diff.RulesChanged());
+}
+
+TEST(ConfigDiff_Compute, TrayAndLoggingDontAffectTaskbars)
+{
+	const Config before;
+	Config after;
+	after.HideTray = true;
+	after.LogVerbosity = spdlog::level::trace;
+	after.LogMaxFileSize = 1;
+	after.Language = L"fr-FR";
+
+	const auto diff = ConfigDiff::Compute(before, after);
+	ASSERT_TRUE(diff.Tray);
+	ASSERT_TRUE(diff.Logging);
+	ASSERT_TRUE(diff.Other);
+	ASSERT_FALSE(diff.AffectsTaskbars());
+}
+
+TEST(ConfigDiff_OfAppearance, FlagsOneState)
+{
+	auto diff = ConfigDiff::OfAppearance(VISIBLE);
+	ASSERT_TRUE(diff.AppearanceChanged(VISIBLE));
+	ASSERT_FALSE(diff.AppearanceChanged(DESKTOP));
+	ASSERT_FALSE(diff.EnabledStates);
+
+	diff |= ConfigDiff::OfAppearance(DESKTOP, true);
+	ASSERT_TRUE(diff.AppearanceChanged(DESKTOP));
+	ASSERT_TRUE(diff.EnabledStates);
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "config/configdiff.hpp"
+#include "config/configsnapshot.hpp"
+
+namespace {
+	Config MakeConfig(std::size_t rules)
+	{
+		Config config;
+		config.DesktopAppearance.Accent = ACCENT_ENABLE_BLURBEHIND;
+		config.DesktopAppearance.Color = { 0x12, 0x34, 0x56, 0x78 };
+		config.BatterySaverAppearance.Enabled = true;
+		config.HideTray = false;
+		config.LogVerbosity = spdlog::level::trace;
+		config.LogFormat = Util::log_format::binary;
+		config.Language = L"fr-FR";
+		config.CopyDlls = true;
+
+		RuledTaskbarAppearance::title_rules_t titleRules;
+		for (std::size_t i = 0; i < rules; ++i)
+		{
+			ActiveInactiveTaskbarAppearance rule;
+			rule.Accent = ACCENT_ENABLE_ACRYLICBLURBEHIND;
+			rule.BlurRadius = static_cast<float>(i % 100);
+			if (i % 4 == 0)
+			{
+				rule.Inactive = TaskbarAppearance { ACCENT_ENABLE_TRANSPARENTGRADIENT, { 0, 0, 0, 0x80 }, true, false, 9.0f };
+			}
+
+			const auto index = std::to_wstring(i);
+			config.VisibleWindowAppearance.ClassRules.emplace(L"Class_" + index, rule);
+			titleRules.emplace(L"Window title " + index, rule);
+			config.MaximisedWindowAppearance.FileRules.emplace(L"app" + index + L".exe", rule);
+		}
+
+		config.VisibleWindowAppearance.SetTitleRules(std::move(titleRules));
+
+		config.IgnoredWindows.ClassList.emplace(L"Shell_TrayWnd");
+		config.IgnoredWindows.SetTitleList({ L"Picture-in-picture", L"Task Switching" });
+		config.IgnoredWindows.FileList.emplace(L"explorer.exe");
+
+		return config;
+	}
+
+	std::string ToJson(const Config &config)
+	{
+		rj::StringBuffer buffer;
+		rj::Writer<rj::StringBuffer, rj::UTF16LE<>> writer(buffer);
+		writer.StartObject();
+		config.Serialize(writer);
+		writer.EndObject();
+
+		return { buffer.GetString(), buffer.GetSize() };
+	}
+}
+
+TEST(ConfigSnapshot_Read, RoundTrips)
+{
+	const auto config = MakeConfig(100);
+	const auto key = ConfigSnapshot::Key(ToJson(config));
+
+	Config read;
+	ASSERT_TRUE(ConfigSnapshot::Read(ConfigSnapshot::Write(config, key), key, read));
+	ASSERT_TRUE(ConfigDiff::Compute(config, read).empty());
+
+	for (const auto title : { L"Window title 42 - Editor", L"Window title 7", L"Untitled" })
+	{
+		ASSERT_EQ(read.VisibleWindowAppearance.TitleMatcher().find(title), config.VisibleWindowAppearance.TitleMatcher().find(title));
+	}
+
+	ASSERT_TRUE(read.IgnoredWindows.TitleMatcher().matches(L"Picture-in-picture"));
+	ASSERT_FALSE(read.IgnoredWindows.TitleMatcher().matches(L"Settings"));
+}
+
+// Saving writes a snapshot of the config it saved instead of parsing the file back.
+TEST(ConfigSnapshot_Write, MatchesTheSavedSettings)
+{
+	const auto config = MakeConfig(100);
+	const auto json = ToJson(config);
+
+	rj::StringStream in(json.c_str());
+	rjh::StreamReader<rj::StringStream> reader(in);
+
+	Config parsed;
+	parsed.Deserialize(reader);
+	ASSERT_TRUE(ConfigDiff::Compute(config, parsed).empty());
+}
+
+TEST(ConfigSnapshot_Key, DependsOnTheFile)
+{
+	ASSERT_EQ(ConfigSnapshot::Key("{}"), ConfigSnapshot::Key("{}"));
+	ASSERT_NE(ConfigSnapshot::Key("{}"), ConfigSnapshot::Key("{ }"));
+}
+
+TEST(ConfigSnapshot_Read, IgnoresOtherKeys)
+{
+	const auto snapshot = ConfigSnapshot::Write(MakeConfig(10), ConfigSnapshot::Key("{}"));
+
+	Config read;
+	read.Language = L"en-US";
+	ASSERT_FALSE(ConfigSnapshot::Read(snapshot, ConfigSnapshot::Key("{ }"), read));
+	ASSERT_EQ(read.Language, L"en-US");
+}
+
+TEST(ConfigSnapshot_Read, RejectsDamagedSnapshots)
+{
+	const auto key = ConfigSnapshot::Key("{}");
+	const auto snapshot = ConfigSnapshot::Write(MakeConfig(10), key);
+
+	Config read;
+	for (std::size_t size = 0; size < snapshot.size(); size += 13)
+	{
+		ASSERT_FALSE(ConfigSnapshot::Read(std::string_view(snapshot).substr(0, size), key, read));
+	}
+
+	auto damaged = snapshot;
+	damaged[damaged.size() / 2] ^= 0x20;
+	ASSERT_FALSE(ConfigSnapshot::Read(damaged, key, read));
+
+	ASSERT_FALSE(ConfigSnapshot::Read(snapshot + '\0', key, read));
+}
+
+TEST(ConfigSnapshot_Read, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	constexpr int rounds = 10;
+	const auto config = MakeConfig(10000);
+	const auto json = ToJson(config);
+	const auto key = ConfigSnapshot::Key(json);
+	const auto snapshot = ConfigSnapshot::Write(config, key);
+
+	const auto measure = [](auto load)
+	{
+		const auto start = clock::now();
+		for (int i = 0; i < rounds; ++i)
+		{
+			load();
+		}
+
+		return static_cast<long long>(duration_cast<microseconds>(clock::now() - start).count() / rounds);
+	};
+
+	const auto parse = measure([&json]
+	{
+		rj::StringStream in(json.c_str());
+		rjh::StreamReader<rj::StringStream> reader(in);
+
+		Config read;
+		read.Deserialize(reader);
+	});
+
+	const auto snapshotRead = measure([&json, &snapshot]
+	{
+		Config read;
+		ASSERT_TRUE(ConfigSnapshot::Read(snapshot, ConfigSnapshot::Key(json), read));
+	});
+
+	std::printf("[ CONFIG   ] 30000 rules, %zu KiB of JSON: parsing %lld us, %zu KiB snapshot %lld us (hashing the file included)\n",
+		json.size() / 1024, parse, snapshot.size() / 1024, snapshotRead);
+
+	EXPECT_LT(snapshotRead, parse);
+}
@@ -2,6 +2,7 @@
 #include <gmock/gmock.h>
 #include <string>
 #include <ranges>
+#include <vector>
 
 #include "config/rapidjsonhelper.hpp"
 
@@ -46,6 +47,7 @@ namespace {
 		MOCK_METHOD(bool, Key, (const wchar_t *str, rj::SizeType length));
 		MOCK_METHOD(bool, String, (const wchar_t *str, rj::SizeType length));
 		MOCK_METHOD(bool, Bool, (bool value));
+		MOCK_METHOD(bool, Uint, (unsigned int value));
 		MOCK_METHOD(bool, StartObject, ());
 		MOCK_METHOD(bool, EndObject, ());
 	};
@@ -59,6 +61,43 @@ namespace {
 	{
 	}
 
+	using StringReader = rjh::StreamReader<rj::StringStream, rj::UTF8<>, rj::kParseCommentsFlag>;
+
+	template<class Value>
+	std::wstring UnsignedDeserializationError(Value &obj)
+	{
+		try
+		{
+			rjh::ForEachMember(obj, testObj, [](std::wstring_view key, auto &value)
+			{
+				unsigned int member = 0;
+				rjh::Deserialize(value, member, key);
+			});
+		}
+		catch (const rjh::DeserializationError &err)
+		{
+			return err.what;
+		}
+
+		return { };
+	}
+
+	rj::ParseErrorCode StreamParseError(const char *json)
+	{
+		rj::StringStream in(json);
+		StringReader reader(in);
+		try
+		{
+			rjh::ForEachMember(reader, testObj, [](std::wstring_view, auto &) { });
+		}
+		catch (const rjh::ParseError &err)
+		{
+			return err.code;
+		}
+
+		return rj::kParseErrorNone;
+	}
+
 	class SameString {
 		std::wstring_view m_MatchStr;
 
@@ -178,6 +217,17 @@ TEST(RapidJSONHelper_Serialize, WritesBool)
 	}
 }
 
+TEST(RapidJSONHelper_Serialize, WritesUnsigned)
+{
+	testing::InSequence s;
+
+	WriterMock mock;
+	EXPECT_CALL(mock, Key).With(SameString(testKey));
+	EXPECT_CALL(mock, Uint(16u));
+
+	rjh::Serialize(mock, 16u, testKey);
+}
+
 TEST(RapidJSONHelper_Serialize, WritesString)
 {
 	testing::InSequence s;
@@ -260,6 +310,31 @@ TEST(RapidJSONHelper_Deserialize, DeserializesBool)
 	}
 }
 
+TEST(RapidJSONHelper_Deserialize, DeserializesUnsigned)
+{
+	const rjh::value_t value(16u);
+	unsigned int member = 0;
+	rjh::Deserialize(value, member, testObj);
+	ASSERT_EQ(member, 16u);
+}
+
+TEST(RapidJSONHelper_Deserialize, ThrowsOnNegativeOrFractionalNumber)
+{
+	for (const auto &value : { rjh::value_t(-1), rjh::value_t(1.5) })
+	{
+		unsigned int member = 0;
+		try
+		{
+			rjh::Deserialize(value, member, testObj);
+			FAIL();
+		}
+		catch (const rjh::DeserializationError &err)
+		{
+			ASSERT_EQ(err.what, L"Found number that isn't a non-negative integer while deserializing key \"test object\"");
+		}
+	}
+}
+
 TEST(RapidJSONHelper_Deserialize, DeserializesEnum)
 {
 	for (const auto expected : { TestEnum::Foo, TestEnum::Bar, TestEnum::Buz, TestEnum::Quux })
@@ -306,3 +381,111 @@ TEST(RapidJSONHelper_Deserialize, DeserializesOptional)
 
 	ASSERT_TRUE(opt.value_or(false));
 }
+
+TEST(RapidJSONHelper_StreamReader, DeserializesMembers)
+{
+	rj::StringStream in(R"({ "bool": true, "unsigned": 16, "enum": "buz", "float": 1.5, "optional": false })");
+	StringReader reader(in);
+
+	bool boolMember = false;
+	unsigned int unsignedMember = 0;
+	TestEnum enumMember = TestEnum::Junk;
+	float floatMember = 0.0f;
+	std::optional<bool> optionalMember;
+	rjh::ForEachMember(reader, testObj, [&](std::wstring_view key, auto &value)
+	{
+		if (key == L"bool")
+		{
+			rjh::Deserialize(value, boolMember, key);
+		}
+		else if (key == L"unsigned")
+		{
+			rjh::Deserialize(value, unsignedMember, key);
+		}
+		else if (key == L"enum")
+		{
+			rjh::Deserialize(value, enumMember, key, testEnumNameMapping);
+		}
+		else if (key == L"float")
+		{
+			rjh::Deserialize(value, floatMember, key);
+		}
+		else if (key == L"optional")
+		{
+			rjh::Deserialize(value, optionalMember, key);
+		}
+	});
+
+	ASSERT_TRUE(boolMember);
+	ASSERT_EQ(unsignedMember, 16u);
+	ASSERT_EQ(enumMember, TestEnum::Buz);
+	ASSERT_EQ(floatMember, 1.5f);
+	ASSERT_EQ(optionalMember, false);
+}
+
+TEST(RapidJSONHelper_StreamReader, DeserializesArrays)
+{
+	rj::StringStream in(R"([ "foo", "bar" ])");
+	StringReader reader(in);
+
+	std::vector<std::wstring> elements;
+	rjh::ForEachElement(reader, testObj, [&elements](auto &value)
+	{
+		rjh::EnsureType(rj::Type::kStringType, value.GetType(), L"array element");
+		elements.emplace_back(rjh::ValueToStringView(value));
+	});
+
+	ASSERT_EQ(elements, (std::vector<std::wstring> { L"foo", L"bar" }));
+}
+
+TEST(RapidJSONHelper_StreamReader, SkipsUnreadMembers)
+{
+	rj::StringStream in(R"({ "skipped": { "a": [ 1, { "b": null } ], "c": "d" }, "read": "foo", "also_skipped": [] })");
+	StringReader reader(in);
+
+	std::vector<std::wstring> keys;
+	std::wstring read;
+	rjh::ForEachMember(reader, testObj, [&](std::wstring_view key, auto &value)
+	{
+		keys.emplace_back(key);
+		if (key == L"read")
+		{
+			read = rjh::ValueToStringView(value);
+		}
+	});
+
+	ASSERT_EQ(keys, (std::vector<std::wstring> { L"skipped", L"read", L"also_skipped" }));
+	ASSERT_EQ(read, L"foo");
+}
+
+TEST(RapidJSONHelper_StreamReader, ThrowsSameErrorsAsDocument)
+{
+	for (const char *json : { R"({ "test_key": -1 })", R"({ "test_key": 1.5 })", R"({ "test_key": "foo" })", R"({ "test_key": [] })", "[ 1 ]" })
+	{
+		rj::GenericDocument<rj::UTF16LE<>> doc;
+		doc.Parse<rj::kParseDefaultFlags, rj::UTF8<>>(json);
+		ASSERT_FALSE(doc.HasParseError());
+
+		rj::StringStream in(json);
+		StringReader reader(in);
+
+		const auto expected = UnsignedDeserializationError(doc);
+		ASSERT_FALSE(expected.empty());
+		ASSERT_EQ(UnsignedDeserializationError(reader), expected);
+	}
+}
+
+TEST(RapidJSONHelper_StreamReader, ThrowsOnMalformedDocument)
+{
+	ASSERT_EQ(StreamParseError(R"({ "test_key": tru })"), rj::kParseErrorValueInvalid);
+	ASSERT_EQ(StreamParseError(R"({ "test_key": true } })"), rj::kParseErrorDocumentRootNotSingular);
+	ASSERT_EQ(StreamParseError(R"({ "test_key": true)"), rj::kParseErrorObjectMissCommaOrCurlyBracket);
+}
+
+TEST(RapidJSONHelper_StreamReader, ReportsEmptyDocument)
+{
+	for (const char *json : { "", "  \n", "// comment\n", "/* comment */ // comment" })
+	{
+		ASSERT_EQ(StreamParseError(json), rj::kParseErrorDocumentEmpty);
+	}
+}
@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "config/ruledtaskbarappearance.hpp"
+
+namespace {
+	static constexpr unsigned int parseFlags = rj::kParseCommentsFlag | rj::kParseTrailingCommasFlag;
+
+	// Keeps track of the peak memory used by the parser stacks.
+	struct CountingAllocator {
+		static constexpr bool kNeedFree = true;
+
+		inline static std::size_t s_Current = 0;
+		inline static std::size_t s_Peak = 0;
+
+		static void ResetPeak() noexcept
+		{
+			s_Peak = s_Current;
+		}
+
+		void *Malloc(std::size_t size)
+		{
+			if (size == 0)
+			{
+				return nullptr;
+			}
+
+			const auto block = static_cast<char *>(std::malloc(sizeof(std::max_align_t) + size));
+			*reinterpret_cast<std::size_t *>(block) = size;
+
+			s_Current += size;
+			s_Peak = std::max(s_Peak, s_Current);
+			return block + sizeof(std::max_align_t);
+		}
+
+		void *Realloc(void *originalPtr, std::size_t originalSize, std::size_t newSize)
+		{
+			void *const newPtr = Malloc(newSize);
+			if (originalPtr && newPtr)
+			{
+				std::memcpy(newPtr, originalPtr, std::min(originalSize, newSize));
+			}
+
+			Free(originalPtr);
+			return newPtr;
+		}
+
+		static void Free(void *ptr) noexcept
+		{
+			if (ptr)
+			{
+				const auto block = static_cast<char *>(ptr) - sizeof(std::max_align_t);
+				s_Current -= *reinterpret_cast<std::size_t *>(block);
+				std::free(block);
+			}
+		}
+
+		bool operator ==(const CountingAllocator &) const noexcept { return true; }
+		bool operator !=(const CountingAllocator &) const noexcept { return false; }
+	};
+
+	using Document = rj::GenericDocument<rj::UTF16LE<>, rj::MemoryPoolAllocator<>, CountingAllocator>;
+	using Reader = rjh::StreamReader<rj::StringStream, rj::UTF8<>, parseFlags, CountingAllocator>;
+
+	std::size_t s_UnknownKeys = 0;
+
+	void CountUnknownKey(std::wstring_view) noexcept
+	{
+		++s_UnknownKeys;
+	}
+
+	void AppendRule(std::string &json, std::string_view key, std::size_t i)
+	{
+		static constexpr const char *accents[] = { "normal", "opaque", "clear", "blur", "acrylic" };
+
+		char color[16];
+		std::snprintf(color, std::size(color), "#%08X", static_cast<unsigned int>(i * 2654435761u));
+
+		json += "      \"";
+		json += key;
+		json += "\": { \"accent\": \"";
+		json += accents[i % std::size(accents)];
+		json += "\", \"color\": \"";
+		json += color;
+		json += "\", \"show_peek\": ";
+		json += i % 2 == 0 ? "true" : "false";
+		json += ", \"show_line\": ";
+		json += i % 3 == 0 ? "true" : "false";
+		json += ", \"blur_radius\": ";
+		json += std::to_string(i % 100);
+		json += ".5";
+		if (i % 4 == 0)
+		{
+			json += ", \"inactive\": { \"accent\": \"clear\", \"color\": \"#00000080\" }";
+		}
+
+		if (i % 10 == 0)
+		{
+			json += ", \"note\": [ \"not\", { \"a\": \"setting\" } ]";
+		}
+
+		json += " },\n";
+	}
+
+	// Half of the rules are class rules, the rest split between titles and files.
+	std::string GenerateConfig(std::size_t rules)
+	{
+		std::string json = "// generated\n{\n  \"enabled\": true,\n  \"accent\": \"acrylic\",\n  \"color\": \"#00000000\",\n  \"rules\": {\n";
+
+		const std::size_t classes = rules / 2;
+		const std::size_t titles = (rules - classes) / 2;
+
+		json += "    \"window_class\": {\n";
+		for (std::size_t i = 0; i < classes; ++i)
+		{
+			AppendRule(json, "Class_" + std::to_string(i), i);
+		}
+
+		json += "    },\n    \"window_title\": {\n";
+		for (std::size_t i = classes; i < classes + titles; ++i)
+		{
+			AppendRule(json, "Window title " + std::to_string(i), i);
+		}
+
+		json += "    },\n    \"process_name\": {\n";
+		for (std::size_t i = classes + titles; i < rules; ++i)
+		{
+			AppendRule(json, "app" + std::to_string(i) + ".exe", i);
+		}
+
+		json += "    }\n  }\n}\n";
+		return json;
+	}
+
+	void DeserializeDocument(const std::string &json, RuledTaskbarAppearance &appearance, std::size_t &peakMemory)
+	{
+		CountingAllocator::ResetPeak();
+
+		rj::StringStream in(json.c_str());
+		Document doc;
+		doc.ParseStream<parseFlags, rj::UTF8<>>(in);
+		ASSERT_FALSE(doc.HasParseError());
+
+		appearance.Deserialize(doc, CountUnknownKey);
+		peakMemory = CountingAllocator::s_Peak + doc.GetAllocator().Capacity();
+	}
+
+	void DeserializeStream(const std::string &json, RuledTaskbarAppearance &appearance, std::size_t &peakMemory)
+	{
+		CountingAllocator::ResetPeak();
+
+		rj::StringStream in(json.c_str());
+		Reader reader(in);
+
+		appearance.Deserialize(reader, CountUnknownKey);
+		peakMemory = CountingAllocator::s_Peak;
+	}
+
+	template<typename Map>
+	bool SameRules(const Map &expected, const Map &actual)
+	{
+		return expected.size() == actual.size() && std::ranges::all_of(expected, [&actual](const auto &rule)
+		{
+			const auto it = actual.find(rule.first);
+			return it != actual.end() &&
+				static_cast<const TaskbarAppearance &>(it->second) == rule.second &&
+				it->second.Inactive == rule.second.Inactive;
+		});
+	}
+}
+
+TEST(RuledTaskbarAppearance_Deserialize, StreamMatchesDocument)
+{
+	const auto json = GenerateConfig(1000);
+	std::size_t peakMemory = 0;
+
+	s_UnknownKeys = 0;
+	RuledTaskbarAppearance fromDocument;
+	DeserializeDocument(json, fromDocument, peakMemory);
+	const auto documentUnknownKeys = s_UnknownKeys;
+
+	s_UnknownKeys = 0;
+	RuledTaskbarAppearance fromStream;
+	DeserializeStream(json, fromStream, peakMemory);
+
+	ASSERT_EQ(documentUnknownKeys, 100u);
+	ASSERT_EQ(s_UnknownKeys, documentUnknownKeys);
+	ASSERT_EQ(fromStream.Enabled, fromDocument.Enabled);
+	ASSERT_TRUE(static_cast<const TaskbarAppearance &>(fromStream) == fromDocument);
+	ASSERT_EQ(fromStream.ClassRules.size(), 500u);
+	ASSERT_TRUE(SameRules(fromDocument.ClassRules, fromStream.ClassRules));
+	ASSERT_TRUE(SameRules(fromDocument.TitleRules(), fromStream.TitleRules()));
+	ASSERT_TRUE(SameRules(fromDocument.FileRules, fromStream.FileRules));
+}
+
+TEST(RuledTaskbarAppearance_Deserialize, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	constexpr int rounds = 10;
+	const auto json = GenerateConfig(10000);
+
+	const auto measure = [&json](auto deserialize, std::size_t &peakMemory)
+	{
+		const auto start = clock::now();
+		for (int i = 0; i < rounds; ++i)
+		{
+			RuledTaskbarAppearance appearance;
+			deserialize(json, appearance, peakMemory);
+		}
+
+		return static_cast<long long>(duration_cast<microseconds>(clock::now() - start).count() / rounds);
+	};
+
+	std::size_t documentMemory = 0, streamMemory = 0;
+	const auto document = measure(DeserializeDocument, documentMemory);
+	const auto stream = measure(DeserializeStream, streamMemory);
+
+	std::printf("[ CONFIG   ] 10000 rules, %zu KiB of JSON: document %lld us and %zu KiB peak, stream %lld us and %zu KiB peak\n",
+		json.size() / 1024, document, documentMemory / 1024, stream, streamMemory / 1024);
+
+	EXPECT_LT(streamMemory, documentMemory);
+}
@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/eventqueue.hpp"
+
+namespace {
+	using event_t = QueuedWinEvent<std::uintptr_t>;
+
+	// same values as the Windows headers
+	constexpr std::uint32_t CREATE = 0x8000;
+	constexpr std::uint32_t DESTROY = 0x8001;
+	constexpr std::uint32_t LOCATIONCHANGE = 0x800B;
+	constexpr std::uint32_t REORDER = 0x8004;
+
+	event_t Event(std::uint32_t event, std::uintptr_t window, std::uint32_t time = 0)
+	{
+		return { .Event = event, .Handle = window, .Time = time };
+	}
+
+	std::vector<std::uint32_t> Times(const std::vector<event_t> &events)
+	{
+		std::vector<std::uint32_t> times;
+		for (const auto &event : events)
+		{
+			times.push_back(event.Time);
+		}
+
+		return times;
+	}
+}
+
+TEST(EventQueue_Ring, TakesInOrder)
+{
+	EventQueue<int, 8> queue;
+	for (int i = 0; i < 5; ++i)
+	{
+		ASSERT_TRUE(queue.push(i));
+	}
+
+	ASSERT_EQ(queue.size(), 5u);
+
+	std::vector<int> out;
+	ASSERT_EQ(queue.take(out), 5u);
+	ASSERT_EQ(out, (std::vector<int> { 0, 1, 2, 3, 4 }));
+	ASSERT_TRUE(queue.empty());
+}
+
+TEST(EventQueue_Ring, WrapsAround)
+{
+	EventQueue<int, 4> queue;
+	std::vector<int> out;
+	for (int i = 0; i < 10; ++i)
+	{
+		ASSERT_TRUE(queue.push(2 * i));
+		ASSERT_TRUE(queue.push(2 * i + 1));
+		queue.take(out);
+	}
+
+	ASSERT_EQ(out.size(), 20u);
+	for (int i = 0; i < 20; ++i)
+	{
+		ASSERT_EQ(out[i], i);
+	}
+
+	ASSERT_EQ(queue.stats().MaxDepth, 2u);
+}
+
+TEST(EventQueue_Overflow, DropsWhenFull)
+{
+	EventQueue<int, 4> queue;
+	for (int i = 0; i < 6; ++i)
+	{
+		queue.push(i);
+	}
+
+	const auto stats = queue.stats();
+	ASSERT_EQ(stats.Received, 6u);
+	ASSERT_EQ(stats.Dropped, 2u);
+	ASSERT_EQ(stats.MaxDepth, 4u);
+
+	// the consumer is told once, and what's left is discarded
+	ASSERT_TRUE(queue.take_overflow());
+	ASSERT_TRUE(queue.empty());
+	ASSERT_FALSE(queue.take_overflow());
+	ASSERT_EQ(queue.stats().Overflows, 1u);
+
+	ASSERT_TRUE(queue.push(42));
+	std::vector<int> out;
+	queue.take(out);
+	ASSERT_EQ(out, (std::vector<int> { 42 }));
+}
+
+TEST(EventQueue_Ring, CrossThread)
+{
+	constexpr std::uint32_t count = 1000000;
+	EventQueue<std::uint32_t, 1024> queue;
+
+	std::jthread producer([&queue]
+	{
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			while (!queue.push(i))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	std::vector<std::uint32_t> out;
+	out.reserve(count);
+	while (out.size() < count)
+	{
+		if (queue.take(out) == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	producer.join();
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		ASSERT_EQ(out[i], i);
+	}
+}
+
+TEST(EventQueue_Coalesce, KeepsLastOfEachKindPerWindow)
+{
+	std::vector<event_t> events = {
+		Event(LOCATIONCHANGE, 1, 0),
+		Event(LOCATIONCHANGE, 2, 1),
+		Event(LOCATIONCHANGE, 1, 2),
+		Event(REORDER, 1, 3),
+		Event(LOCATIONCHANGE, 1, 4),
+		Event(LOCATIONCHANGE, 2, 5)
+	};
+
+	ASSERT_EQ(CoalesceWinEvents(events), 3u);
+	ASSERT_EQ(Times(events), (std::vector<std::uint32_t> { 3, 4, 5 }));
+}
+
+TEST(EventQueue_Coalesce, HandleReuseEndsCreated)
+{
+	// the handle of a destroyed window got reused: the last lifecycle event must win.
+	std::vector<event_t> events = {
+		Event(CREATE, 1, 0),
+		Event(DESTROY, 1, 1),
+		Event(CREATE, 1, 2)
+	};
+
+	ASSERT_EQ(CoalesceWinEvents(events), 1u);
+	ASSERT_EQ(events.back().Event, CREATE);
+	ASSERT_EQ(Times(events), (std::vector<std::uint32_t> { 1, 2 }));
+}
+
+TEST(EventQueue_Coalesce, RaisesKeepFinalZOrder)
+{
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<std::uintptr_t> window(1, 10);
+
+	std::vector<event_t> events;
+	for (std::uint32_t i = 0; i < 200; ++i)
+	{
+		events.push_back(Event(REORDER, window(rng), i));
+	}
+
+	// raising every window in turn puts the last raised on top
+	const auto stack = [](const std::vector<event_t> &raises)
+	{
+		std::vector<std::uintptr_t> order;
+		for (const auto &raise : raises)
+		{
+			std::erase(order, raise.Handle);
+			order.insert(order.begin(), raise.Handle);
+		}
+
+		return order;
+	};
+
+	const auto expected = stack(events);
+	CoalesceWinEvents(events);
+	ASSERT_LE(events.size(), 10u);
+	ASSERT_EQ(stack(events), expected);
+}
+
+TEST(EventQueue_Coalesce, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	// dragging a few windows around: mostly location changes, with the odd raise
+	constexpr std::size_t events = 200000;
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<std::uintptr_t> window(1, 8);
+	std::uniform_int_distribution<int> kind(0, 19);
+
+	std::vector<event_t> trace;
+	for (std::size_t i = 0; i < events; ++i)
+	{
+		trace.push_back(Event(kind(rng) == 0 ? REORDER : LOCATIONCHANGE, window(rng), static_cast<std::uint32_t>(i)));
+	}
+
+	for (const std::size_t perTurn : { 1, 4, 16, 64, 256 })
+	{
+		EventQueue<event_t, 4096> queue;
+		std::size_t dispatched = 0;
+		std::vector<event_t> batch;
+
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < trace.size(); i += perTurn)
+		{
+			for (std::size_t j = i; j < i + perTurn && j < trace.size(); ++j)
+			{
+				queue.push(trace[j]);
+			}
+
+			batch.clear();
+			queue.take(batch);
+			queue.count_coalesced(CoalesceWinEvents(batch));
+			dispatched += batch.size();
+		}
+		const auto elapsed = clock::now() - start;
+
+		ASSERT_EQ(queue.stats().Dropped, 0u);
+		ASSERT_EQ(queue.stats().Coalesced + dispatched, events);
+		std::printf("[ EVENTQ   ] %zu events per pump turn: %zu of %zu events dispatched, %lld ns/event queue overhead\n",
+			perTurn, dispatched, events,
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / events));
+	}
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/eventtrace.hpp"
+#include "tracegenerator.hpp"
+
+namespace {
+	std::vector<TraceRecord> ReadAll(std::span<const std::uint8_t> data)
+	{
+		std::vector<TraceRecord> records;
+		EventTraceReader reader(data);
+		while (auto record = reader.next())
+		{
+			records.push_back(std::move(*record));
+		}
+
+		return records;
+	}
+
+	struct FakeHandle { };
+}
+
+TEST(EventTrace_Writer, MapsHandlesToSequentialIds)
+{
+	EventTraceWriter writer;
+	FakeHandle a, b;
+
+	ASSERT_EQ(writer.window_id(&a), 1u);
+	ASSERT_EQ(writer.window_id(&b), 2u);
+	ASSERT_EQ(writer.window_id(&a), 1u);
+	ASSERT_EQ(writer.window_id(static_cast<FakeHandle *>(nullptr)), 0u);
+
+	// monitors are numbered independently
+	ASSERT_EQ(writer.monitor_id(&b), 1u);
+}
+
+TEST(EventTrace_Reader, RoundTripsRecords)
+{
+	TraceGenerator generator;
+	generator.Events = 5000;
+	const auto records = generator.records();
+
+	EventTraceWriter writer;
+	for (const auto &record : records)
+	{
+		writer.write(record);
+	}
+
+	ASSERT_EQ(writer.record_count(), records.size());
+	ASSERT_EQ(ReadAll(writer.data()), records);
+}
+
+TEST(EventTrace_Reader, TimesAreRelativeToFirstRecord)
+{
+	EventTraceWriter writer;
+	for (const std::uint32_t time : { 0xFFFFFFF0u, 0xFFFFFFFFu, 0x10u, 0x8u })
+	{
+		TraceRecord record;
+		record.Event = TraceEvent::Peek;
+		record.Time = time;
+		writer.write(record);
+	}
+
+	const auto records = ReadAll(writer.data());
+	ASSERT_EQ(records.size(), 4u);
+	ASSERT_EQ(records[0].Time, 0u);
+	ASSERT_EQ(records[1].Time, 0xFu);
+	ASSERT_EQ(records[2].Time, 0x20u);
+	ASSERT_EQ(records[3].Time, 0x18u);
+}
+
+TEST(EventTrace_Reader, IsCompact)
+{
+	TraceGenerator generator;
+	generator.Events = 10000;
+
+	// event, time delta, window id (up to two bytes), monitor and flags
+	ASSERT_LE(generator.trace().size(), generator.Events * 6u + generator.Windows * 5u + 64);
+}
+
+TEST(EventTrace_Reader, ThrowsOnBadMagic)
+{
+	const std::uint8_t data[] = { 'N', 'O', 'P', 'E', EventTraceWriter::VERSION };
+	ASSERT_THROW(EventTraceReader { data }, std::runtime_error);
+}
+
+TEST(EventTrace_Reader, ThrowsOnTruncatedTrace)
+{
+	EventTraceWriter writer;
+	TraceRecord record;
+	record.Event = TraceEvent::Show;
+	record.Window = { 1, 1, TraceWindowFlags::Valid };
+	writer.write(record);
+
+	const auto data = writer.data();
+	EventTraceReader reader(data.first(data.size() - 1));
+	ASSERT_THROW(reader.next(), std::runtime_error);
+}
+
+TEST(EventTrace_Reader, ThrowsOnUnknownEvent)
+{
+	EventTraceWriter writer;
+	std::vector<std::uint8_t> data(writer.data().begin(), writer.data().end());
+	data.push_back(static_cast<std::uint8_t>(TraceEvent::Max) + 1);
+	data.push_back(0);
+
+	EventTraceReader reader(data);
+	ASSERT_THROW(reader.next(), std::runtime_error);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+
+#include "../../TranslucentTB/taskbar/launchermonitorresolver.hpp"
+
+namespace {
+	using resolver_t = LauncherMonitorResolver<int>;
+	using clock = resolver_t::clock;
+	using namespace std::chrono_literals;
+}
+
+TEST(LauncherMonitorResolver_Guess, UsesFallbackFirst)
+{
+	resolver_t resolver;
+	const auto now = clock::now();
+
+	ASSERT_EQ(resolver.open(1, 0, now), 1);
+	ASSERT_TRUE(resolver.pending());
+
+	const auto resolution = resolver.resolve(1, now + 3ms);
+	ASSERT_TRUE(resolution.has_value());
+	ASSERT_FALSE(resolution->Corrected);
+	ASSERT_FALSE(resolver.pending());
+	ASSERT_EQ(resolver.stats().Hits, 1u);
+
+	// a right guess counts as no time at all
+	ASSERT_EQ(resolver.stats().Latency.max(), 0u);
+}
+
+TEST(LauncherMonitorResolver_Guess, UsesLastKnownMonitor)
+{
+	resolver_t resolver;
+	const auto now = clock::now();
+
+	resolver.open(1, 0, now);
+	resolver.resolve(2, now);
+
+	// the foreground window is still on monitor 1, but the launcher was last on 2
+	ASSERT_EQ(resolver.open(1, 0, now), 2);
+
+	resolver.forget();
+	resolver.cancel();
+	ASSERT_EQ(resolver.open(1, 0, now), 1);
+}
+
+TEST(LauncherMonitorResolver_Correction, RecordsLatency)
+{
+	resolver_t resolver;
+	const auto now = clock::now();
+
+	resolver.open(1, 0, now);
+	const auto resolution = resolver.resolve(2, now + 12ms);
+	ASSERT_TRUE(resolution.has_value());
+	ASSERT_TRUE(resolution->Corrected);
+	ASSERT_EQ(resolution->Guess, 1);
+	ASSERT_EQ(resolution->Actual, 2);
+
+	ASSERT_EQ(resolver.stats().Corrections, 1u);
+	ASSERT_EQ(resolver.stats().Latency.max(), 12000u);
+
+	// already resolved
+	ASSERT_FALSE(resolver.resolve(3, now + 20ms).has_value());
+}
+
+TEST(LauncherMonitorResolver_Correction, NullMonitorKeepsGuess)
+{
+	resolver_t resolver;
+	const auto now = clock::now();
+
+	resolver.open(1, 0, now);
+	const auto resolution = resolver.resolve(0, now);
+	ASSERT_TRUE(resolution.has_value());
+	ASSERT_FALSE(resolution->Corrected);
+	ASSERT_EQ(resolution->Actual, 1);
+}
+
+TEST(LauncherMonitorResolver_Events, AcceptsOnlyLaterEvents)
+{
+	resolver_t resolver;
+	ASSERT_FALSE(resolver.accepts(100));
+
+	resolver.open(1, 100, clock::now());
+	ASSERT_FALSE(resolver.accepts(99));
+	ASSERT_TRUE(resolver.accepts(100));
+	ASSERT_TRUE(resolver.accepts(150));
+
+	// tick count wrapped around
+	resolver.open(1, UINT32_MAX - 5, clock::now());
+	ASSERT_TRUE(resolver.accepts(3));
+	ASSERT_FALSE(resolver.accepts(UINT32_MAX - 10));
+}
+
+TEST(LauncherMonitorResolver_Events, CancelCountsAbandoned)
+{
+	resolver_t resolver;
+	resolver.cancel();
+	ASSERT_EQ(resolver.stats().Abandoned, 0u);
+
+	resolver.open(1, 0, clock::now());
+	resolver.cancel();
+	ASSERT_FALSE(resolver.pending());
+	ASSERT_FALSE(resolver.accepts(0));
+	ASSERT_EQ(resolver.stats().Abandoned, 1u);
+
+	// opened again before being resolved
+	resolver.open(1, 0, clock::now());
+	resolver.open(1, 0, clock::now());
+	ASSERT_EQ(resolver.stats().Abandoned, 2u);
+	ASSERT_EQ(resolver.stats().Latency.count(), 0u);
+}
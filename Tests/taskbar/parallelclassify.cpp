@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/parallelclassify.hpp"
+
+namespace {
+	std::vector<int> Items(int count)
+	{
+		std::vector<int> items;
+		for (int i = 0; i < count; ++i)
+		{
+			items.push_back(i);
+		}
+
+		return items;
+	}
+
+	// stands in for the cross-process calls made to classify a window
+	int SlowClassify(int item)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+		return item * 2;
+	}
+}
+
+TEST(ParallelClassify_Results, KeepItemOrder)
+{
+	const auto items = Items(1000);
+	const auto results = ParallelClassify<int>(items, 4, 16, [] { return 0; }, [](int, int item)
+	{
+		return item * 2;
+	});
+
+	ASSERT_EQ(results.size(), items.size());
+	for (std::size_t i = 0; i < items.size(); ++i)
+	{
+		ASSERT_EQ(results[i], items[i] * 2);
+	}
+}
+
+TEST(ParallelClassify_Threads, OneContextPerThread)
+{
+	std::atomic<int> contexts = 0;
+	const auto make_context = [&contexts]
+	{
+		++contexts;
+		return std::this_thread::get_id();
+	};
+
+	const auto results = ParallelClassify<std::thread::id>(Items(1000), 4, 16, make_context, [](std::thread::id context, int)
+	{
+		// every item is classified with the context of the thread doing it
+		EXPECT_EQ(context, std::this_thread::get_id());
+		return context;
+	});
+
+	ASSERT_EQ(contexts, 4);
+
+	// the calling thread only waits
+	ASSERT_EQ(std::find(results.begin(), results.end(), std::this_thread::get_id()), results.end());
+}
+
+TEST(ParallelClassify_Threads, FewItemsUseFewThreads)
+{
+	std::atomic<int> contexts = 0;
+	ParallelClassify<int>(Items(40), 4, 16, [&contexts] { return ++contexts; }, [](int, int item) { return item; });
+	ASSERT_EQ(contexts, 2);
+
+	contexts = 0;
+	ParallelClassify<int>(Items(3), 4, 16, [&contexts] { return ++contexts; }, [](int, int item) { return item; });
+	ASSERT_EQ(contexts, 1);
+
+	contexts = 0;
+	ASSERT_TRUE(ParallelClassify<int>(Items(0), 4, 16, [&contexts] { return ++contexts; }, [](int, int item) { return item; }).empty());
+}
+
+TEST(ParallelClassify_Threads, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	// a busy desktop
+	const auto items = Items(400);
+
+	const auto serialStart = clock::now();
+	std::vector<int> serial;
+	for (const int item : items)
+	{
+		serial.push_back(SlowClassify(item));
+	}
+	const auto serialTime = clock::now() - serialStart;
+
+	const auto parallelStart = clock::now();
+	const auto parallel = ParallelClassify<int>(items, 4, 32, [] { return 0; }, [](int, int item)
+	{
+		return SlowClassify(item);
+	});
+	const auto parallelTime = clock::now() - parallelStart;
+
+	ASSERT_EQ(parallel, serial);
+
+	std::printf("[ CLASSIFY ] %zu windows: serial %lld us, 4 threads %lld us\n",
+		items.size(),
+		static_cast<long long>(duration_cast<microseconds>(serialTime).count()),
+		static_cast<long long>(duration_cast<microseconds>(parallelTime).count()));
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include "../../TranslucentTB/windows/processimagecache.hpp"
+
+namespace {
+	// the handle stands for the process, 0 being one that exited
+	using Cache = BasicProcessImageCache<int>;
+
+	bool Running(int process) noexcept
+	{
+		return process != 0;
+	}
+}
+
+TEST(ProcessImageCache_Image, PrecomputesFileName)
+{
+	const ProcessImage image(L"C:/Program Files/App/app.exe");
+	ASSERT_EQ(image.FileName, L"app.exe");
+}
+
+TEST(ProcessImageCache_Find, IgnoresExitedProcesses)
+{
+	Cache cache(8);
+	cache.insert(1234, 0, ProcessImage(L"C:/old.exe"));
+	ASSERT_EQ(cache.find(1234, Running), nullptr);
+
+	// the process ID got reused
+	cache.insert(1234, 1, ProcessImage(L"C:/new.exe"));
+	ASSERT_EQ(cache.find(1234, Running)->FileName, L"new.exe");
+	ASSERT_EQ(cache.size(), 1u);
+
+	ASSERT_EQ(cache.stats().Hits, 1u);
+	ASSERT_EQ(cache.stats().Misses, 1u);
+}
+
+TEST(ProcessImageCache_Insert, EvictsLeastRecentlyUsed)
+{
+	Cache cache(2);
+	cache.insert(1, 1, ProcessImage(L"C:/one.exe"));
+	cache.insert(2, 1, ProcessImage(L"C:/two.exe"));
+	cache.find(1, Running); // 2 is now the oldest
+	cache.insert(3, 1, ProcessImage(L"C:/three.exe"));
+
+	ASSERT_EQ(cache.size(), 2u);
+	ASSERT_NE(cache.find(1, Running), nullptr);
+	ASSERT_EQ(cache.find(2, Running), nullptr);
+	ASSERT_NE(cache.find(3, Running), nullptr);
+	ASSERT_EQ(cache.stats().Evictions, 1u);
+}
+
+TEST(ProcessImageCache_Capacity, ShrinkingEvicts)
+{
+	Cache cache(4);
+	for (std::uint32_t i = 0; i < 4; ++i)
+	{
+		cache.insert(i, 1, ProcessImage(L"C:/app.exe"));
+	}
+
+	cache.set_capacity(1);
+	ASSERT_EQ(cache.size(), 1u);
+	ASSERT_NE(cache.find(3, Running), nullptr);
+}
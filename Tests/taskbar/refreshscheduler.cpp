@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/refreshscheduler.hpp"
+#include "replayengine.hpp"
+#include "tracegenerator.hpp"
+
+namespace {
+	using scheduler_t = RefreshScheduler<int>;
+	const scheduler_t::time_point epoch { };
+}
+
+TEST(RefreshScheduler_Mark, ReturnsTrueOnlyForFirstOfBatch)
+{
+	scheduler_t scheduler;
+	ASSERT_TRUE(scheduler.mark(1, epoch));
+	ASSERT_FALSE(scheduler.mark(2, epoch));
+	ASSERT_FALSE(scheduler.mark(1, epoch));
+
+	scheduler.take(std::nullopt, epoch);
+	ASSERT_TRUE(scheduler.mark(2, epoch));
+}
+
+TEST(RefreshScheduler_Take, CoalescesMonitors)
+{
+	scheduler_t scheduler;
+	for (int i = 0; i < 50; ++i)
+	{
+		scheduler.mark(i % 2, epoch);
+	}
+
+	ASSERT_EQ(scheduler.take(std::nullopt, epoch), (std::vector<int> { 0, 1 }));
+	ASSERT_FALSE(scheduler.pending());
+	ASSERT_TRUE(scheduler.take(std::nullopt, epoch).empty());
+
+	ASSERT_EQ(scheduler.counters().Requests, 50u);
+	ASSERT_EQ(scheduler.counters().Flushes, 1u);
+}
+
+TEST(RefreshScheduler_Take, MovesLastMonitorToEnd)
+{
+	scheduler_t scheduler;
+	scheduler.mark(1, epoch);
+	scheduler.mark(2, epoch);
+	scheduler.mark(3, epoch);
+
+	ASSERT_EQ(scheduler.take(1, epoch), (std::vector<int> { 2, 3, 1 }));
+}
+
+TEST(RefreshScheduler_Overdue, RespectsMaximumLatency)
+{
+	using namespace std::chrono_literals;
+
+	scheduler_t unbounded;
+	unbounded.mark(1, epoch);
+	ASSERT_FALSE(unbounded.overdue(epoch + 1h));
+
+	scheduler_t bounded(10ms);
+	ASSERT_FALSE(bounded.overdue(epoch + 1h));
+
+	bounded.mark(1, epoch);
+	bounded.mark(2, epoch + 5ms);
+	ASSERT_FALSE(bounded.overdue(epoch + 9ms));
+	ASSERT_TRUE(bounded.overdue(epoch + 10ms));
+
+	bounded.take(std::nullopt, epoch + 10ms);
+	ASSERT_EQ(bounded.counters().Overdue, 1u);
+	ASSERT_FALSE(bounded.overdue(epoch + 1h));
+}
+
+TEST(RefreshScheduler_Replay, ReducesAttributeApplications)
+{
+	TraceGenerator generator;
+	generator.Events = 20000;
+	const auto trace = generator.trace();
+
+	ReplayEngine immediate;
+	immediate.replay(trace);
+
+	ReplayEngine coalesced({ .Coalesce = true });
+	coalesced.replay(trace);
+
+	ASSERT_LT(coalesced.stats().Refreshes, immediate.stats().Refreshes / 2);
+	ASSERT_EQ(coalesced.scheduler_counters().Applications, coalesced.stats().Refreshes);
+
+	// both must land on the same appearance in the end
+	for (std::uint32_t monitor = 1; monitor <= generator.Monitors; ++monitor)
+	{
+		ASSERT_EQ(coalesced.appearance(monitor), immediate.appearance(monitor));
+	}
+}
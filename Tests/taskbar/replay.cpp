@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+
+#include "replayengine.hpp"
+#include "tracegenerator.hpp"
+
+namespace {
+	TraceRecord WindowEvent(TraceEvent event, std::uint32_t id, std::uint32_t monitor, std::uint8_t flags = TraceWindowFlags::Valid | TraceWindowFlags::Matches)
+	{
+		TraceRecord record;
+		record.Event = event;
+		record.Window = { id, monitor, flags };
+		return record;
+	}
+
+	TraceRecord TwoMonitorReset()
+	{
+		TraceRecord reset;
+		reset.Event = TraceEvent::Reset;
+		reset.Taskbars = { { 1, 1 }, { 2, 2 } };
+		return reset;
+	}
+
+	void PrintStats(const char *name, const ReplayStats &stats)
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::nanoseconds;
+
+		std::printf("[ REPLAY   ] %s: %llu events, %.0f events/s, %.3f refreshes/event, latency p50 %lld ns, p99 %lld ns, max %lld ns\n",
+			name,
+			static_cast<unsigned long long>(stats.Events),
+			stats.events_per_second(),
+			stats.refreshes_per_event(),
+			static_cast<long long>(stats.latency_percentile(50).count()),
+			static_cast<long long>(stats.latency_percentile(99).count()),
+			static_cast<long long>(stats.latency_percentile(100).count()));
+	}
+}
+
+TEST(Taskbar_Replay, MaximisedWindowChangesAppearance)
+{
+	ReplayEngine engine;
+	engine.replay(TwoMonitorReset());
+	ASSERT_EQ(engine.appearance(1), AppearanceState::Desktop);
+	ASSERT_EQ(engine.appearance(2), AppearanceState::Desktop);
+
+	engine.replay(WindowEvent(TraceEvent::Show, 3, 2, TraceWindowFlags::Valid | TraceWindowFlags::Matches | TraceWindowFlags::Maximised));
+	ASSERT_EQ(engine.appearance(1), AppearanceState::Desktop);
+	ASSERT_EQ(engine.appearance(2), AppearanceState::MaximisedWindow);
+
+	engine.replay(WindowEvent(TraceEvent::MinimizeStart, 3, 2));
+	ASSERT_EQ(engine.appearance(2), AppearanceState::Desktop);
+}
+
+TEST(Taskbar_Replay, WindowMovesBetweenMonitors)
+{
+	ReplayEngine engine;
+	engine.replay(TwoMonitorReset());
+
+	engine.replay(WindowEvent(TraceEvent::Show, 3, 1));
+	ASSERT_EQ(engine.appearance(1), AppearanceState::VisibleWindow);
+
+	engine.replay(WindowEvent(TraceEvent::LocationChange, 3, 2));
+	ASSERT_EQ(engine.appearance(1), AppearanceState::Desktop);
+	ASSERT_EQ(engine.appearance(2), AppearanceState::VisibleWindow);
+
+	ASSERT_FALSE(engine.tracker().find(1)->second.NormalWindows.contains(3));
+	ASSERT_TRUE(engine.tracker().find(2)->second.NormalWindows.contains(3));
+}
+
+TEST(Taskbar_Replay, IgnoresFilteredAndCoreWindows)
+{
+	ReplayEngine engine;
+	engine.replay(TwoMonitorReset());
+
+	engine.replay(WindowEvent(TraceEvent::Show, 3, 1, TraceWindowFlags::Valid));
+	engine.replay(WindowEvent(TraceEvent::Show, 4, 1, TraceWindowFlags::Valid | TraceWindowFlags::Matches | TraceWindowFlags::CoreWindow));
+	ASSERT_EQ(engine.appearance(1), AppearanceState::Desktop);
+}
+
+TEST(Taskbar_Replay, DestroyRemovesWindow)
+{
+	ReplayEngine engine;
+	engine.replay(TwoMonitorReset());
+
+	engine.replay(WindowEvent(TraceEvent::Create, 3, 1));
+	ASSERT_EQ(engine.appearance(1), AppearanceState::VisibleWindow);
+
+	// destroyed windows carry no information
+	engine.replay(WindowEvent(TraceEvent::Destroy, 3, 0, 0));
+	ASSERT_EQ(engine.appearance(1), AppearanceState::Desktop);
+}
+
+TEST(Taskbar_Replay, StartOpenedOnMonitor)
+{
+	ReplayEngine engine;
+	engine.replay(TwoMonitorReset());
+
+	TraceRecord start;
+	start.Event = TraceEvent::StartVisibility;
+	start.Window.Monitor = 2;
+	start.State = true;
+	engine.replay(start);
+	ASSERT_EQ(engine.appearance(1), AppearanceState::Desktop);
+	ASSERT_EQ(engine.appearance(2), AppearanceState::StartOpened);
+
+	start.State = false;
+	start.Window.Monitor = 0;
+	engine.replay(start);
+	ASSERT_EQ(engine.appearance(2), AppearanceState::Desktop);
+}
+
+TEST(Taskbar_Replay, TaskViewRefreshesAllMonitors)
+{
+	ReplayEngine engine;
+	engine.replay(TwoMonitorReset());
+	const auto refreshes = engine.stats().Refreshes;
+
+	TraceRecord taskView;
+	taskView.Event = TraceEvent::TaskViewVisibility;
+	taskView.State = true;
+	engine.replay(taskView);
+
+	ASSERT_EQ(engine.stats().Refreshes - refreshes, 2u);
+	ASSERT_EQ(engine.appearance(1), AppearanceState::TaskViewOpened);
+	ASSERT_EQ(engine.appearance(2), AppearanceState::TaskViewOpened);
+}
+
+TEST(Taskbar_Replay, IsDeterministic)
+{
+	TraceGenerator generator;
+	generator.Events = 20000;
+	const auto trace = generator.trace();
+
+	ReplayEngine first, second;
+	first.replay(trace);
+	second.replay(trace);
+
+	ASSERT_EQ(first.stats().Events, second.stats().Events);
+	ASSERT_EQ(first.stats().Refreshes, second.stats().Refreshes);
+	for (std::uint32_t monitor = 1; monitor <= generator.Monitors; ++monitor)
+	{
+		ASSERT_EQ(first.appearance(monitor), second.appearance(monitor));
+	}
+}
+
+TEST(Taskbar_Replay, IndexedZOrderAgreesWithWalk)
+{
+	constexpr std::uint8_t maximised = TraceWindowFlags::Valid | TraceWindowFlags::Matches | TraceWindowFlags::Maximised;
+
+	TraceRecord reset = TwoMonitorReset();
+	reset.Windows = { { 3, 1, maximised }, { 4, 1, maximised }, { 5, 2, maximised }, { 6, 1 } };
+
+	const std::vector<TraceRecord> trace {
+		reset,
+		WindowEvent(TraceEvent::Foreground, 4, 1),
+		WindowEvent(TraceEvent::Foreground, 6, 1),
+		WindowEvent(TraceEvent::Reorder, 3, 1, maximised),
+		WindowEvent(TraceEvent::LocationChange, 4, 2, maximised),
+		WindowEvent(TraceEvent::Foreground, 7, 2, maximised),
+		WindowEvent(TraceEvent::Show, 7, 2, maximised),
+		WindowEvent(TraceEvent::Destroy, 7, 2),
+		WindowEvent(TraceEvent::Destroy, 3, 1),
+		WindowEvent(TraceEvent::MinimizeStart, 4, 2),
+	};
+
+	ReplayEngine walk({ .MaximisedHasRules = true });
+	ReplayEngine indexed({ .MaximisedHasRules = true, .IndexedZOrder = true });
+	for (const auto &record : trace)
+	{
+		walk.replay(record);
+		indexed.replay(record);
+
+		ASSERT_EQ(indexed.top_maximised(1), walk.top_maximised(1));
+		ASSERT_EQ(indexed.top_maximised(2), walk.top_maximised(2));
+	}
+
+	ASSERT_EQ(indexed.top_maximised(2), 5u);
+}
+
+TEST(Taskbar_Replay, DISABLED_Benchmark)
+{
+	TraceGenerator generator;
+	const auto trace = generator.trace();
+
+	ReplayEngine engine;
+	engine.replay(trace);
+	ASSERT_EQ(engine.stats().Events, generator.Events + 1);
+	PrintStats("window storm", engine.stats());
+
+	ReplayEngine rules({ .MaximisedHasRules = true });
+	rules.replay(trace);
+	PrintStats("window storm, maximised rules", rules.stats());
+
+	ReplayEngine indexed({ .MaximisedHasRules = true, .IndexedZOrder = true });
+	indexed.replay(trace);
+	PrintStats("window storm, maximised rules, z-order index", indexed.stats());
+	std::printf("[ REPLAY   ] z-order steps: walk %llu, index %llu\n",
+		static_cast<unsigned long long>(rules.stats().ZOrderSteps),
+		static_cast<unsigned long long>(indexed.stats().ZOrderSteps));
+
+	ReplayEngine coalesced({ .Coalesce = true });
+	coalesced.replay(trace);
+	PrintStats("window storm, coalesced", coalesced.stats());
+}
@@ -0,0 +1,508 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/appearancestate.hpp"
+#include "../../TranslucentTB/taskbar/eventtrace.hpp"
+#include "../../TranslucentTB/taskbar/refreshscheduler.hpp"
+#include "../../TranslucentTB/taskbar/windowtracker.hpp"
+#include "../../TranslucentTB/taskbar/zorderindex.hpp"
+
+// Scripted stand-in for the Win32 window manager: it only knows what the trace told it.
+class FakeWindowSystem {
+	std::unordered_map<std::uint32_t, TraceWindow> m_Windows;
+	std::list<std::uint32_t> m_ZOrder; // front is the top
+	std::unordered_map<std::uint32_t, std::list<std::uint32_t>::iterator> m_ZOrderPosition;
+
+public:
+	void clear()
+	{
+		m_Windows.clear();
+		m_ZOrder.clear();
+		m_ZOrderPosition.clear();
+	}
+
+	void update(const TraceWindow &window)
+	{
+		m_Windows.insert_or_assign(window.Id, window);
+		if (!m_ZOrderPosition.contains(window.Id))
+		{
+			m_ZOrderPosition.emplace(window.Id, m_ZOrder.insert(m_ZOrder.end(), window.Id));
+		}
+	}
+
+	void bring_to_top(std::uint32_t id)
+	{
+		if (const auto it = m_ZOrderPosition.find(id); it != m_ZOrderPosition.end())
+		{
+			m_ZOrder.splice(m_ZOrder.begin(), m_ZOrder, it->second);
+		}
+	}
+
+	void destroy(std::uint32_t id)
+	{
+		m_Windows.erase(id);
+		if (const auto it = m_ZOrderPosition.find(id); it != m_ZOrderPosition.end())
+		{
+			m_ZOrder.erase(it->second);
+			m_ZOrderPosition.erase(it);
+		}
+	}
+
+	TraceWindow get(std::uint32_t id) const
+	{
+		if (const auto it = m_Windows.find(id); it != m_Windows.end())
+		{
+			return it->second;
+		}
+		else
+		{
+			return { id };
+		}
+	}
+
+	const std::list<std::uint32_t> &z_order() const noexcept
+	{
+		return m_ZOrder;
+	}
+};
+
+struct ReplayOptions {
+	// mask of AppearanceStateBit, by default everything except battery saver (like the default config)
+	std::uint8_t EnabledStates = static_cast<std::uint8_t>(~AppearanceStateBit(AppearanceState::BatterySaver));
+
+	// when the maximised appearance has rules, the worker needs the top maximised window
+	bool MaximisedHasRules = false;
+
+	// find it with the z-order index like the worker does, instead of walking the whole z-order
+	bool IndexedZOrder = false;
+
+	// batch refreshes like the worker does. events sharing a timestamp are considered
+	// to be handled in the same message pump turn.
+	bool Coalesce = false;
+};
+
+struct ReplayStats {
+	std::uint64_t Events = 0;
+	std::uint64_t Resets = 0;
+	std::uint64_t Refreshes = 0;
+	std::uint64_t ZOrderSteps = 0;
+	std::chrono::nanoseconds Elapsed { };
+
+	// time between an event being dispatched and the last appearance decision it caused,
+	// for every event that caused at least one decision.
+	std::vector<std::chrono::nanoseconds> Latencies;
+
+	double events_per_second() const noexcept
+	{
+		const auto seconds = std::chrono::duration<double>(Elapsed).count();
+		return seconds > 0 ? Events / seconds : 0;
+	}
+
+	double refreshes_per_event() const noexcept
+	{
+		return Events ? static_cast<double>(Refreshes) / Events : 0;
+	}
+
+	std::chrono::nanoseconds latency_percentile(double percentile) const
+	{
+		if (Latencies.empty())
+		{
+			return { };
+		}
+
+		auto sorted = Latencies;
+		const auto index = std::min(static_cast<std::size_t>(percentile / 100.0 * sorted.size()), sorted.size() - 1);
+		std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		return sorted[index];
+	}
+};
+
+// Drives the worker's bookkeeping and appearance decision logic from a recorded trace.
+// The event handling mirrors the callbacks of TaskbarAttributeWorker.
+class ReplayEngine {
+	template<bool doRefresh>
+	struct Listener {
+		ReplayEngine &engine;
+
+		void inserted(WindowState state, std::uint32_t window, std::uint32_t monitor)
+		{
+			if (state == WindowState::Maximised)
+			{
+				engine.m_MaximisedZOrder.insert(window, monitor);
+			}
+		}
+
+		void removed(WindowState state, std::uint32_t window, std::uint32_t monitor)
+		{
+			if (state == WindowState::Maximised)
+			{
+				engine.m_MaximisedZOrder.remove(window, monitor);
+			}
+		}
+
+		template<typename It>
+		void refresh(It it)
+		{
+			if constexpr (doRefresh)
+			{
+				engine.Refresh(it);
+			}
+		}
+	};
+
+	using tracker_t = WindowTracker<std::uint32_t, std::uint32_t, std::uint32_t>;
+
+	ReplayOptions m_Options;
+	FakeWindowSystem m_System;
+	tracker_t m_Tracker;
+	ZOrderIndex<std::uint32_t, std::uint32_t> m_MaximisedZOrder;
+	std::unordered_map<std::uint32_t, std::uint32_t> m_TopMaximised;
+	AppearanceInputs<std::uint32_t> m_Inputs;
+	std::uint32_t m_ForegroundWindow = 0;
+	std::unordered_map<std::uint32_t, AppearanceState> m_Appearances;
+
+	RefreshScheduler<std::uint32_t> m_Scheduler;
+	std::optional<std::uint32_t> m_LastTime;
+
+	ReplayStats m_Stats;
+	std::chrono::steady_clock::time_point m_LastDecision;
+
+	void Refresh(tracker_t::iterator it)
+	{
+		if (m_Options.Coalesce)
+		{
+			m_Scheduler.mark(it->first);
+		}
+		else
+		{
+			Apply(it);
+		}
+	}
+
+	void Apply(tracker_t::iterator it)
+	{
+		const auto &info = it->second;
+		auto state = ResolveAppearanceState(m_Inputs, m_Options.EnabledStates, it->first, !info.MaximisedWindows.empty(), !info.NormalWindows.empty());
+
+		if (state == AppearanceState::MaximisedWindow && m_Options.MaximisedHasRules)
+		{
+			std::uint32_t top = 0;
+			if (m_Options.IndexedZOrder)
+			{
+				++m_Stats.ZOrderSteps;
+				top = m_MaximisedZOrder.top(it->first).value_or(0);
+			}
+			else
+			{
+				for (const std::uint32_t window : m_System.z_order())
+				{
+					++m_Stats.ZOrderSteps;
+					if (info.MaximisedWindows.contains(window))
+					{
+						top = window;
+						break;
+					}
+				}
+			}
+
+			m_TopMaximised.insert_or_assign(it->first, top);
+		}
+
+		m_Appearances.insert_or_assign(it->first, state);
+		++m_Stats.Refreshes;
+		m_LastDecision = std::chrono::steady_clock::now();
+	}
+
+	void RefreshAll()
+	{
+		for (auto it = m_Tracker.begin(); it != m_Tracker.end(); ++it)
+		{
+			Refresh(it);
+		}
+	}
+
+	void RefreshMonitor(std::uint32_t monitor)
+	{
+		if (const auto it = m_Tracker.find(monitor); it != m_Tracker.end())
+		{
+			Refresh(it);
+		}
+	}
+
+	template<bool refresh = true>
+	void Insert(const TraceWindow &window)
+	{
+		if (window.has(TraceWindowFlags::CoreWindow))
+		{
+			return;
+		}
+
+		WindowState state = WindowState::None;
+		if (window.has(TraceWindowFlags::Matches))
+		{
+			if (window.has(TraceWindowFlags::Maximised))
+			{
+				state = WindowState::Maximised;
+			}
+			else if (!window.has(TraceWindowFlags::Minimised))
+			{
+				state = WindowState::Normal;
+			}
+		}
+
+		m_Tracker.place(window.Id, window.Monitor, state, Listener<refresh> { *this });
+	}
+
+	void Reset(const TraceRecord &record)
+	{
+		++m_Stats.Resets;
+
+		m_System.clear();
+		m_Tracker.clear();
+		m_MaximisedZOrder.clear();
+		m_Scheduler.clear();
+		m_Inputs = {
+			.PowerSaver = (record.GlobalFlags & TraceGlobalFlags::PowerSaver) != 0,
+			.TaskViewActive = (record.GlobalFlags & TraceGlobalFlags::TaskViewActive) != 0,
+			.PeekActive = (record.GlobalFlags & TraceGlobalFlags::PeekActive) != 0,
+			.IsWindows11 = (record.GlobalFlags & TraceGlobalFlags::Windows11) != 0,
+			.StartMonitor = record.StartMonitor,
+			.SearchMonitor = record.SearchMonitor,
+			.FindInStartMonitor = record.FindInStartMonitor
+		};
+		m_ForegroundWindow = record.Window.Id;
+
+		for (const auto &taskbar : record.Taskbars)
+		{
+			m_Tracker.insert_taskbar(taskbar.Monitor, taskbar.Id);
+		}
+
+		// enumeration order is the z-order
+		for (const auto &window : record.Windows)
+		{
+			m_System.update(window);
+		}
+
+		for (const auto &window : record.Windows)
+		{
+			Insert<false>(window);
+		}
+
+		const std::vector<std::uint32_t> zOrder(m_System.z_order().begin(), m_System.z_order().end());
+		m_MaximisedZOrder.reorder(zOrder);
+
+		RefreshAll();
+	}
+
+	bool IsTaskbar(std::uint32_t id) const
+	{
+		return std::any_of(m_Tracker.begin(), m_Tracker.end(), [id](const auto &entry)
+		{
+			return entry.second.Taskbar == id;
+		});
+	}
+
+	void Dispatch(const TraceRecord &record)
+	{
+		const auto &window = record.Window;
+		if (record.is_window_event() && record.Event != TraceEvent::Destroy && window.has(TraceWindowFlags::Valid))
+		{
+			m_System.update(window);
+		}
+
+		switch (record.Event)
+		{
+		case TraceEvent::Reset:
+			Reset(record);
+			break;
+
+		case TraceEvent::Create:
+			// taskbar creation makes the worker reset, which is its own record.
+			if (window.has(TraceWindowFlags::Valid) && !window.has(TraceWindowFlags::Taskbar))
+			{
+				Insert(window);
+			}
+			break;
+
+		case TraceEvent::Destroy:
+			m_System.destroy(window.Id);
+			if (!IsTaskbar(window.Id))
+			{
+				m_Tracker.remove(window.Id, Listener<true> { *this });
+			}
+			break;
+
+		case TraceEvent::Show:
+		case TraceEvent::Uncloak:
+		case TraceEvent::MinimizeEnd:
+		case TraceEvent::LocationChange:
+		case TraceEvent::NameChange:
+		case TraceEvent::ParentChange:
+			if (window.has(TraceWindowFlags::Valid))
+			{
+				Insert(window);
+			}
+			break;
+
+		case TraceEvent::Hide:
+		case TraceEvent::Cloak:
+		case TraceEvent::MinimizeStart:
+			m_Tracker.remove(window.Id, Listener<true> { *this });
+			break;
+
+		case TraceEvent::Foreground:
+		{
+			const auto oldMonitor = m_System.get(m_ForegroundWindow).Monitor;
+			m_ForegroundWindow = window.has(TraceWindowFlags::Valid) ? window.Id : 0;
+			m_System.bring_to_top(m_ForegroundWindow);
+			m_MaximisedZOrder.raise(m_ForegroundWindow);
+
+			if (oldMonitor)
+			{
+				RefreshMonitor(oldMonitor);
+			}
+
+			if (m_ForegroundWindow && window.Monitor != oldMonitor)
+			{
+				RefreshMonitor(window.Monitor);
+			}
+			break;
+		}
+
+		case TraceEvent::Reorder:
+			if (window.has(TraceWindowFlags::Valid))
+			{
+				m_System.bring_to_top(window.Id);
+				m_MaximisedZOrder.raise(window.Id);
+				RefreshMonitor(window.Monitor);
+			}
+			break;
+
+		case TraceEvent::StartVisibility:
+		case TraceEvent::SearchVisibility:
+		case TraceEvent::FindInStartVisibility:
+		{
+			auto &current = record.Event == TraceEvent::StartVisibility ? m_Inputs.StartMonitor :
+				record.Event == TraceEvent::SearchVisibility ? m_Inputs.SearchMonitor : m_Inputs.FindInStartMonitor;
+
+			const auto monitor = record.State ? window.Monitor : current;
+			current = record.State ? window.Monitor : 0;
+			RefreshMonitor(monitor);
+			break;
+		}
+
+		case TraceEvent::TaskViewVisibility:
+			m_Inputs.TaskViewActive = record.State;
+			RefreshAll();
+			break;
+
+		case TraceEvent::Peek:
+			m_Inputs.PeekActive = record.State;
+			RefreshAll();
+			break;
+
+		case TraceEvent::PowerSaver:
+			m_Inputs.PowerSaver = record.State;
+			RefreshAll();
+			break;
+		}
+	}
+
+public:
+	explicit ReplayEngine(ReplayOptions options = { }) : m_Options(options) { }
+
+	void replay(const TraceRecord &record)
+	{
+		const auto refreshes = m_Stats.Refreshes;
+		const auto start = std::chrono::steady_clock::now();
+
+		if (m_LastTime && *m_LastTime != record.Time)
+		{
+			flush();
+		}
+
+		m_LastTime = record.Time;
+		m_Scheduler.count_event();
+		Dispatch(record);
+
+		const auto end = std::chrono::steady_clock::now();
+		++m_Stats.Events;
+		m_Stats.Elapsed += end - start;
+		if (m_Stats.Refreshes != refreshes)
+		{
+			m_Stats.Latencies.push_back(m_LastDecision - start);
+		}
+	}
+
+	void replay(std::span<const std::uint8_t> trace)
+	{
+		EventTraceReader reader(trace);
+		while (const auto record = reader.next())
+		{
+			replay(*record);
+		}
+
+		flush();
+	}
+
+	// Applies the refreshes batched so far, when coalescing.
+	void flush()
+	{
+		for (const std::uint32_t monitor : m_Scheduler.take())
+		{
+			if (const auto it = m_Tracker.find(monitor); it != m_Tracker.end())
+			{
+				m_Scheduler.count_application();
+				Apply(it);
+			}
+		}
+	}
+
+	const RefreshScheduler<std::uint32_t>::Counters &scheduler_counters() const noexcept
+	{
+		return m_Scheduler.counters();
+	}
+
+	const ReplayStats &stats() const noexcept
+	{
+		return m_Stats;
+	}
+
+	// Appearance last decided for the taskbar on that monitor.
+	std::optional<AppearanceState> appearance(std::uint32_t monitor) const
+	{
+		if (const auto it = m_Appearances.find(monitor); it != m_Appearances.end())
+		{
+			return it->second;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+	}
+
+	// Topmost maximised window found by the last maximised appearance decision on that monitor, 0 if none.
+	std::optional<std::uint32_t> top_maximised(std::uint32_t monitor) const
+	{
+		if (const auto it = m_TopMaximised.find(monitor); it != m_TopMaximised.end())
+		{
+			return it->second;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+	}
+
+	const tracker_t &tracker() const noexcept
+	{
+		return m_Tracker;
+	}
+};
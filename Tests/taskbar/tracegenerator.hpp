@@ -0,0 +1,136 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/eventtrace.hpp"
+
+// Generates a reproducible window storm, similar to what IDEs and browsers produce:
+// mostly location, title and z-order changes on a handful of busy windows.
+struct TraceGenerator {
+	std::uint32_t Monitors = 2;
+	std::uint32_t Windows = 300;
+	std::uint32_t Events = 100000;
+	std::uint32_t Seed = 42;
+
+	std::vector<TraceRecord> records() const
+	{
+		std::mt19937 rng(Seed);
+		std::vector<TraceRecord> records;
+		records.reserve(Events + 1);
+
+		const auto randomWindow = [this, &rng](std::uint32_t id)
+		{
+			TraceWindow window { id, std::uniform_int_distribution<std::uint32_t>(1, Monitors)(rng), TraceWindowFlags::Valid };
+			const auto kind = std::uniform_int_distribution<int>(0, 9)(rng);
+			if (kind < 6)
+			{
+				window.Flags |= TraceWindowFlags::Matches;
+			}
+
+			if (kind < 2)
+			{
+				window.Flags |= TraceWindowFlags::Maximised;
+			}
+			else if (kind == 5)
+			{
+				window.Flags |= TraceWindowFlags::Minimised;
+			}
+
+			return window;
+		};
+
+		// taskbars get the first ids, windows the following ones.
+		const std::uint32_t firstWindow = Monitors + 1;
+		std::uint32_t nextWindow = firstWindow + Windows;
+
+		TraceRecord &reset = records.emplace_back();
+		reset.Event = TraceEvent::Reset;
+		for (std::uint32_t i = 0; i < Monitors; ++i)
+		{
+			reset.Taskbars.push_back({ i + 1, i + 1 });
+		}
+
+		for (std::uint32_t id = firstWindow; id < nextWindow; ++id)
+		{
+			reset.Windows.push_back(randomWindow(id));
+		}
+
+		reset.Window = reset.Windows.front();
+
+		// a few windows get the vast majority of the events.
+		std::uniform_int_distribution<std::uint32_t> busyWindow(firstWindow, firstWindow + 9);
+		std::uniform_int_distribution<int> percent(0, 99);
+		std::uint32_t time = 0;
+		for (std::uint32_t i = 0; i < Events; ++i)
+		{
+			TraceRecord &record = records.emplace_back();
+			time += percent(rng) < 90 ? 0 : 1;
+			record.Time = time;
+
+			const std::uint32_t id = percent(rng) < 80 ? busyWindow(rng) : std::uniform_int_distribution<std::uint32_t>(firstWindow, nextWindow - 1)(rng);
+			record.Window = randomWindow(id);
+
+			const int roll = percent(rng);
+			if (roll < 40)
+			{
+				record.Event = TraceEvent::LocationChange;
+			}
+			else if (roll < 55)
+			{
+				record.Event = TraceEvent::NameChange;
+			}
+			else if (roll < 65)
+			{
+				record.Event = TraceEvent::Reorder;
+			}
+			else if (roll < 72)
+			{
+				record.Event = TraceEvent::Foreground;
+			}
+			else if (roll < 80)
+			{
+				record.Event = roll % 2 ? TraceEvent::Show : TraceEvent::Hide;
+			}
+			else if (roll < 85)
+			{
+				record.Event = roll % 2 ? TraceEvent::MinimizeStart : TraceEvent::MinimizeEnd;
+			}
+			else if (roll < 90)
+			{
+				record.Event = roll % 2 ? TraceEvent::Cloak : TraceEvent::Uncloak;
+			}
+			else if (roll < 95)
+			{
+				record.Event = TraceEvent::Create;
+				record.Window = randomWindow(nextWindow++);
+			}
+			else if (roll < 99)
+			{
+				record.Event = TraceEvent::Destroy;
+				record.Window = { id };
+			}
+			else
+			{
+				record.Event = TraceEvent::StartVisibility;
+				record.Window = { 0, std::uniform_int_distribution<std::uint32_t>(1, Monitors)(rng) };
+				record.State = percent(rng) < 50;
+			}
+		}
+
+		return records;
+	}
+
+	std::vector<std::uint8_t> trace() const
+	{
+		EventTraceWriter writer;
+		for (const auto &record : records())
+		{
+			writer.write(record);
+		}
+
+		const auto data = writer.data();
+		return { data.begin(), data.end() };
+	}
+};
@@ -0,0 +1,298 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../../TranslucentTB/windows/windowidentitycache.hpp"
+
+namespace {
+	// Stands in for the Win32 queries, counting how often each of them runs.
+	struct FakeBackend {
+		std::uint64_t ClassQueries = 0;
+		std::uint64_t TitleQueries = 0;
+		std::uint64_t FileQueries = 0;
+		std::uint32_t TitleGeneration = 0;
+	};
+
+	struct FakeWindow {
+		std::uint32_t Id;
+		FakeBackend *Backend;
+
+		bool operator ==(const FakeWindow &other) const noexcept { return Id == other.Id; }
+
+		std::optional<std::wstring> classname() const
+		{
+			++Backend->ClassQueries;
+			if (Id == 0)
+			{
+				return std::nullopt;
+			}
+
+			return L"WindowClass" + std::to_wstring(Id % 16);
+		}
+
+		std::optional<std::wstring> title() const
+		{
+			++Backend->TitleQueries;
+			return L"Window " + std::to_wstring(Id) + L" - revision " + std::to_wstring(Backend->TitleGeneration);
+		}
+
+		std::optional<std::wstring> filename() const
+		{
+			++Backend->FileQueries;
+			return L"program" + std::to_wstring(Id % 8) + L".exe";
+		}
+
+		bool active() const noexcept { return false; }
+	};
+
+	using cache_t = WindowIdentityCache<FakeWindow>;
+
+	// Same lookup order as the window filter.
+	template<typename T>
+	bool IsFiltered(const T &window, const std::unordered_set<std::wstring> &classes, const std::unordered_set<std::wstring> &files, const std::wstring &title)
+	{
+		if (const auto className = window.classname(); className && classes.contains(*className))
+		{
+			return true;
+		}
+
+		if (const auto fileName = window.filename(); fileName && files.contains(*fileName))
+		{
+			return true;
+		}
+
+		const auto windowTitle = window.title();
+		return windowTitle && windowTitle->find(title) != std::wstring::npos;
+	}
+}
+
+template<>
+struct std::hash<FakeWindow> {
+	std::size_t operator()(const FakeWindow &window) const noexcept
+	{
+		return std::hash<std::uint32_t>{}(window.Id);
+	}
+};
+
+TEST(WindowIdentityCache_Lookup, QueriesOncePerWindow)
+{
+	FakeBackend backend;
+	cache_t cache;
+	const FakeWindow window { 1, &backend };
+
+	for (int i = 0; i < 10; ++i)
+	{
+		ASSERT_EQ(*cache.classname(window), L"WindowClass1");
+		ASSERT_EQ(*cache.filename(window), L"program1.exe");
+		ASSERT_EQ(*cache.title(window), L"Window 1 - revision 0");
+	}
+
+	ASSERT_EQ(backend.ClassQueries, 1u);
+	ASSERT_EQ(backend.FileQueries, 1u);
+	ASSERT_EQ(backend.TitleQueries, 1u);
+	ASSERT_EQ(cache.stats().Misses, 3u);
+	ASSERT_EQ(cache.stats().Hits, 27u);
+}
+
+TEST(WindowIdentityCache_Lookup, RemembersFailures)
+{
+	FakeBackend backend;
+	cache_t cache;
+	const FakeWindow window { 0, &backend };
+
+	ASSERT_EQ(cache.classname(window), nullptr);
+	ASSERT_EQ(cache.classname(window), nullptr);
+	ASSERT_EQ(backend.ClassQueries, 1u);
+}
+
+TEST(WindowIdentityCache_Lookup, InternsSharedNames)
+{
+	FakeBackend backend;
+	cache_t cache;
+
+	const auto first = cache.classname({ 1, &backend });
+	const auto second = cache.classname({ 17, &backend });
+	ASSERT_EQ(first, second);
+	ASSERT_EQ(cache.interned_size(), 1u);
+}
+
+TEST(WindowIdentityCache_Invalidation, TitleChangeRequeriesOnlyTitle)
+{
+	FakeBackend backend;
+	cache_t cache;
+	const FakeWindow window { 1, &backend };
+
+	cache.classname(window);
+	cache.title(window);
+
+	++backend.TitleGeneration;
+	ASSERT_EQ(*cache.title(window), L"Window 1 - revision 0");
+
+	cache.invalidate_title(window);
+	ASSERT_EQ(*cache.title(window), L"Window 1 - revision 1");
+	cache.classname(window);
+
+	ASSERT_EQ(backend.TitleQueries, 2u);
+	ASSERT_EQ(backend.ClassQueries, 1u);
+	ASSERT_EQ(cache.stats().Invalidations, 1u);
+}
+
+TEST(WindowIdentityCache_Invalidation, EraseForgetsWindow)
+{
+	FakeBackend backend;
+	cache_t cache;
+	const FakeWindow window { 1, &backend };
+
+	cache.classname(window);
+	cache.erase(window);
+	ASSERT_EQ(cache.size(), 0u);
+
+	cache.classname(window);
+	ASSERT_EQ(backend.ClassQueries, 2u);
+}
+
+TEST(WindowIdentityCache_Prime, CarriesOverWithoutQuerying)
+{
+	FakeBackend backend;
+	cache_t lookups, owner;
+	const FakeWindow window { 1, &backend };
+	const FakeWindow failing { 0, &backend };
+
+	lookups.classname(window);
+	lookups.title(window);
+	lookups.classname(failing);
+
+	owner.prime(window, lookups.snapshot(window));
+	owner.prime(failing, lookups.snapshot(failing));
+	ASSERT_EQ(backend.ClassQueries, 2u);
+	ASSERT_EQ(backend.TitleQueries, 1u);
+
+	ASSERT_EQ(*owner.classname(window), L"WindowClass1");
+	ASSERT_EQ(*owner.title(window), L"Window 1 - revision 0");
+	ASSERT_EQ(owner.classname(failing), nullptr);
+	ASSERT_EQ(backend.ClassQueries, 2u);
+	ASSERT_EQ(backend.TitleQueries, 1u);
+
+	// the file name wasn't looked up, so it still has to be
+	ASSERT_EQ(*owner.filename(window), L"program1.exe");
+	ASSERT_EQ(backend.FileQueries, 1u);
+}
+
+TEST(WindowIdentityCache_Prime, KeepsWhatIsKnown)
+{
+	FakeBackend backend;
+	cache_t lookups, owner;
+	const FakeWindow window { 1, &backend };
+
+	lookups.title(window);
+	++backend.TitleGeneration;
+	owner.title(window);
+
+	owner.prime(window, lookups.snapshot(window));
+	ASSERT_EQ(*owner.title(window), L"Window 1 - revision 1");
+
+	owner.invalidate_title(window);
+	owner.prime(window, lookups.snapshot(window));
+	ASSERT_EQ(*owner.title(window), L"Window 1 - revision 0");
+	ASSERT_EQ(backend.TitleQueries, 2u);
+}
+
+TEST(WindowIdentityCache_Prime, EmptySnapshotAddsNothing)
+{
+	FakeBackend backend;
+	cache_t lookups, owner;
+	const FakeWindow window { 1, &backend };
+
+	owner.prime(window, lookups.snapshot(window));
+	ASSERT_EQ(owner.size(), 0u);
+}
+
+TEST(WindowIdentityCache_Eviction, EvictsLeastRecentlyUsed)
+{
+	FakeBackend backend;
+	cache_t cache(2);
+
+	cache.classname({ 1, &backend });
+	cache.classname({ 2, &backend });
+	cache.classname({ 1, &backend }); // 2 is now the oldest
+	cache.classname({ 3, &backend });
+
+	ASSERT_EQ(cache.size(), 2u);
+	ASSERT_EQ(cache.stats().Evictions, 1u);
+
+	cache.classname({ 1, &backend });
+	ASSERT_EQ(backend.ClassQueries, 3u);
+
+	cache.classname({ 2, &backend });
+	ASSERT_EQ(backend.ClassQueries, 4u);
+}
+
+TEST(WindowIdentityCache_Eviction, BoundsInternedNames)
+{
+	FakeBackend backend;
+	cache_t cache(1024, 4);
+
+	for (std::uint32_t i = 1; i <= 32; ++i)
+	{
+		cache.filename({ i, &backend });
+		ASSERT_LE(cache.interned_size(), 4u);
+	}
+}
+
+TEST(WindowIdentityCache_Benchmark, DISABLED_FilterLookups)
+{
+	using clock = std::chrono::steady_clock;
+
+	const std::unordered_set<std::wstring> classes { L"WindowClass3", L"WindowClass7" };
+	const std::unordered_set<std::wstring> files { L"program5.exe" };
+	const std::wstring title = L"never matches";
+
+	// a few hot windows get most of the events, like the worker sees during a drag
+	std::mt19937 rng(42);
+	std::discrete_distribution<int> hot { 90, 10 };
+	std::uniform_int_distribution<std::uint32_t> hotWindow(1, 20), coldWindow(21, 400);
+	std::vector<std::uint32_t> ids(200000);
+	for (auto &id : ids)
+	{
+		id = hot(rng) == 0 ? hotWindow(rng) : coldWindow(rng);
+	}
+
+	FakeBackend uncachedBackend;
+	std::uint64_t uncachedMatches = 0;
+	const auto uncachedStart = clock::now();
+	for (const auto id : ids)
+	{
+		uncachedMatches += IsFiltered(FakeWindow { id, &uncachedBackend }, classes, files, title);
+	}
+	const auto uncachedTime = clock::now() - uncachedStart;
+
+	FakeBackend cachedBackend;
+	cache_t cache(256);
+	std::uint64_t cachedMatches = 0;
+	const auto cachedStart = clock::now();
+	for (const auto id : ids)
+	{
+		cachedMatches += IsFiltered(cache[FakeWindow { id, &cachedBackend }], classes, files, title);
+	}
+	const auto cachedTime = clock::now() - cachedStart;
+
+	ASSERT_EQ(cachedMatches, uncachedMatches);
+	ASSERT_LT(cachedBackend.ClassQueries, uncachedBackend.ClassQueries / 4);
+	ASSERT_GT(cache.stats().hit_rate(), 0.75);
+
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+	std::printf("[ IDENTITY ] %zu lookups: uncached %lld ns/lookup, cached %lld ns/lookup, hit rate %.1f%%, %llu backend queries instead of %llu\n",
+		ids.size(),
+		static_cast<long long>(duration_cast<nanoseconds>(uncachedTime).count() / static_cast<long long>(ids.size())),
+		static_cast<long long>(duration_cast<nanoseconds>(cachedTime).count() / static_cast<long long>(ids.size())),
+		cache.stats().hit_rate() * 100.0,
+		static_cast<unsigned long long>(cachedBackend.ClassQueries + cachedBackend.FileQueries + cachedBackend.TitleQueries),
+		static_cast<unsigned long long>(uncachedBackend.ClassQueries + uncachedBackend.FileQueries + uncachedBackend.TitleQueries));
+}
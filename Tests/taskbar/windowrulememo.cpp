@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <optional>
+
+#include "../../TranslucentTB/taskbar/windowrulememo.hpp"
+
+namespace {
+	using memo_t = WindowRuleMemo<int, int, 2>;
+}
+
+TEST(WindowRuleMemo_Lookup, ComputesOnce)
+{
+	memo_t memo;
+	int computed = 0;
+	const auto compute = [&computed]
+	{
+		++computed;
+		return std::optional<int> { 42 };
+	};
+
+	ASSERT_EQ(memo.rule(0, 1, compute), 42);
+	ASSERT_EQ(memo.rule(0, 1, compute), 42);
+	ASSERT_EQ(computed, 1);
+
+	// rule sets are independent
+	memo.rule(1, 1, compute);
+	ASSERT_EQ(computed, 2);
+
+	ASSERT_EQ(memo.stats().Hits, 1u);
+	ASSERT_EQ(memo.stats().Misses, 2u);
+}
+
+TEST(WindowRuleMemo_Lookup, RemembersMissingRule)
+{
+	memo_t memo;
+	int computed = 0;
+	const auto compute = [&computed]
+	{
+		++computed;
+		return std::optional<int> { };
+	};
+
+	ASSERT_FALSE(memo.rule(0, 1, compute).has_value());
+	ASSERT_FALSE(memo.rule(0, 1, compute).has_value());
+	ASSERT_EQ(computed, 1);
+}
+
+TEST(WindowRuleMemo_Invalidation, NewGenerationForgetsEverything)
+{
+	memo_t memo;
+	memo.sync(1);
+
+	bool filtered = true;
+	ASSERT_TRUE(memo.filtered(1, [&filtered] { return filtered; }));
+
+	filtered = false;
+	memo.sync(1);
+	ASSERT_TRUE(memo.filtered(1, [&filtered] { return filtered; }));
+
+	memo.sync(2);
+	ASSERT_FALSE(memo.filtered(1, [&filtered] { return filtered; }));
+	ASSERT_EQ(memo.stats().Invalidations, 1u);
+}
+
+TEST(WindowRuleMemo_Invalidation, EraseForgetsWindow)
+{
+	memo_t memo;
+	int computed = 0;
+	const auto compute = [&computed]
+	{
+		++computed;
+		return false;
+	};
+
+	memo.filtered(1, compute);
+	memo.filtered(2, compute);
+	memo.erase(1);
+	memo.filtered(1, compute);
+	memo.filtered(2, compute);
+
+	ASSERT_EQ(computed, 3);
+}
+
+TEST(WindowRuleMemo_Capacity, StaysBounded)
+{
+	memo_t memo(4);
+	for (int i = 0; i < 100; ++i)
+	{
+		memo.filtered(i, [] { return false; });
+		ASSERT_LE(memo.size(), 4u);
+	}
+}
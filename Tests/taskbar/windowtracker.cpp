@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/windowtracker.hpp"
+
+namespace {
+	using tracker_t = WindowTracker<int, int, int>;
+
+	struct RecordingListener {
+		std::vector<int> Inserted;
+		std::vector<int> Removed;
+		std::vector<int> Refreshed;
+
+		void inserted(WindowState, int window, int) { Inserted.push_back(window); }
+		void removed(WindowState, int window, int) { Removed.push_back(window); }
+		void refresh(tracker_t::iterator it) { Refreshed.push_back(it->first); }
+	};
+
+	struct NullListener {
+		void inserted(WindowState, int, int) noexcept { }
+		void removed(WindowState, int, int) noexcept { }
+		void refresh(tracker_t::iterator) noexcept { }
+	};
+
+	// What the tracker used to do: erase the window from the sets of every monitor on every event.
+	struct ScanningTracker {
+		struct Sets {
+			std::unordered_set<int> MaximisedWindows;
+			std::unordered_set<int> NormalWindows;
+		};
+
+		std::unordered_map<int, Sets> Monitors;
+
+		void place(int window, int mon, WindowState state)
+		{
+			for (auto &[id, sets] : Monitors)
+			{
+				sets.MaximisedWindows.erase(window);
+				sets.NormalWindows.erase(window);
+				if (state != WindowState::None && id == mon)
+				{
+					(state == WindowState::Maximised ? sets.MaximisedWindows : sets.NormalWindows).insert(window);
+				}
+			}
+		}
+	};
+
+	bool SameWindows(const tracker_t::window_set &windows, const std::unordered_set<int> &expected)
+	{
+		return windows.size() == expected.size() && std::all_of(expected.begin(), expected.end(), [&windows](int window)
+		{
+			return windows.contains(window);
+		});
+	}
+
+	tracker_t TwoMonitors()
+	{
+		tracker_t tracker;
+		tracker.insert_taskbar(1, 100);
+		tracker.insert_taskbar(2, 200);
+		return tracker;
+	}
+}
+
+TEST(WindowTracker_Index, PlaceAndLocate)
+{
+	auto tracker = TwoMonitors();
+	RecordingListener listener;
+
+	tracker.place(5, 1, WindowState::Normal, listener);
+	ASSERT_TRUE(tracker.find(1)->second.NormalWindows.contains(5));
+	ASSERT_EQ(tracker.locate(5)->Mon, 1);
+	ASSERT_EQ(tracker.locate(5)->State, WindowState::Normal);
+	ASSERT_FALSE(tracker.locate(6).has_value());
+
+	tracker.place(5, 1, WindowState::Maximised, listener);
+	ASSERT_FALSE(tracker.find(1)->second.NormalWindows.contains(5));
+	ASSERT_TRUE(tracker.find(1)->second.MaximisedWindows.contains(5));
+	ASSERT_EQ(tracker.locate(5)->State, WindowState::Maximised);
+	ASSERT_EQ(tracker.window_count(), 1u);
+
+	ASSERT_EQ(listener.Inserted, (std::vector<int> { 5, 5 }));
+	ASSERT_EQ(listener.Removed, (std::vector<int> { 5 }));
+	ASSERT_EQ(listener.Refreshed, (std::vector<int> { 1, 1 }));
+}
+
+TEST(WindowTracker_Index, MoveRefreshesBothMonitors)
+{
+	auto tracker = TwoMonitors();
+	NullListener setup;
+	tracker.place(5, 1, WindowState::Maximised, setup);
+
+	RecordingListener listener;
+	tracker.place(5, 2, WindowState::Maximised, listener);
+
+	ASSERT_TRUE(tracker.find(1)->second.MaximisedWindows.empty());
+	ASSERT_TRUE(tracker.find(2)->second.MaximisedWindows.contains(5));
+	ASSERT_EQ(tracker.locate(5)->Mon, 2);
+	ASSERT_EQ(listener.Refreshed, (std::vector<int> { 1, 2 }));
+}
+
+TEST(WindowTracker_Index, RemoveOnlyTouchesItsMonitor)
+{
+	auto tracker = TwoMonitors();
+	NullListener setup;
+	tracker.place(5, 2, WindowState::Normal, setup);
+
+	RecordingListener listener;
+	ASSERT_FALSE(tracker.remove(5, tracker.find(1), listener));
+	ASSERT_TRUE(listener.Refreshed.empty());
+
+	ASSERT_TRUE(tracker.remove(5, listener));
+	ASSERT_FALSE(tracker.remove(5, listener));
+	ASSERT_EQ(listener.Refreshed, (std::vector<int> { 2 }));
+	ASSERT_EQ(tracker.window_count(), 0u);
+}
+
+TEST(WindowTracker_Index, UntrackedStateOrMonitorRemoves)
+{
+	auto tracker = TwoMonitors();
+	NullListener listener;
+
+	tracker.place(5, 1, WindowState::Normal, listener);
+	tracker.place(5, 1, WindowState::None, listener);
+	ASSERT_FALSE(tracker.locate(5).has_value());
+
+	// no taskbar on monitor 3
+	tracker.place(5, 1, WindowState::Normal, listener);
+	tracker.place(5, 3, WindowState::Normal, listener);
+	ASSERT_FALSE(tracker.locate(5).has_value());
+	ASSERT_TRUE(tracker.find(1)->second.NormalWindows.empty());
+}
+
+TEST(WindowTracker_Index, ReplacingTaskbarForgetsItsWindows)
+{
+	auto tracker = TwoMonitors();
+	NullListener listener;
+	tracker.place(5, 1, WindowState::Normal, listener);
+	tracker.place(6, 2, WindowState::Normal, listener);
+
+	tracker.insert_taskbar(1, 101);
+	ASSERT_FALSE(tracker.locate(5).has_value());
+	ASSERT_TRUE(tracker.locate(6).has_value());
+}
+
+TEST(WindowTracker_Taskbars, ReplaceKeepsWindowsOfRemainingMonitors)
+{
+	auto tracker = TwoMonitors();
+	NullListener setup;
+	tracker.place(5, 1, WindowState::Normal, setup);
+	tracker.place(6, 2, WindowState::Maximised, setup);
+
+	RecordingListener listener;
+	std::vector<std::pair<int, int>> taskbars { { 2, 201 }, { 3, 300 } };
+	tracker.replace_taskbars(taskbars, listener);
+
+	ASSERT_EQ(tracker.size(), 2u);
+	ASSERT_EQ(tracker.find(2)->second.Taskbar, 201);
+	ASSERT_EQ(tracker.find(3)->second.Taskbar, 300);
+	ASSERT_EQ(tracker.find(1), tracker.end());
+
+	// monitor 1 went away with its window, monitor 2 kept its own
+	ASSERT_FALSE(tracker.locate(5).has_value());
+	ASSERT_EQ(tracker.locate(6)->Mon, 2);
+	ASSERT_TRUE(tracker.find(2)->second.MaximisedWindows.contains(6));
+	ASSERT_EQ(listener.Removed, (std::vector<int> { 5 }));
+	ASSERT_TRUE(listener.Refreshed.empty());
+
+	// still usable afterwards
+	tracker.place(5, 3, WindowState::Normal, listener);
+	ASSERT_EQ(tracker.locate(5)->Mon, 3);
+}
+
+TEST(WindowTracker_Index, AgreesWithScanningTracker)
+{
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> window(1, 200);
+	std::uniform_int_distribution<int> monitor(1, 5); // 5 has no taskbar
+	std::uniform_int_distribution<int> state(0, 2);
+
+	tracker_t tracker;
+	ScanningTracker scanning;
+	for (int mon = 1; mon <= 4; ++mon)
+	{
+		tracker.insert_taskbar(mon, mon);
+		scanning.Monitors[mon];
+	}
+
+	NullListener listener;
+	for (int i = 0; i < 20000; ++i)
+	{
+		const int w = window(rng), mon = monitor(rng);
+		const auto s = static_cast<WindowState>(state(rng));
+		tracker.place(w, mon, s, listener);
+		scanning.place(w, mon, s);
+	}
+
+	for (int mon = 1; mon <= 4; ++mon)
+	{
+		ASSERT_TRUE(SameWindows(tracker.find(mon)->second.MaximisedWindows, scanning.Monitors[mon].MaximisedWindows));
+		ASSERT_TRUE(SameWindows(tracker.find(mon)->second.NormalWindows, scanning.Monitors[mon].NormalWindows));
+	}
+}
+
+TEST(WindowTracker_Index, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	constexpr int events = 200000;
+	for (const int monitors : { 1, 2, 4, 8, 16 })
+	{
+		std::mt19937 rng(42);
+		std::uniform_int_distribution<int> window(1, 300);
+		std::uniform_int_distribution<int> monitor(1, monitors);
+		std::uniform_int_distribution<int> state(0, 2);
+
+		std::vector<std::tuple<int, int, WindowState>> trace;
+		for (int i = 0; i < events; ++i)
+		{
+			trace.emplace_back(window(rng), monitor(rng), static_cast<WindowState>(state(rng)));
+		}
+
+		tracker_t tracker;
+		ScanningTracker scanning;
+		for (int mon = 1; mon <= monitors; ++mon)
+		{
+			tracker.insert_taskbar(mon, mon);
+			scanning.Monitors[mon];
+		}
+
+		const auto scanningStart = clock::now();
+		for (const auto &[w, mon, s] : trace)
+		{
+			scanning.place(w, mon, s);
+		}
+		const auto scanningTime = clock::now() - scanningStart;
+
+		NullListener listener;
+		const auto indexedStart = clock::now();
+		for (const auto &[w, mon, s] : trace)
+		{
+			tracker.place(w, mon, s, listener);
+		}
+		const auto indexedTime = clock::now() - indexedStart;
+
+		std::printf("[ TRACKER  ] %d monitors: scanning %lld ns/event, indexed %lld ns/event\n",
+			monitors,
+			static_cast<long long>(duration_cast<nanoseconds>(scanningTime).count() / events),
+			static_cast<long long>(duration_cast<nanoseconds>(indexedTime).count() / events));
+	}
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "../../TranslucentTB/taskbar/workermetrics.hpp"
+
+namespace {
+	// something that looks like the cheapest callbacks: a few hash lookups worth of work
+	std::uint64_t Work(std::uint64_t seed)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		}
+
+		return seed;
+	}
+
+	std::uint64_t Callback(WorkerMetrics &metrics, std::uint64_t seed)
+	{
+		metrics.count(TraceEvent::LocationChange);
+		const auto timer = metrics.time(WorkerMetrics::Timer::StateChange);
+		return Work(seed);
+	}
+}
+
+TEST(WorkerMetrics_Disabled, RecordsNothing)
+{
+	WorkerMetrics metrics;
+	metrics.count(TraceEvent::Show);
+	metrics.count(WorkerMetrics::Counter::Refreshes);
+	{
+		const auto timer = metrics.time(WorkerMetrics::Timer::GetConfig);
+	}
+
+	ASSERT_EQ(metrics.events(TraceEvent::Show), 0u);
+	ASSERT_EQ(metrics.counter_value(WorkerMetrics::Counter::Refreshes), 0u);
+	ASSERT_EQ(metrics.latency(WorkerMetrics::Timer::GetConfig).count(), 0u);
+}
+
+// A timer started while disabled doesn't touch the histograms, even if metrics get enabled
+// before it stops: that's what keeps the disabled path down to a branch.
+TEST(WorkerMetrics_Disabled, TimersRecordNothing)
+{
+	WorkerMetrics metrics;
+	for (std::size_t i = 0; i < WorkerMetrics::TIMER_COUNT; ++i)
+	{
+		const auto timer = metrics.time(static_cast<WorkerMetrics::Timer>(i));
+		metrics.count(static_cast<TraceEvent>(i % WorkerMetrics::EVENT_COUNT));
+	}
+
+	{
+		const auto timer = metrics.time(WorkerMetrics::Timer::SetAttribute);
+		metrics.enable(true);
+	}
+
+	for (std::size_t i = 0; i < WorkerMetrics::TIMER_COUNT; ++i)
+	{
+		ASSERT_EQ(metrics.latency(static_cast<WorkerMetrics::Timer>(i)).count(), 0u) << i;
+	}
+
+	for (std::size_t i = 0; i < WorkerMetrics::EVENT_COUNT; ++i)
+	{
+		ASSERT_EQ(metrics.events(static_cast<TraceEvent>(i)), 0u) << i;
+	}
+}
+
+TEST(WorkerMetrics_Enabled, CountsAndTimes)
+{
+	WorkerMetrics metrics;
+	metrics.enable(true);
+
+	metrics.count(TraceEvent::Show);
+	metrics.count(TraceEvent::Show);
+	metrics.count(TraceEvent::Peek);
+	metrics.count(WorkerMetrics::Counter::ExplorerRestarts);
+	{
+		const auto timer = metrics.time(WorkerMetrics::Timer::SetAttribute);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	ASSERT_EQ(metrics.events(TraceEvent::Show), 2u);
+	ASSERT_EQ(metrics.events(TraceEvent::Peek), 1u);
+	ASSERT_EQ(metrics.events(TraceEvent::Hide), 0u);
+	ASSERT_EQ(metrics.counter_value(WorkerMetrics::Counter::ExplorerRestarts), 1u);
+
+	const auto &latency = metrics.latency(WorkerMetrics::Timer::SetAttribute);
+	ASSERT_EQ(latency.count(), 1u);
+	ASSERT_GE(latency.max(), 1000000u);
+
+	// disabling keeps what was collected until cleared
+	metrics.enable(false);
+	ASSERT_EQ(metrics.events(TraceEvent::Show), 2u);
+	metrics.clear();
+	ASSERT_EQ(metrics.events(TraceEvent::Show), 0u);
+	ASSERT_EQ(metrics.latency(WorkerMetrics::Timer::SetAttribute).count(), 0u);
+}
+
+TEST(WorkerMetrics_Export, Json)
+{
+	WorkerMetrics metrics;
+	metrics.enable(true);
+	metrics.count(TraceEvent::Foreground);
+	metrics.count(WorkerMetrics::Counter::FullResets);
+	metrics.record(WorkerMetrics::Timer::GetConfig, std::chrono::nanoseconds(1500));
+
+	const auto json = metrics.to_json();
+	ASSERT_EQ(json.front(), '{');
+	ASSERT_EQ(json.back(), '}');
+	ASSERT_NE(json.find("\"foreground\":1"), std::string::npos);
+	ASSERT_NE(json.find("\"full_resets\":1"), std::string::npos);
+	ASSERT_NE(json.find("\"get_config\":{\"count\":1,\"min_ns\":1500"), std::string::npos);
+	ASSERT_NE(json.find("\"max_ns\":1500"), std::string::npos);
+
+	// every name is there exactly once
+	for (std::size_t i = 0; i < WorkerMetrics::TIMER_COUNT; ++i)
+	{
+		const auto key = "\"" + std::string(WorkerMetrics::name(static_cast<WorkerMetrics::Timer>(i))) + "\":{";
+		ASSERT_NE(json.find(key), std::string::npos) << key;
+	}
+
+	std::size_t open = 0, close = 0;
+	for (const char c : json)
+	{
+		open += c == '{' || c == '[';
+		close += c == '}' || c == ']';
+	}
+
+	ASSERT_EQ(open, close);
+}
+
+// Metrics are off by default, so the hooks must not pay for them. Each loop is timed a few
+// times and the fastest run is kept, which filters out most scheduling noise.
+TEST(WorkerMetrics_Overhead, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using namespace std::chrono_literals;
+
+	constexpr std::uint64_t calls = 200000;
+	constexpr int runs = 5;
+	std::uint64_t sink = 0;
+
+	const auto fastest = [&sink](auto call)
+	{
+		auto best = clock::duration::max();
+		for (int run = 0; run < runs; ++run)
+		{
+			const auto start = clock::now();
+			for (std::uint64_t i = 0; i < calls; ++i)
+			{
+				sink += call(i);
+			}
+
+			best = std::min(best, clock::now() - start);
+		}
+
+		return best;
+	};
+
+	WorkerMetrics metrics;
+	const auto baseline = fastest([](std::uint64_t i) { return Work(i); });
+	const auto disabled = fastest([&metrics](std::uint64_t i) { return Callback(metrics, i); });
+
+	ASSERT_EQ(metrics.events(TraceEvent::LocationChange), 0u);
+	ASSERT_NE(sink, 0u);
+	ASSERT_LT(disabled, 3 * baseline + 1ms) << "baseline " << baseline.count() << ", disabled " << disabled.count();
+}
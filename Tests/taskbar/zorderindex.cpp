@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <list>
+#include <optional>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../../TranslucentTB/taskbar/zorderindex.hpp"
+
+namespace {
+	using index_t = ZOrderIndex<int, int>;
+
+	// Straightforward model: a single z-order of every window, and which monitor they are tracked on.
+	struct NaiveZOrder {
+		std::list<int> Order;
+		std::unordered_map<int, int> Tracked;
+
+		void raise(int window)
+		{
+			Order.remove(window);
+			Order.push_front(window);
+		}
+
+		std::optional<int> top(int mon) const
+		{
+			for (const int window : Order)
+			{
+				if (const auto it = Tracked.find(window); it != Tracked.end() && it->second == mon)
+				{
+					return window;
+				}
+			}
+
+			return std::nullopt;
+		}
+	};
+}
+
+TEST(ZOrderIndex_Order, InsertGoesOnTop)
+{
+	index_t index;
+	index.insert(1, 10);
+	index.insert(2, 10);
+	index.insert(3, 20);
+
+	ASSERT_EQ(index.top(10), 2);
+	ASSERT_EQ(index.top(20), 3);
+	ASSERT_FALSE(index.top(30).has_value());
+	ASSERT_EQ(index.size(), 3u);
+	ASSERT_EQ(index.size(10), 2u);
+}
+
+TEST(ZOrderIndex_Order, RaiseMovesToTop)
+{
+	index_t index;
+	index.insert(1, 10);
+	index.insert(2, 10);
+
+	index.raise(1);
+	ASSERT_EQ(index.top(10), 1);
+
+	// untracked windows are ignored
+	index.raise(5);
+	ASSERT_EQ(index.top(10), 1);
+	ASSERT_FALSE(index.contains(5));
+}
+
+TEST(ZOrderIndex_Order, RemoveRevealsNextWindow)
+{
+	index_t index;
+	index.insert(1, 10);
+	index.insert(2, 10);
+
+	index.remove(2, 10);
+	ASSERT_EQ(index.top(10), 1);
+
+	index.remove(1, 10);
+	ASSERT_FALSE(index.top(10).has_value());
+	ASSERT_EQ(index.size(), 0u);
+}
+
+TEST(ZOrderIndex_Monitors, MoveToOtherMonitor)
+{
+	index_t index;
+	index.insert(1, 10);
+	index.insert(2, 10);
+	index.insert(3, 20);
+
+	index.insert(2, 20);
+	ASSERT_EQ(index.top(10), 1);
+	ASSERT_EQ(index.top(20), 2);
+
+	// a stale removal from the old monitor must not drop the window
+	index.remove(2, 10);
+	ASSERT_TRUE(index.contains(2));
+	ASSERT_EQ(index.top(20), 2);
+}
+
+TEST(ZOrderIndex_Order, ReorderFollowsZOrder)
+{
+	index_t index;
+	index.insert(1, 10);
+	index.insert(2, 10);
+	index.insert(3, 10);
+	index.insert(4, 20);
+
+	index.reorder({ 7, 1, 4, 3, 8 });
+	ASSERT_EQ(index.top(10), 1);
+	ASSERT_EQ(index.top(20), 4);
+
+	index.remove(1, 10);
+	ASSERT_EQ(index.top(10), 3);
+	index.remove(3, 10);
+	ASSERT_EQ(index.top(10), 2);
+}
+
+TEST(ZOrderIndex_Order, AgreesWithNaiveZOrder)
+{
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> window(1, 50);
+	std::uniform_int_distribution<int> monitor(1, 3);
+	std::uniform_int_distribution<int> operation(0, 2);
+
+	index_t index;
+	NaiveZOrder naive;
+	for (int i = 0; i < 20000; ++i)
+	{
+		const int w = window(rng);
+		switch (operation(rng))
+		{
+		case 0:
+		{
+			// gets maximised, which also raises it
+			const int mon = monitor(rng);
+			index.insert(w, mon);
+			naive.Tracked.insert_or_assign(w, mon);
+			naive.raise(w);
+			break;
+		}
+
+		case 1:
+			index.raise(w);
+			naive.raise(w);
+			break;
+
+		case 2:
+			if (const auto it = naive.Tracked.find(w); it != naive.Tracked.end())
+			{
+				index.remove(w, it->second);
+				naive.Tracked.erase(it);
+			}
+			break;
+		}
+
+		for (int mon = 1; mon <= 3; ++mon)
+		{
+			ASSERT_EQ(index.top(mon), naive.top(mon));
+		}
+	}
+
+	// resyncing from the real z-order gives the same answer
+	index.reorder(std::vector<int>(naive.Order.begin(), naive.Order.end()));
+	for (int mon = 1; mon <= 3; ++mon)
+	{
+		ASSERT_EQ(index.top(mon), naive.top(mon));
+	}
+}
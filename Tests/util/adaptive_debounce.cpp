@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <chrono>
+
+#include "util/adaptive_debounce.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+	using clock = Util::adaptive_debounce::clock;
+
+	// Feeds a burst of changes the given time apart, and waits for it to settle.
+	clock::time_point Burst(Util::adaptive_debounce &debounce, clock::time_point now, clock::duration pause, int changes)
+	{
+		clock::duration delay { };
+		for (int i = 0; i < changes; ++i)
+		{
+			if (i != 0)
+			{
+				now += pause;
+			}
+
+			delay = debounce.change(now);
+		}
+
+		now += delay;
+		debounce.settle(now);
+		return now;
+	}
+}
+
+TEST(AdaptiveDebounce_Delay, StartsAt200Milliseconds)
+{
+	const Util::adaptive_debounce debounce;
+	ASSERT_EQ(debounce.delay(), 200ms);
+	ASSERT_FALSE(debounce.in_burst());
+}
+
+TEST(AdaptiveDebounce_Settle, ReturnsTheFirstChange)
+{
+	Util::adaptive_debounce debounce;
+	const clock::time_point start { 1s };
+
+	debounce.change(start);
+	debounce.change(start + 10ms);
+	ASSERT_TRUE(debounce.in_burst());
+
+	ASSERT_EQ(debounce.settle(start + 300ms), start);
+	ASSERT_FALSE(debounce.in_burst());
+}
+
+TEST(AdaptiveDebounce_Delay, ShrinksForSingleWrites)
+{
+	Util::adaptive_debounce debounce;
+	clock::time_point now { 1s };
+	for (int i = 0; i < 20; ++i)
+	{
+		now = Burst(debounce, now + 10s, { }, 1);
+	}
+
+	ASSERT_EQ(debounce.delay(), Util::adaptive_debounce::MIN_DELAY);
+}
+
+TEST(AdaptiveDebounce_Delay, LearnsTheLongestPause)
+{
+	Util::adaptive_debounce debounce;
+	clock::time_point now { 1s };
+	for (int i = 0; i < 20; ++i)
+	{
+		now = Burst(debounce, now + 10s, 40ms, 3);
+	}
+
+	ASSERT_GT(debounce.delay(), 80ms - 5ms);
+	ASSERT_LE(debounce.delay(), 80ms + 5ms);
+}
+
+TEST(AdaptiveDebounce_Delay, CatchesUpWhenCutShort)
+{
+	Util::adaptive_debounce debounce;
+	clock::time_point now { 1s };
+	for (int i = 0; i < 20; ++i)
+	{
+		now = Burst(debounce, now + 10s, { }, 1);
+	}
+
+	// an editor that pauses longer than the delay: the second write comes right after settling
+	const auto delay = debounce.change(now + 10s);
+	debounce.settle(now + 10s + delay);
+	debounce.change(now + 10s + delay + 5ms);
+
+	ASSERT_GE(debounce.delay(), 2 * (delay + 5ms));
+}
+
+TEST(AdaptiveDebounce_Delay, StaysBounded)
+{
+	Util::adaptive_debounce debounce;
+	clock::time_point now { 1s };
+
+	const auto delay = debounce.change(now);
+	debounce.settle(now + delay);
+	debounce.change(now + delay + 1ms);
+	debounce.settle(now + 1min);
+	ASSERT_LE(debounce.delay(), Util::adaptive_debounce::MAX_DELAY);
+
+	now = Burst(debounce, now + 2min, 1h, 2);
+	ASSERT_EQ(debounce.delay(), Util::adaptive_debounce::MAX_DELAY);
+}
@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#include "util/binary_log.hpp"
+
+namespace {
+	namespace bl = Util::binary_log;
+
+	constexpr bl::call_site INSERTION { "Inserting {} window {} [{}] to monitor {}", "C:\\src\\taskbarattributeworker.cpp", 123, 1 };
+	constexpr bl::call_site HRESULT_FAILED { "{} failed with {} ({} retries, ok: {})", "/src/win32.cpp", 45, 3 };
+	constexpr bl::call_site NO_ARGS { "Start menu closed", "start.cpp", 7, 1 };
+
+	template<typename... Args>
+	void Log(std::string &file, bl::writer &writer, const bl::call_site &site, std::uint64_t timestamp, const Args &...args)
+	{
+		std::string encoded;
+		bl::encode_args(encoded, args...);
+		const auto id = writer.define(file, site);
+		bl::encode_entry(file, id, timestamp, 42, encoded);
+	}
+
+	std::vector<bl::message> ReadAll(std::string_view file, bool expectCorrupt = false)
+	{
+		bl::reader reader(file);
+		EXPECT_TRUE(reader.valid());
+
+		std::vector<bl::message> messages;
+		bl::message msg;
+		while (reader.next(msg))
+		{
+			messages.push_back(msg);
+		}
+
+		EXPECT_EQ(reader.corrupt(), expectCorrupt);
+		return messages;
+	}
+
+	std::string Hex(const void *pointer)
+	{
+		char buf[32];
+		const auto result = std::to_chars(buf, buf + sizeof(buf), reinterpret_cast<std::uintptr_t>(pointer), 16);
+		return "0x" + std::string(buf, result.ptr);
+	}
+
+	std::string Render(std::string_view format, const auto &...args)
+	{
+		std::string encoded, out;
+		bl::encode_args(encoded, args...);
+		EXPECT_TRUE(bl::render(out, format, encoded));
+		return out;
+	}
+}
+
+TEST(BinaryLog_Render, ArgumentTypes)
+{
+	ASSERT_EQ(Render("{} {} {} {}", 42u, -7, true, false), "42 -7 true false");
+	ASSERT_EQ(Render("{}", std::uint64_t { UINT64_MAX }), "18446744073709551615");
+	ASSERT_EQ(Render("{}", std::int64_t { INT64_MIN }), "-9223372036854775808");
+	ASSERT_EQ(Render("{}", reinterpret_cast<void *>(0x1234AB)), "0x1234ab");
+	ASSERT_EQ(Render("{}", static_cast<void *>(nullptr)), "0x0");
+	ASSERT_EQ(Render("{}", bl::hresult { static_cast<std::int32_t>(0x80070005) }), "0x80070005");
+	ASSERT_EQ(Render("{}", bl::hresult { 1 }), "0x00000001");
+	ASSERT_EQ(Render("{}|{}", "narrow", std::string("owned")), "narrow|owned");
+	ASSERT_EQ(Render("{}|{}", L"wide", std::wstring(L"owned")), "wide|owned");
+}
+
+TEST(BinaryLog_Render, Pointers)
+{
+	int value = 0;
+	void *const pointer = &value;
+	ASSERT_EQ(Render("{} at {}", 5, pointer), "5 at " + Hex(pointer));
+}
+
+TEST(BinaryLog_Render, Unicode)
+{
+	// BMP, a surrogate pair, and an unpaired surrogate
+	ASSERT_EQ(Render("{}", L"caf\u00e9 \u65e5\u672c"), "caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac");
+	ASSERT_EQ(Render("{}", L"\U0001F600"), "\xf0\x9f\x98\x80");
+	ASSERT_EQ(Render("{}", std::wstring_view(L"\xD800", 1)), "\xef\xbf\xbd");
+	ASSERT_EQ(Render("{}", "caf\xc3\xa9"), "caf\xc3\xa9");
+}
+
+TEST(BinaryLog_Render, Placeholders)
+{
+	ASSERT_EQ(Render("{{}} {} }}{{", 1), "{} 1 }{");
+	ASSERT_EQ(Render("{:x} {}", 1, 2), "1 2");
+	ASSERT_EQ(Render("{} {}", 1), "1 {?}");
+	ASSERT_EQ(Render("{}", 1, 2), "1");
+	ASSERT_EQ(Render("unterminated {", 1), "unterminated {");
+}
+
+TEST(BinaryLog_Render, LongStringsAreCut)
+{
+	const std::string longString(100000, 'x');
+	ASSERT_EQ(Render("{}", longString).size(), UINT16_MAX);
+	const std::wstring longWideString(100000, L'x');
+	ASSERT_EQ(Render("{}", longWideString).size(), UINT16_MAX);
+}
+
+TEST(BinaryLog_Render, MalformedArguments)
+{
+	std::string encoded, out;
+	bl::encode_args(encoded, "some string");
+	ASSERT_FALSE(bl::render(out, "{}", encoded.substr(0, encoded.size() - 1)));
+	ASSERT_FALSE(bl::render(out, "{}", "\x01\x7F"));
+	ASSERT_FALSE(bl::render(out, "{}", ""));
+}
+
+TEST(BinaryLog_RoundTrip, Entries)
+{
+	std::string file(bl::MAGIC);
+	bl::writer writer;
+
+	int window = 0;
+	Log(file, writer, INSERTION, 1000, L"maximised", static_cast<void *>(&window), std::wstring_view(L"Notepad"), reinterpret_cast<void *>(0x10001));
+	Log(file, writer, HRESULT_FAILED, 2000, "DwmSetWindowAttribute", bl::hresult { static_cast<std::int32_t>(0x80004005) }, 3u, false);
+	Log(file, writer, INSERTION, 3000, L"normal", static_cast<void *>(nullptr), L"", static_cast<void *>(nullptr));
+	Log(file, writer, NO_ARGS, 4000);
+	bl::encode_text(file, 4, "error.cpp", 99, 5000, 7, "already formatted");
+
+	const auto messages = ReadAll(file);
+	ASSERT_EQ(messages.size(), 5u);
+
+	ASSERT_EQ(messages[0].Text, "Inserting maximised window " + Hex(&window) + " [Notepad] to monitor 0x10001");
+	ASSERT_EQ(messages[0].Level, 1);
+	ASSERT_EQ(messages[0].File, INSERTION.File);
+	ASSERT_EQ(messages[0].Line, 123u);
+	ASSERT_EQ(messages[0].Timestamp, 1000u);
+	ASSERT_EQ(messages[0].Thread, 42u);
+
+	ASSERT_EQ(messages[1].Text, "DwmSetWindowAttribute failed with 0x80004005 (3 retries, ok: false)");
+	ASSERT_EQ(messages[1].Level, 3);
+
+	ASSERT_EQ(messages[2].Text, "Inserting normal window 0x0 [] to monitor 0x0");
+	ASSERT_EQ(messages[2].Timestamp, 3000u);
+
+	ASSERT_EQ(messages[3].Text, "Start menu closed");
+
+	ASSERT_EQ(messages[4].Text, "already formatted");
+	ASSERT_EQ(messages[4].Level, 4);
+	ASSERT_EQ(messages[4].File, "error.cpp");
+	ASSERT_EQ(messages[4].Line, 99u);
+	ASSERT_EQ(messages[4].Timestamp, 5000u);
+	ASSERT_EQ(messages[4].Thread, 7u);
+}
+
+TEST(BinaryLog_RoundTrip, DefinitionsAreWrittenOnce)
+{
+	std::string file(bl::MAGIC);
+	bl::writer writer;
+	Log(file, writer, NO_ARGS, 0);
+	const auto firstSize = file.size();
+	Log(file, writer, NO_ARGS, 0);
+	const auto secondSize = file.size() - firstSize;
+	ASSERT_LT(secondSize, firstSize - bl::MAGIC.size());
+
+	// a new file needs them again
+	writer.clear();
+	std::string other(bl::MAGIC);
+	Log(other, writer, NO_ARGS, 0);
+	ASSERT_EQ(ReadAll(other).size(), 1u);
+	ASSERT_EQ(ReadAll(other)[0].Text, "Start menu closed");
+}
+
+TEST(BinaryLog_RoundTrip, TruncatedFile)
+{
+	std::string file(bl::MAGIC);
+	bl::writer writer;
+	Log(file, writer, NO_ARGS, 0);
+	Log(file, writer, HRESULT_FAILED, 0, "a", bl::hresult { 0 }, 1u, true);
+
+	// the last record got cut while being written
+	const auto messages = ReadAll(std::string_view(file).substr(0, file.size() - 3), true);
+	ASSERT_EQ(messages.size(), 1u);
+	ASSERT_EQ(messages[0].Text, "Start menu closed");
+}
+
+TEST(BinaryLog_RoundTrip, ZeroPaddingEndsTheFile)
+{
+	// a log file still being written is mapped past what got written
+	std::string file(bl::MAGIC);
+	bl::writer writer;
+	Log(file, writer, NO_ARGS, 0);
+	file.append(4096, '\0');
+
+	ASSERT_EQ(ReadAll(file).size(), 1u);
+}
+
+TEST(BinaryLog_RoundTrip, LostDefinition)
+{
+	// what's left when the log queue dropped the record that had the definition
+	std::string dropped, file(bl::MAGIC);
+	bl::writer writer;
+	Log(dropped, writer, HRESULT_FAILED, 0, "a", bl::hresult { 0 }, 1u, true);
+	Log(file, writer, HRESULT_FAILED, 0, "b", bl::hresult { 5 }, 2u, false);
+
+	const auto messages = ReadAll(file);
+	ASSERT_EQ(messages.size(), 1u);
+	ASSERT_EQ(messages[0].Text, "[undefined message 1] b 0x00000005 2 false");
+}
+
+TEST(BinaryLog_RoundTrip, UnknownRecordsAreSkipped)
+{
+	std::string file(bl::MAGIC);
+	bl::writer writer;
+	file += '\x7F';
+	file.append("\x03\x00\x00\x00" "abc", 7);
+	Log(file, writer, NO_ARGS, 0);
+
+	ASSERT_EQ(ReadAll(file).size(), 1u);
+}
+
+TEST(BinaryLog_RoundTrip, NotABinaryLog)
+{
+	bl::reader reader("\xEF\xBB\xBF[2024-01-01 00:00:00.000] [info] text log");
+	bl::message msg;
+	ASSERT_FALSE(reader.valid());
+	ASSERT_FALSE(reader.next(msg));
+}
+
+TEST(BinaryLog_Format, Line)
+{
+	bl::message msg;
+	msg.Level = 1;
+	msg.File = "C:\\src\\taskbar\\taskbarattributeworker.cpp";
+	msg.Line = 993;
+	msg.Text = "Start menu closed";
+
+	// 2024-02-29 13:04:05.678901234 UTC
+	msg.Timestamp = 1709211845678901234ull;
+	ASSERT_EQ(bl::format_line(msg), "[2024-02-29 13:04:05.678] [debug] [taskbarattributeworker.cpp:993] Start menu closed");
+
+	msg.File = { };
+	msg.Level = 2;
+	msg.Timestamp = 0;
+	ASSERT_EQ(bl::format_line(msg), "[1970-01-01 00:00:00.000] [info] Start menu closed");
+}
+
+TEST(BinaryLog_Format, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	constexpr std::size_t messages = 200000;
+	int window = 0;
+	const std::wstring className = L"Shell_TrayWnd", fileName = L"explorer.exe";
+
+	// what a call site did: format the message, then turn it to UTF-8 for the log
+	{
+		wchar_t text[256];
+		std::string utf8;
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < messages; ++i)
+		{
+			const int length = std::swprintf(text, std::size(text), L"Inserting %ls window %p [%ls] [%ls] to monitor %p", L"maximised", static_cast<void *>(&window), className.c_str(), fileName.c_str(), static_cast<void *>(&utf8));
+			utf8.clear();
+			for (int j = 0; j < length; ++j)
+			{
+				bl::impl::append_utf8(utf8, static_cast<std::uint32_t>(text[j]));
+			}
+		}
+		const auto elapsed = clock::now() - start;
+
+		std::printf("[ BINLOG   ] formatted: %lld ns/message\n",
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / messages));
+	}
+
+	// what a deferred call site does
+	{
+		static constexpr bl::call_site site { "Inserting {} window {} [{}] [{}] to monitor {}", __FILE__, __LINE__, 1 };
+		bl::writer writer;
+		std::string encoded, record;
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < messages; ++i)
+		{
+			encoded.clear();
+			record.clear();
+			bl::encode_args(encoded, L"maximised", static_cast<void *>(&window), className, fileName, static_cast<void *>(&encoded));
+			bl::encode_entry(record, writer.define(record, site), i, 1, encoded);
+		}
+		const auto elapsed = clock::now() - start;
+
+		std::printf("[ BINLOG   ] deferred: %lld ns/message, %zu bytes/message\n",
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / messages), record.size());
+	}
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "util/flat_hash.hpp"
+#include "util/flat_map.hpp"
+
+namespace {
+	// looks like a window or monitor handle: aligned, so the low bits are always clear
+	using handle = const void *;
+
+	handle MakeHandle(std::uintptr_t i)
+	{
+		return reinterpret_cast<handle>(0x10000 + i * 16);
+	}
+
+	template<typename Set>
+	std::uint64_t SetWorkload(const std::vector<handle> &handles, int rounds)
+	{
+		std::uint64_t found = 0;
+		Set set;
+		for (int round = 0; round < rounds; ++round)
+		{
+			for (const auto h : handles)
+			{
+				set.insert(h);
+			}
+
+			for (const auto h : handles)
+			{
+				found += set.contains(h);
+			}
+
+			for (const auto h : handles)
+			{
+				set.erase(h);
+			}
+		}
+
+		return found;
+	}
+
+	template<typename Map>
+	std::uint64_t MapWorkload(const std::vector<handle> &handles, int rounds)
+	{
+		std::uint64_t found = 0;
+		Map map;
+		for (const auto h : handles)
+		{
+			map.insert_or_assign(h, 0);
+		}
+
+		for (int round = 0; round < rounds; ++round)
+		{
+			for (const auto h : handles)
+			{
+				if (const auto it = map.find(h); it != map.end())
+				{
+					found += ++it->second > 0;
+				}
+			}
+		}
+
+		return found;
+	}
+
+	template<typename Workload>
+	long long NanosecondsPerOperation(Workload &&workload, std::size_t operations)
+	{
+		using clock = std::chrono::steady_clock;
+
+		const auto start = clock::now();
+		const auto result = workload();
+		const auto elapsed = clock::now() - start;
+
+		EXPECT_GT(result, 0u);
+		return static_cast<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / static_cast<long long>(operations));
+	}
+}
+
+TEST(Util_FlatHashSet, InsertFindErase)
+{
+	Util::flat_hash_set<handle> set;
+	ASSERT_TRUE(set.empty());
+	ASSERT_FALSE(set.contains(MakeHandle(1)));
+
+	ASSERT_TRUE(set.insert(MakeHandle(1)).second);
+	ASSERT_FALSE(set.insert(MakeHandle(1)).second);
+	ASSERT_TRUE(set.insert(MakeHandle(2)).second);
+	ASSERT_EQ(set.size(), 2u);
+	ASSERT_EQ(*set.find(MakeHandle(2)), MakeHandle(2));
+
+	ASSERT_EQ(set.erase(MakeHandle(1)), 1u);
+	ASSERT_EQ(set.erase(MakeHandle(1)), 0u);
+	ASSERT_FALSE(set.contains(MakeHandle(1)));
+	ASSERT_TRUE(set.contains(MakeHandle(2)));
+
+	set.clear();
+	ASSERT_TRUE(set.empty());
+	ASSERT_EQ(set.begin(), set.end());
+}
+
+TEST(Util_FlatHashSet, IteratesEveryElement)
+{
+	Util::flat_hash_set<handle> set;
+	std::unordered_set<handle> expected;
+	for (std::uintptr_t i = 0; i < 100; ++i)
+	{
+		set.insert(MakeHandle(i));
+		expected.insert(MakeHandle(i));
+	}
+
+	std::unordered_set<handle> seen(set.begin(), set.end());
+	ASSERT_EQ(seen, expected);
+	ASSERT_EQ(set.size(), 100u);
+}
+
+TEST(Util_FlatHashSet, AgreesWithUnorderedSet)
+{
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<std::uintptr_t> key(0, 300);
+	std::uniform_int_distribution<int> operation(0, 2);
+
+	Util::flat_hash_set<handle> set;
+	std::unordered_set<handle> expected;
+	for (int i = 0; i < 100000; ++i)
+	{
+		const auto h = MakeHandle(key(rng));
+		switch (operation(rng))
+		{
+		case 0:
+			ASSERT_EQ(set.insert(h).second, expected.insert(h).second);
+			break;
+
+		case 1:
+			ASSERT_EQ(set.erase(h), expected.erase(h));
+			break;
+
+		case 2:
+			ASSERT_EQ(set.contains(h), expected.contains(h));
+			break;
+		}
+
+		ASSERT_EQ(set.size(), expected.size());
+	}
+
+	for (const auto h : expected)
+	{
+		ASSERT_TRUE(set.contains(h));
+	}
+}
+
+TEST(Util_FlatHashSet, Equality)
+{
+	Util::flat_hash_set<int> a, b;
+	a.insert(1);
+	a.insert(2);
+	b.insert(2);
+	ASSERT_FALSE(a == b);
+
+	b.insert(1);
+	ASSERT_TRUE(a == b);
+}
+
+TEST(Util_FlatHashMap, InsertOrAssign)
+{
+	Util::flat_hash_map<handle, int> map;
+	ASSERT_TRUE(map.insert_or_assign(MakeHandle(1), 1).second);
+	ASSERT_FALSE(map.insert_or_assign(MakeHandle(1), 2).second);
+	ASSERT_EQ(map.find(MakeHandle(1))->second, 2);
+
+	map[MakeHandle(3)] += 5;
+	ASSERT_EQ(map[MakeHandle(3)], 5);
+	ASSERT_EQ(map.size(), 2u);
+
+	ASSERT_FALSE(map.try_emplace(MakeHandle(3), 7).second);
+	ASSERT_EQ(map[MakeHandle(3)], 5);
+}
+
+TEST(Util_FlatMap, StaysSorted)
+{
+	Util::flat_map<int, int> map;
+	map.insert_or_assign(3, 30);
+	map.insert_or_assign(1, 10);
+	map.insert_or_assign(2, 20);
+	map.insert_or_assign(2, 21);
+
+	std::vector<int> keys;
+	for (const auto &[key, value] : map)
+	{
+		keys.push_back(key);
+	}
+
+	ASSERT_EQ(keys, (std::vector<int> { 1, 2, 3 }));
+	ASSERT_EQ(map.find(2)->second, 21);
+	ASSERT_EQ(map.find(4), map.end());
+
+	ASSERT_EQ(map.erase(1), 1u);
+	ASSERT_FALSE(map.contains(1));
+	ASSERT_EQ(map.size(), 2u);
+}
+
+TEST(Util_FlatHash, DISABLED_Benchmark)
+{
+	// a monitor usually has a handful of visible windows, rarely more than a hundred
+	for (const std::uintptr_t count : { 4, 16, 64, 256 })
+	{
+		std::vector<handle> handles;
+		for (std::uintptr_t i = 0; i < count; ++i)
+		{
+			handles.push_back(MakeHandle(i * 7919));
+		}
+
+		const int rounds = static_cast<int>(400000 / count);
+		const auto operations = handles.size() * 3 * rounds;
+		const auto node = NanosecondsPerOperation([&] { return SetWorkload<std::unordered_set<handle>>(handles, rounds); }, operations);
+		const auto flat = NanosecondsPerOperation([&] { return SetWorkload<Util::flat_hash_set<handle>>(handles, rounds); }, operations);
+
+		std::printf("[ FLATHASH ] window set of %zu: unordered_set %lld ns/op, flat_hash_set %lld ns/op\n", static_cast<std::size_t>(count), node, flat);
+	}
+
+	// one entry per monitor
+	for (const std::uintptr_t count : { 1, 2, 4, 8 })
+	{
+		std::vector<handle> handles;
+		for (std::uintptr_t i = 0; i < count; ++i)
+		{
+			handles.push_back(MakeHandle(i * 104729));
+		}
+
+		const int rounds = static_cast<int>(1000000 / count);
+		const auto operations = handles.size() * rounds;
+		const auto node = NanosecondsPerOperation([&] { return MapWorkload<std::unordered_map<handle, int>>(handles, rounds); }, operations);
+		const auto flat = NanosecondsPerOperation([&] { return MapWorkload<Util::flat_map<handle, int>>(handles, rounds); }, operations);
+
+		std::printf("[ FLATHASH ] monitor map of %zu: unordered_map %lld ns/op, flat_map %lld ns/op\n", static_cast<std::size_t>(count), node, flat);
+	}
+}
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/flight_recorder.hpp"
+
+namespace {
+	namespace bl = Util::binary_log;
+
+	constexpr bl::call_site INSERTION { "Inserting {} window {} to monitor {}", "taskbarattributeworker.cpp", 123, 1 };
+
+	std::string Args(const auto &...args)
+	{
+		std::string encoded;
+		bl::encode_args(encoded, args...);
+		return encoded;
+	}
+
+	void RecordNumber(Util::flight_recorder &recorder, std::uint32_t thread, std::uint64_t i)
+	{
+		recorder.record(0, "file.cpp", 1, i, thread, std::to_string(i));
+	}
+}
+
+TEST(FlightRecorder_Take, ReturnsMessagesInOrder)
+{
+	Util::flight_recorder recorder(8);
+	recorder.record(INSERTION, 10, 5, Args(L"maximised", true, 3u));
+	recorder.record(2, "main.cpp", 42, 20, 6, L"Started", L"");
+	recorder.record(1, "other.cpp", 7, 30, 7, std::string_view("narrow"));
+
+	const auto dump = recorder.take();
+	ASSERT_EQ(dump.Messages.size(), 3u);
+	EXPECT_EQ(dump.Lost, 0u);
+
+	EXPECT_EQ(dump.Messages[0].Text, "Inserting maximised window true to monitor 3");
+	EXPECT_EQ(dump.Messages[0].File, "taskbarattributeworker.cpp");
+	EXPECT_EQ(dump.Messages[0].Line, 123u);
+	EXPECT_EQ(dump.Messages[0].Level, 1);
+	EXPECT_EQ(dump.Messages[0].Timestamp, 10u);
+	EXPECT_EQ(dump.Messages[0].Thread, 5u);
+
+	EXPECT_EQ(dump.Messages[1].Text, "Started");
+	EXPECT_EQ(dump.Messages[1].File, "main.cpp");
+	EXPECT_EQ(dump.Messages[1].Line, 42u);
+	EXPECT_EQ(dump.Messages[1].Level, 2);
+
+	EXPECT_EQ(dump.Messages[2].Text, "narrow");
+	EXPECT_EQ(dump.Messages[2].Thread, 7u);
+}
+
+TEST(FlightRecorder_Take, ClearsWhatItReturns)
+{
+	Util::flight_recorder recorder(8);
+	RecordNumber(recorder, 0, 1);
+	EXPECT_EQ(recorder.take().Messages.size(), 1u);
+
+	const auto empty = recorder.take();
+	EXPECT_TRUE(empty.Messages.empty());
+	EXPECT_EQ(empty.Lost, 0u);
+
+	RecordNumber(recorder, 0, 2);
+	const auto dump = recorder.take();
+	ASSERT_EQ(dump.Messages.size(), 1u);
+	EXPECT_EQ(dump.Messages[0].Text, "2");
+}
+
+TEST(FlightRecorder_Take, KeepsLatestWhenWrapping)
+{
+	Util::flight_recorder recorder(4);
+	for (std::uint64_t i = 0; i < 10; ++i)
+	{
+		RecordNumber(recorder, 0, i);
+	}
+
+	const auto dump = recorder.take();
+	ASSERT_EQ(dump.Messages.size(), 4u);
+	EXPECT_EQ(dump.Lost, 6u);
+	for (std::size_t i = 0; i < 4; ++i)
+	{
+		EXPECT_EQ(dump.Messages[i].Text, std::to_string(6 + i));
+	}
+}
+
+TEST(FlightRecorder_Take, CapacityIsRoundedUp)
+{
+	Util::flight_recorder recorder(3);
+	for (std::uint64_t i = 0; i < 4; ++i)
+	{
+		RecordNumber(recorder, 0, i);
+	}
+
+	EXPECT_EQ(recorder.take().Messages.size(), 4u);
+}
+
+TEST(FlightRecorder_Record, WideTextWithDetail)
+{
+	Util::flight_recorder recorder(4);
+	recorder.record(3, "win32.cpp", 9, 0, 0, L"Failed to open caf\u00E9 \U0001F600", L"Access is denied.");
+
+	const auto dump = recorder.take();
+	ASSERT_EQ(dump.Messages.size(), 1u);
+	EXPECT_EQ(dump.Messages[0].Text, "Failed to open caf\xC3\xA9 \xF0\x9F\x98\x80 (Access is denied.)");
+}
+
+TEST(FlightRecorder_Record, CutsLongTextOnCodePoints)
+{
+	Util::flight_recorder recorder(4);
+	recorder.record(0, "file.cpp", 1, 0, 0, std::wstring(Util::flight_recorder::PAYLOAD_SIZE - 1, L'a') + L"\u00E9");
+
+	const auto dump = recorder.take();
+	ASSERT_EQ(dump.Messages.size(), 1u);
+	EXPECT_EQ(dump.Messages[0].Text, std::string(Util::flight_recorder::PAYLOAD_SIZE - 1, 'a') + " [...]");
+}
+
+TEST(FlightRecorder_Record, DropsArgumentsThatDontFit)
+{
+	Util::flight_recorder recorder(4);
+	recorder.record(INSERTION, 0, 0, Args(std::string(Util::flight_recorder::PAYLOAD_SIZE, 'x'), 1u, 2u));
+
+	const auto dump = recorder.take();
+	ASSERT_EQ(dump.Messages.size(), 1u);
+	EXPECT_EQ(dump.Messages[0].Text, "Inserting {?} window {?} to monitor {?} [...]");
+}
+
+TEST(FlightRecorder_Record, ConcurrentWritersWhileTaking)
+{
+	constexpr std::uint32_t threads = 4;
+	constexpr std::uint64_t perThread = 20000;
+
+	Util::flight_recorder recorder(256);
+	std::atomic<bool> done = false;
+	std::vector<std::thread> writers;
+	for (std::uint32_t t = 0; t < threads; ++t)
+	{
+		writers.emplace_back([&recorder, t]
+		{
+			for (std::uint64_t i = 0; i < perThread; ++i)
+			{
+				RecordNumber(recorder, t, i);
+			}
+		});
+	}
+
+	std::uint64_t seen = 0, lost = 0;
+	std::vector<std::uint64_t> last(threads, 0);
+	const auto check = [&](const Util::flight_recorder::dump &dump)
+	{
+		seen += dump.Messages.size();
+		lost += dump.Lost;
+		for (const auto &msg : dump.Messages)
+		{
+			// never torn, and each thread's messages stay in order
+			const auto value = std::stoull(msg.Text);
+			ASSERT_EQ(msg.Timestamp, value);
+			ASSERT_LT(msg.Thread, threads);
+			ASSERT_GE(value + 1, last[msg.Thread]);
+			last[msg.Thread] = value + 1;
+		}
+	};
+
+	std::thread reader([&]
+	{
+		while (!done.load())
+		{
+			check(recorder.take());
+		}
+	});
+
+	for (auto &writer : writers)
+	{
+		writer.join();
+	}
+
+	done = true;
+	reader.join();
+	check(recorder.take());
+
+	EXPECT_EQ(seen + lost, threads * perThread);
+	EXPECT_GT(seen, 0u);
+}
+
+TEST(FlightRecorder_Record, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	constexpr std::size_t messages = 1000000;
+	Util::flight_recorder recorder;
+	const std::wstring detail = L"The operation completed successfully.";
+
+	{
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < messages; ++i)
+		{
+			recorder.record(1, __FILE__, __LINE__, i, 1, L"Window became foreground", detail);
+		}
+		const auto elapsed = clock::now() - start;
+
+		std::printf("[ FLIGHT   ] wide text: %lld ns/message\n",
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / messages));
+	}
+
+	{
+		std::string args;
+		int window = 0;
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < messages; ++i)
+		{
+			args.clear();
+			bl::encode_args(args, L"maximised", static_cast<void *>(&window), i);
+			recorder.record(INSERTION, i, 1, args);
+		}
+		const auto elapsed = clock::now() - start;
+
+		std::printf("[ FLIGHT   ] deferred: %lld ns/message\n",
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / messages));
+	}
+
+	const auto start = clock::now();
+	const auto dump = recorder.take();
+	const auto elapsed = clock::now() - start;
+	std::printf("[ FLIGHT   ] take: %zu messages in %lld us\n", dump.Messages.size(),
+		static_cast<long long>(duration_cast<std::chrono::microseconds>(elapsed).count()));
+
+	EXPECT_EQ(dump.Messages.size(), Util::flight_recorder::DEFAULT_CAPACITY);
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+
+#include "util/histogram.hpp"
+
+TEST(Histogram_Buckets, PowersOfTwo)
+{
+	ASSERT_EQ(Util::log2_histogram::bucket_of(0), 0u);
+	ASSERT_EQ(Util::log2_histogram::bucket_of(1), 1u);
+	ASSERT_EQ(Util::log2_histogram::bucket_of(2), 2u);
+	ASSERT_EQ(Util::log2_histogram::bucket_of(3), 2u);
+	ASSERT_EQ(Util::log2_histogram::bucket_of(4), 3u);
+	ASSERT_EQ(Util::log2_histogram::bucket_of(UINT64_MAX), 64u);
+
+	ASSERT_EQ(Util::log2_histogram::bucket_upper_bound(0), 0u);
+	ASSERT_EQ(Util::log2_histogram::bucket_upper_bound(3), 7u);
+	ASSERT_EQ(Util::log2_histogram::bucket_upper_bound(64), UINT64_MAX);
+}
+
+TEST(Histogram_Summary, Empty)
+{
+	const Util::log2_histogram histogram;
+	ASSERT_EQ(histogram.count(), 0u);
+	ASSERT_EQ(histogram.min(), 0u);
+	ASSERT_EQ(histogram.max(), 0u);
+	ASSERT_EQ(histogram.mean(), 0.0);
+	ASSERT_EQ(histogram.percentile(0.5), 0u);
+}
+
+TEST(Histogram_Summary, Percentiles)
+{
+	Util::log2_histogram histogram;
+	for (std::uint64_t i = 0; i < 90; ++i)
+	{
+		histogram.record(10); // bucket [8, 16)
+	}
+
+	for (std::uint64_t i = 0; i < 10; ++i)
+	{
+		histogram.record(5000); // bucket [4096, 8192)
+	}
+
+	ASSERT_EQ(histogram.count(), 100u);
+	ASSERT_EQ(histogram.min(), 10u);
+	ASSERT_EQ(histogram.max(), 5000u);
+	ASSERT_DOUBLE_EQ(histogram.mean(), 509.0);
+
+	ASSERT_EQ(histogram.percentile(0.5), 15u);
+	ASSERT_EQ(histogram.percentile(0.9), 15u);
+
+	// clamped to the largest value rather than the end of its bucket
+	ASSERT_EQ(histogram.percentile(0.99), 5000u);
+	ASSERT_EQ(histogram.percentile(1.0), 5000u);
+}
+
+TEST(Histogram_Summary, Merge)
+{
+	Util::log2_histogram a, b;
+	a.record(1);
+	a.record(2);
+	b.record(100);
+
+	a.merge(b);
+	ASSERT_EQ(a.count(), 3u);
+	ASSERT_EQ(a.count(1), 1u);
+	ASSERT_EQ(a.count(2), 1u);
+	ASSERT_EQ(a.count(7), 1u);
+	ASSERT_EQ(a.min(), 1u);
+	ASSERT_EQ(a.max(), 100u);
+
+	a.clear();
+	ASSERT_EQ(a.count(), 0u);
+	ASSERT_EQ(a.count(7), 0u);
+}
+
+TEST(Histogram_Buckets, LogLinearBoundsAreContiguous)
+{
+	using histogram = Util::log_linear_histogram<3>;
+	for (std::size_t bucket = 0; bucket < histogram::BUCKETS - 1; ++bucket)
+	{
+		const auto upper = histogram::bucket_upper_bound(bucket);
+		ASSERT_EQ(histogram::bucket_of(upper), bucket);
+		ASSERT_EQ(histogram::bucket_of(upper + 1), bucket + 1);
+	}
+
+	ASSERT_EQ(histogram::bucket_upper_bound(histogram::BUCKETS - 1), UINT64_MAX);
+	ASSERT_EQ(histogram::bucket_of(UINT64_MAX), histogram::BUCKETS - 1);
+}
+
+TEST(Histogram_Summary, LogLinearPrecision)
+{
+	Util::log_linear_histogram<3> histogram;
+	histogram.record(1000);
+	histogram.record(100000);
+
+	// buckets are at most 1/8 wide relative to their values
+	ASSERT_GE(histogram.percentile(0.5), 1000u);
+	ASSERT_LE(histogram.percentile(0.5), 1000u + 1000u / 8);
+	ASSERT_EQ(histogram.percentile(1.0), 100000u);
+}
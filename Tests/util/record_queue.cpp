@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/record_queue.hpp"
+
+namespace {
+	using namespace std::chrono_literals;
+
+	std::string TakeAll(Util::record_queue &queue)
+	{
+		std::string out;
+		queue.take(out, 0, 0ms);
+		return out;
+	}
+}
+
+TEST(RecordQueue_Batching, TakesEverythingInOrder)
+{
+	Util::record_queue queue(64);
+	ASSERT_EQ(queue.push("abc"), 1u);
+	ASSERT_EQ(queue.push("de"), 2u);
+	ASSERT_EQ(queue.push(""), 3u);
+	ASSERT_EQ(queue.push("f"), 4u);
+
+	ASSERT_EQ(TakeAll(queue), "abcdef");
+	ASSERT_EQ(TakeAll(queue), "");
+	ASSERT_EQ(queue.statistics().Batches, 1u);
+}
+
+TEST(RecordQueue_Batching, WrapsAround)
+{
+	// records end up split across the end of the ring
+	Util::record_queue queue(23);
+	std::string expected, taken;
+	for (int i = 0; i < 100; ++i)
+	{
+		const std::string record(static_cast<std::size_t>(i % 7), static_cast<char>('a' + i % 26));
+		ASSERT_NE(queue.push(record), 0u);
+		expected += record;
+		taken += TakeAll(queue);
+	}
+
+	ASSERT_EQ(taken, expected);
+}
+
+TEST(RecordQueue_Backpressure, DropNewest)
+{
+	Util::record_queue queue(24, Util::backpressure::drop_newest);
+	ASSERT_NE(queue.push("aaaa"), 0u); // 8 bytes with the header
+	ASSERT_NE(queue.push("bbbb"), 0u);
+	ASSERT_NE(queue.push("cccc"), 0u);
+	ASSERT_EQ(queue.push("dddd"), 0u);
+
+	ASSERT_EQ(TakeAll(queue), "aaaabbbbcccc");
+	ASSERT_EQ(queue.statistics().Dropped, 1u);
+}
+
+TEST(RecordQueue_Backpressure, DropOldest)
+{
+	Util::record_queue queue(24, Util::backpressure::drop_oldest);
+	queue.push("aaaa");
+	queue.push("bbbb");
+	queue.push("cccc");
+	ASSERT_NE(queue.push("dddddddd"), 0u); // needs two records gone
+
+	ASSERT_EQ(TakeAll(queue), "ccccdddddddd");
+	ASSERT_EQ(queue.statistics().Dropped, 2u);
+}
+
+TEST(RecordQueue_Backpressure, TooLargeIsDropped)
+{
+	Util::record_queue queue(16);
+	ASSERT_EQ(queue.push(std::string(13, 'x')), 0u);
+	ASSERT_NE(queue.push(std::string(12, 'x')), 0u);
+}
+
+TEST(RecordQueue_Backpressure, BlockWaitsForConsumer)
+{
+	Util::record_queue queue(16, Util::backpressure::block);
+	ASSERT_NE(queue.push("aaaaaaaa"), 0u);
+
+	std::jthread producer([&queue]
+	{
+		queue.push("bbbbbbbb");
+	});
+
+	std::string out;
+	while (out.size() < 16)
+	{
+		queue.mark_handled(queue.take(out, 0, 10ms));
+	}
+
+	ASSERT_EQ(out, "aaaaaaaabbbbbbbb");
+	ASSERT_EQ(queue.statistics().Dropped, 0u);
+}
+
+TEST(RecordQueue_Consumer, FlushWaitsUntilHandled)
+{
+	Util::record_queue queue(1024);
+	std::string written;
+	std::mutex writtenLock;
+
+	std::jthread consumer([&]
+	{
+		std::string batch;
+		while (const auto sequence = queue.take(batch, 1024, 10s))
+		{
+			{
+				std::scoped_lock guard(writtenLock);
+				written += batch;
+			}
+
+			batch.clear();
+			queue.mark_handled(sequence);
+		}
+	});
+
+	queue.push("hello ");
+	queue.push("world");
+
+	// nowhere near the batch size nor the timeout, flushing wakes the consumer up
+	ASSERT_TRUE(queue.flush());
+	{
+		std::scoped_lock guard(writtenLock);
+		ASSERT_EQ(written, "hello world");
+	}
+
+	// and so does an urgent record
+	const auto sequence = queue.push("!", true);
+	ASSERT_TRUE(queue.flush());
+	ASSERT_EQ(sequence, 3u);
+
+	queue.close();
+	consumer.join();
+	ASSERT_EQ(written, "hello world!");
+	ASSERT_EQ(queue.push("late"), 0u);
+}
+
+TEST(RecordQueue_Consumer, CloseDrainsRemaining)
+{
+	Util::record_queue queue(64);
+	queue.push("left");
+	queue.push("over");
+	queue.close();
+
+	std::string out;
+	ASSERT_NE(queue.take(out, 1024, 10s), 0u);
+	ASSERT_EQ(out, "leftover");
+	ASSERT_EQ(queue.take(out, 1024, 10s), 0u);
+}
+
+TEST(RecordQueue_Consumer, ManyProducers)
+{
+	constexpr int producers = 4;
+	constexpr int perProducer = 100000;
+	Util::record_queue queue(4096, Util::backpressure::block);
+
+	std::vector<std::jthread> threads;
+	for (int p = 0; p < producers; ++p)
+	{
+		threads.emplace_back([&queue, p]
+		{
+			for (int i = 0; i < perProducer; ++i)
+			{
+				queue.push(std::string(1, static_cast<char>('a' + p)));
+			}
+		});
+	}
+
+	std::string out;
+	while (out.size() < producers * perProducer)
+	{
+		queue.mark_handled(queue.take(out, 1024, 10ms));
+	}
+
+	for (int p = 0; p < producers; ++p)
+	{
+		ASSERT_EQ(std::count(out.begin(), out.end(), static_cast<char>('a' + p)), perProducer);
+	}
+}
+
+TEST(RecordQueue_Consumer, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	// a typical log line
+	constexpr std::size_t messages = 200000;
+	const std::string line = "[2024-01-01 00:00:00.000] [debug] [taskbarattributeworker.cpp:123] Inserting window 0x1234 (explorer.exe) in visible windows of monitor 0x5678\n";
+
+	// the synchronous sink: one unbuffered write per entry, under the sink lock
+	{
+		std::FILE *file = std::tmpfile();
+		ASSERT_NE(file, nullptr);
+		std::setvbuf(file, nullptr, _IONBF, 0);
+		std::mutex lock;
+
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < messages; ++i)
+		{
+			std::scoped_lock guard(lock);
+			std::fwrite(line.data(), 1, line.size(), file);
+		}
+		const auto elapsed = clock::now() - start;
+		std::fclose(file);
+
+		std::printf("[ LOGSINK  ] synchronous: %lld ns/entry\n",
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / messages));
+	}
+
+	// the asynchronous sink: entries are queued, and a writer thread writes them in batches
+	{
+		std::FILE *file = std::tmpfile();
+		ASSERT_NE(file, nullptr);
+		std::setvbuf(file, nullptr, _IONBF, 0);
+		Util::record_queue queue(1024 * 1024);
+		std::uint64_t writes = 0;
+
+		std::jthread writer([&queue, file, &writes]
+		{
+			std::string batch;
+			while (const auto sequence = queue.take(batch, 64 * 1024, 1s))
+			{
+				if (!batch.empty())
+				{
+					std::fwrite(batch.data(), 1, batch.size(), file);
+					++writes;
+					batch.clear();
+				}
+
+				queue.mark_handled(sequence);
+			}
+		});
+
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < messages; ++i)
+		{
+			queue.push(line);
+		}
+		const auto logged = clock::now() - start;
+		queue.flush();
+		const auto elapsed = clock::now() - start;
+
+		queue.close();
+		writer.join();
+		ASSERT_EQ(std::ftell(file), static_cast<long>(messages * line.size()));
+		std::fclose(file);
+
+		std::printf("[ LOGSINK  ] asynchronous: %lld ns/entry for the caller, %lld ns/entry until written, %llu writes\n",
+			static_cast<long long>(duration_cast<nanoseconds>(logged).count() / messages),
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / messages),
+			static_cast<unsigned long long>(writes));
+	}
+}
@@ -0,0 +1,295 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "util/rotating_log.hpp"
+
+namespace {
+	struct FakeFileSystem {
+		struct entry {
+			std::string Contents;
+			std::uint64_t LastWrite = 0;
+			bool Locked = false; // like a file another process has open
+		};
+
+		std::map<std::filesystem::path, entry> Files;
+		std::uint64_t Clock = 0;
+		bool FailCreate = false;
+		std::size_t Flushes = 0;
+
+		void Add(const std::filesystem::path &path, bool locked = false)
+		{
+			Files[path] = { { }, ++Clock, locked };
+		}
+	};
+
+	class FakeStorage {
+		std::shared_ptr<FakeFileSystem> m_Fs;
+
+	public:
+		class file_type {
+			FakeFileSystem *m_Fs = nullptr;
+			std::filesystem::path m_Path;
+
+		public:
+			file_type() = default;
+			file_type(FakeFileSystem *fs, std::filesystem::path path) : m_Fs(fs), m_Path(std::move(path)) { }
+
+			explicit operator bool() const noexcept { return m_Fs != nullptr; }
+
+			bool append(std::string_view data)
+			{
+				auto &file = m_Fs->Files.at(m_Path);
+				file.Contents += data;
+				file.LastWrite = ++m_Fs->Clock;
+				return true;
+			}
+
+			bool flush()
+			{
+				++m_Fs->Flushes;
+				return true;
+			}
+		};
+
+		explicit FakeStorage(std::shared_ptr<FakeFileSystem> fs) : m_Fs(std::move(fs)) { }
+
+		file_type create(const std::filesystem::path &path)
+		{
+			if (m_Fs->FailCreate)
+			{
+				return { };
+			}
+
+			m_Fs->Files[path] = { { }, ++m_Fs->Clock, false };
+			return { m_Fs.get(), path };
+		}
+
+		std::vector<Util::stored_log_file> list(const std::filesystem::path &folder)
+		{
+			std::vector<Util::stored_log_file> files;
+			for (const auto &[path, file] : m_Fs->Files)
+			{
+				if (path.parent_path() == folder && path.extension() == ".log")
+				{
+					files.push_back({ path, file.LastWrite });
+				}
+			}
+
+			return files;
+		}
+
+		bool remove(const std::filesystem::path &path)
+		{
+			if (const auto it = m_Fs->Files.find(path); it != m_Fs->Files.end() && !it->second.Locked)
+			{
+				m_Fs->Files.erase(it);
+				return true;
+			}
+
+			return false;
+		}
+	};
+
+	using RotatingLog = Util::rotating_log<FakeStorage>;
+
+	const std::filesystem::path FOLDER = "logs";
+
+	std::vector<std::string> FileNames(const FakeFileSystem &fs)
+	{
+		std::vector<std::string> names;
+		for (const auto &[path, file] : fs.Files)
+		{
+			names.push_back(path.filename().string());
+		}
+
+		return names;
+	}
+}
+
+TEST(RotatingLog_Write, StaysInOneFileWithoutLimit)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log");
+	ASSERT_TRUE(log.open("BOM"));
+
+	for (int i = 0; i < 100; ++i)
+	{
+		ASSERT_TRUE(log.write("0123456789"));
+	}
+
+	ASSERT_EQ(fs->Files.size(), 1u);
+	ASSERT_EQ(fs->Files[FOLDER / "100.log"].Contents.size(), 3u + 1000u);
+	ASSERT_EQ(log.size(), 1003u);
+}
+
+TEST(RotatingLog_Write, StartsNewPartsWithPreamble)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log", { .MaxFileSize = 25 });
+	ASSERT_TRUE(log.open("H:"));
+
+	for (const auto entry : { "aaaaaaaaaa", "bbbbbbbbbb", "cccccccccc", "dddddddddd", "eeeeeeeeee" })
+	{
+		ASSERT_TRUE(log.write(entry));
+	}
+
+	ASSERT_EQ(FileNames(*fs), (std::vector<std::string> { "100.1.log", "100.2.log", "100.log" }));
+	ASSERT_EQ(fs->Files[FOLDER / "100.log"].Contents, "H:aaaaaaaaaabbbbbbbbbb");
+	ASSERT_EQ(fs->Files[FOLDER / "100.1.log"].Contents, "H:ccccccccccdddddddddd");
+	ASSERT_EQ(fs->Files[FOLDER / "100.2.log"].Contents, "H:eeeeeeeeee");
+	ASSERT_EQ(log.path(), FOLDER / "100.2.log");
+	ASSERT_EQ(log.part(), 2u);
+}
+
+TEST(RotatingLog_Write, OversizedWriteGetsItsOwnPart)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log", { .MaxFileSize = 8 });
+	ASSERT_TRUE(log.open(""));
+
+	ASSERT_TRUE(log.write(std::string(20, 'a')));
+	ASSERT_TRUE(log.write(std::string(20, 'b')));
+
+	ASSERT_EQ(fs->Files[FOLDER / "100.log"].Contents, std::string(20, 'a'));
+	ASSERT_EQ(fs->Files[FOLDER / "100.1.log"].Contents, std::string(20, 'b'));
+}
+
+TEST(RotatingLog_Write, PreambleAdditionsOnlyStartLaterParts)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log", { .MaxFileSize = 12 });
+	ASSERT_TRUE(log.open("M"));
+
+	ASSERT_TRUE(log.write("D1E1"));
+	log.add_to_preamble("D1");
+	ASSERT_TRUE(log.write("E1E1E1E1"));
+
+	ASSERT_EQ(fs->Files[FOLDER / "100.log"].Contents, "MD1E1");
+	ASSERT_EQ(fs->Files[FOLDER / "100.1.log"].Contents, "MD1E1E1E1E1");
+}
+
+TEST(RotatingLog_Write, KeepsWritingWhenRotationFails)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log", { .MaxFileSize = 10 });
+	ASSERT_TRUE(log.open(""));
+	ASSERT_TRUE(log.write("aaaaaaaa"));
+
+	fs->FailCreate = true;
+	ASSERT_TRUE(log.write("bbbbbbbb"));
+	ASSERT_TRUE(log.write("cc"));
+	ASSERT_EQ(fs->Files.size(), 1u);
+	ASSERT_EQ(fs->Files[FOLDER / "100.log"].Contents, "aaaaaaaabbbbbbbbcc");
+
+	// only tried again after another full part worth of data
+	fs->FailCreate = false;
+	ASSERT_TRUE(log.write("dddddddd"));
+	ASSERT_EQ(fs->Files.size(), 1u);
+	ASSERT_TRUE(log.write("eeeeeeee"));
+	ASSERT_EQ(fs->Files.size(), 2u);
+	ASSERT_EQ(fs->Files[FOLDER / "100.1.log"].Contents, "eeeeeeee");
+}
+
+TEST(RotatingLog_Write, FailsWhenNotOpen)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	fs->FailCreate = true;
+
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log");
+	ASSERT_FALSE(log.open(""));
+	ASSERT_FALSE(log.is_open());
+	ASSERT_FALSE(log.write("a"));
+	ASSERT_FALSE(log.flush());
+}
+
+TEST(RotatingLog_Cleanup, DeletesStaleLogsWhenOpening)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	for (const auto name : { "1.log", "2.log", "2.1.log", "3.log" })
+	{
+		fs->Add(FOLDER / name);
+	}
+	fs->Add(FOLDER / "3.ttbevents");
+	fs->Add("elsewhere/0.log");
+
+	RotatingLog log(FakeStorage(fs), FOLDER / "4.log", { .MaxFiles = 3 });
+	ASSERT_TRUE(log.open(""));
+
+	ASSERT_EQ(FileNames(*fs), (std::vector<std::string> { "0.log", "2.1.log", "3.log", "3.ttbevents", "4.log" }));
+}
+
+TEST(RotatingLog_Cleanup, LeavesRoomForTheLogBeforeOpening)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	for (const auto name : { "1.log", "2.log", "3.log" })
+	{
+		fs->Add(FOLDER / name);
+	}
+
+	RotatingLog log(FakeStorage(fs), FOLDER / "4.log", { .MaxFiles = 2 });
+	ASSERT_EQ(log.cleanup(), 2u);
+	ASSERT_EQ(FileNames(*fs), (std::vector<std::string> { "3.log" }));
+
+	ASSERT_TRUE(log.open(""));
+	ASSERT_EQ(FileNames(*fs), (std::vector<std::string> { "3.log", "4.log" }));
+}
+
+TEST(RotatingLog_Cleanup, DeletesOldPartsWhenRotating)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log", { .MaxFileSize = 4, .MaxFiles = 2 });
+	ASSERT_TRUE(log.open(""));
+
+	for (int i = 0; i < 5; ++i)
+	{
+		ASSERT_TRUE(log.write("abcd"));
+	}
+
+	ASSERT_EQ(FileNames(*fs), (std::vector<std::string> { "100.3.log", "100.4.log" }));
+}
+
+TEST(RotatingLog_Cleanup, SkipsFilesThatCantBeDeleted)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	fs->Add(FOLDER / "1.log", true);
+	fs->Add(FOLDER / "2.log");
+
+	RotatingLog log(FakeStorage(fs), FOLDER / "3.log", { .MaxFiles = 1 });
+	ASSERT_TRUE(log.open(""));
+
+	ASSERT_EQ(FileNames(*fs), (std::vector<std::string> { "1.log", "3.log" }));
+	ASSERT_EQ(log.cleanup(), 0u);
+}
+
+TEST(RotatingLog_Cleanup, NoLimitKeepsEverything)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	fs->Add(FOLDER / "1.log");
+
+	RotatingLog log(FakeStorage(fs), FOLDER / "2.log");
+	ASSERT_TRUE(log.open(""));
+	ASSERT_EQ(log.cleanup(), 0u);
+	ASSERT_EQ(fs->Files.size(), 2u);
+}
+
+TEST(RotatingLog_Settings, ChangingThemAppliesToTheCurrentPart)
+{
+	const auto fs = std::make_shared<FakeFileSystem>();
+	RotatingLog log(FakeStorage(fs), FOLDER / "100.log");
+	ASSERT_TRUE(log.open(""));
+	ASSERT_TRUE(log.write("aaaaaaaa"));
+
+	log.set_settings({ .MaxFileSize = 10 });
+	ASSERT_TRUE(log.write("bbbb"));
+	ASSERT_EQ(log.part(), 1u);
+
+	ASSERT_TRUE(log.flush());
+	ASSERT_EQ(fs->Flushes, 1u);
+}
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/substring_matcher.hpp"
+
+namespace {
+	std::optional<std::size_t> NaiveFind(const std::vector<std::wstring> &patterns, std::wstring_view text)
+	{
+		std::optional<std::size_t> best;
+		for (std::size_t i = 0; i < patterns.size(); ++i)
+		{
+			if (text.find(patterns[i]) != std::wstring_view::npos && (!best || patterns[i].length() > patterns[*best].length()))
+			{
+				best = i;
+			}
+		}
+
+		return best;
+	}
+
+	std::wstring RandomString(std::mt19937 &rng, std::size_t minLength, std::size_t maxLength)
+	{
+		std::uniform_int_distribution<std::size_t> length(minLength, maxLength);
+		std::uniform_int_distribution<int> character(L'a', L'h');
+
+		std::wstring str(length(rng), L'\0');
+		for (auto &c : str)
+		{
+			c = static_cast<wchar_t>(character(rng));
+		}
+
+		return str;
+	}
+}
+
+TEST(Util_SubstringMatcher, EmptyMatcherMatchesNothing)
+{
+	const Util::substring_matcher matcher;
+	ASSERT_FALSE(matcher.matches(L"anything"));
+	ASSERT_FALSE(matcher.find(L"anything").has_value());
+}
+
+TEST(Util_SubstringMatcher, FindsOverlappingPatterns)
+{
+	const std::vector<std::wstring> patterns { L"he", L"she", L"his", L"hers" };
+	const Util::substring_matcher matcher(patterns);
+
+	std::vector<std::pair<std::size_t, std::size_t>> found;
+	matcher.find_all(L"ushers", [&found](std::size_t index, std::size_t end)
+	{
+		found.emplace_back(index, end);
+	});
+
+	const std::vector<std::pair<std::size_t, std::size_t>> expected { { 1, 4 }, { 0, 4 }, { 3, 6 } };
+	ASSERT_EQ(found, expected);
+}
+
+TEST(Util_SubstringMatcher, LongestMatchWins)
+{
+	const std::vector<std::wstring> patterns { L"Mozilla", L"Mozilla Firefox", L"Firefox" };
+	const Util::substring_matcher matcher(patterns);
+
+	ASSERT_EQ(matcher.find(L"New Tab - Mozilla Firefox"), 1u);
+	ASSERT_EQ(matcher.find(L"Mozilla Thunderbird"), 0u);
+	ASSERT_FALSE(matcher.find(L"Microsoft Edge").has_value());
+}
+
+TEST(Util_SubstringMatcher, TiesGoToLowestIndex)
+{
+	const std::vector<std::wstring> patterns { L"abc", L"xyz", L"abc" };
+	const Util::substring_matcher matcher(patterns);
+
+	ASSERT_EQ(matcher.find(L"xyz abc"), 0u);
+	ASSERT_EQ(matcher.find(L"abc xyz"), 0u);
+}
+
+TEST(Util_SubstringMatcher, EmptyPatternMatchesEverything)
+{
+	const std::vector<std::wstring> patterns { L"", L"foo" };
+	const Util::substring_matcher matcher(patterns);
+
+	ASSERT_TRUE(matcher.matches(L""));
+	ASSERT_EQ(matcher.find(L"bar"), 0u);
+	ASSERT_EQ(matcher.find(L"foo"), 1u);
+}
+
+TEST(Util_SubstringMatcher, AgreesWithNaiveSearch)
+{
+	std::mt19937 rng(1234);
+	for (int round = 0; round < 20; ++round)
+	{
+		std::vector<std::wstring> patterns;
+		for (int i = 0; i < 50; ++i)
+		{
+			patterns.push_back(RandomString(rng, 1, 6));
+		}
+
+		const Util::substring_matcher matcher(patterns);
+		for (int i = 0; i < 200; ++i)
+		{
+			const auto text = RandomString(rng, 0, 40);
+			const auto expected = NaiveFind(patterns, text);
+
+			ASSERT_EQ(matcher.matches(text), expected.has_value());
+			if (expected)
+			{
+				// ties might be broken differently by the naive search, so compare lengths
+				ASSERT_EQ(patterns[*matcher.find(text)].length(), patterns[*expected].length());
+			}
+		}
+	}
+}
+
+TEST(Util_SubstringMatcher, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	std::mt19937 rng(42);
+	std::vector<std::wstring> titles;
+	for (int i = 0; i < 1000; ++i)
+	{
+		titles.push_back(RandomString(rng, 20, 80));
+	}
+
+	for (const std::size_t count : { 10, 100, 1000, 10000 })
+	{
+		std::vector<std::wstring> patterns;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			patterns.push_back(RandomString(rng, 8, 24));
+		}
+
+		const auto buildStart = clock::now();
+		const Util::substring_matcher matcher(patterns);
+		const auto buildTime = clock::now() - buildStart;
+
+		std::size_t naiveMatches = 0;
+		const auto naiveStart = clock::now();
+		for (const auto &title : titles)
+		{
+			naiveMatches += NaiveFind(patterns, title).has_value();
+		}
+		const auto naiveTime = clock::now() - naiveStart;
+
+		std::size_t matcherMatches = 0;
+		const auto matcherStart = clock::now();
+		for (const auto &title : titles)
+		{
+			matcherMatches += matcher.find(title).has_value();
+		}
+		const auto matcherTime = clock::now() - matcherStart;
+
+		ASSERT_EQ(matcherMatches, naiveMatches);
+
+		std::printf("[ MATCHER  ] %zu patterns: build %lld us, linear scan %lld ns/title, automaton %lld ns/title\n",
+			count,
+			static_cast<long long>(duration_cast<std::chrono::microseconds>(buildTime).count()),
+			static_cast<long long>(duration_cast<nanoseconds>(naiveTime).count() / static_cast<long long>(titles.size())),
+			static_cast<long long>(duration_cast<nanoseconds>(matcherTime).count() / static_cast<long long>(titles.size())));
+	}
+}
+
+TEST(Util_SubstringMatcher, RestoredMatcherMatchesTheSame)
+{
+	const std::vector<std::wstring> patterns { L"Mozilla", L"Mozilla Firefox", L"Firefox", L"fox" };
+	const Util::substring_matcher matcher(patterns);
+
+	const auto restored = Util::substring_matcher::restore(matcher.patterns(), matcher.nodes(), matcher.edges());
+	ASSERT_TRUE(restored.has_value());
+
+	for (const auto text : { L"New Tab - Mozilla Firefox", L"Mozilla Thunderbird", L"firefox", L"" })
+	{
+		ASSERT_EQ(restored->find(text), matcher.find(text));
+		ASSERT_EQ(restored->matches(text), matcher.matches(text));
+	}
+}
+
+TEST(Util_SubstringMatcher, RestoreRejectsInconsistentTables)
+{
+	const std::vector<std::wstring> patterns { L"he", L"she" };
+	const Util::substring_matcher matcher(patterns);
+
+	auto edges = matcher.edges();
+	edges.back().target = static_cast<std::uint32_t>(matcher.nodes().size());
+	ASSERT_FALSE(Util::substring_matcher::restore(matcher.patterns(), matcher.nodes(), edges).has_value());
+
+	auto nodes = matcher.nodes();
+	nodes.back().pattern = 2;
+	ASSERT_FALSE(Util::substring_matcher::restore(matcher.patterns(), nodes, matcher.edges()).has_value());
+
+	ASSERT_FALSE(Util::substring_matcher::restore(matcher.patterns(), { }, { }).has_value());
+}
+
+TEST(Util_SubstringMatcher, RestoreRejectsLinksThatLoop)
+{
+	const std::vector<std::wstring> patterns { L"he", L"she", L"hers" };
+	const Util::substring_matcher matcher(patterns);
+
+	// fail links pointing at themselves or deeper would make matching go around forever
+	auto nodes = matcher.nodes();
+	nodes.back().fail = static_cast<std::uint32_t>(nodes.size() - 1);
+	ASSERT_FALSE(Util::substring_matcher::restore(matcher.patterns(), nodes, matcher.edges()).has_value());
+
+	nodes = matcher.nodes();
+	nodes[1].next_output = static_cast<std::uint32_t>(nodes.size() - 1);
+	ASSERT_FALSE(Util::substring_matcher::restore(matcher.patterns(), nodes, matcher.edges()).has_value());
+
+	// an edge back to the root
+	auto edges = matcher.edges();
+	edges.back().target = 0;
+	ASSERT_FALSE(Util::substring_matcher::restore(matcher.patterns(), matcher.nodes(), edges).has_value());
+}
+
+TEST(Util_SubstringMatcher, RestoreOrBuildRebuildsDamagedTables)
+{
+	const std::vector<std::wstring> patterns { L"he", L"she", L"hers" };
+	const Util::substring_matcher matcher(patterns);
+
+	auto nodes = matcher.nodes();
+	for (auto &n : nodes)
+	{
+		n.fail = static_cast<std::uint32_t>(nodes.size() - 1);
+	}
+
+	const auto rebuilt = Util::substring_matcher::restore_or_build(matcher.patterns(), nodes, matcher.edges());
+	for (const auto text : { L"ushers", L"she sells", L"hhhhhhh", L"" })
+	{
+		ASSERT_EQ(rebuilt.find(text), matcher.find(text));
+	}
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "util/trace_recorder.hpp"
+
+namespace {
+	using phase = Util::trace_recorder::phase;
+
+	std::size_t CountOf(const std::string &str, const std::string &needle)
+	{
+		std::size_t count = 0;
+		for (auto pos = str.find(needle); pos != std::string::npos; pos = str.find(needle, pos + needle.size()))
+		{
+			++count;
+		}
+
+		return count;
+	}
+}
+
+TEST(TraceRecorder_Recording, DisabledRecordsNothing)
+{
+	Util::trace_recorder recorder;
+	{
+		const auto scope = recorder.trace("scope", "test");
+		recorder.instant("instant", "test");
+		recorder.begin_flow("flow", "test", recorder.new_flow());
+	}
+
+	ASSERT_TRUE(recorder.snapshot().empty());
+}
+
+TEST(TraceRecorder_Recording, ScopesAreCompleteEvents)
+{
+	Util::trace_recorder recorder;
+	recorder.enable(true);
+	{
+		const auto outer = recorder.trace("outer", "test");
+		{
+			const auto inner = recorder.trace("inner", "test");
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	const auto threads = recorder.snapshot();
+	ASSERT_EQ(threads.size(), 1u);
+
+	// recorded when they end, so the inner one first
+	const auto &events = threads[0].Events;
+	ASSERT_EQ(events.size(), 2u);
+	ASSERT_STREQ(events[0].Name, "inner");
+	ASSERT_STREQ(events[1].Name, "outer");
+	ASSERT_EQ(events[0].Phase, phase::complete);
+	ASSERT_GE(events[0].Value, 1000000u);
+
+	// the outer scope encloses the inner one
+	ASSERT_LE(events[1].Timestamp, events[0].Timestamp);
+	ASSERT_GE(events[1].Timestamp + events[1].Value, events[0].Timestamp + events[0].Value);
+}
+
+TEST(TraceRecorder_Recording, RingKeepsNewest)
+{
+	Util::trace_recorder recorder(8);
+	recorder.enable(true);
+	for (std::uint64_t i = 0; i < 20; ++i)
+	{
+		recorder.begin_flow("flow", "test", i);
+	}
+
+	const auto threads = recorder.snapshot();
+	ASSERT_EQ(threads.size(), 1u);
+	ASSERT_EQ(threads[0].Lost, 12u);
+	ASSERT_EQ(threads[0].Events.size(), 8u);
+	for (std::uint64_t i = 0; i < 8; ++i)
+	{
+		ASSERT_EQ(threads[0].Events[i].Value, 12 + i);
+	}
+
+	recorder.clear();
+	ASSERT_TRUE(recorder.snapshot()[0].Events.empty());
+
+	recorder.begin_flow("flow", "test", 42);
+	const auto afterClear = recorder.snapshot();
+	ASSERT_EQ(afterClear[0].Lost, 0u);
+	ASSERT_EQ(afterClear[0].Events.size(), 1u);
+	ASSERT_EQ(afterClear[0].Events[0].Value, 42u);
+}
+
+TEST(TraceRecorder_Recording, BufferPerThread)
+{
+	Util::trace_recorder recorder;
+	recorder.enable(true);
+	recorder.name_thread("main");
+	recorder.instant("main", "test");
+
+	const auto flow = recorder.new_flow();
+	recorder.begin_flow("handoff", "test", flow);
+	std::jthread([&recorder, flow]
+	{
+		recorder.name_thread("helper");
+		const auto scope = recorder.trace("helper", "test");
+		recorder.end_flow("handoff", "test", flow);
+	}).join();
+
+	const auto threads = recorder.snapshot();
+	ASSERT_EQ(threads.size(), 2u);
+	ASSERT_NE(threads[0].ThreadId, threads[1].ThreadId);
+	ASSERT_STREQ(threads[0].ThreadName, "main");
+	ASSERT_STREQ(threads[1].ThreadName, "helper");
+	ASSERT_EQ(threads[1].Events.size(), 2u);
+	ASSERT_EQ(threads[1].Events[0].Phase, phase::flow_end);
+	ASSERT_EQ(threads[1].Events[0].Value, flow);
+
+	// buffers of exited threads are kept until cleared
+	recorder.clear();
+	ASSERT_EQ(recorder.snapshot().size(), 1u);
+}
+
+TEST(TraceRecorder_Recording, SnapshotWhileRecording)
+{
+	Util::trace_recorder recorder(64);
+	recorder.enable(true);
+
+	std::atomic<bool> stop = false;
+	std::jthread writer([&recorder, &stop]
+	{
+		for (std::uint64_t i = 0; !stop.load(std::memory_order_relaxed); ++i)
+		{
+			recorder.begin_flow("flow", "test", i);
+		}
+	});
+
+	// whatever gets copied while the writer laps the ring must still be in order
+	for (int i = 0; i < 1000; ++i)
+	{
+		for (const auto &thread : recorder.snapshot())
+		{
+			for (std::size_t j = 1; j < thread.Events.size(); ++j)
+			{
+				ASSERT_EQ(thread.Events[j].Value, thread.Events[j - 1].Value + 1);
+			}
+		}
+	}
+
+	stop = true;
+}
+
+TEST(TraceRecorder_Json, ChromeFormat)
+{
+	Util::trace_recorder recorder;
+	recorder.enable(true);
+	recorder.name_thread("\"quoted\"");
+	const auto now = Util::trace_recorder::clock::now();
+	recorder.complete("refresh", "worker", now, now + std::chrono::nanoseconds(1500));
+	recorder.begin_flow("reload", "config", 7);
+	recorder.end_flow("reload", "config", 7);
+	recorder.instant("tick", "worker");
+
+	const auto json = recorder.to_chrome_json(1234);
+	ASSERT_EQ(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0u);
+	ASSERT_EQ(json.substr(json.size() - 2), "]}");
+	ASSERT_NE(json.find("\"args\":{\"name\":\"\\\"quoted\\\"\"}"), std::string::npos);
+	ASSERT_NE(json.find("\"name\":\"refresh\",\"cat\":\"worker\",\"ph\":\"X\",\"pid\":1234"), std::string::npos);
+	ASSERT_NE(json.find("\"dur\":1.500"), std::string::npos);
+	ASSERT_NE(json.find("\"ph\":\"s\""), std::string::npos);
+	ASSERT_NE(json.find("\"id\":7,\"bp\":\"e\""), std::string::npos);
+	ASSERT_NE(json.find("\"ph\":\"i\""), std::string::npos);
+	ASSERT_EQ(CountOf(json, "\"pid\":1234"), 5u);
+}
+
+TEST(TraceRecorder_Recording, DISABLED_Benchmark)
+{
+	using clock = std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	constexpr std::size_t iterations = 1000000;
+	Util::trace_recorder recorder;
+
+	for (const bool enabled : { false, true })
+	{
+		recorder.enable(enabled);
+
+		// warm up, which also allocates the buffer
+		for (std::size_t i = 0; i < 1000; ++i)
+		{
+			const auto scope = recorder.trace("scope", "bench");
+		}
+
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < iterations; ++i)
+		{
+			const auto scope = recorder.trace("scope", "bench");
+		}
+		const auto elapsed = clock::now() - start;
+
+		std::printf("[ TRACE    ] %s: %lld ns/scope\n", enabled ? "enabled" : "disabled",
+			static_cast<long long>(duration_cast<nanoseconds>(elapsed).count() / iterations));
+	}
+}
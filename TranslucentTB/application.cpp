@@ -10,11 +10,15 @@
 #include "../ProgramLog/error/win32.hpp"
 #include "uwp/uwp.hpp"
 
-void Application::ConfigurationChanged(void *context)
+void Application::ConfigurationChanged(void *context, const ConfigDiff &diff, std::chrono::steady_clock::time_point changedAt)
 {
 	const auto that = static_cast<Application *>(context);
-	that->m_Worker.ConfigurationChanged();
-	that->m_AppWindow.ConfigurationChanged();
+	that->m_Worker.ConfigurationReloaded(diff, changedAt);
+
+	if (diff.Tray)
+	{
+		that->m_AppWindow.ConfigurationChanged();
+	}
 }
 
 winrt::TranslucentTB::Xaml::App Application::CreateXamlApp() try
@@ -1,5 +1,6 @@
 #pragma once
 #include "arch.h"
+#include <chrono>
 #include <filesystem>
 #include <memory>
 #include <optional>
@@ -21,7 +22,7 @@
 #include "uwp/xamlthreadpool.hpp"
 
 class Application final {
-	static void ConfigurationChanged(void *context);
+	static void ConfigurationChanged(void *context, const ConfigDiff &diff, std::chrono::steady_clock::time_point changedAt);
 	static winrt::TranslucentTB::Xaml::App CreateXamlApp();
 
 	ConfigManager m_Config;
@@ -14,6 +14,7 @@
 #include "../ProgramLog/error/winrt.hpp"
 #include "../ProgramLog/log.hpp"
 #include "uwp/uwp.hpp"
+#include "util/trace_recorder.hpp"
 
 void HardenProcess()
 {
@@ -95,6 +96,7 @@ _Use_decl_annotations_ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, wchar
 #ifdef _DEBUG
 	SetThreadDescription(GetCurrentThread(), APP_NAME L" Main Thread");
 #endif
+	Util::trace_recorder::global().name_thread("Main Thread");
 
 	auto storageFolder = UWP::GetAppStorageFolder();
 	Log::Initialize(storageFolder);
@@ -139,6 +141,12 @@ _Use_decl_annotations_ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, wchar
 	// Run the main program loop. When this method exits, TranslucentTB itself is about to exit.
 	const auto ret = Application(hInstance, std::move(storageFolder)).Run();
 
+	// the log is written from another thread, and won't get the chance to finish.
+	if (const auto sink = Log::GetSink())
+	{
+		sink->flush();
+	}
+
 	// why are we brutally terminating you might ask?
 	// Windows.UI.Xaml.dll likes to read null pointers if you exit the app too quickly after
 	// closing a XAML window. While this is not a big deal for the user since we
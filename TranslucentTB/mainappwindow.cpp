@@ -1,12 +1,21 @@
 #include "mainappwindow.hpp"
+#include <cstdio>
+#include <format>
 #include <member_thunk/member_thunk.hpp>
+#include <processthreadsapi.h>
+#include <share.h>
+#include <string>
+#include <wil/resource.h>
 
 #include "application.hpp"
 #include "constants.hpp"
 #include "localization.hpp"
 #include "resources/ids.h"
 #include "../ProgramLog/log.hpp"
+#include "../ProgramLog/error/errno.hpp"
 #include "../ProgramLog/error/win32.hpp"
+#include "util/binary_log.hpp"
+#include "util/trace_recorder.hpp"
 
 LRESULT MainAppWindow::MessageHandler(UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
@@ -78,6 +87,9 @@ void MainAppWindow::RefreshMenu()
 		trayPage.SinkState(txmp::LogSinkState::Failed);
 	}
 
+	trayPage.SetRecordWorkerEvents(m_App.GetWorker().IsRecordingEvents());
+	trayPage.SetCollectWorkerMetrics(m_App.GetWorker().IsCollectingMetrics());
+	trayPage.SetRecordPerformanceTrace(Util::trace_recorder::global().enabled());
 	trayPage.SetDisableSavingSettings(settings.DisableSaving);
 
 	trayPage.SetStartupState(m_App.GetStartupManager().GetState());
@@ -92,6 +104,10 @@ void MainAppWindow::RegisterMenuHandlers()
 	m_OpenLogFileRequestedRevoker = menu.OpenLogFileRequested(winrt::auto_revoke, { this, &MainAppWindow::OpenLogFileRequested });
 	m_LogLevelChangedRevoker = menu.LogLevelChanged(winrt::auto_revoke, { this, &MainAppWindow::LogLevelChanged });
 	m_DumpDynamicStateRequestedRevoker = menu.DumpDynamicStateRequested(winrt::auto_revoke, { this, &MainAppWindow::DumpDynamicStateRequested });
+	m_DumpFlightRecorderRequestedRevoker = menu.DumpFlightRecorderRequested(winrt::auto_revoke, MainAppWindow::DumpFlightRecorderRequested);
+	m_RecordWorkerEventsChangedRevoker = menu.RecordWorkerEventsChanged(winrt::auto_revoke, { this, &MainAppWindow::RecordWorkerEventsChanged });
+	m_CollectWorkerMetricsChangedRevoker = menu.CollectWorkerMetricsChanged(winrt::auto_revoke, { this, &MainAppWindow::CollectWorkerMetricsChanged });
+	m_RecordPerformanceTraceChangedRevoker = menu.RecordPerformanceTraceChanged(winrt::auto_revoke, MainAppWindow::RecordPerformanceTraceChanged);
 	m_EditSettingsRequestedRevoker = menu.EditSettingsRequested(winrt::auto_revoke, { this, &MainAppWindow::EditSettingsRequested });
 	m_ResetSettingsRequestedRevoker = menu.ResetSettingsRequested(winrt::auto_revoke, { this, &MainAppWindow::ResetSettingsRequested });
 	m_ResetDynamicStateRequestedRevoker = menu.ResetDynamicStateRequested(winrt::auto_revoke, { this, &MainAppWindow::ResetDynamicStateRequested });
@@ -112,6 +128,7 @@ void MainAppWindow::TaskbarSettingsChanged(const txmp::TaskbarState &state, cons
 	// restore color because the context menu doesn't transmit that info
 	appearance.Color(config.Color);
 
+	auto diff = ConfigDiff::OfAppearance(static_cast<std::size_t>(state));
 	if (const auto optAppearance = appearance.try_as<txmp::OptionalTaskbarAppearance>())
 	{
 		if (state == txmp::TaskbarState::Desktop) [[unlikely]]
@@ -119,14 +136,17 @@ void MainAppWindow::TaskbarSettingsChanged(const txmp::TaskbarState &state, cons
 			throw std::invalid_argument("Desktop appearance is not optional");
 		}
 
-		static_cast<OptionalTaskbarAppearance &>(config) = optAppearance;
+		auto &optConfig = static_cast<OptionalTaskbarAppearance &>(config);
+		const bool wasEnabled = optConfig.Enabled;
+		optConfig = optAppearance;
+		diff.EnabledStates = optConfig.Enabled != wasEnabled;
 	}
 	else
 	{
 		config = appearance;
 	}
 
-	m_App.GetWorker().ConfigurationChanged();
+	m_App.GetWorker().ConfigurationChanged(diff);
 }
 
 void MainAppWindow::ColorRequested(const txmp::TaskbarState &state)
@@ -190,8 +210,72 @@ void MainAppWindow::OpenLogFileRequested()
 {
 	if (const auto sink = Log::GetSink())
 	{
-		HresultVerify(win32::EditFile(sink->file()), spdlog::level::err, L"Failed to open log file.");
+		// writes what the writer thread still holds, and drops the padding of the mapped file.
+		sink->flush();
+
+		if (sink->format() == Util::log_format::binary)
+		{
+			if (const auto decoded = DecodeBinaryLog(sink->file()); !decoded.empty())
+			{
+				HresultVerify(win32::EditFile(decoded), spdlog::level::err, L"Failed to open log file.");
+			}
+		}
+		else
+		{
+			HresultVerify(win32::EditFile(sink->file()), spdlog::level::err, L"Failed to open log file.");
+		}
+	}
+}
+
+std::filesystem::path MainAppWindow::DecodeBinaryLog(const std::filesystem::path &log)
+{
+	std::string contents;
+	{
+		// the log is still being written to
+		wil::unique_file file(_wfsopen(log.c_str(), L"rbS", _SH_DENYNO));
+		if (!file)
+		{
+			ErrnoTHandle(errno, spdlog::level::warn, L"Failed to open binary log file");
+			return { };
+		}
+
+		char buffer[64 * 1024];
+		while (const auto read = std::fread(buffer, 1, sizeof(buffer), file.get()))
+		{
+			contents.append(buffer, read);
+		}
+	}
+
+	std::string text(UTF8_BOM);
+	Util::binary_log::reader reader(contents);
+	Util::binary_log::message message;
+	while (reader.next(message))
+	{
+		text += Util::binary_log::format_line(message);
+		text += "\r\n";
+	}
+
+	auto path = log;
+	path.replace_extension(L".decoded.log");
+
+	wil::unique_file file;
+	if (const errno_t err = _wfopen_s(file.put(), path.c_str(), L"wbS"); err == 0)
+	{
+		if (std::fwrite(text.data(), 1, text.size(), file.get()) == text.size())
+		{
+			return path;
+		}
+		else
+		{
+			ErrnoTHandle(errno, spdlog::level::warn, L"Failed to write decoded log file");
+		}
 	}
+	else
+	{
+		ErrnoTHandle(err, spdlog::level::warn, L"Failed to open decoded log file");
+	}
+
+	return { };
 }
 
 void MainAppWindow::LogLevelChanged(const txmp::LogLevel &level)
@@ -208,6 +292,87 @@ void MainAppWindow::DumpDynamicStateRequested()
 	m_App.GetWorker().DumpState();
 }
 
+void MainAppWindow::DumpFlightRecorderRequested()
+{
+	Log::DumpFlightRecorder(L"requested from tray");
+}
+
+void MainAppWindow::RecordWorkerEventsChanged(bool recording)
+{
+	auto &worker = m_App.GetWorker();
+	if (recording)
+	{
+		worker.StartRecordingEvents();
+	}
+	else
+	{
+		worker.StopRecordingEvents();
+	}
+}
+
+void MainAppWindow::CollectWorkerMetricsChanged(bool collecting)
+{
+	auto &worker = m_App.GetWorker();
+	if (collecting)
+	{
+		worker.StartCollectingMetrics();
+	}
+	else
+	{
+		worker.StopCollectingMetrics();
+	}
+}
+
+void MainAppWindow::RecordPerformanceTraceChanged(bool recording)
+{
+	auto &tracer = Util::trace_recorder::global();
+	if (recording)
+	{
+		if (!tracer.enabled())
+		{
+			tracer.clear();
+			tracer.enable(true);
+			MessagePrint(spdlog::level::info, L"Started recording performance trace");
+		}
+	}
+	else if (tracer.enabled())
+	{
+		tracer.enable(false);
+		SavePerformanceTrace();
+	}
+}
+
+void MainAppWindow::SavePerformanceTrace()
+{
+	const auto sink = Log::GetSink();
+	if (!sink)
+	{
+		MessagePrint(spdlog::level::warn, L"Discarding performance trace because there is no log file");
+		return;
+	}
+
+	auto path = sink->file();
+	path.replace_extension(L".ttbtrace.json");
+
+	wil::unique_file file;
+	if (const errno_t err = _wfopen_s(file.put(), path.c_str(), L"wbS"); err == 0)
+	{
+		const auto json = Util::trace_recorder::global().to_chrome_json(GetCurrentProcessId());
+		if (std::fwrite(json.data(), 1, json.size(), file.get()) == json.size())
+		{
+			MessagePrint(spdlog::level::info, std::format(L"Saved performance trace to {}", path.native()));
+		}
+		else
+		{
+			ErrnoTHandle(errno, spdlog::level::warn, L"Failed to write performance trace");
+		}
+	}
+	else
+	{
+		ErrnoTHandle(err, spdlog::level::warn, L"Failed to open performance trace file");
+	}
+}
+
 void MainAppWindow::EditSettingsRequested()
 {
 	m_App.GetConfigManager().EditConfigFile();
@@ -216,10 +381,10 @@ void MainAppWindow::EditSettingsRequested()
 void MainAppWindow::ResetSettingsRequested()
 {
 	auto &manager = m_App.GetConfigManager();
-	manager.GetConfig() = { };
+	const auto diff = manager.ResetConfig();
 
 	manager.UpdateVerbosity();
-	m_App.GetWorker().ConfigurationChanged();
+	m_App.GetWorker().ConfigurationChanged(diff);
 	ConfigurationChanged();
 }
 
@@ -2,6 +2,7 @@
 #include "arch.h"
 #include "tray/traycontextmenu.hpp"
 #include <cstddef>
+#include <filesystem>
 #include <spdlog/common.h>
 #include <tuple>
 #include <windef.h>
@@ -35,6 +36,10 @@ private:
 	page_t::OpenLogFileRequested_revoker m_OpenLogFileRequestedRevoker;
 	page_t::LogLevelChanged_revoker m_LogLevelChangedRevoker;
 	page_t::DumpDynamicStateRequested_revoker m_DumpDynamicStateRequestedRevoker;
+	page_t::DumpFlightRecorderRequested_revoker m_DumpFlightRecorderRequestedRevoker;
+	page_t::RecordWorkerEventsChanged_revoker m_RecordWorkerEventsChangedRevoker;
+	page_t::CollectWorkerMetricsChanged_revoker m_CollectWorkerMetricsChangedRevoker;
+	page_t::RecordPerformanceTraceChanged_revoker m_RecordPerformanceTraceChangedRevoker;
 	page_t::EditSettingsRequested_revoker m_EditSettingsRequestedRevoker;
 	page_t::ResetSettingsRequested_revoker m_ResetSettingsRequestedRevoker;
 	page_t::DisableSavingSettingsChanged_revoker m_DisableSavingSettingsChangedRevoker;
@@ -57,8 +62,14 @@ private:
 	void ColorRequested(const txmp::TaskbarState &state);
 
 	void OpenLogFileRequested();
+	static std::filesystem::path DecodeBinaryLog(const std::filesystem::path &log);
 	void LogLevelChanged(const txmp::LogLevel &level);
 	void DumpDynamicStateRequested();
+	static void DumpFlightRecorderRequested();
+	void RecordWorkerEventsChanged(bool recording);
+	void CollectWorkerMetricsChanged(bool collecting);
+	static void RecordPerformanceTraceChanged(bool recording);
+	static void SavePerformanceTrace();
 	void EditSettingsRequested();
 	void ResetSettingsRequested();
 	void DisableSavingSettingsChanged(bool disabled) noexcept;
@@ -1,11 +1,13 @@
 #include "configmanager.hpp"
 #include <cerrno>
 #include <cstdio>
+#include <fileapi.h>
+#include <memoryapi.h>
 #include <rapidjson/encodedstream.h>
 #include <rapidjson/error/error.h>
-#include <rapidjson/filereadstream.h>
-#include <rapidjson/filewritestream.h>
+#include <rapidjson/memorystream.h>
 #include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
 #include <share.h>
 #include <Shlwapi.h>
 #include <wil/resource.h>
@@ -19,7 +21,9 @@
 #include "../../ProgramLog/error/win32.hpp"
 #include "../../ProgramLog/error/winrt.hpp"
 #include "../../ProgramLog/log.hpp"
+#include "config/configsnapshot.hpp"
 #include "config/rapidjsonhelper.hpp"
+#include "util/trace_recorder.hpp"
 #include "win32.hpp"
 #include "../localization.hpp"
 #include "../resources/ids.h"
@@ -47,17 +51,29 @@ void ConfigManager::WatcherCallback(void *context, DWORD, std::wstring_view file
 	if (fileName.empty() || win32::IsSameFilename(fileName, CONFIG_FILE))
 	{
 		const auto that = static_cast<ConfigManager *>(context);
+		if (that->m_SavedStamp && that->m_SavedStamp == that->GetFileStamp())
+		{
+			// our own save, there's nothing new to load
+			return;
+		}
+
+		auto &tracer = Util::trace_recorder::global();
+		const auto trace = tracer.trace("ConfigManager::WatcherCallback", "config");
+		that->m_ReloadFlow = tracer.new_flow();
+		tracer.begin_flow("ConfigReload", "config", that->m_ReloadFlow);
 
-		if (!that->ScheduleReload())
+		const auto now = std::chrono::steady_clock::now();
+		if (!that->ScheduleReload(that->m_ReloadDebounce.change(now)))
 		{
-			that->Reload();
+			that->Reload(that->m_ReloadDebounce.settle(now));
 		}
 	}
 }
 
 void ConfigManager::TimerCallback(void *context, DWORD, DWORD)
 {
-	static_cast<ConfigManager *>(context)->Reload();
+	const auto that = static_cast<ConfigManager *>(context);
+	that->Reload(that->m_ReloadDebounce.settle(std::chrono::steady_clock::now()));
 }
 
 bool ConfigManager::TryOpenConfigAsJson() noexcept
@@ -94,16 +110,15 @@ bool ConfigManager::TryOpenConfigAsJson() noexcept
 	}
 }
 
-void ConfigManager::SaveToFile(FILE *f) const
+std::string ConfigManager::Serialize() const
 {
 	static constexpr std::string_view COMMENT = "// See https://TranslucentTB.github.io/config for more information\n";
 	static constexpr std::wstring_view SCHEMA = L"https://TranslucentTB.github.io/settings.schema.json";
 
-	char buffer[1024];
-	rj::FileWriteStream filestream(f, buffer, std::size(buffer));
+	rj::StringBuffer buffer;
 
-	using OutputStream = rj::EncodedOutputStream<rj::UTF8<>, rj::FileWriteStream>;
-	OutputStream out(filestream, true);
+	using OutputStream = rj::EncodedOutputStream<rj::UTF8<>, rj::StringBuffer>;
+	OutputStream out(buffer, true);
 
 	for (const char c : COMMENT)
 	{
@@ -119,57 +134,254 @@ void ConfigManager::SaveToFile(FILE *f) const
 	writer.EndObject();
 
 	writer.Flush();
+	return { buffer.GetString(), buffer.GetSize() };
 }
 
-bool ConfigManager::LoadFromFile(FILE *f)
+std::optional<ConfigManager::FileStamp> ConfigManager::GetFileStamp() const noexcept
 {
-	static constexpr std::wstring_view DESERIALIZE_FAILED = L"Failed to deserialize JSON document";
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (GetFileAttributesEx(m_ConfigPath.c_str(), GetFileExInfoStandard, &data))
+	{
+		return FileStamp {
+			.LastWrite = (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime,
+			.Size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow
+		};
+	}
+	else
+	{
+		return std::nullopt;
+	}
+}
 
-	char buffer[1024];
-	rj::FileReadStream filestream(f, buffer, std::size(buffer));
+bool ConfigManager::WriteConfigFile(std::string_view contents) const
+{
+	std::filesystem::path tempFile = m_ConfigPath;
+	tempFile.replace_extension(L".tmp");
 
-	rj::AutoUTFInputStream<uint32_t, rj::FileReadStream> in(filestream);
+	wil::unique_file file;
+	if (const errno_t err = _wfopen_s(file.put(), tempFile.c_str(), L"wbS"); err != 0)
+	{
+		ErrnoTHandle(err, spdlog::level::err, L"Failed to save configuration!");
+		return false;
+	}
 
-	rj::GenericDocument<rj::UTF16LE<>> doc;
-	if (const rj::ParseResult result = doc.ParseStream<rj::kParseCommentsFlag | rj::kParseTrailingCommasFlag, rj::AutoUTF<uint32_t>>(in))
+	if (fwrite(contents.data(), 1, contents.size(), file.get()) != contents.size() || fflush(file.get()) != 0)
 	{
-		// remove the schema key to avoid a false unknown key warning
-		doc.RemoveMember(rjh::StringViewToValue(SCHEMA_KEY));
+		// don't replace the settings with half of them
+		ErrnoTHandle(errno, spdlog::level::err, L"Failed to write temporary configuration file");
+		return false;
+	}
 
-		try
+	file.reset();
+	if (!ReplaceFile(m_ConfigPath.c_str(), tempFile.c_str(), nullptr, REPLACEFILE_WRITE_THROUGH | REPLACEFILE_IGNORE_MERGE_ERRORS | REPLACEFILE_IGNORE_ACL_ERRORS, nullptr, nullptr))
+	{
+		// If the target file doesn't exist (e.g. brand new installation of TranslucentTB), ReplaceFile fails.
+		if (const auto lastErr = GetLastError(); lastErr == ERROR_FILE_NOT_FOUND)
 		{
-			// load the defaults before deserializing to not reuse previous settings
-			// in case some keys are missing from the file
-			m_Config = { };
-			m_Config.Deserialize(doc, [](std::wstring_view unknownKey)
+			if (!MoveFileEx(tempFile.c_str(), m_ConfigPath.c_str(), MOVEFILE_WRITE_THROUGH))
 			{
-				if (Error::ShouldLog<spdlog::level::info>())
-				{
-					MessagePrint(spdlog::level::info, std::format(L"Unknown key found in JSON: {}", unknownKey));
-				}
-			});
+				LastErrorHandle(spdlog::level::err, L"Failed to move temporary configuration file");
+				return false;
+			}
+		}
+		else
+		{
+			HresultHandle(HRESULT_FROM_WIN32(lastErr), spdlog::level::err, L"Failed to replace configuration file");
+			return false;
+		}
+	}
 
-			// everything went fine, we can return!
-			return true;
+	return true;
+}
+
+void ConfigManager::WriteSnapshot(const std::filesystem::path &path, std::string_view snapshot) noexcept
+{
+	std::filesystem::path tempFile = path;
+	tempFile += L".tmp";
+
+	{
+		const wil::unique_hfile file(CreateFile(tempFile.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+		if (!file)
+		{
+			LastErrorHandle(spdlog::level::info, L"Failed to create configuration snapshot");
+			return;
+		}
+
+		DWORD written = 0;
+		if (!WriteFile(file.get(), snapshot.data(), static_cast<DWORD>(snapshot.size()), &written, nullptr) || written != snapshot.size())
+		{
+			LastErrorHandle(spdlog::level::info, L"Failed to write configuration snapshot");
+			return;
 		}
-		HelperDeserializationErrorCatch(spdlog::level::err, DESERIALIZE_FAILED)
-		StdSystemErrorCatch(spdlog::level::err, DESERIALIZE_FAILED);
 	}
-	else if (result.Code() != rj::kParseErrorDocumentEmpty)
+
+	// readers only ever see a complete snapshot.
+	if (!MoveFileEx(tempFile.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		LastErrorHandle(spdlog::level::info, L"Failed to replace configuration snapshot");
+	}
+}
+
+bool ConfigManager::LoadFromSnapshot(std::uint64_t key)
+{
+	const wil::unique_hfile file(CreateFile(m_SnapshotPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+	if (!file)
 	{
-		ParseErrorCodeHandle(result.Code(), spdlog::level::err, DESERIALIZE_FAILED);
+		// there's none until the settings got parsed once
+		return false;
 	}
 
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file.get(), &size) || size.QuadPart < static_cast<LONGLONG>(ConfigSnapshot::HEADER_SIZE) || size.QuadPart > UINT32_MAX)
+	{
+		return false;
+	}
+
+	const wil::unique_handle mapping(CreateFileMapping(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if (!mapping)
+	{
+		LastErrorHandle(spdlog::level::info, L"Failed to map configuration snapshot");
+		return false;
+	}
+
+	const wil::unique_mapview_ptr<char> view(static_cast<char *>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0)));
+	if (!view)
+	{
+		LastErrorHandle(spdlog::level::info, L"Failed to map view of configuration snapshot");
+		return false;
+	}
+
+	return ConfigSnapshot::Read({ view.get(), static_cast<std::size_t>(size.QuadPart) }, key, m_Config);
+}
+
+void ConfigManager::SaveSnapshot(std::uint64_t key)
+{
+	if (m_Config.DisableSaving)
+	{
+		return;
+	}
+
+	if (m_SnapshotWriter.joinable())
+	{
+		m_SnapshotWriter.join();
+	}
+
+	try
+	{
+		m_SnapshotWriter = std::thread([path = m_SnapshotPath, snapshot = ConfigSnapshot::Write(m_Config, key)]() noexcept
+		{
+			WriteSnapshot(path, snapshot);
+		});
+	}
+	StdSystemErrorCatch(spdlog::level::info, L"Failed to start writing configuration snapshot");
+}
+
+std::optional<ConfigManager::FileContents> ConfigManager::ReadConfigFile(bool &fileExists) const
+{
+	if (const wil::unique_file file { _wfsopen(m_ConfigPath.c_str(), L"rbS", _SH_DENYNO) })
+	{
+		// note: this demarks if the file exists, even if reading it fails.
+		fileExists = true;
+
+		std::string contents;
+		char buffer[4096];
+		while (const std::size_t read = fread(buffer, 1, std::size(buffer), file.get()))
+		{
+			contents.append(buffer, read);
+		}
+
+		if (ferror(file.get()))
+		{
+			ErrnoTHandle(errno, spdlog::level::err, L"Failed to read configuration file");
+			return std::nullopt;
+		}
+
+		const auto key = ConfigSnapshot::Key(contents);
+		return FileContents { std::move(contents), key };
+	}
+	else
+	{
+		const errno_t err = errno;
+		fileExists = err != ENOENT;
+		if (fileExists)
+		{
+			// if the file failed to open, but it exists, something went wrong
+			ErrnoTHandle(err, spdlog::level::err, L"Failed to open configuration file");
+		}
+
+		return std::nullopt;
+	}
+}
+
+bool ConfigManager::LoadFromContents(const FileContents &contents)
+{
+	if (LoadFromSnapshot(contents.Key))
+	{
+		MessagePrint(spdlog::level::debug, L"Loaded configuration from snapshot");
+		return true;
+	}
+	else if (LoadFromJson(contents.Data))
+	{
+		SaveSnapshot(contents.Key);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool ConfigManager::LoadFromJson(std::string_view contents)
+{
+	static constexpr std::wstring_view DESERIALIZE_FAILED = L"Failed to deserialize JSON document";
+
+	rj::MemoryStream memstream(contents.data(), contents.size());
+
+	using InputStream = rj::AutoUTFInputStream<uint32_t, rj::MemoryStream>;
+	InputStream in(memstream);
+
+	// deserialize straight from the parser, without building a document first
+	rjh::StreamReader<InputStream, rj::AutoUTF<uint32_t>, rj::kParseCommentsFlag | rj::kParseTrailingCommasFlag> reader(in);
+
+	try
+	{
+		// load the defaults before deserializing to not reuse previous settings
+		// in case some keys are missing from the file
+		m_Config = { };
+		m_Config.Deserialize(reader, [](std::wstring_view unknownKey)
+		{
+			// the schema key is only there for editors
+			if (unknownKey != SCHEMA_KEY && Error::ShouldLog<spdlog::level::info>())
+			{
+				MessagePrint(spdlog::level::info, std::format(L"Unknown key found in JSON: {}", unknownKey));
+			}
+		});
+
+		// everything went fine, we can return!
+		return true;
+	}
+	catch (const rjh::ParseError &err)
+	{
+		if (err.code != rj::kParseErrorDocumentEmpty)
+		{
+			ParseErrorCodeHandle(err.code, spdlog::level::err, DESERIALIZE_FAILED);
+		}
+	}
+	HelperDeserializationErrorCatch(spdlog::level::err, DESERIALIZE_FAILED)
+	StdSystemErrorCatch(spdlog::level::err, DESERIALIZE_FAILED);
+
 	// parsing failed, use defaults
 	m_Config = { };
 	return false;
 }
 
-bool ConfigManager::Load(bool firstLoad)
+void ConfigManager::Load(const std::optional<FileContents> &contents, bool firstLoad)
 {
-	if (const wil::unique_file file { _wfsopen(m_ConfigPath.c_str(), L"rbS", _SH_DENYNO) })
+	if (contents)
 	{
-		if (LoadFromFile(file.get()))
+		// a file that failed to parse counts as loaded too, it would only fail again.
+		m_FileKey = contents->Key;
+		if (LoadFromContents(*contents))
 		{
 			if (firstLoad)
 			{
@@ -186,42 +398,66 @@ bool ConfigManager::Load(bool firstLoad)
 				Localization::ShowLocalizedMessageBox(IDS_LANGUAGE_CHANGED, MB_OK | MB_ICONINFORMATION | MB_SETFOREGROUND, wil::GetModuleInstanceHandle(), newLang ? LANGIDFROMLCID(newLang) : MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL)).detach();
 			}
 		}
-
-		// note: this demarks if the file exists, even if parsing failed.
-		return true;
 	}
 	else
 	{
-		const errno_t err = errno;
-		const bool fileExists = err != ENOENT;
-		if (fileExists)
-		{
-			// if the file failed to open, but it exists, something went wrong
-			ErrnoTHandle(err, spdlog::level::err, L"Failed to open configuration file");
-		}
-
-		// opening file failed, use defaults
+		// reading the file failed, use defaults
+		m_FileKey.reset();
 		m_Config = { };
-		return fileExists;
 	}
 }
 
-void ConfigManager::Reload()
+void ConfigManager::Reload(std::chrono::steady_clock::time_point changedAt)
 {
-	Load();
-	UpdateVerbosity();
-	m_Callback(m_Context);
+	auto &tracer = Util::trace_recorder::global();
+	const auto trace = tracer.trace("ConfigManager::Reload", "config");
+	tracer.end_flow("ConfigReload", "config", m_ReloadFlow);
+
+	bool fileExists = false;
+	const auto contents = ReadConfigFile(fileExists);
+	if (contents && m_FileKey == contents->Key)
+	{
+		// editors that write a temporary file, rename it and touch timestamps land here.
+		MessagePrint(spdlog::level::debug, L"Configuration file changed, but its contents didn't");
+		m_Callback(m_Context, { }, changedAt);
+		return;
+	}
+
+	const Config previous = std::move(m_Config);
+	Load(contents);
+
+	const auto diff = Commit(previous);
+	if (diff.empty())
+	{
+		// only reformatting or comments changed, nothing needs a refresh.
+		MessagePrint(spdlog::level::debug, L"Configuration file changed, but its settings didn't");
+	}
+	else if (diff.Logging)
+	{
+		UpdateVerbosity();
+	}
+
+	m_Callback(m_Context, diff, changedAt);
+}
+
+ConfigDiff ConfigManager::Commit(const Config &previous)
+{
+	const auto diff = ConfigDiff::Compute(previous, m_Config);
+	if (diff.InvalidatesWindowCaches())
+	{
+		++m_Generation;
+	}
+
+	return diff;
 }
 
-bool ConfigManager::ScheduleReload()
+bool ConfigManager::ScheduleReload(std::chrono::steady_clock::duration delay)
 {
 	if (m_ReloadTimer)
 	{
 		LARGE_INTEGER waitTime{};
-		// 200 ms, relative to current time. arbitrarily chosen to get a balance
-		// between feeling snappy and not triggering errors due to the various weird
-		// ways editors save files.
-		waitTime.QuadPart = -2000000;
+		// in 100 ns units, negative meaning relative to current time
+		waitTime.QuadPart = -std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, 10'000'000>>>(delay).count();
 		if (SetWaitableTimer(m_ReloadTimer.get(), &waitTime, 0, TimerCallback, this, false))
 		{
 			return true;
@@ -237,8 +473,11 @@ bool ConfigManager::ScheduleReload()
 
 ConfigManager::ConfigManager(const std::optional<std::filesystem::path> &storageFolder, bool &fileExists, callback_t callback, void *context) :
 	m_ConfigPath(DetermineConfigPath(storageFolder)),
+	m_SnapshotPath(std::filesystem::path(m_ConfigPath).replace_extension(SNAPSHOT_EXTENSION)),
+	m_Generation(0),
 	m_Watcher(m_ConfigPath.parent_path(), false, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE, WatcherCallback, this),
 	m_ReloadTimer(CreateWaitableTimer(nullptr, true, nullptr)),
+	m_ReloadFlow(0),
 	m_ShownChangeWarning(false),
 	m_Callback(callback),
 	m_Context(context)
@@ -248,8 +487,14 @@ ConfigManager::ConfigManager(const std::optional<std::filesystem::path> &storage
 		LastErrorHandle(spdlog::level::warn, L"Failed to create waitable timer");
 	}
 
-	fileExists = Load(true);
+	Load(ReadConfigFile(fileExists), true);
 	UpdateVerbosity();
+
+	// with the retention from the settings rather than the default one.
+	if (const auto sink = Log::GetSink())
+	{
+		sink->remove_stale_logs();
+	}
 }
 
 ConfigManager::~ConfigManager()
@@ -261,6 +506,11 @@ ConfigManager::~ConfigManager()
 			LastErrorHandle(spdlog::level::info, L"Failed to cancel reload timer");
 		}
 	}
+
+	if (m_SnapshotWriter.joinable())
+	{
+		m_SnapshotWriter.join();
+	}
 }
 
 void ConfigManager::UpgradeBlur()
@@ -289,6 +539,9 @@ void ConfigManager::UpdateVerbosity()
 	if (const auto sink = Log::GetSink())
 	{
 		sink->set_level(m_Config.LogVerbosity);
+		sink->set_backpressure(m_Config.LogOverflow);
+		sink->set_format(m_Config.LogFormat);
+		sink->set_rotation(Config::GetLogRotation(m_Config.LogMaxFileSize, m_Config.LogRetainedFiles));
 	}
 }
 
@@ -307,43 +560,46 @@ void ConfigManager::DeleteConfigFile()
 	std::error_code errc;
 	std::filesystem::remove(m_ConfigPath, errc);
 	StdErrorCodeVerify(errc, spdlog::level::warn, L"Failed to delete config file");
+
+	std::filesystem::remove(m_SnapshotPath, errc);
+	StdErrorCodeVerify(errc, spdlog::level::info, L"Failed to delete config snapshot");
+
+	m_FileKey.reset();
+	m_SavedStamp.reset();
 }
 
-void ConfigManager::SaveConfig() const
+void ConfigManager::SaveConfig()
 {
 	if (m_Config.DisableSaving)
 	{
 		return;
 	}
 
-	std::filesystem::path tempFile = m_ConfigPath;
-	tempFile.replace_extension(L".tmp");
-
-	wil::unique_file file;
-	const errno_t err = _wfopen_s(file.put(), tempFile.c_str(), L"wbS");
-	if (err == 0)
+	const auto contents = Serialize();
+	const auto key = ConfigSnapshot::Key(contents);
+	if (m_FileKey == key)
 	{
-		SaveToFile(file.get());
-
-		file.reset();
-		if (!ReplaceFile(m_ConfigPath.c_str(), tempFile.c_str(), nullptr, REPLACEFILE_WRITE_THROUGH | REPLACEFILE_IGNORE_MERGE_ERRORS | REPLACEFILE_IGNORE_ACL_ERRORS, nullptr, nullptr))
-		{
-			// If the target file doesn't exist (e.g. brand new installation of TranslucentTB), ReplaceFile fails.
-			if (const auto lastErr = GetLastError(); lastErr == ERROR_FILE_NOT_FOUND)
-			{
-				if (!MoveFileEx(tempFile.c_str(), m_ConfigPath.c_str(), MOVEFILE_WRITE_THROUGH))
-				{
-					LastErrorHandle(spdlog::level::err, L"Failed to move temporary configuration file");
-				}
-			}
-			else
-			{
-				HresultHandle(HRESULT_FROM_WIN32(lastErr), spdlog::level::err, L"Failed to replace configuration file");
-			}
-		}
+		// exiting without changing anything lands here, there's no need to touch the file.
+		MessagePrint(spdlog::level::debug, L"Configuration file already up to date");
+		return;
 	}
-	else
+
+	if (WriteConfigFile(contents))
 	{
-		ErrnoTHandle(err, spdlog::level::err, L"Failed to save configuration!");
+		m_FileKey = key;
+		m_SavedStamp = GetFileStamp();
+
+		// the file now holds the current settings, so the snapshot can be of them
+		// and the next launch doesn't have to parse what was just written.
+		SaveSnapshot(key);
 	}
 }
+
+ConfigDiff ConfigManager::ResetConfig()
+{
+	// the file doesn't reflect the settings anymore, reload it even if it stays the same.
+	m_FileKey.reset();
+
+	const Config previous = std::exchange(m_Config, { });
+	return Commit(previous);
+}
@@ -1,13 +1,19 @@
 #pragma once
 #include "arch.h"
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <synchapi.h>
+#include <thread>
 #include <type_traits>
 #include <wil/resource.h>
 
 #include "config/config.hpp"
+#include "config/configdiff.hpp"
+#include "util/adaptive_debounce.hpp"
 #include "../folderwatcher.hpp"
 
 class ConfigManager {
@@ -15,18 +21,50 @@ class ConfigManager {
 	// the file as JSON with comments
 	static constexpr std::wstring_view CONFIG_FILE = L"settings.json";
 	static constexpr std::wstring_view SCHEMA_KEY = L"$schema";
+	static constexpr std::wstring_view SNAPSHOT_EXTENSION = L".snapshot";
 
-	using callback_t = std::add_pointer_t<void(void *)>;
+	// gets when the settings file started changing, the diff is empty if the settings didn't change.
+	using callback_t = std::add_pointer_t<void(void *, const ConfigDiff &, std::chrono::steady_clock::time_point)>;
+
+	// The settings file as it was read, along with its snapshot key.
+	struct FileContents {
+		std::string Data;
+		std::uint64_t Key;
+	};
+
+	// Last write time and size of the settings file, enough to recognize it as we saved it.
+	struct FileStamp {
+		std::uint64_t LastWrite;
+		std::uint64_t Size;
+
+		bool operator ==(const FileStamp &) const noexcept = default;
+	};
 
 	static std::filesystem::path DetermineConfigPath(const std::optional<std::filesystem::path> &storageFolder);
 	static void WatcherCallback(void *context, DWORD, std::wstring_view fileName);
 	static void APIENTRY TimerCallback(void *context, DWORD timerLow, DWORD timerHigh);
+	static void WriteSnapshot(const std::filesystem::path &path, std::string_view snapshot) noexcept;
 
 	std::filesystem::path m_ConfigPath;
+	std::filesystem::path m_SnapshotPath; // compiled copy of the settings, see ConfigSnapshot
 	Config m_Config;
+
+	// bumped whenever a new config changes the rules or the window filter.
+	// lets users of the config know their derived state is stale.
+	std::uint64_t m_Generation;
 	FolderWatcher m_Watcher;
 
 	wil::unique_handle m_ReloadTimer;
+	std::uint64_t m_ReloadFlow; // links the file change to the reload in performance traces
+	Util::adaptive_debounce m_ReloadDebounce;
+
+	// key of what the settings file was last loaded from or saved with, if any.
+	// changes to the file that don't touch its contents don't need a reload,
+	// and saving settings that didn't change doesn't need a write.
+	std::optional<std::uint64_t> m_FileKey;
+
+	// the settings file right after our last save, so that the watcher ignores that write.
+	std::optional<FileStamp> m_SavedStamp;
 
 	std::wstring m_StartupLanguage;
 	bool m_ShownChangeWarning;
@@ -34,12 +72,25 @@ class ConfigManager {
 	callback_t m_Callback;
 	void *m_Context;
 
+	// writes the snapshot of the last settings that had to be parsed
+	std::thread m_SnapshotWriter;
+
 	bool TryOpenConfigAsJson() noexcept;
-	void SaveToFile(FILE *f) const;
-	bool LoadFromFile(FILE *f);
-	bool Load(bool firstLoad = false);
-	void Reload();
-	bool ScheduleReload();
+	std::string Serialize() const;
+	std::optional<FileStamp> GetFileStamp() const noexcept;
+	bool WriteConfigFile(std::string_view contents) const;
+	bool LoadFromSnapshot(std::uint64_t key);
+	void SaveSnapshot(std::uint64_t key);
+	std::optional<FileContents> ReadConfigFile(bool &fileExists) const;
+	bool LoadFromContents(const FileContents &contents);
+	bool LoadFromJson(std::string_view contents);
+	void Load(const std::optional<FileContents> &contents, bool firstLoad = false);
+	void Reload(std::chrono::steady_clock::time_point changedAt);
+	// waits for the editor to be done saving. see Util::adaptive_debounce for how long that is.
+	bool ScheduleReload(std::chrono::steady_clock::duration delay);
+
+	// Compares the config with what it replaced, and bumps the generation if needed.
+	ConfigDiff Commit(const Config &previous);
 
 public:
 	ConfigManager(const std::optional<std::filesystem::path> &storageFolder, bool &fileExists, callback_t callback, void *context);
@@ -49,10 +100,16 @@ public:
 	void UpdateVerbosity();
 	void EditConfigFile();
 	void DeleteConfigFile();
-	void SaveConfig() const;
+	void SaveConfig();
+	ConfigDiff ResetConfig();
 
 	constexpr Config &GetConfig() noexcept
 	{
 		return m_Config;
 	}
+
+	constexpr std::uint64_t GetConfigGeneration() const noexcept
+	{
+		return m_Generation;
+	}
 };
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+
+// Same values as TranslucentTB.Xaml.Models.Primitives.TaskbarState,
+// but usable without pulling in the WinRT projection.
+enum class AppearanceState : std::uint8_t {
+	Desktop,
+	VisibleWindow,
+	MaximisedWindow,
+	StartOpened,
+	SearchOpened,
+	TaskViewOpened,
+	BatterySaver
+};
+
+constexpr std::uint8_t AppearanceStateBit(AppearanceState state) noexcept
+{
+	return static_cast<std::uint8_t>(1u << static_cast<std::uint8_t>(state));
+}
+
+// Global (not per-monitor) state that decides which appearance a taskbar gets.
+template<typename Monitor>
+struct AppearanceInputs {
+	bool PowerSaver = false;
+	bool TaskViewActive = false;
+	bool PeekActive = false;
+	bool IsWindows11 = false;
+	Monitor StartMonitor = { };
+	Monitor SearchMonitor = { };
+	Monitor FindInStartMonitor = { };
+};
+
+// Picks which of the user's appearances applies to the taskbar on monitor.
+// enabledStates is a mask of AppearanceStateBit for the optional appearances that are enabled.
+// Rules of the visible and maximised appearances are not considered here, the caller is
+// expected to look them up when this returns either of those states.
+template<typename Monitor>
+constexpr AppearanceState ResolveAppearanceState(const AppearanceInputs<Monitor> &inputs, std::uint8_t enabledStates, Monitor monitor, bool hasMaximised, bool hasNormal) noexcept
+{
+	const auto enabled = [enabledStates](AppearanceState state)
+	{
+		return (enabledStates & AppearanceStateBit(state)) != 0;
+	};
+
+	if (enabled(AppearanceState::BatterySaver) && inputs.PowerSaver)
+	{
+		return AppearanceState::BatterySaver;
+	}
+
+	if (enabled(AppearanceState::TaskViewOpened) && inputs.TaskViewActive)
+	{
+		return AppearanceState::TaskViewOpened;
+	}
+
+	// Task View is ignored by peek, so shall we
+	if (inputs.PeekActive)
+	{
+		return AppearanceState::Desktop;
+	}
+
+	const Monitor null = { };
+	const bool searchOpened = inputs.SearchMonitor == monitor || inputs.FindInStartMonitor == monitor;
+
+	// on windows 11, search is considered open when start is, so we need to check for start first.
+	bool startOpened;
+	if (inputs.IsWindows11 && (inputs.SearchMonitor != null || inputs.FindInStartMonitor != null))
+	{
+		// checking the search monitor is more reliable on windows 11 (if available)
+		// so check the start monitor to see if it's open and then use the search monitor
+		// to check *where* it's open.
+		startOpened = inputs.StartMonitor != null && searchOpened;
+	}
+	else
+	{
+		startOpened = inputs.StartMonitor == monitor;
+	}
+
+	if (enabled(AppearanceState::StartOpened) && startOpened)
+	{
+		return AppearanceState::StartOpened;
+	}
+
+	if (enabled(AppearanceState::SearchOpened) && !startOpened && searchOpened)
+	{
+		return AppearanceState::SearchOpened;
+	}
+
+	if (enabled(AppearanceState::MaximisedWindow) && hasMaximised)
+	{
+		return AppearanceState::MaximisedWindow;
+	}
+
+	if (enabled(AppearanceState::VisibleWindow) && (hasMaximised || hasNormal))
+	{
+		return AppearanceState::VisibleWindow;
+	}
+
+	return AppearanceState::Desktop;
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "util/flat_hash.hpp"
+
+// A WinEvent, as received by the hook callback.
+template<typename Window>
+struct QueuedWinEvent {
+	std::uint32_t Event = 0;
+	Window Handle { };
+	std::int32_t Object = 0;
+	std::int32_t Child = 0;
+	std::uint32_t Time = 0;
+};
+
+// Bounded single producer, single consumer ring buffer. Neither push() nor take() block or
+// allocate (take() only allocates if the output vector has to grow), so events can be
+// queued from a hook callback even while the consumer is busy.
+// push() must only be called from one thread, and take(), take_overflow(), clear() and
+// count_coalesced() from one thread. They don't have to be the same thread. stats() can
+// be called from anywhere.
+//
+// When the ring is full, new items get dropped and the queue is marked as overflowed.
+// Since the consumer then missed something, it should take_overflow() and resynchronize
+// its state some other way.
+template<typename T, std::size_t Capacity>
+class EventQueue {
+	static_assert(std::has_single_bit(Capacity), "Capacity must be a power of two");
+
+public:
+	struct Stats {
+		std::uint64_t Received = 0;
+		std::uint64_t Dropped = 0;
+		std::uint64_t Overflows = 0; // times the consumer had to resynchronize
+		std::uint64_t Coalesced = 0;
+		std::size_t MaxDepth = 0;
+	};
+
+private:
+	// head and tail only ever increase, the slot is the low bits.
+	// keep them on their own cache line so producer and consumer don't fight over it.
+	alignas(64) std::atomic<std::size_t> m_Head = 0; // written by the consumer
+	alignas(64) std::atomic<std::size_t> m_Tail = 0; // written by the producer
+	alignas(64) std::atomic<bool> m_Overflowed = false;
+
+	// written by the producer
+	std::atomic<std::uint64_t> m_Received = 0;
+	std::atomic<std::uint64_t> m_Dropped = 0;
+	std::atomic<std::size_t> m_MaxDepth = 0;
+
+	// written by the consumer
+	std::atomic<std::uint64_t> m_Overflows = 0;
+	std::atomic<std::uint64_t> m_Coalesced = 0;
+
+	std::unique_ptr<T[]> m_Slots;
+
+public:
+	EventQueue() : m_Slots(std::make_unique<T[]>(Capacity)) { }
+
+	EventQueue(const EventQueue &) = delete;
+	EventQueue &operator =(const EventQueue &) = delete;
+
+	// Producer side. Returns false if the item got dropped because the queue is full.
+	bool push(const T &item) noexcept
+	{
+		m_Received.fetch_add(1, std::memory_order_relaxed);
+
+		const auto tail = m_Tail.load(std::memory_order_relaxed);
+		const auto depth = tail - m_Head.load(std::memory_order_acquire);
+		if (depth == Capacity)
+		{
+			m_Dropped.fetch_add(1, std::memory_order_relaxed);
+			m_Overflowed.store(true, std::memory_order_release);
+			return false;
+		}
+
+		m_Slots[tail & (Capacity - 1)] = item;
+		m_Tail.store(tail + 1, std::memory_order_release);
+
+		if (depth + 1 > m_MaxDepth.load(std::memory_order_relaxed))
+		{
+			m_MaxDepth.store(depth + 1, std::memory_order_relaxed);
+		}
+
+		return true;
+	}
+
+	// Consumer side. Appends everything queued right now to out, and returns how many items
+	// that was. Items pushed while this runs are left for the next call.
+	std::size_t take(std::vector<T> &out)
+	{
+		const auto head = m_Head.load(std::memory_order_relaxed);
+		const auto tail = m_Tail.load(std::memory_order_acquire);
+		for (auto i = head; i != tail; ++i)
+		{
+			out.push_back(m_Slots[i & (Capacity - 1)]);
+		}
+
+		m_Head.store(tail, std::memory_order_release);
+		return tail - head;
+	}
+
+	// Consumer side. Returns whether items were dropped since the last call, and if so,
+	// discards everything still queued: the consumer has to resynchronize anyway.
+	bool take_overflow() noexcept
+	{
+		if (m_Overflowed.exchange(false, std::memory_order_acquire))
+		{
+			m_Overflows.fetch_add(1, std::memory_order_relaxed);
+			clear();
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	// Consumer side.
+	void clear() noexcept
+	{
+		m_Head.store(m_Tail.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	// Consumer side.
+	void count_coalesced(std::size_t count) noexcept
+	{
+		m_Coalesced.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// Only exact when called from the consumer with the producer idle.
+	std::size_t size() const noexcept
+	{
+		return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+	}
+
+	bool empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	static constexpr std::size_t capacity() noexcept
+	{
+		return Capacity;
+	}
+
+	Stats stats() const noexcept
+	{
+		return {
+			.Received = m_Received.load(std::memory_order_relaxed),
+			.Dropped = m_Dropped.load(std::memory_order_relaxed),
+			.Overflows = m_Overflows.load(std::memory_order_relaxed),
+			.Coalesced = m_Coalesced.load(std::memory_order_relaxed),
+			.MaxDepth = m_MaxDepth.load(std::memory_order_relaxed)
+		};
+	}
+};
+
+// Identifies the kind of event and the window it is for, see CoalesceWinEvents.
+template<typename Window>
+struct WinEventKey {
+	Window Handle { };
+	std::uint32_t Event = 0;
+
+	bool operator ==(const WinEventKey &) const = default;
+};
+
+template<typename Window>
+struct WinEventKeyHash {
+	std::size_t operator()(const WinEventKey<Window> &key) const noexcept
+	{
+		return std::hash<Window> { }(key.Handle) * 31 + key.Event;
+	}
+};
+
+// Removes every event that is followed by another event of the same kind for the same window
+// later in the batch, and keeps the order of the others. Returns how many events got removed.
+//
+// This is enough for handlers that look at the current state of the window rather than at
+// what the event says: only the last one of a burst of location changes does anything useful.
+// Keeping the last event rather than the first preserves the relative order of the last
+// change of each window, so things like a sequence of raises still end up in the same z-order.
+template<typename Window>
+std::size_t CoalesceWinEvents(std::vector<QueuedWinEvent<Window>> &events)
+{
+	if (events.size() < 2)
+	{
+		return 0;
+	}
+
+	Util::flat_hash_set<WinEventKey<Window>, WinEventKeyHash<Window>> seen;
+	seen.reserve(events.size());
+
+	// walk backwards so the last event of each kind is the one that gets kept,
+	// and pack the kept ones at the end.
+	std::size_t first = events.size();
+	for (std::size_t i = events.size(); i-- > 0;)
+	{
+		if (seen.insert({ events[i].Handle, events[i].Event }).second)
+		{
+			events[--first] = events[i];
+		}
+	}
+
+	events.erase(events.begin(), events.begin() + first);
+	return first;
+}
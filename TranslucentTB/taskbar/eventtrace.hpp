@@ -0,0 +1,372 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Compact binary recording of the events seen by the taskbar attribute worker,
+// along with what the worker knew about the window at the time. Handles are replaced
+// with small sequential identifiers, both to keep the trace small and to not leak
+// anything about the machine it was recorded on.
+//
+// Layout: the magic and version, followed by records. Every record starts with the event
+// byte and the time elapsed since the previous record in milliseconds (zigzag varint),
+// and is followed by an event-specific payload. All integers are LEB128 varints.
+// When read back, record times are relative to the first record.
+
+enum class TraceEvent : std::uint8_t {
+	// Full snapshot of the worker state, recorded whenever the state gets reset.
+	Reset,
+
+	// Window events, payload is a window.
+	Create,
+	Destroy,
+	Show,
+	Hide,
+	Cloak,
+	Uncloak,
+	MinimizeStart,
+	MinimizeEnd,
+	LocationChange,
+	NameChange,
+	ParentChange,
+	Foreground,
+	Reorder,
+
+	// Shell state events, payload is a monitor and the new state.
+	StartVisibility,
+	SearchVisibility,
+	FindInStartVisibility,
+
+	// Global state events, payload is the new state.
+	TaskViewVisibility,
+	Peek,
+	PowerSaver,
+
+	Max = PowerSaver
+};
+
+namespace TraceWindowFlags {
+	static constexpr std::uint8_t Valid = 1 << 0;
+	static constexpr std::uint8_t Matches = 1 << 1; // user window that isn't ignored by the config
+	static constexpr std::uint8_t Maximised = 1 << 2;
+	static constexpr std::uint8_t Minimised = 1 << 3;
+	static constexpr std::uint8_t Taskbar = 1 << 4;
+	static constexpr std::uint8_t CoreWindow = 1 << 5;
+}
+
+namespace TraceGlobalFlags {
+	static constexpr std::uint8_t PowerSaver = 1 << 0;
+	static constexpr std::uint8_t TaskViewActive = 1 << 1;
+	static constexpr std::uint8_t PeekActive = 1 << 2;
+	static constexpr std::uint8_t Windows11 = 1 << 3;
+}
+
+struct TraceWindow {
+	std::uint32_t Id = 0;      // 0 is the null window
+	std::uint32_t Monitor = 0; // 0 is no monitor
+	std::uint8_t Flags = 0;
+
+	constexpr bool has(std::uint8_t flag) const noexcept
+	{
+		return (Flags & flag) == flag;
+	}
+
+	constexpr bool operator ==(const TraceWindow &) const noexcept = default;
+};
+
+struct TraceRecord {
+	TraceEvent Event = TraceEvent::Reset;
+	std::uint32_t Time = 0;
+
+	// Window events use the whole window, shell state events only the monitor.
+	// For resets, this is the foreground window.
+	TraceWindow Window;
+
+	// Shell and global state events.
+	bool State = false;
+
+	// Reset only.
+	std::uint8_t GlobalFlags = 0;
+	std::uint32_t StartMonitor = 0;
+	std::uint32_t SearchMonitor = 0;
+	std::uint32_t FindInStartMonitor = 0;
+	std::vector<TraceWindow> Taskbars;
+	std::vector<TraceWindow> Windows;
+
+	constexpr bool is_window_event() const noexcept
+	{
+		return Event >= TraceEvent::Create && Event <= TraceEvent::Reorder;
+	}
+
+	constexpr bool is_shell_event() const noexcept
+	{
+		return Event >= TraceEvent::StartVisibility && Event <= TraceEvent::FindInStartVisibility;
+	}
+
+	bool operator ==(const TraceRecord &) const = default;
+};
+
+class EventTraceWriter {
+public:
+	static constexpr std::array<std::uint8_t, 4> MAGIC = { 'T', 'T', 'B', 'E' };
+	static constexpr std::uint8_t VERSION = 1;
+
+private:
+	std::vector<std::uint8_t> m_Buffer;
+	std::unordered_map<std::uintptr_t, std::uint32_t> m_WindowIds;
+	std::unordered_map<std::uintptr_t, std::uint32_t> m_MonitorIds;
+	std::uint32_t m_LastTime = 0;
+	bool m_HasTime = false;
+	std::size_t m_RecordCount = 0;
+
+	static std::uint32_t MapId(std::unordered_map<std::uintptr_t, std::uint32_t> &map, std::uintptr_t handle)
+	{
+		if (handle == 0)
+		{
+			return 0;
+		}
+
+		return map.try_emplace(handle, static_cast<std::uint32_t>(map.size() + 1)).first->second;
+	}
+
+	void put(std::uint8_t byte)
+	{
+		m_Buffer.push_back(byte);
+	}
+
+	void put_varint(std::uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			put(static_cast<std::uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+
+		put(static_cast<std::uint8_t>(value));
+	}
+
+	void put_window(const TraceWindow &window)
+	{
+		put_varint(window.Id);
+		put_varint(window.Monitor);
+		put(window.Flags);
+	}
+
+public:
+	EventTraceWriter()
+	{
+		m_Buffer.assign(MAGIC.begin(), MAGIC.end());
+		put(VERSION);
+	}
+
+	// Maps a native handle to its identifier in the trace.
+	template<typename T>
+	std::uint32_t window_id(T *handle)
+	{
+		return MapId(m_WindowIds, reinterpret_cast<std::uintptr_t>(handle));
+	}
+
+	template<typename T>
+	std::uint32_t monitor_id(T *handle)
+	{
+		return MapId(m_MonitorIds, reinterpret_cast<std::uintptr_t>(handle));
+	}
+
+	void write(const TraceRecord &record)
+	{
+		put(static_cast<std::uint8_t>(record.Event));
+
+		// tick counts wrap around, and hook events can arrive slightly out of order:
+		// compute the difference with wrapping and store it zigzag encoded.
+		const auto delta = m_HasTime ? static_cast<std::int32_t>(record.Time - m_LastTime) : 0;
+		put_varint((static_cast<std::uint32_t>(delta) << 1) ^ static_cast<std::uint32_t>(delta >> 31));
+		m_LastTime = record.Time;
+		m_HasTime = true;
+
+		if (record.Event == TraceEvent::Reset)
+		{
+			put(record.GlobalFlags);
+			put_varint(record.StartMonitor);
+			put_varint(record.SearchMonitor);
+			put_varint(record.FindInStartMonitor);
+			put_window(record.Window);
+
+			put_varint(record.Taskbars.size());
+			for (const auto &taskbar : record.Taskbars)
+			{
+				put_varint(taskbar.Id);
+				put_varint(taskbar.Monitor);
+			}
+
+			put_varint(record.Windows.size());
+			for (const auto &window : record.Windows)
+			{
+				put_window(window);
+			}
+		}
+		else if (record.is_window_event())
+		{
+			put_window(record.Window);
+		}
+		else if (record.is_shell_event())
+		{
+			put_varint(record.Window.Monitor);
+			put(record.State);
+		}
+		else
+		{
+			put(record.State);
+		}
+
+		++m_RecordCount;
+	}
+
+	std::span<const std::uint8_t> data() const noexcept
+	{
+		return m_Buffer;
+	}
+
+	std::size_t record_count() const noexcept
+	{
+		return m_RecordCount;
+	}
+};
+
+class EventTraceReader {
+	std::span<const std::uint8_t> m_Data;
+	std::size_t m_Position;
+	std::uint32_t m_Time;
+
+	[[noreturn]] static void ThrowTruncated()
+	{
+		throw std::runtime_error("Event trace is truncated");
+	}
+
+	std::uint8_t get()
+	{
+		if (m_Position >= m_Data.size())
+		{
+			ThrowTruncated();
+		}
+
+		return m_Data[m_Position++];
+	}
+
+	std::uint64_t get_varint()
+	{
+		std::uint64_t value = 0;
+		for (unsigned int shift = 0; shift < 64; shift += 7)
+		{
+			const std::uint8_t byte = get();
+			value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				return value;
+			}
+		}
+
+		throw std::runtime_error("Event trace contains an invalid integer");
+	}
+
+	std::uint32_t get_varint32()
+	{
+		const auto value = get_varint();
+		if (value > UINT32_MAX)
+		{
+			throw std::runtime_error("Event trace contains an out of range integer");
+		}
+
+		return static_cast<std::uint32_t>(value);
+	}
+
+	TraceWindow get_window()
+	{
+		TraceWindow window;
+		window.Id = get_varint32();
+		window.Monitor = get_varint32();
+		window.Flags = get();
+		return window;
+	}
+
+public:
+	explicit EventTraceReader(std::span<const std::uint8_t> data) : m_Data(data), m_Position(0), m_Time(0)
+	{
+		for (const std::uint8_t expected : EventTraceWriter::MAGIC)
+		{
+			if (get() != expected)
+			{
+				throw std::runtime_error("Not an event trace");
+			}
+		}
+
+		if (get() != EventTraceWriter::VERSION)
+		{
+			throw std::runtime_error("Unsupported event trace version");
+		}
+	}
+
+	std::optional<TraceRecord> next()
+	{
+		if (m_Position == m_Data.size())
+		{
+			return std::nullopt;
+		}
+
+		TraceRecord record;
+		const std::uint8_t event = get();
+		if (event > static_cast<std::uint8_t>(TraceEvent::Max))
+		{
+			throw std::runtime_error("Event trace contains an unknown event");
+		}
+
+		record.Event = static_cast<TraceEvent>(event);
+
+		const auto zigzag = get_varint32();
+		const auto delta = static_cast<std::int32_t>((zigzag >> 1) ^ (0u - (zigzag & 1)));
+		m_Time += static_cast<std::uint32_t>(delta);
+		record.Time = m_Time;
+
+		if (record.Event == TraceEvent::Reset)
+		{
+			record.GlobalFlags = get();
+			record.StartMonitor = get_varint32();
+			record.SearchMonitor = get_varint32();
+			record.FindInStartMonitor = get_varint32();
+			record.Window = get_window();
+
+			const auto taskbarCount = get_varint32();
+			for (std::uint32_t i = 0; i < taskbarCount; ++i)
+			{
+				TraceWindow &taskbar = record.Taskbars.emplace_back();
+				taskbar.Id = get_varint32();
+				taskbar.Monitor = get_varint32();
+			}
+
+			const auto windowCount = get_varint32();
+			for (std::uint32_t i = 0; i < windowCount; ++i)
+			{
+				record.Windows.push_back(get_window());
+			}
+		}
+		else if (record.is_window_event())
+		{
+			record.Window = get_window();
+		}
+		else if (record.is_shell_event())
+		{
+			record.Window.Monitor = get_varint32();
+			record.State = get() != 0;
+		}
+		else
+		{
+			record.State = get() != 0;
+		}
+
+		return record;
+	}
+};
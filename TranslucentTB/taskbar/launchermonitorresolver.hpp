@@ -0,0 +1,127 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "util/histogram.hpp"
+
+// Figures out which monitor a launcher (Start, Search, Find in Start) opened on, without
+// blocking the thread that got told it opened.
+//
+// We assume the launcher is the foreground window once it's opened, but the foreground
+// window isn't always updated yet when we get notified. So the owner applies a guess right
+// away (the monitor the launcher was last on), and resolves the real monitor from the first
+// foreground change that happened after the launcher opened, or after a short delay when
+// there's none. If the guess was wrong, the owner corrects it.
+template<typename Monitor>
+class LauncherMonitorResolver {
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Resolution {
+		Monitor Guess;
+		Monitor Actual;
+		bool Corrected;
+	};
+
+	struct Stats {
+		std::uint64_t Hits = 0;
+		std::uint64_t Corrections = 0;
+		std::uint64_t Abandoned = 0; // closed before being resolved
+
+		// microseconds from the launcher opening to the right monitor being applied.
+		// guesses that were right count as no time at all.
+		Util::log2_histogram Latency;
+	};
+
+private:
+	Monitor m_LastKnown { };
+	Monitor m_Guess { };
+	bool m_Pending = false;
+	std::uint32_t m_OpenedTick = 0;
+	clock::time_point m_OpenedAt;
+	Stats m_Stats;
+
+public:
+	// Starts a resolution, and returns the monitor to use until then. tick is the time
+	// in the same unit and base as the timestamps later passed to accepts().
+	Monitor open(Monitor fallback, std::uint32_t tick, clock::time_point now) noexcept
+	{
+		if (m_Pending)
+		{
+			++m_Stats.Abandoned;
+		}
+
+		m_Guess = m_LastKnown ? m_LastKnown : fallback;
+		m_Pending = true;
+		m_OpenedTick = tick;
+		m_OpenedAt = now;
+		return m_Guess;
+	}
+
+	bool pending() const noexcept
+	{
+		return m_Pending;
+	}
+
+	// Whether an event with this timestamp can resolve the pending resolution, which is
+	// the case when it happened after the launcher opened.
+	bool accepts(std::uint32_t tick) const noexcept
+	{
+		// wraps around after 49 days, like GetTickCount
+		return m_Pending && static_cast<std::int32_t>(tick - m_OpenedTick) >= 0;
+	}
+
+	// Ends the pending resolution. A null actual monitor means it can't be known,
+	// and the guess is kept.
+	std::optional<Resolution> resolve(Monitor actual, clock::time_point now) noexcept
+	{
+		if (!m_Pending)
+		{
+			return std::nullopt;
+		}
+
+		m_Pending = false;
+		if (!actual)
+		{
+			actual = m_Guess;
+		}
+
+		m_LastKnown = actual;
+
+		const bool corrected = actual != m_Guess;
+		if (corrected)
+		{
+			++m_Stats.Corrections;
+			m_Stats.Latency.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - m_OpenedAt).count()));
+		}
+		else
+		{
+			++m_Stats.Hits;
+			m_Stats.Latency.record(0);
+		}
+
+		return Resolution { m_Guess, actual, corrected };
+	}
+
+	// The launcher closed, or its state is being rebuilt.
+	void cancel() noexcept
+	{
+		if (m_Pending)
+		{
+			m_Pending = false;
+			++m_Stats.Abandoned;
+		}
+	}
+
+	// Forgets the last known monitor, for when monitor handles are not valid anymore.
+	void forget() noexcept
+	{
+		m_LastKnown = { };
+	}
+
+	const Stats &stats() const noexcept
+	{
+		return m_Stats;
+	}
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Calls classify(context, item) for every item on a few helper threads, and returns the
+// results in the same order as the items. Each helper calls make_context() once first, for
+// things that can't be shared between threads (like a COM apartment and the objects
+// created in it).
+//
+// The calling thread blocks until everything is done, so classify() must not wait on
+// anything the calling thread would have to do, like processing a message sent to one
+// of its windows.
+template<typename Result, typename Item, typename MakeContext, typename Classify>
+std::vector<Result> ParallelClassify(const std::vector<Item> &items, std::size_t maxThreads, std::size_t minItemsPerThread, MakeContext &&make_context, Classify &&classify)
+{
+	std::vector<Result> results(items.size());
+	std::atomic<std::size_t> next = 0;
+
+	const auto work = [&]
+	{
+		auto context = make_context();
+		for (std::size_t i = next++; i < items.size(); i = next++)
+		{
+			results[i] = classify(context, items[i]);
+		}
+	};
+
+	const std::size_t threads = std::clamp<std::size_t>(items.size() / std::max<std::size_t>(minItemsPerThread, 1), 1, std::max<std::size_t>(maxThreads, 1));
+
+	std::vector<std::jthread> helpers;
+	helpers.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i)
+	{
+		helpers.emplace_back(work);
+	}
+
+	helpers.clear(); // joins
+	return results;
+}
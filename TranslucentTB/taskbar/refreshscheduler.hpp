@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Collects the taskbars whose appearance needs to be recomputed, so that a burst of
+// events only leads to a single attribute application per taskbar.
+//
+// The owner is expected to flush once per message pump turn: mark() returns true when
+// the first monitor of a batch gets marked, which is the cue to schedule that flush.
+// When a maximum latency is set, overdue() tells when a batch has been pending for too
+// long (for example during an event storm that starves the pump) and must be flushed
+// right away instead.
+template<typename Monitor, typename Clock = std::chrono::steady_clock>
+class RefreshScheduler {
+public:
+	using duration = typename Clock::duration;
+	using time_point = typename Clock::time_point;
+
+	struct Counters {
+		std::uint64_t Events = 0;       // events received by the owner
+		std::uint64_t Requests = 0;     // refresh requests, including those for monitors already pending
+		std::uint64_t Flushes = 0;      // batches flushed
+		std::uint64_t Applications = 0; // attribute applications issued
+		std::uint64_t Overdue = 0;      // batches flushed early because of the latency bound
+	};
+
+private:
+	std::vector<Monitor> m_Dirty;
+	time_point m_BatchStart;
+	std::optional<duration> m_MaxLatency;
+	Counters m_Counters;
+
+public:
+	explicit RefreshScheduler(std::optional<duration> maxLatency = std::nullopt) noexcept : m_MaxLatency(maxLatency) { }
+
+	void count_event() noexcept
+	{
+		++m_Counters.Events;
+	}
+
+	bool mark(Monitor mon, time_point now = Clock::now())
+	{
+		++m_Counters.Requests;
+		if (std::find(m_Dirty.begin(), m_Dirty.end(), mon) != m_Dirty.end())
+		{
+			return false;
+		}
+
+		const bool first = m_Dirty.empty();
+		if (first)
+		{
+			m_BatchStart = now;
+		}
+
+		m_Dirty.push_back(mon);
+		return first;
+	}
+
+	bool pending() const noexcept
+	{
+		return !m_Dirty.empty();
+	}
+
+	bool pending(Monitor mon) const noexcept
+	{
+		return std::find(m_Dirty.begin(), m_Dirty.end(), mon) != m_Dirty.end();
+	}
+
+	bool overdue(time_point now = Clock::now()) const noexcept
+	{
+		return m_MaxLatency && !m_Dirty.empty() && now - m_BatchStart >= *m_MaxLatency;
+	}
+
+	// Drops a monitor that went away, without counting it as applied.
+	void forget(Monitor mon)
+	{
+		std::erase(m_Dirty, mon);
+	}
+
+	void clear() noexcept
+	{
+		m_Dirty.clear();
+	}
+
+	// Hands over the pending monitors and starts a new batch. Monitors marked while the
+	// caller applies the returned batch go into the next one.
+	// The last argument is moved to the end of the batch, if present.
+	std::vector<Monitor> take(std::optional<Monitor> last = std::nullopt, time_point now = Clock::now())
+	{
+		if (overdue(now))
+		{
+			++m_Counters.Overdue;
+		}
+
+		std::vector<Monitor> batch;
+		batch.swap(m_Dirty);
+
+		if (last)
+		{
+			if (const auto it = std::find(batch.begin(), batch.end(), *last); it != batch.end())
+			{
+				std::rotate(it, it + 1, batch.end());
+			}
+		}
+
+		if (!batch.empty())
+		{
+			++m_Counters.Flushes;
+		}
+
+		return batch;
+	}
+
+	void count_application() noexcept
+	{
+		++m_Counters.Applications;
+	}
+
+	const Counters &counters() const noexcept
+	{
+		return m_Counters;
+	}
+
+	std::optional<duration> max_latency() const noexcept
+	{
+		return m_MaxLatency;
+	}
+};
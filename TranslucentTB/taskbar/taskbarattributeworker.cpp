@@ -1,15 +1,20 @@
 #include "taskbarattributeworker.hpp"
+#include <algorithm>
 #include <functional>
 #include <member_thunk/member_thunk.hpp>
 #include <tlhelp32.h>
 
 #include "constants.hpp"
 #include "../localization.hpp"
+#include "../../ProgramLog/error/errno.hpp"
+#include "../../ProgramLog/error/std.hpp"
 #include "../../ProgramLog/error/win32.hpp"
 #include "../../ProgramLog/error/winrt.hpp"
+#include "../../ProgramLog/log.hpp"
 #include "undoc/explorer.hpp"
 #include "undoc/user32.hpp"
 #include "undoc/winuser.hpp"
+#include "parallelclassify.hpp"
 #include "win32.hpp"
 #include "winrt/Windows.Foundation.h"
 #include "winrt/Windows.Foundation.Metadata.h"
@@ -17,12 +22,11 @@
 class TaskbarAttributeWorker::AttributeRefresher {
 private:
 	TaskbarAttributeWorker &m_Worker;
-	taskbar_iterator m_MainMonIt;
 	bool m_Refresh;
 
 public:
 	AttributeRefresher(TaskbarAttributeWorker &worker, bool refresh = true) noexcept :
-		m_Worker(worker), m_MainMonIt(m_Worker.m_Taskbars.end()), m_Refresh(refresh) { }
+		m_Worker(worker), m_Refresh(refresh) { }
 
 	AttributeRefresher(const AttributeRefresher &) = delete;
 	AttributeRefresher &operator =(const AttributeRefresher &) = delete;
@@ -31,178 +35,584 @@ public:
 	{
 		if (m_Refresh)
 		{
-			if (it->first == MonitorFromPoint({ 0, 0 }, MONITOR_DEFAULTTOPRIMARY))
-			{
-				assert(m_MainMonIt == m_Worker.m_Taskbars.end());
-				m_MainMonIt = it;
-			}
-			else
-			{
-				m_Worker.RefreshAttribute(it);
-			}
+			m_Worker.ScheduleRefresh(it);
 		}
 	}
+};
+
+template<void(TaskbarAttributeWorker::*logger)(std::wstring_view, Window, HMONITOR)>
+struct TaskbarAttributeWorker::TrackerListener {
+	TaskbarAttributeWorker &worker;
+	AttributeRefresher &refresher;
+
+	static constexpr std::wstring_view StateName(WindowState state) noexcept
+	{
+		return state == WindowState::Maximised ? L"maximised" : L"normal";
+	}
+
+	void inserted(WindowState state, Window window, HMONITOR mon)
+	{
+		worker.LogWindowInsertion(StateName(state), window, mon);
 
-	void disarm() noexcept { m_MainMonIt = m_Worker.m_Taskbars.end(); }
+		// a window that just got maximised is almost always on top
+		if (state == WindowState::Maximised)
+		{
+			worker.m_MaximisedZOrder.insert(window, mon);
+		}
+	}
 
-	~AttributeRefresher() noexcept(false)
+	void removed(WindowState state, Window window, HMONITOR mon)
 	{
-		if (m_Refresh && m_MainMonIt != m_Worker.m_Taskbars.end())
+		(worker.*logger)(StateName(state), window, mon);
+
+		if (state == WindowState::Maximised)
 		{
-			m_Worker.RefreshAttribute(m_MainMonIt);
+			worker.m_MaximisedZOrder.remove(window, mon);
 		}
 	}
+
+	void refresh(taskbar_iterator it)
+	{
+		refresher.refresh(it);
+	}
 };
 
 template<DWORD insert, DWORD remove>
-void TaskbarAttributeWorker::WindowInsertRemove(DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+void TaskbarAttributeWorker::WindowInsertRemove(const ResolvedWinEvent &e)
 {
-	if (const Window window(hwnd); idObject == OBJID_WINDOW && idChild == CHILDID_SELF)
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::InsertRemove);
+	const auto trace = m_Tracer.trace("WindowInsertRemove", "worker");
+
+	const Window window(e.Event.Handle);
+	NoteWindowEvent(e.Event.Event, window, e.Event.Time);
+
+	if (e.Event.Event == insert && window.valid())
 	{
-		if (event == insert && window.valid())
-		{
-			InsertWindow(window, true);
-		}
-		else if (event == remove)
-		{
-			AttributeRefresher refresher(*this);
-			for (auto it = m_Taskbars.begin(); it != m_Taskbars.end(); ++it)
-			{
-				RemoveWindow(window, it, refresher);
-			}
-		}
+		InsertWindow(e);
+	}
+	else if (e.Event.Event == remove)
+	{
+		AttributeRefresher refresher(*this);
+		m_Taskbars.remove(window, TrackerListener<&TaskbarAttributeWorker::LogWindowRemoval> { *this, refresher });
 	}
 }
 
 void TaskbarAttributeWorker::OnAeroPeekEnterExit(DWORD event, HWND, LONG, LONG, DWORD, DWORD)
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::Peek);
+	const auto trace = m_Tracer.trace("OnAeroPeekEnterExit", "worker");
+
 	m_PeekActive = event == EVENT_SYSTEM_PEEKSTART;
+	NoteStateEvent(TraceEvent::Peek, m_PeekActive);
 	MessagePrint(spdlog::level::debug, m_PeekActive ? L"Aero Peek entered" : L"Aero Peek exited");
 
+	if (!m_PeekActive)
+	{
+		// we don't know what happened to the peek button while peek was active
+		for (auto &[mon, info] : m_Taskbars)
+		{
+			info.Taskbar.Applied.ShowPeek.reset();
+		}
+	}
+
 	RefreshAllAttributes();
 }
 
-void TaskbarAttributeWorker::OnWindowStateChange(DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+void TaskbarAttributeWorker::OnWindowStateChange(const ResolvedWinEvent &e)
 {
-	if (const Window window(hwnd); idObject == OBJID_WINDOW && idChild == CHILDID_SELF && window.valid())
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::StateChange);
+	const auto trace = m_Tracer.trace("OnWindowStateChange", "worker");
+
+	const Window window(e.Event.Handle);
+	NoteWindowEvent(e.Event.Event, window, e.Event.Time);
+
+	if (window.valid())
 	{
-		InsertWindow(window, true);
+		InsertWindow(e);
 	}
 }
 
-void TaskbarAttributeWorker::OnWindowCreateDestroy(DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+void TaskbarAttributeWorker::OnWindowTitleChange(const ResolvedWinEvent &e)
 {
-	if (const Window window(hwnd); idObject == OBJID_WINDOW && idChild == CHILDID_SELF)
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::TitleChange);
+	const auto trace = m_Tracer.trace("OnWindowTitleChange", "worker");
+
+	// the cached title was already invalidated by DispatchWindowEvent.
+	OnWindowStateChange(e);
+}
+
+void TaskbarAttributeWorker::OnWindowCreateDestroy(const ResolvedWinEvent &e)
+{
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::CreateDestroy);
+	const auto trace = m_Tracer.trace("OnWindowCreateDestroy", "worker");
+
+	const Window window(e.Event.Handle);
+	NoteWindowEvent(e.Event.Event, window, e.Event.Time);
+
+	if (e.Event.Event == EVENT_OBJECT_CREATE && window.valid())
+	{
+		if (const auto className = m_WindowIdentities.classname(window); className && (*className == TASKBAR || *className == SECONDARY_TASKBAR))
+		{
+			MessagePrint(spdlog::level::debug, L"A taskbar got created, refreshing...");
+			ReconcileState();
+		}
+		else
+		{
+			InsertWindow(e);
+		}
+	}
+	else if (e.Event.Event == EVENT_OBJECT_DESTROY)
 	{
-		if (event == EVENT_OBJECT_CREATE && window.valid())
+		// events are asynchronous, the window might be invalid already
+		// important to not try to query its info here, just go off the handle
+		for (const auto &[mon, info] : m_Taskbars)
 		{
-			if (const auto className = window.classname(); className && (*className == TASKBAR || *className == SECONDARY_TASKBAR))
+			if (info.Taskbar.TaskbarWindow == window)
 			{
-				MessagePrint(spdlog::level::debug, L"A taskbar got created, refreshing...");
+				MessagePrint(spdlog::level::debug, L"A taskbar got destroyed, refreshing...");
 				ResetState();
+				return;
 			}
-			else
+		}
+
+		AttributeRefresher refresher(*this);
+		m_Taskbars.remove(window, TrackerListener<&TaskbarAttributeWorker::LogWindowRemovalDestroyed> { *this, refresher });
+	}
+}
+
+void TaskbarAttributeWorker::OnForegroundWindowChange(const ResolvedWinEvent &e)
+{
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::ForegroundChange);
+	const auto trace = m_Tracer.trace("OnForegroundWindowChange", "worker");
+
+	const Window window(e.Event.Handle);
+	NoteWindowEvent(e.Event.Event, window, e.Event.Time);
+
+	const Window oldForegroundWindow = std::exchange(m_ForegroundWindow, window.valid() ? window : Window::NullWindow);
+	m_MaximisedZOrder.raise(m_ForegroundWindow);
+
+	if (Error::ShouldLog<spdlog::level::debug>())
+	{
+		DeferredPrint(spdlog::level::debug, "Changed foreground window to {} [{}] [{}] [{}]", m_ForegroundWindow.handle(),
+			CachedIdentity(m_WindowIdentities.title(m_ForegroundWindow)), CachedIdentity(m_WindowIdentities.classname(m_ForegroundWindow)),
+			CachedIdentity(m_WindowIdentities.filename(m_ForegroundWindow)));
+	}
+	else if (Error::ShouldRecord<spdlog::level::debug>())
+	{
+		DeferredPrint(spdlog::level::debug, "Changed foreground window to {}", m_ForegroundWindow.handle());
+	}
+
+	// a launcher that just opened is the new foreground window.
+	for (std::size_t i = 0; i < LAUNCHER_COUNT; ++i)
+	{
+		if (m_LauncherResolvers[i].accepts(e.Event.Time))
+		{
+			ResolveLauncherMonitor(static_cast<Launcher>(i), m_ForegroundWindow.monitor());
+		}
+	}
+
+	AttributeRefresher refresher(*this);
+	HMONITOR oldMonitor = nullptr;
+	if (oldForegroundWindow)
+	{
+		oldMonitor = oldForegroundWindow.monitor();
+		if (const auto it = m_Taskbars.find(oldMonitor); it != m_Taskbars.end())
+		{
+			refresher.refresh(it);
+		}
+	}
+
+	if (m_ForegroundWindow)
+	{
+		if (auto newMonitor = m_ForegroundWindow.monitor(); newMonitor != oldMonitor)
+		{
+			if (const auto it = m_Taskbars.find(newMonitor); it != m_Taskbars.end())
 			{
-				InsertWindow(window, true);
+				refresher.refresh(it);
 			}
 		}
-		else if (event == EVENT_OBJECT_DESTROY)
+	}
+}
+
+void TaskbarAttributeWorker::OnWindowOrderChange(const ResolvedWinEvent &e)
+{
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::OrderChange);
+	const auto trace = m_Tracer.trace("OnWindowOrderChange", "worker");
+
+	const Window window(e.Event.Handle);
+	NoteWindowEvent(e.Event.Event, window, e.Event.Time);
+
+	if (!window.valid())
+	{
+		return;
+	}
+
+	m_MaximisedZOrder.raise(window);
+	if (const auto iter = m_Taskbars.find(window.monitor()); iter != m_Taskbars.end())
+	{
+		ScheduleRefresh(iter);
+	}
+}
+
+void TaskbarAttributeWorker::QueueWindowEvent(DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD time)
+{
+	// most events are for things like the caret and the cursor, don't even queue those.
+	if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+	{
+		return;
+	}
+
+	m_Metrics.count(TraceEventFromWinEvent(event));
+
+	// if the queue is full, whoever takes from it notices and the drain reconciles instead.
+	m_EventQueue.push({ event, hwnd, idObject, idChild, time });
+
+	// once per batch: whoever takes the events clears this first.
+	if (!m_EventsSignaled.exchange(true))
+	{
+		const auto trace = m_Tracer.trace("QueueWindowEvent", "worker");
+		const auto flow = m_Tracer.new_flow();
+		m_Tracer.begin_flow("WindowEvents", "worker", flow);
+		m_EventQueueFlow.store(flow, std::memory_order_relaxed);
+
+		if (m_WindowEventThread.joinable())
+		{
+			m_EventsQueued.SetEvent();
+		}
+		else
 		{
-			// events are asynchronous, the window might be invalid already
-			// important to not try to query its info here, just go off the handle
-			AttributeRefresher refresher(*this);
-			for (auto it = m_Taskbars.begin(); it != m_Taskbars.end(); ++it)
-			{
-				if (it->second.Taskbar.TaskbarWindow == window)
-				{
-					MessagePrint(spdlog::level::debug, L"A taskbar got destroyed, refreshing...");
-					ResetState();
+			PostWindowEventDrain();
+		}
+	}
+}
 
-					// iterators invalid
-					refresher.disarm();
-					return;
-				}
+void TaskbarAttributeWorker::PostWindowEventDrain()
+{
+	const auto posted = [this]
+	{
+		const std::scoped_lock guard(m_ResolvedEventsLock);
+		if (m_EventDrainPosted)
+		{
+			return true;
+		}
 
-				RemoveWindow<LogWindowRemovalDestroyed>(window, it, refresher);
-			}
+		m_EventDrainFlow = m_Tracer.new_flow();
+		m_Tracer.begin_flow("ResolvedWindowEvents", "worker", m_EventDrainFlow);
+		m_EventDrainPosted = m_DrainWindowEventsMessage && post_message(*m_DrainWindowEventsMessage);
+		return m_EventDrainPosted;
+	}();
+
+	if (!posted) [[unlikely]]
+	{
+		// the next event tries again.
+		LastErrorHandle(spdlog::level::warn, L"Failed to schedule window event processing");
+		if (!m_WindowEventThread.joinable())
+		{
+			m_EventsSignaled = false;
 		}
 	}
 }
 
-void TaskbarAttributeWorker::OnForegroundWindowChange(DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+void TaskbarAttributeWorker::DrainWindowEvents()
+{
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::EventDrain);
+	const auto trace = m_Tracer.trace("DrainWindowEvents", "worker");
+
+	std::vector<ResolvedWinEvent> batch;
+	bool overflowed;
+	{
+		// handlers can pump messages, and events resolved while this runs need another drain.
+		const std::scoped_lock guard(m_ResolvedEventsLock);
+		m_EventDrainPosted = false;
+		m_Tracer.end_flow("ResolvedWindowEvents", "worker", m_EventDrainFlow);
+
+		batch.swap(m_ResolvedEvents);
+		overflowed = std::exchange(m_ResolvedEventsOverflowed, false);
+	}
+
+	if (!m_WindowEventThread.joinable())
+	{
+		// nobody else takes them, resolved here without the lookups done ahead of time.
+		overflowed = !TakeWindowEvents(batch, nullptr) || overflowed;
+	}
+
+	if (overflowed)
+	{
+		MessagePrint(spdlog::level::warn, L"Window event queue overflowed, reconciling worker state");
+
+		// dropped destroy and title change events might have left stale identities behind.
+		m_WindowIdentities.clear();
+		m_RuleMemo.clear();
+		ReconcileState(true);
+		return;
+	}
+
+	for (const auto &event : batch)
+	{
+		DispatchWindowEvent(event);
+	}
+}
+
+void TaskbarAttributeWorker::DispatchWindowEvent(const ResolvedWinEvent &e)
 {
-	if (idObject == OBJID_WINDOW && idChild == CHILDID_SELF)
+	const Window window(e.Event.Handle);
+	switch (e.Event.Event)
+	{
+	case EVENT_OBJECT_NAMECHANGE:
+		m_WindowIdentities.invalidate_title(window);
+		m_RuleMemo.erase(window);
+		break;
+
+	case EVENT_OBJECT_CREATE:
+	case EVENT_OBJECT_DESTROY:
+		// handles get reused, so whatever we knew about this one is stale either way
+		m_WindowIdentities.erase(window);
+		m_RuleMemo.erase(window);
+		break;
+	}
+
+	// the window event thread invalidated its own cache the same way before looking these up.
+	m_WindowIdentities.prime(window, e.Identity);
+
+	switch (e.Event.Event)
 	{
-		const Window oldForegroundWindow = std::exchange(m_ForegroundWindow, Window(hwnd).valid() ? hwnd : Window::NullWindow);
+	case EVENT_OBJECT_CLOAKED:
+	case EVENT_OBJECT_UNCLOAKED:
+		WindowInsertRemove<EVENT_OBJECT_UNCLOAKED, EVENT_OBJECT_CLOAKED>(e);
+		break;
+
+	case EVENT_SYSTEM_MINIMIZESTART:
+	case EVENT_SYSTEM_MINIMIZEEND:
+		WindowInsertRemove<EVENT_SYSTEM_MINIMIZEEND, EVENT_SYSTEM_MINIMIZESTART>(e);
+		break;
+
+	case EVENT_OBJECT_SHOW:
+	case EVENT_OBJECT_HIDE:
+		WindowInsertRemove<EVENT_OBJECT_SHOW, EVENT_OBJECT_HIDE>(e);
+		break;
+
+	case EVENT_OBJECT_CREATE:
+	case EVENT_OBJECT_DESTROY:
+		OnWindowCreateDestroy(e);
+		break;
+
+	case EVENT_SYSTEM_FOREGROUND:
+		OnForegroundWindowChange(e);
+		break;
+
+	case EVENT_OBJECT_REORDER:
+		OnWindowOrderChange(e);
+		break;
+
+	case EVENT_OBJECT_NAMECHANGE:
+		OnWindowTitleChange(e);
+		break;
+
+	case EVENT_OBJECT_LOCATIONCHANGE:
+	case EVENT_OBJECT_PARENTCHANGE:
+		OnWindowStateChange(e);
+		break;
+	}
+}
+
+void TaskbarAttributeWorker::WindowEventThread(std::stop_token stop)
+{
+	m_Tracer.name_thread("Window Event Thread");
+
+#ifdef _DEBUG
+	HresultVerify(SetThreadDescription(GetCurrentThread(), APP_NAME L" Window Event Thread"), spdlog::level::info, L"Failed to set thread description");
+#endif
 
-		if (Error::ShouldLog<spdlog::level::debug>())
+	WindowEventContext context { .Classification = CreateClassificationContext() };
+	std::vector<ResolvedWinEvent> batch;
+	while (true)
+	{
+		m_EventsQueued.wait();
+		if (stop.stop_requested())
 		{
-			MessagePrint(spdlog::level::debug, std::format(L"Changed foreground window to {}", DumpWindow(m_ForegroundWindow)));
+			break;
 		}
 
-		AttributeRefresher refresher(*this);
-		HMONITOR oldMonitor = nullptr;
-		if (oldForegroundWindow)
+		const bool overflowed = !TakeWindowEvents(batch, &context);
+		if (overflowed)
 		{
-			oldMonitor = oldForegroundWindow.monitor();
-			if (const auto it = m_Taskbars.find(oldMonitor); it != m_Taskbars.end())
-			{
-				refresher.refresh(it);
-			}
+			// same as the worker, dropped events might have left stale identities behind.
+			context.Identities.clear();
 		}
 
-		if (m_ForegroundWindow)
+		if (overflowed || !batch.empty())
 		{
-			if (auto newMonitor = m_ForegroundWindow.monitor(); newMonitor != oldMonitor)
 			{
-				if (const auto it = m_Taskbars.find(newMonitor); it != m_Taskbars.end())
+				const std::scoped_lock guard(m_ResolvedEventsLock);
+				if (overflowed)
 				{
-					refresher.refresh(it);
+					// the worker reconciles everything instead.
+					m_ResolvedEvents.clear();
+					m_ResolvedEventsOverflowed = true;
+				}
+				else
+				{
+					m_ResolvedEvents.insert(m_ResolvedEvents.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
 				}
 			}
+
+			batch.clear();
+			PostWindowEventDrain();
 		}
 	}
 }
 
-void TaskbarAttributeWorker::OnWindowOrderChange(DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+void TaskbarAttributeWorker::StopWindowEventThread()
+{
+	if (m_WindowEventThread.joinable())
+	{
+		m_WindowEventThread.request_stop();
+		m_EventsQueued.SetEvent();
+		m_WindowEventThread.join();
+	}
+}
+
+bool TaskbarAttributeWorker::TakeWindowEvents(std::vector<ResolvedWinEvent> &out, WindowEventContext *context)
+{
+	const auto trace = m_Tracer.trace("TakeWindowEvents", "worker");
+
+	// the hooks wake whoever takes the events again for anything queued after this.
+	m_EventsSignaled.exchange(false);
+	m_Tracer.end_flow("WindowEvents", "worker", m_EventQueueFlow.load(std::memory_order_relaxed));
+
+	if (m_EventQueue.take_overflow())
+	{
+		return false;
+	}
+
+	std::vector<QueuedWinEvent<HWND>> batch;
+	m_EventQueue.take(batch);
+
+	// the event trace needs every event for replays to be faithful.
+	if (m_CoalesceEvents)
+	{
+		m_EventQueue.count_coalesced(CoalesceWinEvents(batch));
+	}
+
+	out.reserve(out.size() + batch.size());
+	for (const auto &event : batch)
+	{
+		out.push_back(ResolveWindowEvent(event, context));
+	}
+
+	return true;
+}
+
+TaskbarAttributeWorker::ResolvedWinEvent TaskbarAttributeWorker::ResolveWindowEvent(const QueuedWinEvent<HWND> &e, WindowEventContext *context)
 {
-	if (const Window window(hwnd); idObject == OBJID_WINDOW && idChild == CHILDID_SELF && window.valid())
+	ResolvedWinEvent resolved { .Event = e };
+	if (!context)
+	{
+		return resolved;
+	}
+
+	const Window window(e.Handle);
+	auto &identities = context->Identities;
+	switch (e.Event)
+	{
+	case EVENT_OBJECT_NAMECHANGE:
+		identities.invalidate_title(window);
+		break;
+
+	case EVENT_OBJECT_CREATE:
+	case EVENT_OBJECT_DESTROY:
+		identities.erase(window);
+		break;
+	}
+
+	// the foreground window gets its rules looked up right after.
+	const bool foreground = e.Event == EVENT_SYSTEM_FOREGROUND;
+	if (!(foreground || InsertsWindow(e.Event)) || !window.valid())
+	{
+		return resolved;
+	}
+
+	// needed by InsertWindow and to find out if a taskbar got created.
+	identities.classname(window);
+
+	if (!foreground && context->Classification.DesktopManager)
+	{
+		resolved.Classification = ClassifyWindow(window, context->Classification.DesktopManager.get());
+	}
+
+	// the window filter only looks at user windows.
+	if (foreground || (resolved.Classification && resolved.Classification->UserWindow))
 	{
-		if (const auto iter = m_Taskbars.find(window.monitor()); iter != m_Taskbars.end())
+		// getting the title of a window of this process sends it a message,
+		// which might have to wait on the worker: leave those to it.
+		if (window.process_id() != GetCurrentProcessId())
 		{
-			RefreshAttribute(iter);
+			identities.title(window);
 		}
+
+		identities.filename(window);
+	}
+
+	resolved.Identity = identities.snapshot(window);
+	return resolved;
+}
+
+bool TaskbarAttributeWorker::InsertsWindow(DWORD event) noexcept
+{
+	switch (event)
+	{
+	case EVENT_OBJECT_UNCLOAKED:
+	case EVENT_SYSTEM_MINIMIZEEND:
+	case EVENT_OBJECT_SHOW:
+	case EVENT_OBJECT_CREATE:
+	case EVENT_OBJECT_NAMECHANGE:
+	case EVENT_OBJECT_LOCATIONCHANGE:
+	case EVENT_OBJECT_PARENTCHANGE:
+		return true;
+
+	default:
+		return false;
 	}
 }
 
 void TaskbarAttributeWorker::OnStartVisibilityChange(bool state)
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::LauncherVisibility);
+	const auto trace = m_Tracer.trace("OnStartVisibilityChange", "worker");
+
 	HMONITOR mon = nullptr;
 	if (state)
 	{
-		mon = m_CurrentStartMonitor = GetStartMenuMonitor();
+		mon = m_CurrentStartMonitor = OpenLauncher(Launcher::Start);
 
-		if (Error::ShouldLog<spdlog::level::debug>())
+		if (Error::ShouldRecord<spdlog::level::debug>())
 		{
-			MessagePrint(spdlog::level::debug, std::format(L"Start menu opened on monitor {}", static_cast<void *>(mon)));
+			DeferredPrint(spdlog::level::debug, "Start menu opened, assuming monitor {}", mon);
 		}
 	}
 	else
 	{
+		CancelLauncher(Launcher::Start);
 		mon = std::exchange(m_CurrentStartMonitor, nullptr);
 
 		MessagePrint(spdlog::level::debug, L"Start menu closed");
 	}
 
+	NoteStateEvent(TraceEvent::StartVisibility, state, m_CurrentStartMonitor);
+
 	if (const auto iter = m_Taskbars.find(mon); iter != m_Taskbars.end())
 	{
-		RefreshAttribute(iter);
+		ScheduleRefresh(iter);
 	}
 }
 
 void TaskbarAttributeWorker::OnTaskViewVisibilityChange(bool state)
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::TaskViewVisibility);
+	const auto trace = m_Tracer.trace("OnTaskViewVisibilityChange", "worker");
+
 	m_TaskViewActive = state;
+	NoteStateEvent(TraceEvent::TaskViewVisibility, m_TaskViewActive);
 	MessagePrint(spdlog::level::debug, m_TaskViewActive ? L"Task View opened" : L"Task View closed");
 
 	RefreshAllAttributes();
@@ -210,51 +620,63 @@ void TaskbarAttributeWorker::OnTaskViewVisibilityChange(bool state)
 
 void TaskbarAttributeWorker::OnSearchVisibilityChange(bool state)
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::LauncherVisibility);
+	const auto trace = m_Tracer.trace("OnSearchVisibilityChange", "worker");
+
 	HMONITOR mon = nullptr;
 	if (state)
 	{
-		mon = m_CurrentSearchMonitor = GetSearchMonitor();
+		mon = m_CurrentSearchMonitor = OpenLauncher(Launcher::Search);
 
-		if (Error::ShouldLog<spdlog::level::debug>())
+		if (Error::ShouldRecord<spdlog::level::debug>())
 		{
-			MessagePrint(spdlog::level::debug, std::format(L"Search opened on monitor {}", static_cast<void *>(mon)));
+			DeferredPrint(spdlog::level::debug, "Search opened, assuming monitor {}", mon);
 		}
 	}
 	else
 	{
+		CancelLauncher(Launcher::Search);
 		mon = std::exchange(m_CurrentSearchMonitor, nullptr);
 
 		MessagePrint(spdlog::level::debug, L"Search closed");
 	}
 
+	NoteStateEvent(TraceEvent::SearchVisibility, state, m_CurrentSearchMonitor);
+
 	if (const auto iter = m_Taskbars.find(mon); iter != m_Taskbars.end())
 	{
-		RefreshAttribute(iter);
+		ScheduleRefresh(iter);
 	}
 }
 
 void TaskbarAttributeWorker::OnFindInStartVisibilityChange(bool state)
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::LauncherVisibility);
+	const auto trace = m_Tracer.trace("OnFindInStartVisibilityChange", "worker");
+
 	HMONITOR mon = nullptr;
 	if (state)
 	{
-		mon = m_CurrentFindInStartMonitor = GetFindInStartMonitor();
+		mon = m_CurrentFindInStartMonitor = OpenLauncher(Launcher::FindInStart);
 
-		if (Error::ShouldLog<spdlog::level::debug>())
+		if (Error::ShouldRecord<spdlog::level::debug>())
 		{
-			MessagePrint(spdlog::level::debug, std::format(L"Find in Start opened on monitor {}", static_cast<void*>(mon)));
+			DeferredPrint(spdlog::level::debug, "Find in Start opened, assuming monitor {}", mon);
 		}
 	}
 	else
 	{
+		CancelLauncher(Launcher::FindInStart);
 		mon = std::exchange(m_CurrentFindInStartMonitor, nullptr);
 
 		MessagePrint(spdlog::level::debug, L"Find in Start closed");
 	}
 
+	NoteStateEvent(TraceEvent::FindInStartVisibility, state, m_CurrentFindInStartMonitor);
+
 	if (const auto iter = m_Taskbars.find(mon); iter != m_Taskbars.end())
 	{
-		RefreshAttribute(iter);
+		ScheduleRefresh(iter);
 	}
 }
 
@@ -279,7 +701,7 @@ LRESULT TaskbarAttributeWorker::OnSystemSettingsChange(UINT uiAction)
 	if (uiAction == SPI_SETWORKAREA)
 	{
 		MessagePrint(spdlog::level::debug, L"Work area change detected, refreshing...");
-		ResetState();
+		ReconcileState();
 	}
 
 	return 0;
@@ -290,6 +712,7 @@ LRESULT TaskbarAttributeWorker::OnPowerBroadcast(const POWERBROADCAST_SETTING *s
 	if (settings && settings->PowerSetting == GUID_POWER_SAVING_STATUS && settings->DataLength == sizeof(DWORD))
 	{
 		m_PowerSaver = *reinterpret_cast<const DWORD *>(&settings->Data);
+		NoteStateEvent(TraceEvent::PowerSaver, m_PowerSaver);
 		RefreshAllAttributes();
 	}
 
@@ -298,16 +721,24 @@ LRESULT TaskbarAttributeWorker::OnPowerBroadcast(const POWERBROADCAST_SETTING *s
 
 LRESULT TaskbarAttributeWorker::OnRequestAttributeRefresh(LPARAM lParam)
 {
-	if (!m_disableAttributeRefreshReply && !m_TaskbarService)
+	if (!m_TaskbarService)
 	{
 		const Window window = reinterpret_cast<HWND>(lParam);
 		if (const auto iter = m_Taskbars.find(window.monitor()); iter != m_Taskbars.end() && iter->second.Taskbar.TaskbarWindow == window)
 		{
-			if (const auto config = GetConfig(iter); config.Accent != ACCENT_NORMAL)
+			// Explorer is overwriting the attribute, so whatever we applied before is gone.
+			if (!m_disableAttributeRefreshReply)
 			{
-				SetAttribute(iter, config);
-				return 1;
+				if (GetConfig(iter).Accent != ACCENT_NORMAL)
+				{
+					// the line and peek button might have been reset along with it.
+					RefreshAttribute(iter, true);
+					return 1;
+				}
 			}
+
+			// we let Explorer apply its own appearance.
+			iter->second.Taskbar.Applied.Attribute = TaskbarAppearance { };
 		}
 	}
 
@@ -332,7 +763,7 @@ LRESULT TaskbarAttributeWorker::MessageHandler(UINT uMsg, WPARAM wParam, LPARAM
 	else if (uMsg == WM_DISPLAYCHANGE)
 	{
 		MessagePrint(spdlog::level::debug, L"Monitor configuration change detected, refreshing...");
-		ResetState();
+		ReconcileState();
 		return 0;
 	}
 	else if (uMsg == WM_POWERBROADCAST && wParam == PBT_POWERSETTINGCHANGE)
@@ -374,90 +805,96 @@ LRESULT TaskbarAttributeWorker::MessageHandler(UINT uMsg, WPARAM wParam, LPARAM
 		OnForceRefreshTaskbar(reinterpret_cast<HWND>(lParam));
 		return 0;
 	}
+	else if (uMsg == m_FlushRefreshMessage)
+	{
+		FlushRefreshes();
+		return 0;
+	}
+	else if (uMsg == m_DrainWindowEventsMessage)
+	{
+		DrainWindowEvents();
+		return 0;
+	}
+	else if (uMsg == WM_TIMER && wParam >= LAUNCHER_RESOLVE_TIMER && wParam < LAUNCHER_RESOLVE_TIMER + LAUNCHER_COUNT)
+	{
+		// no foreground change told us where it opened, so it was likely the foreground window already.
+		ResolveLauncherMonitor(static_cast<Launcher>(wParam - LAUNCHER_RESOLVE_TIMER), Window::ForegroundWindow().monitor());
+		return 0;
+	}
 
 	return MessageWindow::MessageHandler(uMsg, wParam, lParam);
 }
 
-TaskbarAppearance TaskbarAttributeWorker::GetConfig(taskbar_iterator taskbar) const
+TaskbarAppearance TaskbarAttributeWorker::GetConfig(taskbar_iterator taskbar, AppearanceState *resolvedState) const
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::GetConfig);
+	const auto trace = m_Tracer.trace("GetConfig", "worker");
+
 	const auto& config = m_ConfigManager.GetConfig();
 
-	if (config.BatterySaverAppearance.Enabled && m_PowerSaver)
+	const AppearanceInputs<HMONITOR> inputs = {
+		.PowerSaver = m_PowerSaver,
+		.TaskViewActive = m_TaskViewActive,
+		.PeekActive = m_PeekActive,
+		.IsWindows11 = m_IsWindows11,
+		.StartMonitor = m_CurrentStartMonitor,
+		.SearchMonitor = m_CurrentSearchMonitor,
+		.FindInStartMonitor = m_CurrentFindInStartMonitor
+	};
+
+	std::uint8_t enabledStates = AppearanceStateBit(AppearanceState::Desktop);
+	const auto enable = [&enabledStates](AppearanceState state, const OptionalTaskbarAppearance &appearance)
 	{
-		return WithPreview(txmp::TaskbarState::BatterySaver, config.BatterySaverAppearance);
-	}
+		if (appearance.Enabled)
+		{
+			enabledStates |= AppearanceStateBit(state);
+		}
+	};
+
+	enable(AppearanceState::VisibleWindow, config.VisibleWindowAppearance);
+	enable(AppearanceState::MaximisedWindow, config.MaximisedWindowAppearance);
+	enable(AppearanceState::StartOpened, config.StartOpenedAppearance);
+	enable(AppearanceState::SearchOpened, config.SearchOpenedAppearance);
+	enable(AppearanceState::TaskViewOpened, config.TaskViewOpenedAppearance);
+	enable(AppearanceState::BatterySaver, config.BatterySaverAppearance);
 
-	if (config.TaskViewOpenedAppearance.Enabled && m_TaskViewActive)
+	const auto &maximisedWindows = taskbar->second.MaximisedWindows;
+	const auto state = ResolveAppearanceState(inputs, enabledStates, taskbar->first, !maximisedWindows.empty(), !taskbar->second.NormalWindows.empty());
+	if (resolvedState)
 	{
-		return WithPreview(txmp::TaskbarState::TaskViewOpened, config.TaskViewOpenedAppearance);
-	}
-
-	// Task View is ignored by peek, so shall we
-	if (m_PeekActive)
-	{
-		return WithPreview(txmp::TaskbarState::Desktop, config.DesktopAppearance);
-	}
-
-	// on windows 11, search is considered open when start is, so we need to check for start first.
-	bool startOpened;
-	if (m_IsWindows11 && (m_CurrentSearchMonitor != nullptr || m_CurrentFindInStartMonitor != nullptr))
-	{
-		// checking the search monitor is more reliable on windows 11 (if available)
-		// so check the start monitor to see if it's open and then use the search monitor
-		// to check *where* it's open.
-		startOpened = m_CurrentStartMonitor != nullptr && (m_CurrentSearchMonitor == taskbar->first || m_CurrentFindInStartMonitor == taskbar->first);
-	}
-	else
-	{
-		startOpened = m_CurrentStartMonitor == taskbar->first;
-	}
-
-	if (config.StartOpenedAppearance.Enabled && startOpened)
-	{
-		return WithPreview(txmp::TaskbarState::StartOpened, config.StartOpenedAppearance);
-	}
-
-	if (config.SearchOpenedAppearance.Enabled && !startOpened && (m_CurrentSearchMonitor == taskbar->first || m_CurrentFindInStartMonitor == taskbar->first))
-	{
-		return WithPreview(txmp::TaskbarState::SearchOpened, config.SearchOpenedAppearance);
+		*resolvedState = state;
 	}
 
-	auto &maximisedWindows = taskbar->second.MaximisedWindows;
-	if (config.MaximisedWindowAppearance.Enabled && !maximisedWindows.empty())
+	switch (state)
 	{
+	case AppearanceState::MaximisedWindow:
 		if (config.MaximisedWindowAppearance.HasRules())
 		{
-			for (const Window wnd : Window::DesktopWindow().get_ordered_childrens())
+			// we only consider the highest z-order maximized window for rules
+			const auto top = m_MaximisedZOrder.top(taskbar->first);
+#ifdef _DEBUG
+			VerifyMaximisedZOrder(taskbar, top);
+#endif
+
+			if (top)
 			{
-				// find the highest maximized window in the z-order.
-				if (maximisedWindows.contains(wnd))
+				if (const auto rule = FindWindowRule(MAXIMISED_RULES, config.MaximisedWindowAppearance, *top))
 				{
-					if (const auto rule = config.MaximisedWindowAppearance.FindRule(wnd))
-					{
-						// if it has a rule, use that rule
-						return *rule;
-					}
-					else
-					{
-						// we only consider the highest z-order maximized window for rules
-						// so stop looking through the z-order
-						break;
-					}
+					// if it has a rule, use that rule
+					return *rule;
 				}
 			}
 		}
 
 		// otherwise, use the normal maximized state
 		return WithPreview(txmp::TaskbarState::MaximisedWindow, config.MaximisedWindowAppearance);
-	}
 
-	if (config.VisibleWindowAppearance.Enabled && (!maximisedWindows.empty() || !taskbar->second.NormalWindows.empty()))
-	{
+	case AppearanceState::VisibleWindow:
 		// if there is no maximized window, and the foreground window is on the current monitor
 		if (config.VisibleWindowAppearance.HasRules() && maximisedWindows.empty() && m_ForegroundWindow.monitor() == taskbar->first)
 		{
 			// find a rule for the foreground window
-			if (const auto rule = config.VisibleWindowAppearance.FindRule(m_ForegroundWindow))
+			if (const auto rule = FindWindowRule(VISIBLE_RULES, config.VisibleWindowAppearance, m_ForegroundWindow))
 			{
 				// if it has a rule, use that rule
 				return *rule;
@@ -466,12 +903,46 @@ TaskbarAppearance TaskbarAttributeWorker::GetConfig(taskbar_iterator taskbar) co
 
 		// otherwise use normal visible state
 		return WithPreview(txmp::TaskbarState::VisibleWindow, config.VisibleWindowAppearance);
+
+	case AppearanceState::BatterySaver:
+		return WithPreview(txmp::TaskbarState::BatterySaver, config.BatterySaverAppearance);
+
+	case AppearanceState::TaskViewOpened:
+		return WithPreview(txmp::TaskbarState::TaskViewOpened, config.TaskViewOpenedAppearance);
+
+	case AppearanceState::StartOpened:
+		return WithPreview(txmp::TaskbarState::StartOpened, config.StartOpenedAppearance);
+
+	case AppearanceState::SearchOpened:
+		return WithPreview(txmp::TaskbarState::SearchOpened, config.SearchOpenedAppearance);
+
+	default:
+		return WithPreview(txmp::TaskbarState::Desktop, config.DesktopAppearance);
 	}
+}
+
+bool TaskbarAttributeWorker::IsFilteredWindow(Window window) const
+{
+	m_RuleMemo.sync(m_ConfigManager.GetConfigGeneration());
+	return m_RuleMemo.filtered(window, [this, window]
+	{
+		return m_ConfigManager.GetConfig().IgnoredWindows.IsFiltered(m_WindowIdentities[window]);
+	});
+}
+
+std::optional<TaskbarAppearance> TaskbarAttributeWorker::FindWindowRule(std::size_t ruleSet, const RuledTaskbarAppearance &rules, Window window) const
+{
+	m_RuleMemo.sync(m_ConfigManager.GetConfigGeneration());
+	const auto &rule = m_RuleMemo.rule(ruleSet, window, [this, &rules, window]
+	{
+		return rules.MatchRule(m_WindowIdentities[window]);
+	});
 
-	return WithPreview(txmp::TaskbarState::Desktop, config.DesktopAppearance);
+	// the active state isn't memoized, it changes way too often
+	return RuledTaskbarAppearance::SelectRule(rule, window);
 }
 
-void TaskbarAttributeWorker::ShowAeroPeekButton(const TaskbarInfo &taskbar, bool show)
+bool TaskbarAttributeWorker::ShowAeroPeekButton(const TaskbarInfo &taskbar, bool show)
 {
 	if (const auto style = taskbar.PeekWindow.get_long_ptr(GWL_EXSTYLE))
 	{
@@ -485,12 +956,17 @@ void TaskbarAttributeWorker::ShowAeroPeekButton(const TaskbarInfo &taskbar, bool
 			if (!SetLayeredWindowAttributes(taskbar.PeekWindow, 0, 1, LWA_ALPHA))
 			{
 				LastErrorHandle(spdlog::level::warn, L"Failed to set peek button layered attributes");
+				return false;
 			}
 		}
+
+		return success;
 	}
+
+	return false;
 }
 
-void TaskbarAttributeWorker::ShowTaskbarLine(const TaskbarInfo &taskbar, bool show)
+bool TaskbarAttributeWorker::ShowTaskbarLine(const TaskbarInfo &taskbar, bool show)
 {
 	if (auto workerW = taskbar.WorkerWWindow)
 	{
@@ -511,6 +987,7 @@ void TaskbarAttributeWorker::ShowTaskbarLine(const TaskbarInfo &taskbar, bool sh
 					if (SetWindowRgn(taskbar.InnerXamlContent, rgn.get(), true))
 					{
 						rgn.release();
+						return true;
 					}
 					else
 					{
@@ -518,28 +995,89 @@ void TaskbarAttributeWorker::ShowTaskbarLine(const TaskbarInfo &taskbar, bool sh
 					}
 				}
 			}
+
+			return false;
 		}
 		else
 		{
 			if (!SetWindowRgn(taskbar.InnerXamlContent, nullptr, true)) [[unlikely]]
 			{
 				LastErrorHandle(spdlog::level::info, L"Failed to clear window region of inner taskbar XAML");
+				return false;
 			}
 		}
 	}
+
+	return true;
+}
+
+bool TaskbarAttributeWorker::IsSameAttribute(const TaskbarAppearance &a, const TaskbarAppearance &b) noexcept
+{
+	if (a.Accent != b.Accent)
+	{
+		return false;
+	}
+
+	// color and blur radius are meaningless on the normal appearance
+	return a.Accent == ACCENT_NORMAL || (a.Color == b.Color && a.BlurRadius == b.BlurRadius);
+}
+
+bool TaskbarAttributeWorker::CheckAppliedCache(bool force, bool upToDate) noexcept
+{
+	if (!force && upToDate)
+	{
+		++m_AppliedCacheHits;
+		return true;
+	}
+	else
+	{
+		++m_AppliedCacheMisses;
+		return false;
+	}
+}
+
+// The cache is updated before applying, because applying can pump messages and start other refreshes.
+// When applying fails, this makes the next refresh try again. The taskbar is looked up again since
+// those messages might have removed it.
+template<typename T>
+void TaskbarAttributeWorker::ForgetApplied(HMONITOR monitor, std::optional<T> AppliedAppearance::*applied)
+{
+	if (const auto it = m_Taskbars.find(monitor); it != m_Taskbars.end())
+	{
+		(it->second.Taskbar.Applied.*applied).reset();
+	}
 }
 
-void TaskbarAttributeWorker::SetAttribute(taskbar_iterator taskbar, TaskbarAppearance config)
+void TaskbarAttributeWorker::SetAttribute(taskbar_iterator taskbar, TaskbarAppearance config, bool force)
 {
+	const auto timer = m_Metrics.time(WorkerMetrics::Timer::SetAttribute);
+	const auto trace = m_Tracer.trace("SetAttribute", "worker");
+
+	auto &applied = taskbar->second.Taskbar.Applied.Attribute;
+	if (CheckAppliedCache(force, applied && IsSameAttribute(*applied, config)))
+	{
+		return;
+	}
+
+	const bool wasNormal = applied && applied->Accent == ACCENT_NORMAL;
+	applied = config;
+
+	const HMONITOR monitor = taskbar->first;
+	bool success = true;
 	if (m_TaskbarService)
 	{
+		HRESULT hr;
 		if (config.Accent == ACCENT_NORMAL)
 		{
-			HresultVerify(m_TaskbarService->ReturnTaskbarToDefaultAppearance(taskbar->second.Taskbar.TaskbarWindow), spdlog::level::info, L"Failed to restore taskbar to normal");
+			const auto call = m_Tracer.trace("ReturnTaskbarToDefaultAppearance", "tap");
+			hr = m_TaskbarService->ReturnTaskbarToDefaultAppearance(taskbar->second.Taskbar.TaskbarWindow);
+			HresultVerify(hr, spdlog::level::info, L"Failed to restore taskbar to normal");
 		}
 		else if (config.Accent == ACCENT_ENABLE_BLURBEHIND)
 		{
-			HresultVerify(m_TaskbarService->SetTaskbarBlur(taskbar->second.Taskbar.TaskbarWindow, config.Color.ToABGR(), config.BlurRadius / 3), spdlog::level::info, L"Failed to set taskbar brush");
+			const auto call = m_Tracer.trace("SetTaskbarBlur", "tap");
+			hr = m_TaskbarService->SetTaskbarBlur(taskbar->second.Taskbar.TaskbarWindow, config.Color.ToABGR(), config.BlurRadius / 3);
+			HresultVerify(hr, spdlog::level::info, L"Failed to set taskbar brush");
 		}
 		else
 		{
@@ -555,8 +1093,12 @@ void TaskbarAttributeWorker::SetAttribute(taskbar_iterator taskbar, TaskbarAppea
 				color.A = 0xFF;
 			}
 
-			HresultVerify(m_TaskbarService->SetTaskbarAppearance(taskbar->second.Taskbar.TaskbarWindow, brush, color.ToABGR()), spdlog::level::info, L"Failed to set taskbar brush");
+			const auto call = m_Tracer.trace("SetTaskbarAppearance", "tap");
+			hr = m_TaskbarService->SetTaskbarAppearance(taskbar->second.Taskbar.TaskbarWindow, brush, color.ToABGR());
+			HresultVerify(hr, spdlog::level::info, L"Failed to set taskbar brush");
 		}
+
+		success = SUCCEEDED(hr);
 	}
 	else
 	{
@@ -564,8 +1106,6 @@ void TaskbarAttributeWorker::SetAttribute(taskbar_iterator taskbar, TaskbarAppea
 
 		if (config.Accent != ACCENT_NORMAL)
 		{
-			m_NormalTaskbars.erase(window);
-
 			const bool isAcrylic = config.Accent == ACCENT_ENABLE_ACRYLICBLURBEHIND;
 			if (isAcrylic && config.Color.A == 0)
 			{
@@ -589,251 +1129,573 @@ void TaskbarAttributeWorker::SetAttribute(taskbar_iterator taskbar, TaskbarAppea
 			if (!SetWindowCompositionAttribute(window, &data)) [[unlikely]]
 			{
 				LastErrorHandle(spdlog::level::info, L"Failed to set window composition attribute");
+				success = false;
 			}
 		}
-		else if (const auto [it, inserted] = m_NormalTaskbars.insert(window); inserted)
+		else if (!wasNormal)
 		{
 			// If this is in response to a window being moved, we send the message way too often
 			// and Explorer doesn't like that too much.
 			window.send_message(WM_DWMCOMPOSITIONCHANGED, 1, 0);
 		}
 	}
+
+	if (!success)
+	{
+		ForgetApplied(monitor, &AppliedAppearance::Attribute);
+	}
 }
 
-void TaskbarAttributeWorker::RefreshAttribute(taskbar_iterator taskbar)
+void TaskbarAttributeWorker::RefreshAttribute(taskbar_iterator taskbar, bool force)
 {
 	// These functions may trigger Windows internal message loops,
 	// do not pass any member of taskbar map by reference.
 	// See comment in InsertWindow.
 	const auto taskbarInfo = taskbar->second.Taskbar;
+	m_Metrics.count(WorkerMetrics::Counter::Refreshes);
+	const auto trace = m_Tracer.trace("RefreshAttribute", "worker");
 
-	const auto &cfg = GetConfig(taskbar);
-	SetAttribute(taskbar, cfg);
+	AppearanceState state;
+	const auto &cfg = GetConfig(taskbar, &state);
 
-	if (m_TaskbarService)
-	{
-		HresultVerify(m_TaskbarService->SetTaskbarBorderVisibility(taskbarInfo.TaskbarWindow, cfg.ShowLine), spdlog::level::info, L"Failed to set taskbar border visibility");
-	}
-	else if (taskbarInfo.InnerXamlContent || taskbarInfo.WorkerWWindow)
+	// Update the cache before applying anything, for the same reason.
+	auto &applied = taskbar->second.Taskbar.Applied;
+	applied.State = state;
+	bool applyLine = false, applyPeek = false;
+	if (m_TaskbarService || taskbarInfo.InnerXamlContent || taskbarInfo.WorkerWWindow)
 	{
-		ShowTaskbarLine(taskbarInfo, cfg.ShowLine);
+		applyLine = !CheckAppliedCache(force, applied.ShowLine == cfg.ShowLine);
+		applied.ShowLine = cfg.ShowLine;
 	}
 	else if (taskbarInfo.PeekWindow)
 	{
 		// Ignore changes when peek is active
 		if (!m_PeekActive)
 		{
-			ShowAeroPeekButton(taskbarInfo, cfg.ShowPeek);
+			applyPeek = !CheckAppliedCache(force, applied.ShowPeek == cfg.ShowPeek);
+			applied.ShowPeek = cfg.ShowPeek;
 		}
 	}
-}
 
-void TaskbarAttributeWorker::RefreshAllAttributes()
-{
-	AttributeRefresher refresher(*this);
-	for (auto it = m_Taskbars.begin(); it != m_Taskbars.end(); ++it)
+	const HMONITOR monitor = taskbar->first;
+	SetAttribute(taskbar, cfg, force);
+
+	if (applyLine)
 	{
-		refresher.refresh(it);
+		bool shown;
+		if (m_TaskbarService)
+		{
+			const auto call = m_Tracer.trace("SetTaskbarBorderVisibility", "tap");
+			const HRESULT hr = m_TaskbarService->SetTaskbarBorderVisibility(taskbarInfo.TaskbarWindow, cfg.ShowLine);
+			HresultVerify(hr, spdlog::level::info, L"Failed to set taskbar border visibility");
+			shown = SUCCEEDED(hr);
+		}
+		else
+		{
+			shown = ShowTaskbarLine(taskbarInfo, cfg.ShowLine);
+		}
+
+		if (!shown)
+		{
+			ForgetApplied(monitor, &AppliedAppearance::ShowLine);
+		}
+	}
+	else if (applyPeek)
+	{
+		if (!ShowAeroPeekButton(taskbarInfo, cfg.ShowPeek))
+		{
+			ForgetApplied(monitor, &AppliedAppearance::ShowPeek);
+		}
 	}
 }
 
-void TaskbarAttributeWorker::LogWindowInsertion(const std::pair<std::unordered_set<Window>::iterator, bool> &result, std::wstring_view state, HMONITOR mon)
+void TaskbarAttributeWorker::ScheduleRefresh(taskbar_iterator taskbar)
 {
-	if (result.second && Error::ShouldLog<spdlog::level::debug>())
+	if (m_RefreshScheduler.mark(taskbar->first))
 	{
-		MessagePrint(spdlog::level::debug, std::format(L"Inserting {} window {} to monitor {}", state, DumpWindow(*result.first), static_cast<void *>(mon)));
+		// the flush gets processed once the messages already queued are handled.
+		// if this fails, the latency bound still gets the batch applied on the next event.
+		if (!m_FlushRefreshMessage || !post_message(*m_FlushRefreshMessage)) [[unlikely]]
+		{
+			LastErrorHandle(spdlog::level::warn, L"Failed to schedule taskbar attribute refresh");
+		}
 	}
 }
 
-void TaskbarAttributeWorker::LogWindowRemoval(std::wstring_view state, Window window, HMONITOR mon)
+void TaskbarAttributeWorker::FlushRefreshes()
 {
-	if (Error::ShouldLog<spdlog::level::debug>())
+	// RefreshAttribute may pump messages, which can schedule more refreshes and even clear m_Taskbars.
+	// taking the batch first means those end up in the next batch, and looking up each
+	// monitor again means we never hold on to an iterator across a refresh.
+	// The main monitor goes last, like it always did.
+	for (const HMONITOR mon : m_RefreshScheduler.take(MonitorFromPoint({ 0, 0 }, MONITOR_DEFAULTTOPRIMARY)))
 	{
-		MessagePrint(spdlog::level::debug, std::format(L"Removing {} window {} from monitor {}", state, DumpWindow(window), static_cast<void *>(mon)));
+		if (const auto it = m_Taskbars.find(mon); it != m_Taskbars.end())
+		{
+			m_RefreshScheduler.count_application();
+			RefreshAttribute(it);
+		}
 	}
 }
 
-void TaskbarAttributeWorker::LogWindowRemovalDestroyed(std::wstring_view state, Window window, HMONITOR mon)
+void TaskbarAttributeWorker::RefreshAllAttributes()
 {
-	if (Error::ShouldLog<spdlog::level::debug>())
+	AttributeRefresher refresher(*this);
+	for (auto it = m_Taskbars.begin(); it != m_Taskbars.end(); ++it)
 	{
-		MessagePrint(spdlog::level::debug, std::format(L"Removing {} window {} [window destroyed] from monitor {}", state, static_cast<void *>(window.handle()), static_cast<void *>(mon)));
+		refresher.refresh(it);
 	}
 }
 
-void TaskbarAttributeWorker::InsertWindow(Window window, bool refresh)
+void TaskbarAttributeWorker::ConfigurationChanged(const ConfigDiff &diff)
 {
-	if (window.classname() == CORE_WINDOW) [[unlikely]]
+	if (diff.IgnoredWindows)
 	{
-		// Windows.UI.Core.CoreWindow is always shell UI stuff
-		// that we either have a dynamic mode for or should ignore.
-		// so just skip it.
-		return;
+		// the filter decides which windows are tracked in the first place.
+		// this refreshes whichever taskbars end up with different windows.
+		ReconcileState(true);
 	}
 
-	AttributeRefresher refresher(*this, refresh);
+	const auto affected = [&diff](const std::optional<AppearanceState> &state)
+	{
+		// enabling or disabling an appearance can move any taskbar to or from it.
+		if (!state || diff.EnabledStates)
+		{
+			return true;
+		}
 
-	// Note: The checks are done before iterating because
-	// some methods (most notably Window::on_current_desktop)
-	// will trigger a Windows internal message loop,
-	// which pumps messages to the worker. When the DPI is
-	// changing, it means m_Taskbars is cleared while we still
-	// have an iterator to it. Acquiring the iterator after the
-	// call to on_current_desktop resolves this issue.
-	const bool windowMatches = window.is_user_window() && !m_ConfigManager.GetConfig().IgnoredWindows.IsFiltered(window);
-	const HMONITOR mon = window.monitor();
+		return diff.AppearanceChanged(static_cast<std::size_t>(*state)) ||
+			(*state == AppearanceState::VisibleWindow && diff.VisibleRules) ||
+			(*state == AppearanceState::MaximisedWindow && diff.MaximisedRules);
+	};
 
+	AttributeRefresher refresher(*this);
 	for (auto it = m_Taskbars.begin(); it != m_Taskbars.end(); ++it)
 	{
-		auto &maximised = it->second.MaximisedWindows;
-		auto &normal = it->second.NormalWindows;
-
-		if (it->first == mon)
+		if (affected(it->second.Taskbar.Applied.State))
 		{
-			if (windowMatches && window.maximised())
-			{
-				if (normal.erase(window) > 0)
-				{
-					LogWindowRemoval(L"normal", window, mon);
-				}
-
-				LogWindowInsertion(maximised.insert(window), L"maximised", mon);
-
-				refresher.refresh(it);
-				continue;
-			}
-			else if (windowMatches && !window.minimised())
-			{
-				if (maximised.erase(window) > 0)
-				{
-					LogWindowRemoval(L"maximised", window, mon);
-				}
-
-				LogWindowInsertion(normal.insert(window), L"normal", mon);
-
-				refresher.refresh(it);
-				continue;
-			}
-
-			// fall out the if if the window is minimized
+			refresher.refresh(it);
 		}
-
-		RemoveWindow(window, it, refresher);
 	}
 }
 
-template<void(*logger)(std::wstring_view, Window, HMONITOR)>
-void TaskbarAttributeWorker::RemoveWindow(Window window, taskbar_iterator it, AttributeRefresher& refresher)
+void TaskbarAttributeWorker::ConfigurationReloaded(const ConfigDiff &diff, WorkerMetrics::clock::time_point changedAt)
 {
-	bool erased = false;
-	if (it->second.MaximisedWindows.erase(window) > 0)
+	m_Metrics.count(WorkerMetrics::Counter::ConfigReloads);
+	if (!diff.AffectsTaskbars())
 	{
-		logger(L"maximised", window, it->first);
-		erased = true;
+		if (diff.empty())
+		{
+			m_Metrics.count(WorkerMetrics::Counter::UnchangedConfigReloads);
+		}
+
+		return;
 	}
 
-	if (it->second.NormalWindows.erase(window) > 0)
+	// a reload is rare enough to apply right away instead of waiting for the flush message,
+	// which then finds nothing left to do. this also makes the timing cover applying.
+	ConfigurationChanged(diff);
+	FlushRefreshes();
+
+	if (m_Metrics.enabled())
 	{
-		logger(L"normal", window, it->first);
-		erased = true;
+		m_Metrics.record(WorkerMetrics::Timer::ConfigReload, WorkerMetrics::clock::now() - changedAt);
 	}
+}
 
-	// only refresh the taskbar once in the case the window is in both
-	if (erased)
+// These are the most frequent log entries, so they are deferred and take what DumpWindow
+// shows from the identity cache. The flight recorder only gets the handles: looking up
+// the identity of every window would cost more than what the log is there to observe.
+void TaskbarAttributeWorker::LogWindowInsertion(std::wstring_view state, Window window, HMONITOR mon)
+{
+	if (Error::ShouldLog<spdlog::level::debug>())
 	{
-		refresher.refresh(it);
+		DeferredPrint(spdlog::level::debug, "Inserting {} window {} [{}] [{}] [{}] to monitor {}", state, window.handle(),
+			CachedIdentity(m_WindowIdentities.title(window)), CachedIdentity(m_WindowIdentities.classname(window)),
+			CachedIdentity(m_WindowIdentities.filename(window)), mon);
+	}
+	else if (Error::ShouldRecord<spdlog::level::debug>())
+	{
+		DeferredPrint(spdlog::level::debug, "Inserting {} window {} to monitor {}", state, window.handle(), mon);
 	}
 }
 
-bool TaskbarAttributeWorker::SetNewWindowExStyle(Window wnd, LONG_PTR oldStyle, LONG_PTR newStyle)
+void TaskbarAttributeWorker::LogWindowRemoval(std::wstring_view state, Window window, HMONITOR mon)
 {
-	if (oldStyle != newStyle)
+	if (Error::ShouldLog<spdlog::level::debug>())
 	{
-		return wnd.set_long_ptr(GWL_EXSTYLE, newStyle).has_value();
+		DeferredPrint(spdlog::level::debug, "Removing {} window {} [{}] [{}] [{}] from monitor {}", state, window.handle(),
+			CachedIdentity(m_WindowIdentities.title(window)), CachedIdentity(m_WindowIdentities.classname(window)),
+			CachedIdentity(m_WindowIdentities.filename(window)), mon);
 	}
-	else
+	else if (Error::ShouldRecord<spdlog::level::debug>())
 	{
-		return true;
+		DeferredPrint(spdlog::level::debug, "Removing {} window {} from monitor {}", state, window.handle(), mon);
 	}
 }
 
-void TaskbarAttributeWorker::DumpWindowSet(std::wstring_view prefix, const std::unordered_set<Window> &set, bool showInfo)
+void TaskbarAttributeWorker::LogWindowRemovalDestroyed(std::wstring_view state, Window window, HMONITOR mon)
 {
-	if (!set.empty())
+	if (Error::ShouldRecord<spdlog::level::debug>())
 	{
-		std::wstring buf;
-		for (const Window window : set)
-		{
-			buf.clear();
-			if (showInfo)
-			{
-				buf += prefix;
-				buf += DumpWindow(window);
-			}
-			else
-			{
-				std::format_to(std::back_inserter(buf), L"{}{}", prefix, static_cast<void *>(window.handle()));
-			}
-			MessagePrint(spdlog::level::off, buf);
-		}
+		DeferredPrint(spdlog::level::debug, "Removing {} window {} [window destroyed] from monitor {}", state, window.handle(), mon);
+	}
+}
+
+TaskbarAttributeWorker::WindowClassification TaskbarAttributeWorker::ClassifyWindow(Window window, IVirtualDesktopManager *desktopManager)
+{
+	return {
+		.UserWindow = desktopManager ? window.is_user_window(desktopManager) : window.is_user_window(),
+		.Maximised = window.maximised(),
+		.Minimised = window.minimised(),
+		.Monitor = window.monitor()
+	};
+}
+
+TaskbarAttributeWorker::ClassificationContext TaskbarAttributeWorker::CreateClassificationContext()
+{
+	// the desktop manager of the worker thread lives in an STA, so other threads need their own.
+	ClassificationContext context;
+	if (const HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED); SUCCEEDED(hr))
+	{
+		context.Apartment = wil::unique_couninitialize_call { };
+		context.DesktopManager = Window::CreateDesktopManager();
 	}
 	else
 	{
-		MessagePrint(spdlog::level::off, std::format(L"{}[none]", prefix));
+		HresultHandle(hr, spdlog::level::warn, L"Failed to initialize COM on window classification thread");
 	}
+
+	return context;
 }
 
-std::wstring TaskbarAttributeWorker::DumpWindow(Window window)
+std::vector<TaskbarAttributeWorker::WindowClassification> TaskbarAttributeWorker::ClassifyWindows(const std::vector<Window> &windows)
 {
-	if (window)
+	std::vector<std::optional<WindowClassification>> results;
+	if (windows.size() >= MIN_WINDOWS_PER_CLASSIFICATION_THREAD * 2)
 	{
-		std::wstring title, className, fileName;
-		if (auto titleOpt = window.title())
+		// none of the classification calls send messages, so blocking this thread
+		// while the helpers run can't deadlock.
+		try
 		{
-			title = std::move(*titleOpt);
-			if (auto classNameOpt = window.classname())
+			results = ParallelClassify<std::optional<WindowClassification>>(windows, MAX_CLASSIFICATION_THREADS, MIN_WINDOWS_PER_CLASSIFICATION_THREAD, &CreateClassificationContext,
+			[](const ClassificationContext &context, Window window) -> std::optional<WindowClassification>
 			{
-				className = std::move(*classNameOpt);
-				if (const auto fileOpt = window.file())
+				if (context.DesktopManager)
 				{
-					fileName = fileOpt->filename().native();
+					return ClassifyWindow(window, context.DesktopManager.get());
 				}
-			}
+				else
+				{
+					return std::nullopt;
+				}
+			});
 		}
+		StdSystemErrorCatch(spdlog::level::warn, L"Failed to start window classification threads");
+	}
 
-		return std::format(L"{} [{}] [{}] [{}]", static_cast<void *>(window.handle()), title, className, fileName);
+	// whatever the helpers couldn't do is done here.
+	results.resize(windows.size());
+
+	std::vector<WindowClassification> classifications;
+	classifications.reserve(windows.size());
+	for (std::size_t i = 0; i < windows.size(); ++i)
+	{
+		classifications.push_back(results[i] ? *results[i] : ClassifyWindow(windows[i]));
+	}
+
+	return classifications;
+}
+
+void TaskbarAttributeWorker::InsertWindow(Window window, bool refresh)
+{
+	// Note: The checks are done before iterating because
+	// some methods (most notably Window::on_current_desktop)
+	// will trigger a Windows internal message loop,
+	// which pumps messages to the worker. When the DPI is
+	// changing, it means m_Taskbars is cleared while we still
+	// have an iterator to it. Acquiring the iterator after the
+	// call to on_current_desktop resolves this issue.
+	InsertWindow(window, ClassifyWindow(window), refresh);
+}
+
+void TaskbarAttributeWorker::InsertWindow(const ResolvedWinEvent &e)
+{
+	// the window event thread already classified it, unless it couldn't.
+	if (e.Classification)
+	{
+		InsertWindow(e.Event.Handle, *e.Classification, true);
 	}
 	else
 	{
-		return L"0x0";
+		InsertWindow(e.Event.Handle, true);
 	}
 }
 
-void TaskbarAttributeWorker::CreateAppVisibility()
+void TaskbarAttributeWorker::InsertWindow(Window window, const WindowClassification &classification, bool refresh)
 {
-	if (m_StartVisibilityChangeMessage)
+	if (const auto className = m_WindowIdentities.classname(window); className && *className == CORE_WINDOW) [[unlikely]]
 	{
-		try
+		// Windows.UI.Core.CoreWindow is always shell UI stuff
+		// that we either have a dynamic mode for or should ignore.
+		// so just skip it.
+		return;
+	}
+
+	AttributeRefresher refresher(*this, refresh);
+
+	const bool windowMatches = classification.UserWindow && !IsFilteredWindow(window);
+
+	WindowState state = WindowState::None;
+	if (windowMatches)
+	{
+		if (classification.Maximised)
 		{
-			m_IAV = wil::CoCreateInstance<IAppVisibility>(CLSID_AppVisibility);
+			state = WindowState::Maximised;
 		}
-		catch (const wil::ResultException &err)
+		else if (!classification.Minimised)
 		{
-			ResultExceptionHandle(err, spdlog::level::warn, L"Failed to create app visibility instance.");
-			return;
+			state = WindowState::Normal;
 		}
-
-		const auto av_sink = winrt::make_self<LauncherVisibilitySink>(*this, *m_StartVisibilityChangeMessage);
-		m_IAVECookie.associate(m_IAV.get());
-		HresultVerify(m_IAV->Advise(av_sink.get(), m_IAVECookie.put()), spdlog::level::warn, L"Failed to register app visibility sink.");
 	}
+
+	m_Taskbars.place(window, classification.Monitor, state, TrackerListener<&TaskbarAttributeWorker::LogWindowRemoval> { *this, refresher });
 }
 
-void TaskbarAttributeWorker::CreateSearchManager()
+void TaskbarAttributeWorker::SyncMaximisedZOrder()
 {
-	UnregisterSearchCallbacks();
-
-	m_SearchManager = nullptr;
+	std::vector<Window> zOrder;
+	for (const Window window : Window::DesktopWindow().get_ordered_childrens())
+	{
+		if (m_MaximisedZOrder.contains(window))
+		{
+			zOrder.push_back(window);
+		}
+	}
+
+	m_MaximisedZOrder.reorder(zOrder);
+}
+
+HMONITOR &TaskbarAttributeWorker::LauncherMonitor(Launcher launcher) noexcept
+{
+	switch (launcher)
+	{
+	case Launcher::Search:
+		return m_CurrentSearchMonitor;
+
+	case Launcher::FindInStart:
+		return m_CurrentFindInStartMonitor;
+
+	default:
+		return m_CurrentStartMonitor;
+	}
+}
+
+HMONITOR TaskbarAttributeWorker::OpenLauncher(Launcher launcher)
+{
+	// we assume that the launcher is the current foreground window;
+	// haven't seen a case where that wasn't true yet.
+	// NOTE: this only stands *when* we get notified that
+	// it has opened (and as long as it is). when we get
+	// notified that it's closed another window may be the
+	// foreground window already (eg the user dismissed start
+	// by clicking on a window)
+	// sometimes the foreground window isn't updated yet when we get notified. instead of
+	// waiting a bit for it, go with a guess and correct it once the foreground window is known.
+	const HMONITOR guess = m_LauncherResolvers.at(static_cast<std::size_t>(launcher)).open(Window::ForegroundWindow().monitor(), GetTickCount(), std::chrono::steady_clock::now());
+
+	if (!SetTimer(m_WindowHandle, LAUNCHER_RESOLVE_TIMER + static_cast<UINT_PTR>(launcher), LAUNCHER_RESOLVE_DELAY, nullptr)) [[unlikely]]
+	{
+		// the next foreground change still resolves it.
+		LastErrorHandle(spdlog::level::warn, L"Failed to schedule launcher monitor resolution");
+	}
+
+	return guess;
+}
+
+void TaskbarAttributeWorker::CancelLauncher(Launcher launcher)
+{
+	auto &resolver = m_LauncherResolvers.at(static_cast<std::size_t>(launcher));
+	if (resolver.pending())
+	{
+		resolver.cancel();
+		KillTimer(m_WindowHandle, LAUNCHER_RESOLVE_TIMER + static_cast<UINT_PTR>(launcher));
+	}
+}
+
+void TaskbarAttributeWorker::ResolveLauncherMonitor(Launcher launcher, HMONITOR actual)
+{
+	const auto resolution = m_LauncherResolvers.at(static_cast<std::size_t>(launcher)).resolve(actual, std::chrono::steady_clock::now());
+	if (!resolution)
+	{
+		return;
+	}
+
+	KillTimer(m_WindowHandle, LAUNCHER_RESOLVE_TIMER + static_cast<UINT_PTR>(launcher));
+
+	if (resolution->Corrected)
+	{
+		if (Error::ShouldRecord<spdlog::level::debug>())
+		{
+			DeferredPrint(spdlog::level::debug, "{} actually opened on monitor {}, not monitor {}", LauncherName(launcher), resolution->Actual, resolution->Guess);
+		}
+
+		LauncherMonitor(launcher) = resolution->Actual;
+		NoteStateEvent(TraceEventFromLauncher(launcher), true, resolution->Actual);
+
+		for (const HMONITOR mon : { resolution->Guess, resolution->Actual })
+		{
+			if (const auto iter = m_Taskbars.find(mon); iter != m_Taskbars.end())
+			{
+				ScheduleRefresh(iter);
+			}
+		}
+	}
+}
+
+void TaskbarAttributeWorker::ResyncLaunchers()
+{
+	// monitor handles might have changed, so the monitors launchers were last on are not good guesses anymore.
+	for (std::size_t i = 0; i < LAUNCHER_COUNT; ++i)
+	{
+		CancelLauncher(static_cast<Launcher>(i));
+		m_LauncherResolvers[i].forget();
+	}
+
+	m_CurrentStartMonitor = IsStartMenuOpened() ? OpenLauncher(Launcher::Start) : nullptr;
+	m_CurrentSearchMonitor = IsSearchOpened() ? OpenLauncher(Launcher::Search) : nullptr;
+	m_CurrentFindInStartMonitor = IsFindInStartOpened() ? OpenLauncher(Launcher::FindInStart) : nullptr;
+}
+
+#ifdef _DEBUG
+void TaskbarAttributeWorker::VerifyMaximisedZOrder(taskbar_iterator taskbar, std::optional<Window> top) const
+{
+	const auto &maximisedWindows = taskbar->second.MaximisedWindows;
+
+	Window expected = Window::NullWindow;
+	for (const Window window : Window::DesktopWindow().get_ordered_childrens())
+	{
+		if (maximisedWindows.contains(window))
+		{
+			expected = window;
+			break;
+		}
+	}
+
+	if (top.value_or(Window::NullWindow) != expected || m_MaximisedZOrder.size(taskbar->first) != maximisedWindows.size())
+	{
+		MessagePrint(spdlog::level::warn, std::format(L"Maximised z-order index out of sync on monitor {}: index has {} on top ({} windows), z-order walk has {} ({} windows)",
+			static_cast<void *>(taskbar->first),
+			DumpWindow(top.value_or(Window::NullWindow)),
+			m_MaximisedZOrder.size(taskbar->first),
+			DumpWindow(expected),
+			maximisedWindows.size()));
+	}
+}
+#endif
+
+bool TaskbarAttributeWorker::SetNewWindowExStyle(Window wnd, LONG_PTR oldStyle, LONG_PTR newStyle)
+{
+	if (oldStyle != newStyle)
+	{
+		return wnd.set_long_ptr(GWL_EXSTYLE, newStyle).has_value();
+	}
+	else
+	{
+		return true;
+	}
+}
+
+void TaskbarAttributeWorker::DumpWindowSet(std::wstring_view prefix, const decltype(m_Taskbars)::window_set &set)
+{
+	if (!set.empty())
+	{
+		std::wstring buf;
+		for (const Window window : set)
+		{
+			buf.clear();
+			buf += prefix;
+			buf += DumpWindow(window);
+			MessagePrint(spdlog::level::off, buf);
+		}
+	}
+	else
+	{
+		MessagePrint(spdlog::level::off, std::format(L"{}[none]", prefix));
+	}
+}
+
+std::wstring TaskbarAttributeWorker::DumpWindow(Window window)
+{
+	if (window)
+	{
+		std::wstring title, className, fileName;
+		if (auto titleOpt = window.title())
+		{
+			title = std::move(*titleOpt);
+			if (auto classNameOpt = window.classname())
+			{
+				className = std::move(*classNameOpt);
+				if (const auto fileOpt = window.file())
+				{
+					fileName = fileOpt->filename().native();
+				}
+			}
+		}
+
+		return std::format(L"{} [{}] [{}] [{}]", static_cast<void *>(window.handle()), title, className, fileName);
+	}
+	else
+	{
+		return L"0x0";
+	}
+}
+
+std::wstring_view TaskbarAttributeWorker::CachedIdentity(const std::wstring *str) noexcept
+{
+	return str ? std::wstring_view(*str) : std::wstring_view { };
+}
+
+std::wstring_view TaskbarAttributeWorker::LauncherName(Launcher launcher) noexcept
+{
+	switch (launcher)
+	{
+	case Launcher::Search:
+		return L"Search";
+
+	case Launcher::FindInStart:
+		return L"Find in Start";
+
+	default:
+		return L"Start menu";
+	}
+}
+
+void TaskbarAttributeWorker::CreateAppVisibility()
+{
+	if (m_StartVisibilityChangeMessage)
+	{
+		try
+		{
+			m_IAV = wil::CoCreateInstance<IAppVisibility>(CLSID_AppVisibility);
+		}
+		catch (const wil::ResultException &err)
+		{
+			ResultExceptionHandle(err, spdlog::level::warn, L"Failed to create app visibility instance.");
+			return;
+		}
+
+		const auto av_sink = winrt::make_self<LauncherVisibilitySink>(*this, *m_StartVisibilityChangeMessage);
+		m_IAVECookie.associate(m_IAV.get());
+		HresultVerify(m_IAV->Advise(av_sink.get(), m_IAVECookie.put()), spdlog::level::warn, L"Failed to register app visibility sink.");
+	}
+}
+
+void TaskbarAttributeWorker::CreateSearchManager()
+{
+	UnregisterSearchCallbacks();
+
+	m_SearchManager = nullptr;
 	m_SearchViewCoordinator = nullptr;
 	m_FindInStartViewCoordinator = nullptr;
 
@@ -949,6 +1811,7 @@ void TaskbarAttributeWorker::ReturnToStock()
 {
 	if (m_TaskbarService)
 	{
+		const auto call = m_Tracer.trace("RestoreAllTaskbarsToDefault", "tap");
 		HresultVerify(m_TaskbarService->RestoreAllTaskbarsToDefault(), spdlog::level::info, L"Failed to restore taskbars");
 	}
 	else
@@ -958,7 +1821,7 @@ void TaskbarAttributeWorker::ReturnToStock()
 		std::vector<TaskbarInfo> taskbarInfos;
 		for (auto it = m_Taskbars.begin(); it != m_Taskbars.end(); ++it)
 		{
-			SetAttribute(it, { ACCENT_NORMAL, { 0, 0, 0, 0 }, true, true, 0.0f });
+			SetAttribute(it, { ACCENT_NORMAL, { 0, 0, 0, 0 }, true, true, 0.0f }, true);
 
 			taskbarInfos.push_back(it->second.Taskbar);
 		}
@@ -1035,6 +1898,12 @@ catch (const winrt::hresult_error &err)
 }
 
 void TaskbarAttributeWorker::InsertTaskbar(HMONITOR mon, Window window)
+{
+	m_Taskbars.insert_taskbar(mon, CreateTaskbarInfo(window));
+	HookTaskbar(window);
+}
+
+TaskbarAttributeWorker::TaskbarInfo TaskbarAttributeWorker::CreateTaskbarInfo(Window window) const
 {
 	TaskbarInfo taskbarInfo = { .TaskbarWindow = window };
 	if (m_TaskbarType == TaskbarType::Mixed)
@@ -1047,9 +1916,17 @@ void TaskbarAttributeWorker::InsertTaskbar(HMONITOR mon, Window window)
 		taskbarInfo.PeekWindow = window.find_child(L"TrayNotifyWnd").find_child(L"TrayShowDesktopButtonWClass");
 	}
 
-	m_NormalTaskbars.insert(window);
-	m_Taskbars.insert_or_assign(mon, MonitorInfo { taskbarInfo });
+	if (!m_TaskbarService)
+	{
+		// assume the taskbar starts with its normal appearance
+		taskbarInfo.Applied.Attribute = TaskbarAppearance { };
+	}
+
+	return taskbarInfo;
+}
 
+void TaskbarAttributeWorker::HookTaskbar(Window window)
+{
 	if (wil::unique_hhook hook { m_InjectExplorerHook(window) })
 	{
 		m_Hooks.push_back(std::move(hook));
@@ -1180,12 +2057,12 @@ TaskbarAttributeWorker::TaskbarAttributeWorker(ConfigManager &cfgManager, HINSTA
 	m_ConfigManager(cfgManager),
 	m_ThunkPage(member_thunk::allocate_page()),
 	m_PeekUnpeekHook(CreateHook(EVENT_SYSTEM_PEEKSTART, EVENT_SYSTEM_PEEKEND, CreateThunk(&TaskbarAttributeWorker::OnAeroPeekEnterExit))),
-	m_CloakUncloakHook(CreateHook(EVENT_OBJECT_CLOAKED, EVENT_OBJECT_UNCLOAKED, CreateThunk(&TaskbarAttributeWorker::WindowInsertRemove<EVENT_OBJECT_UNCLOAKED, EVENT_OBJECT_CLOAKED>))),
-	m_MinimizeRestoreHook(CreateHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, CreateThunk(&TaskbarAttributeWorker::WindowInsertRemove<EVENT_SYSTEM_MINIMIZEEND, EVENT_SYSTEM_MINIMIZESTART>))),
-	m_ShowHideHook(CreateHook(EVENT_OBJECT_SHOW, EVENT_OBJECT_HIDE, CreateThunk(&TaskbarAttributeWorker::WindowInsertRemove<EVENT_OBJECT_SHOW, EVENT_OBJECT_HIDE>))),
-	m_CreateDestroyHook(CreateHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_DESTROY, CreateThunk(&TaskbarAttributeWorker::OnWindowCreateDestroy))),
-	m_ForegroundChangeHook(CreateHook(EVENT_SYSTEM_FOREGROUND, CreateThunk(&TaskbarAttributeWorker::OnForegroundWindowChange))),
-	m_OrderChangeHook(CreateHook(EVENT_OBJECT_REORDER, CreateThunk(&TaskbarAttributeWorker::OnWindowOrderChange))),
+	m_CloakUncloakHook(CreateHook(EVENT_OBJECT_CLOAKED, EVENT_OBJECT_UNCLOAKED, CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent))),
+	m_MinimizeRestoreHook(CreateHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent))),
+	m_ShowHideHook(CreateHook(EVENT_OBJECT_SHOW, EVENT_OBJECT_HIDE, CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent))),
+	m_CreateDestroyHook(CreateHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_DESTROY, CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent))),
+	m_ForegroundChangeHook(CreateHook(EVENT_SYSTEM_FOREGROUND, CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent))),
+	m_OrderChangeHook(CreateHook(EVENT_OBJECT_REORDER, CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent))),
 	m_SearchManager(nullptr),
 	m_SearchViewCoordinator(nullptr),
 	m_FindInStartViewCoordinator(nullptr),
@@ -1197,7 +2074,18 @@ TaskbarAttributeWorker::TaskbarAttributeWorker(ConfigManager &cfgManager, HINSTA
 	m_SearchVisibilityChangeMessage(Window::RegisterMessage(WM_TTBSEARCHVISIBILITYCHANGE)),
 	m_FindInStartVisibilityChangeMessage(Window::RegisterMessage(WM_TTBFINDINSTARTVISIBILITYCHANGE)),
 	m_ForceRefreshTaskbar(Window::RegisterMessage(WM_TTBFORCEREFRESHTASKBAR)),
+	m_FlushRefreshMessage(Window::RegisterMessage(WM_TTBFLUSHATTRIBUTEREFRESH)),
+	m_DrainWindowEventsMessage(Window::RegisterMessage(WM_TTBDRAINWINDOWEVENTS)),
 	m_LastExplorerPid(0),
+	m_AppliedCacheHits(0),
+	m_AppliedCacheMisses(0),
+	m_EventsSignaled(false),
+	m_CoalesceEvents(true),
+	m_EventQueueFlow(0),
+	m_ResolvedEventsOverflowed(false),
+	m_EventDrainPosted(false),
+	m_EventDrainFlow(0),
+	m_RefreshScheduler(MAX_REFRESH_LATENCY),
 	m_HookDll(storageFolder, cfgManager.GetConfig().CopyDlls.value_or(true), L"ExplorerHooks.dll"),
 	m_InjectExplorerHook(m_HookDll.GetProc<PFN_INJECT_EXPLORER_HOOK>("InjectExplorerHook")),
 	m_TAPDll(storageFolder, cfgManager.GetConfig().CopyDlls.value_or(true), L"ExplorerTAP.dll"),
@@ -1205,10 +2093,10 @@ TaskbarAttributeWorker::TaskbarAttributeWorker(ConfigManager &cfgManager, HINSTA
 	m_IsWindows11(win32::IsAtLeastBuild(22000)),
 	m_IsBlurAccentStateSupported(!m_IsWindows11)
 {
-	const auto stateThunk = CreateThunk(&TaskbarAttributeWorker::OnWindowStateChange);
-	m_ResizeMoveHook = CreateHook(EVENT_OBJECT_LOCATIONCHANGE, stateThunk);
-	m_TitleChangeHook = CreateHook(EVENT_OBJECT_NAMECHANGE, stateThunk);
-	m_ParentChangeHook = CreateHook(EVENT_OBJECT_PARENTCHANGE, stateThunk);
+	const auto queueThunk = CreateThunk(&TaskbarAttributeWorker::QueueWindowEvent);
+	m_ResizeMoveHook = CreateHook(EVENT_OBJECT_LOCATIONCHANGE, queueThunk);
+	m_TitleChangeHook = CreateHook(EVENT_OBJECT_NAMECHANGE, queueThunk);
+	m_ParentChangeHook = CreateHook(EVENT_OBJECT_PARENTCHANGE, queueThunk);
 	m_ThunkPage.mark_executable();
 
 	m_PowerSaverHook.reset(RegisterPowerSettingNotification(m_WindowHandle, &GUID_POWER_SAVING_STATUS, DEVICE_NOTIFY_WINDOW_HANDLE));
@@ -1230,6 +2118,20 @@ TaskbarAttributeWorker::TaskbarAttributeWorker(ConfigManager &cfgManager, HINSTA
 
 	// we don't want to consider the first state reset as an Explorer restart.
 	ResetState(true);
+
+	// last, so that nothing can throw with the thread running. until then, and if it doesn't
+	// start, the drain takes the events itself.
+	try
+	{
+		m_WindowEventThread = std::jthread([this](std::stop_token stop)
+		{
+			WindowEventThread(std::move(stop));
+		});
+
+		// for what got queued in the meantime.
+		m_EventsQueued.SetEvent();
+	}
+	StdSystemErrorCatch(spdlog::level::warn, L"Failed to start window event thread");
 }
 
 void TaskbarAttributeWorker::DumpState()
@@ -1259,6 +2161,17 @@ void TaskbarAttributeWorker::DumpState()
 		std::format_to(std::back_inserter(buf), L"\tWorkerW handle: {}", DumpWindow(info.Taskbar.WorkerWWindow));
 		MessagePrint(spdlog::level::off, buf);
 
+		buf.clear();
+		if (const auto &applied = info.Taskbar.Applied; applied.Attribute)
+		{
+			std::format_to(std::back_inserter(buf), L"\tApplied appearance: accent {}, color {}, blur radius {}", static_cast<int>(applied.Attribute->Accent), applied.Attribute->Color.ToString(), applied.Attribute->BlurRadius);
+		}
+		else
+		{
+			buf += L"\tApplied appearance: unknown";
+		}
+		MessagePrint(spdlog::level::off, buf);
+
 		MessagePrint(spdlog::level::off, L"\tMaximised windows:");
 		DumpWindowSet(L"\t\t\t", info.MaximisedWindows);
 
@@ -1307,6 +2220,16 @@ void TaskbarAttributeWorker::DumpState()
 		MessagePrint(spdlog::level::off, L"Find in Start is opened: false");
 	}
 
+	for (std::size_t i = 0; i < LAUNCHER_COUNT; ++i)
+	{
+		const auto &launcherStats = m_LauncherResolvers[i].stats();
+		buf.clear();
+		std::format_to(std::back_inserter(buf), L"{} monitor resolution: {} right guesses, {} corrections, {} abandoned, time to correct monitor p50 {} us, p99 {} us, max {} us",
+			LauncherName(static_cast<Launcher>(i)), launcherStats.Hits, launcherStats.Corrections, launcherStats.Abandoned,
+			launcherStats.Latency.percentile(0.5), launcherStats.Latency.percentile(0.99), launcherStats.Latency.max());
+		MessagePrint(spdlog::level::off, buf);
+	}
+
 	buf.clear();
 	std::format_to(std::back_inserter(buf), L"Current foreground window: {}", DumpWindow(m_ForegroundWindow));
 	MessagePrint(spdlog::level::off, buf);
@@ -1338,8 +2261,121 @@ void TaskbarAttributeWorker::DumpState()
 	std::format_to(std::back_inserter(buf), L"Battery saver is active: {}", m_PowerSaver);
 	MessagePrint(spdlog::level::off, buf);
 
+	const auto &counters = m_RefreshScheduler.counters();
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Events received: {}", counters.Events);
+	MessagePrint(spdlog::level::off, buf);
+
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Attribute refresh requests: {}", counters.Requests);
+	MessagePrint(spdlog::level::off, buf);
+
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Attribute applications: {} in {} batches ({} flushed early)", counters.Applications, counters.Flushes, counters.Overdue);
+	MessagePrint(spdlog::level::off, buf);
+
+	if (counters.Applications != 0)
+	{
+		buf.clear();
+		std::format_to(std::back_inserter(buf), L"Events per attribute application: {:.2f}", static_cast<double>(counters.Events) / counters.Applications);
+		MessagePrint(spdlog::level::off, buf);
+	}
+
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Applied appearance cache: {} hits, {} misses", m_AppliedCacheHits, m_AppliedCacheMisses);
+	MessagePrint(spdlog::level::off, buf);
+
+	const auto &identityStats = m_WindowIdentities.stats();
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Window identity cache: {} windows, {} interned names", m_WindowIdentities.size(), m_WindowIdentities.interned_size());
+	MessagePrint(spdlog::level::off, buf);
+
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Window identity lookups: {} hits, {} misses ({:.1f}% hit rate), {} evictions, {} invalidations", identityStats.Hits, identityStats.Misses, identityStats.hit_rate() * 100.0, identityStats.Evictions, identityStats.Invalidations);
+	MessagePrint(spdlog::level::off, buf);
+
+	const auto imageStats = Window::GetProcessImageCacheStats();
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Process image cache: {} hits, {} misses, {} evictions", imageStats.Hits, imageStats.Misses, imageStats.Evictions);
+	MessagePrint(spdlog::level::off, buf);
+
+	const auto &memoStats = m_RuleMemo.stats();
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Window rule memo: {} windows, config generation {}, {} hits, {} misses ({:.1f}% hit rate), {} invalidations", m_RuleMemo.size(), m_RuleMemo.generation(), memoStats.Hits, memoStats.Misses, memoStats.hit_rate() * 100.0, memoStats.Invalidations);
+	MessagePrint(spdlog::level::off, buf);
+
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Full state resets: {}, {} windows classified in {} us", m_ResetCounters.FullResets, m_ResetCounters.WindowsClassified, m_ResetCounters.FullResetTime.count());
+	MessagePrint(spdlog::level::off, buf);
+
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"State reconciliations: {} ({} fell back to a full reset), {} windows reclassified in {} us", m_ResetCounters.Reconciliations, m_ResetCounters.Fallbacks, m_ResetCounters.WindowsReclassified, m_ResetCounters.ReconciliationTime.count());
+	MessagePrint(spdlog::level::off, buf);
+
+	const auto queueStats = m_EventQueue.stats();
+	buf.clear();
+	std::format_to(std::back_inserter(buf), L"Window event queue: {} queued (at most {} of {}), {} received, {} coalesced, {} dropped, {} overflows", m_EventQueue.size(), queueStats.MaxDepth, m_EventQueue.capacity(), queueStats.Received, queueStats.Coalesced, queueStats.Dropped, queueStats.Overflows);
+	MessagePrint(spdlog::level::off, buf);
+
+	if (m_Metrics.enabled())
+	{
+		MessagePrint(spdlog::level::off, L"Worker metrics:");
+
+		buf.clear();
+		buf += L"\tEvents:";
+		for (std::size_t i = 0; i < WorkerMetrics::EVENT_COUNT; ++i)
+		{
+			const auto event = static_cast<TraceEvent>(i);
+			if (const auto count = m_Metrics.events(event))
+			{
+				const auto name = WorkerMetrics::name(event);
+				std::format_to(std::back_inserter(buf), L" {} {}", std::wstring(name.begin(), name.end()), count);
+			}
+		}
+		MessagePrint(spdlog::level::off, buf);
+
+		buf.clear();
+		buf += L"\tCounters:";
+		for (std::size_t i = 0; i < WorkerMetrics::COUNTER_COUNT; ++i)
+		{
+			const auto counter = static_cast<WorkerMetrics::Counter>(i);
+			const auto name = WorkerMetrics::name(counter);
+			std::format_to(std::back_inserter(buf), L" {} {}", std::wstring(name.begin(), name.end()), m_Metrics.counter_value(counter));
+		}
+		MessagePrint(spdlog::level::off, buf);
+
+		for (std::size_t i = 0; i < WorkerMetrics::TIMER_COUNT; ++i)
+		{
+			const auto timer = static_cast<WorkerMetrics::Timer>(i);
+			if (const auto &latency = m_Metrics.latency(timer); latency.count() != 0)
+			{
+				const auto name = WorkerMetrics::name(timer);
+				buf.clear();
+				std::format_to(std::back_inserter(buf), L"\t{}: {} calls, p50 {} ns, p90 {} ns, p99 {} ns, max {} ns", std::wstring(name.begin(), name.end()), latency.count(), latency.percentile(0.5), latency.percentile(0.9), latency.percentile(0.99), latency.max());
+				MessagePrint(spdlog::level::off, buf);
+			}
+		}
+
+		ExportMetrics();
+	}
+
 	MessagePrint(spdlog::level::off, L"Taskbars currently using normal appearance:");
-	DumpWindowSet(L"\t\t", m_NormalTaskbars, false);
+	bool anyNormal = false;
+	for (const auto &[monitor, info] : m_Taskbars)
+	{
+		if (const auto &attribute = info.Taskbar.Applied.Attribute; attribute && attribute->Accent == ACCENT_NORMAL)
+		{
+			buf.clear();
+			std::format_to(std::back_inserter(buf), L"\t\t{}", static_cast<void *>(info.Taskbar.TaskbarWindow.handle()));
+			MessagePrint(spdlog::level::off, buf);
+			anyNormal = true;
+		}
+	}
+
+	if (!anyNormal)
+	{
+		MessagePrint(spdlog::level::off, L"\t\t[none]");
+	}
 
 	MessagePrint(spdlog::level::off, L"===== End TaskbarAttributeWorker state dump =====");
 }
@@ -1349,7 +2385,9 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 	if (!m_ResettingState)
 	{
 		MessagePrint(spdlog::level::debug, L"Resetting worker state");
+		const auto trace = m_Tracer.trace("ResetState", "worker");
 
+		const auto start = std::chrono::steady_clock::now();
 		m_ResettingState = true;
 		m_ResetStateReentered = false;
 		auto guard = wil::scope_exit([this]
@@ -1366,9 +2404,16 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 		m_CurrentSearchMonitor = nullptr;
 		m_CurrentFindInStartMonitor = nullptr;
 		m_ForegroundWindow = Window::NullWindow;
+		for (std::size_t i = 0; i < LAUNCHER_COUNT; ++i)
+		{
+			CancelLauncher(static_cast<Launcher>(i));
+		}
 
 		m_Taskbars.clear();
-		m_NormalTaskbars.clear();
+		m_MaximisedZOrder.clear();
+		m_RefreshScheduler.clear();
+		m_WindowIdentities.clear();
+		m_RuleMemo.clear();
 
 		m_TaskbarService = nullptr;
 
@@ -1386,11 +2431,13 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 					const auto now = std::chrono::steady_clock::now();
 					if (now < m_LastExplorerRestart + std::chrono::seconds(30)) [[unlikely]]
 					{
+						Log::DumpFlightRecorder(L"Explorer restart loop");
 						Localization::ShowLocalizedMessageBox(IDS_EXPLORER_RESTARTED_TOO_MUCH, MB_OK | MB_ICONWARNING | MB_SETFOREGROUND, hinstance()).join();
 						ExitProcess(1);
 					}
 
 					m_LastExplorerRestart = now;
+					m_Metrics.count(WorkerMetrics::Counter::ExplorerRestarts);
 				}
 			}
 
@@ -1400,7 +2447,12 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 
 			if (m_TaskbarType == TaskbarType::XAML)
 			{
-				const HRESULT hr = m_InjectExplorerTAP(main_taskbar, IID_PPV_ARGS(m_TaskbarService.put()));
+				const HRESULT hr = [this, &main_taskbar]
+				{
+					const auto call = m_Tracer.trace("InjectExplorerTAP", "tap");
+					return m_InjectExplorerTAP(main_taskbar, IID_PPV_ARGS(m_TaskbarService.put()));
+				}();
+
 				if (hr == HRESULT_FROM_WIN32(ERROR_PRODUCT_VERSION))
 				{
 					Localization::ShowLocalizedMessageBox(IDS_RESTART_REQUIRED, MB_OK | MB_ICONWARNING | MB_SETFOREGROUND, hinstance()).join();
@@ -1411,6 +2463,7 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 					HresultVerify(hr, spdlog::level::critical, L"Failed to initialize XAML Diagnostics.");
 				}
 
+				const auto call = m_Tracer.trace("RestoreAllTaskbarsToDefaultWhenProcessDies", "tap");
 				HresultVerify(m_TaskbarService->RestoreAllTaskbarsToDefaultWhenProcessDies(GetCurrentProcessId()), spdlog::level::warn, L"Couldn't configure TAP to restore taskbar appearance once " APP_NAME L" dies.");
 			}
 			else if (m_TaskbarType != TaskbarType::Unknown)
@@ -1461,30 +2514,45 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 		}
 
 		m_ForegroundWindow = Window::ForegroundWindow();
-		if (IsStartMenuOpened())
-		{
-			m_CurrentStartMonitor = GetStartMenuMonitor();
-		}
+		ResyncLaunchers();
 
-		if (IsSearchOpened())
+		std::vector<Window> windows;
+		for (const Window window : Window::FindEnum())
 		{
-			m_CurrentSearchMonitor = GetSearchMonitor();
+			windows.push_back(window);
 		}
 
-		if (IsFindInStartOpened())
-		{
-			m_CurrentFindInStartMonitor = GetFindInStartMonitor();
-		}
+		const auto classifications = ClassifyWindows(windows);
 
-		for (const Window window : Window::FindEnum())
+		std::vector<TraceWindow> snapshots;
+		for (std::size_t i = 0; i < windows.size(); ++i)
 		{
-			InsertWindow(window, false);
+			if (m_EventTrace)
+			{
+				snapshots.push_back(SnapshotWindow(windows[i]));
+			}
+
+			InsertWindow(windows[i], classifications[i], false);
 		}
 
+		const std::size_t classified = windows.size();
+
+		SyncMaximisedZOrder();
+
 		if (!m_ResetStateReentered)
 		{
+			RecordReset(std::move(snapshots));
+
 			// Apply the calculated effects
 			RefreshAllAttributes();
+
+			const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+			++m_ResetCounters.FullResets;
+			m_Metrics.count(WorkerMetrics::Counter::FullResets);
+			m_ResetCounters.WindowsClassified += classified;
+			m_ResetCounters.FullResetTime += elapsed;
+
+			MessagePrint(spdlog::level::debug, std::format(L"Reset worker state in {} us, classified {} windows", elapsed.count(), classified));
 		}
 		else
 		{
@@ -1501,8 +2569,463 @@ void TaskbarAttributeWorker::ResetState(bool manual)
 	}
 }
 
+void TaskbarAttributeWorker::ReconcileState(bool reclassifyAll)
+{
+	if (m_ResettingState)
+	{
+		MessagePrint(spdlog::level::debug, L"ResetState re-entrancy detected");
+
+		m_ResetStateReentered = true;
+		return;
+	}
+
+	MessagePrint(spdlog::level::debug, L"Reconciling worker state");
+	const auto trace = m_Tracer.trace("ReconcileState", "worker");
+
+	const auto start = std::chrono::steady_clock::now();
+	std::optional<std::size_t> reclassified;
+	{
+		m_ResettingState = true;
+		m_ResetStateReentered = false;
+		auto guard = wil::scope_exit([this]
+		{
+			m_ResettingState = false;
+			m_ResetStateReentered = false;
+		});
+
+		reclassified = TryReconcileState(reclassifyAll);
+		if (reclassified && m_ResetStateReentered)
+		{
+			// something else asked for a reset while we were at it, what we have might not be valid anymore.
+			reclassified.reset();
+		}
+	}
+
+	if (reclassified)
+	{
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		++m_ResetCounters.Reconciliations;
+		m_Metrics.count(WorkerMetrics::Counter::Reconciliations);
+		m_ResetCounters.WindowsReclassified += *reclassified;
+		m_ResetCounters.ReconciliationTime += elapsed;
+
+		MessagePrint(spdlog::level::debug, std::format(L"Reconciled worker state in {} us, reclassified {} windows", elapsed.count(), *reclassified));
+	}
+	else
+	{
+		MessagePrint(spdlog::level::debug, L"Worker state can't be reconciled, doing a full reset");
+
+		++m_ResetCounters.Fallbacks;
+		ResetState();
+	}
+}
+
+std::optional<std::size_t> TaskbarAttributeWorker::TryReconcileState(bool reclassifyAll)
+{
+	// the event trace wants full snapshots, and an unknown taskbar type means the last reset bailed out early.
+	if (m_EventTrace || m_TaskbarType == TaskbarType::Unknown)
+	{
+		return std::nullopt;
+	}
+
+	// a new Explorer instance needs to be hooked and injected again.
+	const Window main_taskbar = Window::Find(TASKBAR);
+	if (!main_taskbar || main_taskbar.process_id() != m_LastExplorerPid)
+	{
+		return std::nullopt;
+	}
+
+	std::vector<std::pair<HMONITOR, Window>> found = { { GetTaskbarMonitor(main_taskbar), main_taskbar } };
+	for (const Window secondtaskbar : Window::FindEnum(SECONDARY_TASKBAR))
+	{
+		found.emplace_back(GetTaskbarMonitor(secondtaskbar), secondtaskbar);
+	}
+
+	const auto find_taskbar = [this](Window window)
+	{
+		return std::find_if(m_Taskbars.begin(), m_Taskbars.end(), [window](const auto &entry)
+		{
+			return entry.second.Taskbar.TaskbarWindow == window;
+		});
+	};
+
+	// hooks are not kept per taskbar, so the only way to drop the hook of a taskbar that went away is a full reset.
+	for (const auto &[mon, info] : m_Taskbars)
+	{
+		const Window taskbar = info.Taskbar.TaskbarWindow;
+		if (std::none_of(found.begin(), found.end(), [taskbar](const auto &entry) { return entry.second == taskbar; }))
+		{
+			return std::nullopt;
+		}
+	}
+
+	std::vector<std::pair<HMONITOR, TaskbarInfo>> taskbars;
+	std::vector<Window> newTaskbars;
+	Util::flat_hash_set<HMONITOR> newMonitors;
+	for (const auto &[mon, window] : found)
+	{
+		if (const auto it = find_taskbar(window); it != m_Taskbars.end())
+		{
+			// Explorer might have redrawn it in the process, so forget what we applied.
+			auto info = it->second.Taskbar;
+			info.Applied = { };
+			taskbars.emplace_back(mon, std::move(info));
+		}
+		else
+		{
+			taskbars.emplace_back(mon, CreateTaskbarInfo(window));
+			newTaskbars.push_back(window);
+		}
+
+		if (m_Taskbars.find(mon) == m_Taskbars.end())
+		{
+			newMonitors.insert(mon);
+		}
+	}
+
+	AttributeRefresher refresher(*this, false);
+	m_RefreshScheduler.clear();
+	m_Taskbars.replace_taskbars(taskbars, TrackerListener<&TaskbarAttributeWorker::LogWindowRemoval> { *this, refresher });
+
+	for (const Window taskbar : newTaskbars)
+	{
+		HookTaskbar(taskbar);
+	}
+
+	// only reclassify windows that moved to another monitor, or that are on a monitor which
+	// just got a taskbar. the others are kept up to date by events, unless some got dropped.
+	std::vector<Window> moved;
+	Util::flat_hash_set<Window> alive;
+	for (const Window window : Window::FindEnum())
+	{
+		alive.insert(window);
+
+		const HMONITOR mon = window.monitor();
+		if (const auto location = m_Taskbars.locate(window); reclassifyAll || (location ? location->Mon != mon : newMonitors.contains(mon)))
+		{
+			moved.push_back(window);
+		}
+	}
+
+	const auto classifications = ClassifyWindows(moved);
+	for (std::size_t i = 0; i < moved.size(); ++i)
+	{
+		InsertWindow(moved[i], classifications[i], false);
+	}
+
+	std::size_t reclassified = moved.size();
+
+	std::vector<Window> vanished;
+	for (const auto &[mon, info] : m_Taskbars)
+	{
+		for (const auto *set : { &info.MaximisedWindows, &info.NormalWindows })
+		{
+			for (const Window window : *set)
+			{
+				if (!alive.contains(window))
+				{
+					vanished.push_back(window);
+				}
+			}
+		}
+	}
+
+	for (const Window window : vanished)
+	{
+		m_Taskbars.remove(window, TrackerListener<&TaskbarAttributeWorker::LogWindowRemovalDestroyed> { *this, refresher });
+		++reclassified;
+	}
+
+	// monitor handles might have changed
+	m_ForegroundWindow = Window::ForegroundWindow();
+	ResyncLaunchers();
+
+	SyncMaximisedZOrder();
+
+	if (!m_ResetStateReentered)
+	{
+		RefreshAllAttributes();
+	}
+
+	return reclassified;
+}
+
+void TaskbarAttributeWorker::StartRecordingEvents()
+{
+	if (!m_EventTrace)
+	{
+		m_EventTrace.emplace();
+		m_CoalesceEvents = false;
+
+		// start the trace with a full snapshot of the current state
+		ResetState(true);
+		MessagePrint(spdlog::level::info, L"Started recording worker events");
+	}
+}
+
+void TaskbarAttributeWorker::StopRecordingEvents()
+{
+	if (!m_EventTrace)
+	{
+		return;
+	}
+
+	const auto trace = std::move(*m_EventTrace);
+	m_EventTrace.reset();
+	m_CoalesceEvents = true;
+
+	const auto sink = Log::GetSink();
+	if (!sink)
+	{
+		MessagePrint(spdlog::level::warn, L"Discarding recorded worker events because there is no log file");
+		return;
+	}
+
+	auto path = sink->file();
+	path.replace_extension(L".ttbevents");
+
+	wil::unique_file file;
+	if (const errno_t err = _wfopen_s(file.put(), path.c_str(), L"wbS"); err == 0)
+	{
+		const auto data = trace.data();
+		if (std::fwrite(data.data(), 1, data.size(), file.get()) == data.size())
+		{
+			MessagePrint(spdlog::level::info, std::format(L"Saved {} worker events to {}", trace.record_count(), path.native()));
+		}
+		else
+		{
+			ErrnoTHandle(errno, spdlog::level::warn, L"Failed to write recorded worker events");
+		}
+	}
+	else
+	{
+		ErrnoTHandle(err, spdlog::level::warn, L"Failed to open recorded worker events file");
+	}
+}
+
+void TaskbarAttributeWorker::StartCollectingMetrics()
+{
+	if (!m_Metrics.enabled())
+	{
+		m_Metrics.clear();
+		m_Metrics.enable(true);
+		MessagePrint(spdlog::level::info, L"Started collecting worker metrics");
+	}
+}
+
+void TaskbarAttributeWorker::StopCollectingMetrics()
+{
+	if (m_Metrics.enabled())
+	{
+		m_Metrics.enable(false);
+		ExportMetrics();
+	}
+}
+
+void TaskbarAttributeWorker::ExportMetrics() const
+{
+	const auto sink = Log::GetSink();
+	if (!sink)
+	{
+		MessagePrint(spdlog::level::warn, L"Not saving worker metrics because there is no log file");
+		return;
+	}
+
+	auto path = sink->file();
+	path.replace_extension(L".ttbmetrics.json");
+
+	wil::unique_file file;
+	if (const errno_t err = _wfopen_s(file.put(), path.c_str(), L"wbS"); err == 0)
+	{
+		const auto json = m_Metrics.to_json();
+		if (std::fwrite(json.data(), 1, json.size(), file.get()) == json.size())
+		{
+			MessagePrint(spdlog::level::info, std::format(L"Saved worker metrics to {}", path.native()));
+		}
+		else
+		{
+			ErrnoTHandle(errno, spdlog::level::warn, L"Failed to write worker metrics");
+		}
+	}
+	else
+	{
+		ErrnoTHandle(err, spdlog::level::warn, L"Failed to open worker metrics file");
+	}
+}
+
+TraceEvent TaskbarAttributeWorker::TraceEventFromWinEvent(DWORD event) noexcept
+{
+	switch (event)
+	{
+	case EVENT_OBJECT_CREATE: return TraceEvent::Create;
+	case EVENT_OBJECT_DESTROY: return TraceEvent::Destroy;
+	case EVENT_OBJECT_SHOW: return TraceEvent::Show;
+	case EVENT_OBJECT_HIDE: return TraceEvent::Hide;
+	case EVENT_OBJECT_CLOAKED: return TraceEvent::Cloak;
+	case EVENT_OBJECT_UNCLOAKED: return TraceEvent::Uncloak;
+	case EVENT_SYSTEM_MINIMIZESTART: return TraceEvent::MinimizeStart;
+	case EVENT_SYSTEM_MINIMIZEEND: return TraceEvent::MinimizeEnd;
+	case EVENT_OBJECT_LOCATIONCHANGE: return TraceEvent::LocationChange;
+	case EVENT_OBJECT_NAMECHANGE: return TraceEvent::NameChange;
+	case EVENT_OBJECT_PARENTCHANGE: return TraceEvent::ParentChange;
+	case EVENT_SYSTEM_FOREGROUND: return TraceEvent::Foreground;
+	default: return TraceEvent::Reorder;
+	}
+}
+
+TraceEvent TaskbarAttributeWorker::TraceEventFromLauncher(Launcher launcher) noexcept
+{
+	switch (launcher)
+	{
+	case Launcher::Search:
+		return TraceEvent::SearchVisibility;
+
+	case Launcher::FindInStart:
+		return TraceEvent::FindInStartVisibility;
+
+	default:
+		return TraceEvent::StartVisibility;
+	}
+}
+
+TraceWindow TaskbarAttributeWorker::SnapshotWindow(Window window)
+{
+	TraceWindow snapshot { m_EventTrace->window_id(window.handle()) };
+	if (window.valid())
+	{
+		snapshot.Flags |= TraceWindowFlags::Valid;
+
+		if (const auto className = m_WindowIdentities.classname(window))
+		{
+			if (*className == TASKBAR || *className == SECONDARY_TASKBAR)
+			{
+				snapshot.Flags |= TraceWindowFlags::Taskbar;
+			}
+			else if (*className == CORE_WINDOW)
+			{
+				snapshot.Flags |= TraceWindowFlags::CoreWindow;
+			}
+		}
+
+		// this can pump messages, but we never hold an iterator to m_Taskbars here.
+		if (window.is_user_window() && !IsFilteredWindow(window))
+		{
+			snapshot.Flags |= TraceWindowFlags::Matches;
+		}
+
+		if (window.maximised())
+		{
+			snapshot.Flags |= TraceWindowFlags::Maximised;
+		}
+
+		if (window.minimised())
+		{
+			snapshot.Flags |= TraceWindowFlags::Minimised;
+		}
+
+		snapshot.Monitor = m_EventTrace->monitor_id(window.monitor());
+	}
+
+	return snapshot;
+}
+
+void TaskbarAttributeWorker::NoteWindowEvent(DWORD event, Window window, DWORD time)
+{
+	NoteEvent();
+
+	if (m_EventTrace)
+	{
+		TraceRecord record;
+		record.Event = TraceEventFromWinEvent(event);
+		record.Time = time;
+
+		// destroyed windows can't be queried anymore.
+		record.Window = record.Event == TraceEvent::Destroy
+			? TraceWindow { m_EventTrace->window_id(window.handle()) }
+			: SnapshotWindow(window);
+
+		m_EventTrace->write(record);
+	}
+}
+
+void TaskbarAttributeWorker::NoteEvent()
+{
+	m_RefreshScheduler.count_event();
+
+	// during an event storm, the flush message can get starved by the events
+	// themselves. this is called before any iterator to m_Taskbars is held.
+	if (m_RefreshScheduler.overdue())
+	{
+		FlushRefreshes();
+	}
+}
+
+void TaskbarAttributeWorker::NoteStateEvent(TraceEvent event, bool state, HMONITOR mon)
+{
+	NoteEvent();
+	m_Metrics.count(event);
+
+	if (m_EventTrace)
+	{
+		TraceRecord record;
+		record.Event = event;
+		record.Time = GetTickCount();
+		record.State = state;
+		record.Window.Monitor = m_EventTrace->monitor_id(state ? mon : nullptr);
+
+		m_EventTrace->write(record);
+	}
+}
+
+void TaskbarAttributeWorker::RecordReset(std::vector<TraceWindow> windows)
+{
+	if (m_EventTrace)
+	{
+		TraceRecord record;
+		record.Event = TraceEvent::Reset;
+		record.Time = GetTickCount();
+		record.Window = { m_EventTrace->window_id(m_ForegroundWindow.handle()), m_EventTrace->monitor_id(m_ForegroundWindow.monitor()), TraceWindowFlags::Valid };
+
+		if (m_PowerSaver)
+		{
+			record.GlobalFlags |= TraceGlobalFlags::PowerSaver;
+		}
+
+		if (m_TaskViewActive)
+		{
+			record.GlobalFlags |= TraceGlobalFlags::TaskViewActive;
+		}
+
+		if (m_PeekActive)
+		{
+			record.GlobalFlags |= TraceGlobalFlags::PeekActive;
+		}
+
+		if (m_IsWindows11)
+		{
+			record.GlobalFlags |= TraceGlobalFlags::Windows11;
+		}
+
+		record.StartMonitor = m_EventTrace->monitor_id(m_CurrentStartMonitor);
+		record.SearchMonitor = m_EventTrace->monitor_id(m_CurrentSearchMonitor);
+		record.FindInStartMonitor = m_EventTrace->monitor_id(m_CurrentFindInStartMonitor);
+
+		for (const auto &[mon, info] : m_Taskbars)
+		{
+			record.Taskbars.push_back({ m_EventTrace->window_id(info.Taskbar.TaskbarWindow.handle()), m_EventTrace->monitor_id(mon) });
+		}
+
+		record.Windows = std::move(windows);
+		m_EventTrace->write(record);
+	}
+}
+
 TaskbarAttributeWorker::~TaskbarAttributeWorker() noexcept(false)
 {
+	StopWindowEventThread();
+	StopRecordingEvents();
+	StopCollectingMetrics();
+
 	m_disableAttributeRefreshReply = true;
 	UnregisterSearchCallbacks();
 	ReturnToStock();
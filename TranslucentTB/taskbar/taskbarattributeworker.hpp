@@ -1,13 +1,14 @@
 #pragma once
 #include "arch.h"
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <member_thunk/page.hpp>
+#include <mutex>
 #include <optional>
 #include <ShObjIdl.h>
 #include <string_view>
-#include <unordered_map>
-#include <unordered_set>
+#include <thread>
 #include <vector>
 #include <wil/com.h>
 #include <wil/resource.h>
@@ -16,21 +17,33 @@
 #include <winrt/Windows.Internal.Shell.Experience.h> // this is evil >:3
 #include <winrt/WindowsUdk.UI.Shell.h> // this is less evil
 
+#include "appearancestate.hpp"
+#include "config/configdiff.hpp"
 #include "config/taskbarappearance.hpp"
 #include "../dynamicloader.hpp"
+#include "eventtrace.hpp"
 #include "../ExplorerHooks/api.hpp"
 #include "../ExplorerTAP/api.hpp"
 #include "ITaskbarAppearanceService.h"
 #include "launchervisibilitysink.hpp"
 #include "../windows/messagewindow.hpp"
+#include "../windows/windowidentitycache.hpp"
 #include "undoc/user32.hpp"
 #include "undoc/uxtheme.hpp"
 #include "util/color.hpp"
 #include "util/null_terminated_string_view.hpp"
+#include "util/trace_recorder.hpp"
 #include "wilx.hpp"
 #include "../ProgramLog/error/win32.hpp"
 #include "../loadabledll.hpp"
 #include "../managers/configmanager.hpp"
+#include "eventqueue.hpp"
+#include "launchermonitorresolver.hpp"
+#include "refreshscheduler.hpp"
+#include "windowrulememo.hpp"
+#include "windowtracker.hpp"
+#include "workermetrics.hpp"
+#include "zorderindex.hpp"
 
 enum class TaskbarType {
 	Unknown,
@@ -44,17 +57,59 @@ private:
 	class AttributeRefresher;
 	friend AttributeRefresher;
 
+	template<void(TaskbarAttributeWorker::*logger)(std::wstring_view, Window, HMONITOR)>
+	struct TrackerListener;
+
+	// What was last applied to a taskbar, so that identical refreshes can be skipped.
+	// An empty optional means unknown, which always gets applied.
+	struct AppliedAppearance {
+		std::optional<TaskbarAppearance> Attribute; // only accent, color and blur radius are relevant
+		std::optional<bool> ShowLine;
+		std::optional<bool> ShowPeek;
+		std::optional<AppearanceState> State; // which appearance the attribute came from
+	};
+
 	struct TaskbarInfo {
 		Window TaskbarWindow;
 		Window PeekWindow;
 		Window InnerXamlContent;
 		Window WorkerWWindow;
+		AppliedAppearance Applied;
+	};
+
+	// What InsertWindow needs to know about a window, besides the window filter.
+	// These queries are thread-safe, so they can be done ahead of time on other threads.
+	struct WindowClassification {
+		bool UserWindow = false;
+		bool Maximised = false;
+		bool Minimised = false;
+		HMONITOR Monitor = nullptr;
+	};
+
+	// A window event, along with what the window event thread found out about its window.
+	// Both are empty when the thread had nothing to look up, or couldn't.
+	struct ResolvedWinEvent {
+		QueuedWinEvent<HWND> Event;
+		std::optional<WindowClassification> Classification; // for events that (re)insert the window
+		WindowIdentityCache<Window>::Identity Identity;
 	};
 
-	struct MonitorInfo {
-		TaskbarInfo Taskbar;
-		std::unordered_set<Window> MaximisedWindows;
-		std::unordered_set<Window> NormalWindows;
+	// What a thread needs to classify windows, besides the window.
+	struct ClassificationContext {
+		wil::unique_couninitialize_call Apartment { false };
+		wil::com_ptr<IVirtualDesktopManager> DesktopManager;
+	};
+
+	// What the window event thread keeps between batches.
+	struct WindowEventContext {
+		ClassificationContext Classification;
+		WindowIdentityCache<Window> Identities { };
+	};
+
+	enum class Launcher : std::size_t {
+		Start,
+		Search,
+		FindInStart
 	};
 
 	struct MonitorEnumInfo {
@@ -90,8 +145,8 @@ private:
 	HMONITOR m_CurrentFindInStartMonitor;
 	Window m_ForegroundWindow;
 	TaskbarType m_TaskbarType;
-	std::unordered_map<HMONITOR, MonitorInfo> m_Taskbars;
-	std::unordered_set<Window> m_NormalTaskbars;
+	WindowTracker<Window, HMONITOR, TaskbarInfo> m_Taskbars;
+	ZOrderIndex<Window, HMONITOR> m_MaximisedZOrder;
 	ConfigManager &m_ConfigManager;
 
 	// Hooks
@@ -131,6 +186,8 @@ private:
 	std::optional<UINT> m_SearchVisibilityChangeMessage;
 	std::optional<UINT> m_FindInStartVisibilityChangeMessage;
 	std::optional<UINT> m_ForceRefreshTaskbar;
+	std::optional<UINT> m_FlushRefreshMessage;
+	std::optional<UINT> m_DrainWindowEventsMessage;
 
 	// Explorer crash detection
 	std::chrono::steady_clock::time_point m_LastExplorerRestart;
@@ -139,6 +196,72 @@ private:
 	// Color previews
 	std::array<std::optional<Util::Color>, 7> m_ColorPreviews;
 
+	// Event recording
+	std::optional<EventTraceWriter> m_EventTrace;
+
+	// Hot path metrics, mutable because GetConfig is timed
+	mutable WorkerMetrics m_Metrics;
+
+	// Performance trace, shared with the rest of the app
+	Util::trace_recorder &m_Tracer = Util::trace_recorder::global();
+
+	// Applied appearance cache
+	std::uint64_t m_AppliedCacheHits;
+	std::uint64_t m_AppliedCacheMisses;
+
+	// State reset accounting
+	struct ResetCounters {
+		std::uint64_t FullResets = 0;
+		std::uint64_t Reconciliations = 0;
+		std::uint64_t Fallbacks = 0; // reconciliations that needed a full reset instead
+		std::uint64_t WindowsClassified = 0; // by full resets
+		std::uint64_t WindowsReclassified = 0; // by reconciliations
+		std::chrono::microseconds FullResetTime { };
+		std::chrono::microseconds ReconciliationTime { };
+	};
+
+	ResetCounters m_ResetCounters;
+
+	// Window identity cache, mutable because GetConfig looks up rules
+	mutable WindowIdentityCache<Window> m_WindowIdentities;
+
+	// Window filter and rule results, per window
+	static constexpr std::size_t MAXIMISED_RULES = 0;
+	static constexpr std::size_t VISIBLE_RULES = 1;
+	mutable WindowRuleMemo<Window, ActiveInactiveTaskbarAppearance, 2> m_RuleMemo;
+
+	// Window classification during state rebuilds
+	static constexpr std::size_t MAX_CLASSIFICATION_THREADS = 4;
+	static constexpr std::size_t MIN_WINDOWS_PER_CLASSIFICATION_THREAD = 32;
+
+	// Window events. The hooks queue them, the window event thread coalesces them and does the
+	// lookups that can block, and the worker applies the results in a drain. Without the thread,
+	// the drain takes the queued events itself.
+	static constexpr std::size_t EVENT_QUEUE_CAPACITY = 4096;
+	EventQueue<QueuedWinEvent<HWND>, EVENT_QUEUE_CAPACITY> m_EventQueue;
+	std::atomic<bool> m_EventsSignaled; // set when the hooks woke whoever takes the events, cleared before taking them
+	std::atomic<bool> m_CoalesceEvents; // not while recording
+	std::atomic<std::uint64_t> m_EventQueueFlow; // links the hook that woke whoever takes the events to them
+	wil::slim_event_auto_reset m_EventsQueued;
+
+	std::mutex m_ResolvedEventsLock;
+	std::vector<ResolvedWinEvent> m_ResolvedEvents;
+	bool m_ResolvedEventsOverflowed;
+	bool m_EventDrainPosted;
+	std::uint64_t m_EventDrainFlow; // links the batch that posted the drain to the drain
+
+	std::jthread m_WindowEventThread;
+
+	// Launcher monitor resolution, timer IDs are LAUNCHER_RESOLVE_TIMER + the launcher
+	static constexpr std::size_t LAUNCHER_COUNT = 3;
+	static constexpr UINT_PTR LAUNCHER_RESOLVE_TIMER = 1;
+	static constexpr UINT LAUNCHER_RESOLVE_DELAY = USER_TIMER_MINIMUM;
+	std::array<LauncherMonitorResolver<HMONITOR>, LAUNCHER_COUNT> m_LauncherResolvers;
+
+	// Refresh batching
+	static constexpr std::chrono::milliseconds MAX_REFRESH_LATENCY { 100 };
+	RefreshScheduler<HMONITOR> m_RefreshScheduler;
+
 	// Hook DLL
 	LoadableDll m_HookDll;
 	PFN_INJECT_EXPLORER_HOOK m_InjectExplorerHook;
@@ -158,13 +281,18 @@ private:
 
 	// Callbacks
 	template<DWORD insert, DWORD remove>
-	void CALLBACK WindowInsertRemove(DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD);
+	void WindowInsertRemove(const ResolvedWinEvent &e);
 
 	void CALLBACK OnAeroPeekEnterExit(DWORD event, HWND, LONG, LONG, DWORD, DWORD);
-	void CALLBACK OnWindowStateChange(DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD);
-	void CALLBACK OnWindowCreateDestroy(DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD);
-	void CALLBACK OnForegroundWindowChange(DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD);
-	void CALLBACK OnWindowOrderChange(DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD);
+	void OnWindowStateChange(const ResolvedWinEvent &e);
+	void OnWindowTitleChange(const ResolvedWinEvent &e);
+	void OnWindowCreateDestroy(const ResolvedWinEvent &e);
+	void OnForegroundWindowChange(const ResolvedWinEvent &e);
+	void OnWindowOrderChange(const ResolvedWinEvent &e);
+	void CALLBACK QueueWindowEvent(DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD time);
+	void DrainWindowEvents();
+	void DispatchWindowEvent(const ResolvedWinEvent &e);
+	void PostWindowEventDrain();
 	void OnStartVisibilityChange(bool state);
 	void OnTaskViewVisibilityChange(bool state);
 	void OnSearchVisibilityChange(bool state);
@@ -175,31 +303,70 @@ private:
 	LRESULT OnRequestAttributeRefresh(LPARAM lParam);
 	LRESULT MessageHandler(UINT uMsg, WPARAM wParam, LPARAM lParam) override;
 
+	// Window event thread
+	void WindowEventThread(std::stop_token stop);
+	void StopWindowEventThread();
+	bool TakeWindowEvents(std::vector<ResolvedWinEvent> &out, WindowEventContext *context);
+	static ResolvedWinEvent ResolveWindowEvent(const QueuedWinEvent<HWND> &e, WindowEventContext *context);
+	static bool InsertsWindow(DWORD event) noexcept;
+
 	// Config
-	TaskbarAppearance GetConfig(taskbar_iterator taskbar) const;
+	TaskbarAppearance GetConfig(taskbar_iterator taskbar, AppearanceState *resolvedState = nullptr) const;
+	bool IsFilteredWindow(Window window) const;
+	std::optional<TaskbarAppearance> FindWindowRule(std::size_t ruleSet, const RuledTaskbarAppearance &rules, Window window) const;
 
 	// Attribute
-	void ShowAeroPeekButton(const TaskbarInfo &taskbar, bool show);
-	void ShowTaskbarLine(const TaskbarInfo &taskbar, bool show);
-	void SetAttribute(taskbar_iterator taskbar, TaskbarAppearance config);
-	void RefreshAttribute(taskbar_iterator taskbar);
+	bool ShowAeroPeekButton(const TaskbarInfo &taskbar, bool show);
+	bool ShowTaskbarLine(const TaskbarInfo &taskbar, bool show);
+	static bool IsSameAttribute(const TaskbarAppearance &a, const TaskbarAppearance &b) noexcept;
+	bool CheckAppliedCache(bool force, bool upToDate) noexcept;
+	template<typename T>
+	void ForgetApplied(HMONITOR monitor, std::optional<T> AppliedAppearance::*applied);
+	void SetAttribute(taskbar_iterator taskbar, TaskbarAppearance config, bool force = false);
+	void RefreshAttribute(taskbar_iterator taskbar, bool force = false);
+	void ScheduleRefresh(taskbar_iterator taskbar);
+	void FlushRefreshes();
 	void RefreshAllAttributes();
 
 	// Log
-	static void LogWindowInsertion(const std::pair<std::unordered_set<Window>::iterator, bool> &result, std::wstring_view state, HMONITOR mon);
-	static void LogWindowRemoval(std::wstring_view state, Window window, HMONITOR mon);
-	static void LogWindowRemovalDestroyed(std::wstring_view state, Window window, HMONITOR mon);
+	void LogWindowInsertion(std::wstring_view state, Window window, HMONITOR mon);
+	void LogWindowRemoval(std::wstring_view state, Window window, HMONITOR mon);
+	void LogWindowRemovalDestroyed(std::wstring_view state, Window window, HMONITOR mon);
 
 	// State
+	static ClassificationContext CreateClassificationContext();
+	static WindowClassification ClassifyWindow(Window window, IVirtualDesktopManager *desktopManager = nullptr);
+	static std::vector<WindowClassification> ClassifyWindows(const std::vector<Window> &windows);
 	void InsertWindow(Window window, bool refresh);
-
-	template<void(*logger)(std::wstring_view, Window, HMONITOR) = LogWindowRemoval>
-	void RemoveWindow(Window window, taskbar_iterator it, AttributeRefresher &refresher);
+	void InsertWindow(Window window, const WindowClassification &classification, bool refresh);
+	void InsertWindow(const ResolvedWinEvent &e);
+	std::optional<std::size_t> TryReconcileState(bool reclassifyAll);
+	void SyncMaximisedZOrder();
+	HMONITOR &LauncherMonitor(Launcher launcher) noexcept;
+	HMONITOR OpenLauncher(Launcher launcher);
+	void CancelLauncher(Launcher launcher);
+	void ResolveLauncherMonitor(Launcher launcher, HMONITOR actual);
+	void ResyncLaunchers();
+#ifdef _DEBUG
+	void VerifyMaximisedZOrder(taskbar_iterator taskbar, std::optional<Window> top) const;
+#endif
+
+	// Event accounting and recording
+	static TraceEvent TraceEventFromWinEvent(DWORD event) noexcept;
+	static TraceEvent TraceEventFromLauncher(Launcher launcher) noexcept;
+	TraceWindow SnapshotWindow(Window window);
+	void NoteEvent();
+	void NoteWindowEvent(DWORD event, Window window, DWORD time);
+	void NoteStateEvent(TraceEvent event, bool state, HMONITOR mon = nullptr);
+	void RecordReset(std::vector<TraceWindow> windows);
+	void ExportMetrics() const;
 
 	// Other
 	static bool SetNewWindowExStyle(Window wnd, LONG_PTR oldStyle, LONG_PTR newStyle);
-	static void DumpWindowSet(std::wstring_view prefix, const std::unordered_set<Window> &set, bool showInfo = true);
+	static void DumpWindowSet(std::wstring_view prefix, const decltype(m_Taskbars)::window_set &set);
 	static std::wstring DumpWindow(Window window);
+	static std::wstring_view CachedIdentity(const std::wstring *str) noexcept;
+	static std::wstring_view LauncherName(Launcher launcher) noexcept;
 	void CreateAppVisibility();
 	void CreateSearchManager();
 	void UnregisterSearchCallbacks() noexcept;
@@ -210,6 +377,8 @@ private:
 	bool IsSearchOpened() const;
 	bool IsFindInStartOpened() const;
 	void InsertTaskbar(HMONITOR mon, Window window);
+	TaskbarInfo CreateTaskbarInfo(Window window) const;
+	void HookTaskbar(Window window);
 	static BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData);
 	static BOOL CALLBACK WindowEnumProc(HWND hwnd, LPARAM lParam);
 	static HMONITOR GetTaskbarMonitor(Window taskbar);
@@ -228,33 +397,6 @@ private:
 		}
 	}
 
-	inline static HMONITOR GetStartMenuMonitor() noexcept
-	{
-		// we assume that start is the current foreground window;
-		// haven't seen a case where that wasn't true yet.
-		// NOTE: this only stands *when* we get notified that
-		// start has opened (and as long as it is). when we get
-		// notified that it's closed another window may be the
-		// foreground window already (eg the user dismissed start
-		// by clicking on a window)
-		Sleep(5); // give it a bit of delay because sometimes it doesn't capture it right
-		return Window::ForegroundWindow().monitor();
-	}
-
-	inline static HMONITOR GetSearchMonitor() noexcept
-	{
-		// same assumption for search
-		Sleep(5);
-		return Window::ForegroundWindow().monitor();
-	}
-
-	inline static HMONITOR GetFindInStartMonitor() noexcept
-	{
-		// same assumption for find in start
-		Sleep(5);
-		return Window::ForegroundWindow().monitor();
-	}
-
 	inline static wil::unique_hwineventhook CreateHook(DWORD event, WINEVENTPROC proc)
 	{
 		return CreateHook(event, event, proc);
@@ -263,26 +405,48 @@ private:
 public:
 	TaskbarAttributeWorker(ConfigManager &cfgManager, HINSTANCE hInstance, DynamicLoader &loader, const std::optional<std::filesystem::path> &storageFolder);
 
-	inline void ConfigurationChanged()
-	{
-		RefreshAllAttributes();
-	}
+	// Only refreshes the taskbars whose appearance might be different.
+	void ConfigurationChanged(const ConfigDiff &diff);
+
+	// Same, for a reload of the settings file, which also gets timed from when the file changed.
+	void ConfigurationReloaded(const ConfigDiff &diff, WorkerMetrics::clock::time_point changedAt);
 
 	void ApplyColorPreview(txmp::TaskbarState state, Util::Color color)
 	{
 		m_ColorPreviews.at(static_cast<std::size_t>(state)) = color;
-		ConfigurationChanged();
+		ConfigurationChanged(ConfigDiff::OfAppearance(static_cast<std::size_t>(state)));
 	}
 
 	inline void RemoveColorPreview(txmp::TaskbarState state)
 	{
 		m_ColorPreviews.at(static_cast<std::size_t>(state)).reset();
-		ConfigurationChanged();
+		ConfigurationChanged(ConfigDiff::OfAppearance(static_cast<std::size_t>(state)));
 	}
 
 	void DumpState();
 	void ResetState(bool manual = false);
 
+	// Cheaper alternative to ResetState for display and work area changes: only reclassifies
+	// the windows that appeared, vanished or changed monitor (or every window, if reclassifyAll
+	// is set). Falls back to a full reset when Explorer restarted or a taskbar went away.
+	void ReconcileState(bool reclassifyAll = false);
+
+	void StartRecordingEvents();
+	void StopRecordingEvents();
+
+	bool IsRecordingEvents() const noexcept
+	{
+		return m_EventTrace.has_value();
+	}
+
+	void StartCollectingMetrics();
+	void StopCollectingMetrics();
+
+	bool IsCollectingMetrics() const noexcept
+	{
+		return m_Metrics.enabled();
+	}
+
 	TaskbarType GetType() noexcept
 	{
 		return m_TaskbarType;
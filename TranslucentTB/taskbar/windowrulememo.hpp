@@ -0,0 +1,126 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// Remembers, per window, whether the window filter matched it and which rule of each
+// rule set it matched. All of these only depend on the window class, process and title,
+// and on the config.
+//
+// Everything is forgotten when the config generation changes. The owner must call erase()
+// when a window gets destroyed or its title changes.
+// To stay bounded, the whole memo is dropped when it reaches its capacity: windows that
+// are still around get looked up again on their next event.
+template<typename Window, typename Rule, std::size_t RuleSets>
+class WindowRuleMemo {
+public:
+	struct Stats {
+		std::uint64_t Hits = 0;
+		std::uint64_t Misses = 0;
+		std::uint64_t Invalidations = 0; // windows forgotten, either individually or by a new generation
+
+		double hit_rate() const noexcept
+		{
+			const auto total = Hits + Misses;
+			return total ? static_cast<double>(Hits) / total : 0.0;
+		}
+	};
+
+private:
+	struct Entry {
+		std::optional<bool> Filtered;
+		std::array<std::optional<std::optional<Rule>>, RuleSets> Rules;
+	};
+
+	std::size_t m_Capacity;
+	std::uint64_t m_Generation;
+	std::unordered_map<Window, Entry> m_Entries;
+	Stats m_Stats;
+
+	Entry &get(Window window)
+	{
+		if (m_Entries.size() >= m_Capacity && !m_Entries.contains(window))
+		{
+			m_Stats.Invalidations += m_Entries.size();
+			m_Entries.clear();
+		}
+
+		return m_Entries[window];
+	}
+
+	template<typename T, typename Compute>
+	const T &lookup(std::optional<T> &slot, Compute &&compute)
+	{
+		if (slot)
+		{
+			++m_Stats.Hits;
+		}
+		else
+		{
+			++m_Stats.Misses;
+			slot.emplace(std::forward<Compute>(compute)());
+		}
+
+		return *slot;
+	}
+
+public:
+	explicit WindowRuleMemo(std::size_t capacity = 1024) noexcept : m_Capacity(capacity ? capacity : 1), m_Generation(0) { }
+
+	// Forgets everything if the generation is not the one the memo was filled with.
+	void sync(std::uint64_t generation) noexcept
+	{
+		if (generation != m_Generation)
+		{
+			m_Generation = generation;
+			clear();
+		}
+	}
+
+	// compute() is only called when the result isn't known yet.
+	template<typename Compute>
+	bool filtered(Window window, Compute &&compute)
+	{
+		return lookup(get(window).Filtered, std::forward<Compute>(compute));
+	}
+
+	// compute() is only called when the result isn't known yet. The returned reference is
+	// valid until the memo is used again.
+	template<typename Compute>
+	const std::optional<Rule> &rule(std::size_t set, Window window, Compute &&compute)
+	{
+		return lookup(get(window).Rules.at(set), std::forward<Compute>(compute));
+	}
+
+	void erase(Window window)
+	{
+		if (m_Entries.erase(window) > 0)
+		{
+			++m_Stats.Invalidations;
+		}
+	}
+
+	void clear() noexcept
+	{
+		m_Stats.Invalidations += m_Entries.size();
+		m_Entries.clear();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return m_Entries.size();
+	}
+
+	std::uint64_t generation() const noexcept
+	{
+		return m_Generation;
+	}
+
+	const Stats &stats() const noexcept
+	{
+		return m_Stats;
+	}
+};
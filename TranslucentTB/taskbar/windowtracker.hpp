@@ -0,0 +1,231 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#include "util/flat_hash.hpp"
+#include "util/flat_map.hpp"
+
+// Where a window is accounted for by the taskbar attribute worker.
+enum class WindowState : std::uint8_t {
+	None,     // not tracked (hidden, minimised, filtered, ...)
+	Normal,
+	Maximised
+};
+
+// Bookkeeping of the windows that are maximised or visible on each monitor.
+// This is deliberately free of any Win32 calls: the caller queries the window
+// and only hands over the result, so that the exact same logic can be driven
+// by the event replay tests.
+//
+// Every window is in at most one set. A reverse index from window to the set it is in
+// keeps the cost of an event independent of the number of monitors.
+//
+// All of it is stored in flat containers: monitor iterators stay valid until a taskbar is
+// inserted, but anything referring into a window set is invalidated by the next change.
+//
+// Functions taking a listener call back into it with:
+// - inserted(WindowState, Window, Monitor): the window got added to a set
+// - removed(WindowState, Window, Monitor): the window got removed from a set
+// - refresh(iterator): the appearance of that monitor's taskbar must be recomputed
+template<typename Window, typename Monitor, typename TaskbarInfo>
+class WindowTracker {
+public:
+	using window_set = Util::flat_hash_set<Window>;
+
+	struct MonitorInfo {
+		TaskbarInfo Taskbar;
+		window_set MaximisedWindows;
+		window_set NormalWindows;
+	};
+
+	using map_t = Util::flat_map<Monitor, MonitorInfo>;
+	using iterator = typename map_t::iterator;
+	using const_iterator = typename map_t::const_iterator;
+
+	struct Location {
+		Monitor Mon;
+		WindowState State;
+	};
+
+private:
+	map_t m_Monitors;
+	Util::flat_hash_map<Window, Location> m_Windows;
+
+	static window_set &set_for(MonitorInfo &info, WindowState state) noexcept
+	{
+		return state == WindowState::Maximised ? info.MaximisedWindows : info.NormalWindows;
+	}
+
+	// Removes the window from the set it is in, without refreshing.
+	template<typename Listener>
+	std::optional<iterator> unlink(typename decltype(m_Windows)::iterator location, Listener &listener)
+	{
+		const auto [window, where] = *location;
+		m_Windows.erase(window);
+
+		if (const auto it = m_Monitors.find(where.Mon); it != m_Monitors.end())
+		{
+			set_for(it->second, where.State).erase(window);
+			listener.removed(where.State, window, where.Mon);
+			return it;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+	}
+
+public:
+	iterator begin() noexcept { return m_Monitors.begin(); }
+	iterator end() noexcept { return m_Monitors.end(); }
+	const_iterator begin() const noexcept { return m_Monitors.begin(); }
+	const_iterator end() const noexcept { return m_Monitors.end(); }
+
+	iterator find(Monitor mon) { return m_Monitors.find(mon); }
+	const_iterator find(Monitor mon) const { return m_Monitors.find(mon); }
+
+	bool empty() const noexcept { return m_Monitors.empty(); }
+	std::size_t size() const noexcept { return m_Monitors.size(); }
+
+	std::size_t window_count() const noexcept { return m_Windows.size(); }
+
+	void clear() noexcept
+	{
+		m_Monitors.clear();
+		m_Windows.clear();
+	}
+
+	void insert_taskbar(Monitor mon, TaskbarInfo taskbar)
+	{
+		if (const auto it = m_Monitors.find(mon); it != m_Monitors.end())
+		{
+			for (const auto &window : it->second.MaximisedWindows)
+			{
+				m_Windows.erase(window);
+			}
+
+			for (const auto &window : it->second.NormalWindows)
+			{
+				m_Windows.erase(window);
+			}
+		}
+
+		m_Monitors.insert_or_assign(mon, MonitorInfo { std::move(taskbar), { }, { } });
+	}
+
+	// Replaces every taskbar with the (monitor, taskbar info) pairs in taskbars. Monitors that are
+	// still there keep their windows, the windows of monitors that went away are removed.
+	// Nothing gets refreshed, since the caller is expected to refresh everything after this.
+	template<typename Range, typename Listener>
+	void replace_taskbars(Range &&taskbars, Listener &&listener)
+	{
+		map_t next;
+		for (auto &[mon, taskbar] : taskbars)
+		{
+			if (const auto it = m_Monitors.find(mon); it != m_Monitors.end())
+			{
+				next.insert_or_assign(mon, MonitorInfo { std::move(taskbar), std::exchange(it->second.MaximisedWindows, { }), std::exchange(it->second.NormalWindows, { }) });
+			}
+			else
+			{
+				next.insert_or_assign(mon, MonitorInfo { std::move(taskbar), { }, { } });
+			}
+		}
+
+		for (const auto &[mon, info] : m_Monitors)
+		{
+			for (const auto state : { WindowState::Maximised, WindowState::Normal })
+			{
+				for (const auto &window : state == WindowState::Maximised ? info.MaximisedWindows : info.NormalWindows)
+				{
+					m_Windows.erase(window);
+					listener.removed(state, window, mon);
+				}
+			}
+		}
+
+		m_Monitors = std::move(next);
+	}
+
+	// Where the window is currently tracked, if anywhere.
+	std::optional<Location> locate(const Window &window) const
+	{
+		if (const auto it = m_Windows.find(window); it != m_Windows.end())
+		{
+			return it->second;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+	}
+
+	// Moves the window into the set for state on monitor mon, and removes it from every other set.
+	// The taskbar on mon is always refreshed when the window is tracked, because something
+	// about the window (title, z-order, ...) might have changed which rule applies.
+	template<typename Listener>
+	void place(Window window, Monitor mon, WindowState state, Listener &&listener)
+	{
+		const auto target = state != WindowState::None ? m_Monitors.find(mon) : m_Monitors.end();
+
+		auto location = m_Windows.find(window);
+		if (location != m_Windows.end() && (target == m_Monitors.end() || location->second.Mon != mon || location->second.State != state))
+		{
+			// refreshed below anyways if it stays on the same monitor
+			if (const auto from = unlink(location, listener); from && *from != target)
+			{
+				listener.refresh(*from);
+			}
+
+			location = m_Windows.end();
+		}
+
+		if (target != m_Monitors.end())
+		{
+			if (location == m_Windows.end())
+			{
+				set_for(target->second, state).insert(window);
+				m_Windows.try_emplace(window, Location { mon, state });
+				listener.inserted(state, window, mon);
+			}
+
+			listener.refresh(target);
+		}
+	}
+
+	// Removes the window from wherever it is tracked, refreshing that monitor.
+	template<typename Listener>
+	bool remove(Window window, Listener &&listener)
+	{
+		if (const auto location = m_Windows.find(window); location != m_Windows.end())
+		{
+			if (const auto from = unlink(location, listener))
+			{
+				listener.refresh(*from);
+			}
+
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	// Removes the window if it is tracked on that monitor, refreshing it.
+	template<typename Listener>
+	bool remove(Window window, iterator it, Listener &&listener)
+	{
+		if (const auto location = m_Windows.find(window); location != m_Windows.end() && location->second.Mon == it->first)
+		{
+			unlink(location, listener);
+			listener.refresh(it);
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+};
@@ -0,0 +1,288 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "eventtrace.hpp"
+#include "util/histogram.hpp"
+
+// Counts of the events the taskbar attribute worker gets and of the work it does, along with
+// latency histograms of its callbacks and of the expensive parts of a refresh.
+//
+// Everything is a no-op while disabled, down to not reading the clock, so that it costs
+// a predictable branch. Only the worker thread records: counters are atomics so that they
+// can be read from elsewhere without tearing, but are incremented with a plain load and
+// store. The histograms must only be read from the worker thread.
+class WorkerMetrics {
+public:
+	enum class Timer : std::size_t {
+		InsertRemove,     // show, hide, cloak, uncloak, minimize start and end
+		StateChange,      // location and parent changes
+		TitleChange,
+		CreateDestroy,
+		ForegroundChange,
+		OrderChange,
+		Peek,
+		LauncherVisibility,
+		TaskViewVisibility,
+		EventDrain,       // a whole batch of queued window events
+		GetConfig,
+		SetAttribute,
+		ConfigReload,     // from the settings file changing to the new settings being applied
+
+		Max = ConfigReload
+	};
+
+	enum class Counter : std::size_t {
+		Refreshes,
+		FullResets,
+		Reconciliations,
+		ExplorerRestarts,
+		ConfigReloads,
+		UnchangedConfigReloads, // the settings file changed, but not the settings
+
+		Max = UnchangedConfigReloads
+	};
+
+	static constexpr std::size_t EVENT_COUNT = static_cast<std::size_t>(TraceEvent::Max) + 1;
+	static constexpr std::size_t TIMER_COUNT = static_cast<std::size_t>(Timer::Max) + 1;
+	static constexpr std::size_t COUNTER_COUNT = static_cast<std::size_t>(Counter::Max) + 1;
+
+	using clock = std::chrono::steady_clock;
+	using histogram = Util::log_linear_histogram<3>; // in nanoseconds
+
+	// Records the time until it goes out of scope.
+	class scoped_timer {
+		WorkerMetrics *m_Metrics;
+		Timer m_Timer;
+		clock::time_point m_Start;
+
+	public:
+		scoped_timer(WorkerMetrics *metrics, Timer timer) noexcept :
+			m_Metrics(metrics),
+			m_Timer(timer),
+			m_Start(metrics ? clock::now() : clock::time_point { })
+		{ }
+
+		scoped_timer(const scoped_timer &) = delete;
+		scoped_timer &operator =(const scoped_timer &) = delete;
+
+		~scoped_timer()
+		{
+			if (m_Metrics)
+			{
+				m_Metrics->record(m_Timer, clock::now() - m_Start);
+			}
+		}
+	};
+
+private:
+	using counter = std::atomic<std::uint64_t>;
+
+	bool m_Enabled = false;
+	std::array<counter, EVENT_COUNT> m_Events { };
+	std::array<counter, COUNTER_COUNT> m_Counters { };
+	std::array<histogram, TIMER_COUNT> m_Latencies { };
+
+	static void increment(counter &c) noexcept
+	{
+		c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	static void append_histogram(std::string &out, const histogram &h)
+	{
+		out += "{\"count\":";
+		out += std::to_string(h.count());
+		out += ",\"min_ns\":";
+		out += std::to_string(h.min());
+		out += ",\"mean_ns\":";
+		out += std::to_string(static_cast<std::uint64_t>(h.mean()));
+		out += ",\"p50_ns\":";
+		out += std::to_string(h.percentile(0.5));
+		out += ",\"p90_ns\":";
+		out += std::to_string(h.percentile(0.9));
+		out += ",\"p99_ns\":";
+		out += std::to_string(h.percentile(0.99));
+		out += ",\"max_ns\":";
+		out += std::to_string(h.max());
+
+		// only the buckets that have something, as [upper bound, count] pairs
+		out += ",\"buckets\":[";
+		bool first = true;
+		for (std::size_t i = 0; i < histogram::BUCKETS; ++i)
+		{
+			if (const auto count = h.count(i))
+			{
+				if (!first)
+				{
+					out += ',';
+				}
+
+				first = false;
+				out += '[';
+				out += std::to_string(histogram::bucket_upper_bound(i));
+				out += ',';
+				out += std::to_string(count);
+				out += ']';
+			}
+		}
+
+		out += "]}";
+	}
+
+public:
+	bool enabled() const noexcept
+	{
+		return m_Enabled;
+	}
+
+	// Doesn't clear what was collected, so that it can still be looked at.
+	void enable(bool enabled) noexcept
+	{
+		m_Enabled = enabled;
+	}
+
+	void clear() noexcept
+	{
+		for (auto &c : m_Events)
+		{
+			c.store(0, std::memory_order_relaxed);
+		}
+
+		for (auto &c : m_Counters)
+		{
+			c.store(0, std::memory_order_relaxed);
+		}
+
+		for (auto &h : m_Latencies)
+		{
+			h.clear();
+		}
+	}
+
+	void count(TraceEvent event) noexcept
+	{
+		if (m_Enabled)
+		{
+			increment(m_Events[static_cast<std::size_t>(event)]);
+		}
+	}
+
+	void count(Counter which) noexcept
+	{
+		if (m_Enabled)
+		{
+			increment(m_Counters[static_cast<std::size_t>(which)]);
+		}
+	}
+
+	[[nodiscard]] scoped_timer time(Timer timer) noexcept
+	{
+		return { m_Enabled ? this : nullptr, timer };
+	}
+
+	void record(Timer timer, clock::duration elapsed) noexcept
+	{
+		const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		m_Latencies[static_cast<std::size_t>(timer)].record(ns > 0 ? static_cast<std::uint64_t>(ns) : 0);
+	}
+
+	std::uint64_t events(TraceEvent event) const noexcept
+	{
+		return m_Events[static_cast<std::size_t>(event)].load(std::memory_order_relaxed);
+	}
+
+	std::uint64_t counter_value(Counter which) const noexcept
+	{
+		return m_Counters[static_cast<std::size_t>(which)].load(std::memory_order_relaxed);
+	}
+
+	const histogram &latency(Timer timer) const noexcept
+	{
+		return m_Latencies[static_cast<std::size_t>(timer)];
+	}
+
+	static constexpr std::string_view name(TraceEvent event) noexcept
+	{
+		constexpr std::array<std::string_view, EVENT_COUNT> names = {
+			"reset", "create", "destroy", "show", "hide", "cloak", "uncloak", "minimize_start", "minimize_end",
+			"location_change", "name_change", "parent_change", "foreground", "reorder",
+			"start_visibility", "search_visibility", "find_in_start_visibility", "task_view_visibility", "peek", "power_saver"
+		};
+
+		return names[static_cast<std::size_t>(event)];
+	}
+
+	static constexpr std::string_view name(Timer timer) noexcept
+	{
+		constexpr std::array<std::string_view, TIMER_COUNT> names = {
+			"insert_remove", "state_change", "title_change", "create_destroy", "foreground_change", "order_change",
+			"peek", "launcher_visibility", "task_view_visibility", "event_drain", "get_config", "set_attribute",
+			"config_reload"
+		};
+
+		return names[static_cast<std::size_t>(timer)];
+	}
+
+	static constexpr std::string_view name(Counter which) noexcept
+	{
+		constexpr std::array<std::string_view, COUNTER_COUNT> names = {
+			"refreshes", "full_resets", "reconciliations", "explorer_restarts", "config_reloads", "unchanged_config_reloads"
+		};
+
+		return names[static_cast<std::size_t>(which)];
+	}
+
+	// Everything as a JSON object, with latencies in nanoseconds.
+	std::string to_json() const
+	{
+		std::string out = "{\"events\":{";
+		for (std::size_t i = 0; i < EVENT_COUNT; ++i)
+		{
+			if (i != 0)
+			{
+				out += ',';
+			}
+
+			out += '"';
+			out += name(static_cast<TraceEvent>(i));
+			out += "\":";
+			out += std::to_string(events(static_cast<TraceEvent>(i)));
+		}
+
+		out += "},\"counters\":{";
+		for (std::size_t i = 0; i < COUNTER_COUNT; ++i)
+		{
+			if (i != 0)
+			{
+				out += ',';
+			}
+
+			out += '"';
+			out += name(static_cast<Counter>(i));
+			out += "\":";
+			out += std::to_string(counter_value(static_cast<Counter>(i)));
+		}
+
+		out += "},\"latencies\":{";
+		for (std::size_t i = 0; i < TIMER_COUNT; ++i)
+		{
+			if (i != 0)
+			{
+				out += ',';
+			}
+
+			out += '"';
+			out += name(static_cast<Timer>(i));
+			out += "\":";
+			append_histogram(out, latency(static_cast<Timer>(i)));
+		}
+
+		out += "}}";
+		return out;
+	}
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the maximised windows of each monitor sorted by z-order, so that the topmost
+// one can be found without walking every top-level window.
+//
+// The order is maintained from events: a window that gets maximised or raised goes on
+// top of its monitor. Anything that lowers a window without raising another one is
+// missed, so the owner should reorder() from a full z-order walk when it has one handy.
+template<typename Window, typename Monitor>
+class ZOrderIndex {
+	using list_t = std::list<Window>; // front is the top
+
+	struct Position {
+		Monitor Mon;
+		typename list_t::iterator It;
+	};
+
+	std::unordered_map<Monitor, list_t> m_Monitors;
+	std::unordered_map<Window, Position> m_Positions;
+
+public:
+	// Puts the window on top of the monitor, moving it from another monitor if needed.
+	void insert(Window window, Monitor mon)
+	{
+		auto &list = m_Monitors[mon];
+		if (const auto it = m_Positions.find(window); it != m_Positions.end())
+		{
+			auto &from = m_Monitors[it->second.Mon];
+			list.splice(list.begin(), from, it->second.It);
+			it->second.Mon = mon;
+		}
+		else
+		{
+			m_Positions.emplace(window, Position { mon, list.insert(list.begin(), window) });
+		}
+	}
+
+	// Only removes the window if it is on that monitor, because it might have been moved
+	// to another monitor already.
+	void remove(Window window, Monitor mon)
+	{
+		if (const auto it = m_Positions.find(window); it != m_Positions.end() && it->second.Mon == mon)
+		{
+			m_Monitors[it->second.Mon].erase(it->second.It);
+			m_Positions.erase(it);
+		}
+	}
+
+	// Moves the window on top of its monitor, if the window is tracked.
+	void raise(Window window)
+	{
+		if (const auto it = m_Positions.find(window); it != m_Positions.end())
+		{
+			auto &list = m_Monitors[it->second.Mon];
+			list.splice(list.begin(), list, it->second.It);
+		}
+	}
+
+	std::optional<Window> top(Monitor mon) const
+	{
+		if (const auto it = m_Monitors.find(mon); it != m_Monitors.end() && !it->second.empty())
+		{
+			return it->second.front();
+		}
+		else
+		{
+			return std::nullopt;
+		}
+	}
+
+	// Sorts the tracked windows to match zOrder, which goes from top to bottom.
+	// Tracked windows missing from it end up at the bottom, in their current order.
+	void reorder(const std::vector<Window> &zOrder)
+	{
+		for (auto window = zOrder.rbegin(); window != zOrder.rend(); ++window)
+		{
+			raise(*window);
+		}
+	}
+
+	void clear() noexcept
+	{
+		m_Monitors.clear();
+		m_Positions.clear();
+	}
+
+	bool contains(Window window) const
+	{
+		return m_Positions.contains(window);
+	}
+
+	std::size_t size() const noexcept
+	{
+		return m_Positions.size();
+	}
+
+	std::size_t size(Monitor mon) const
+	{
+		if (const auto it = m_Monitors.find(mon); it != m_Monitors.end())
+		{
+			return it->second.size();
+		}
+		else
+		{
+			return 0;
+		}
+	}
+};
@@ -3,11 +3,13 @@
 
 #include "../windows/window.hpp"
 #include "uwp.hpp"
+#include "util/trace_recorder.hpp"
 #include "../../ProgramLog/error/win32.hpp"
 
 DWORD WINAPI XamlThread::ThreadProc(LPVOID param)
 {
 	const auto that = static_cast<XamlThread *>(param);
+	Util::trace_recorder::global().name_thread("XAML Island Thread");
 	that->ThreadInit();
 	that->m_Ready.SetEvent();
 
@@ -48,6 +50,8 @@ void XamlThread::DeletedCallback(void *data)
 
 void XamlThread::ThreadInit()
 {
+	const auto trace = Util::trace_recorder::global().trace("XamlThread::ThreadInit", "xaml");
+
 	try
 	{
 		winrt::init_apartment(winrt::apartment_type::single_threaded);
@@ -1,6 +1,8 @@
 #include "xamlthreadpool.hpp"
 #include <wil/safecast.h>
 
+#include "util/trace_recorder.hpp"
+
 XamlThread &XamlThreadPool::GetAvailableThread(std::unique_lock<Util::thread_independent_mutex> &lock)
 {
 	for (auto it = m_Threads.begin(); it != m_Threads.end(); ++it)
@@ -17,6 +19,7 @@ XamlThread &XamlThreadPool::GetAvailableThread(std::unique_lock<Util::thread_ind
 		}
 	}
 
+	const auto trace = Util::trace_recorder::global().trace("XamlThreadPool::CreateThread", "xaml");
 	auto &thread = m_Threads.emplace_back(std::make_unique<XamlThread>());
 	lock = thread->Lock();
 	return *thread;
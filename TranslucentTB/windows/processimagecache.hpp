@@ -0,0 +1,145 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// The image of a process, with its file name split out once so that the
+// window filter and rules can match on it directly.
+struct ProcessImage {
+	std::filesystem::path Path;
+	std::wstring FileName;
+
+	ProcessImage() = default;
+	explicit ProcessImage(std::filesystem::path path) : Path(std::move(path)), FileName(Path.filename().wstring()) { }
+};
+
+// Least recently used cache of process images, keyed by process ID.
+//
+// Each entry keeps a handle to its process open. A process ID can't be reused while a
+// handle to the process exists, so an entry is valid for as long as its process runs,
+// which the caller checks with the handle on lookup.
+//
+// find can be called concurrently with other calls to find, everything else needs
+// exclusive access. Recency is tracked with a counter, and eviction looks for the
+// oldest entry, which is fine for the few dozen entries this holds.
+template<typename Handle>
+class BasicProcessImageCache {
+public:
+	struct Stats {
+		std::uint64_t Hits = 0;
+		std::uint64_t Misses = 0;
+		std::uint64_t Evictions = 0;
+	};
+
+private:
+	struct Entry {
+		Handle Process;
+		ProcessImage Image;
+		mutable std::atomic<std::uint64_t> LastUsed;
+	};
+
+	std::size_t m_Capacity;
+	std::unordered_map<std::uint32_t, Entry> m_Entries;
+
+	mutable std::atomic<std::uint64_t> m_Clock = 0;
+	mutable std::atomic<std::uint64_t> m_Hits = 0;
+	mutable std::atomic<std::uint64_t> m_Misses = 0;
+	std::uint64_t m_Evictions = 0;
+
+	std::uint64_t tick() const noexcept
+	{
+		return m_Clock.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	void trim()
+	{
+		while (m_Entries.size() > m_Capacity)
+		{
+			auto oldest = m_Entries.begin();
+			for (auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+			{
+				if (it->second.LastUsed.load(std::memory_order_relaxed) < oldest->second.LastUsed.load(std::memory_order_relaxed))
+				{
+					oldest = it;
+				}
+			}
+
+			m_Entries.erase(oldest);
+			++m_Evictions;
+		}
+	}
+
+public:
+	explicit BasicProcessImageCache(std::size_t capacity) : m_Capacity(capacity ? capacity : 1) { }
+
+	// Finds the image of a process, if it is still running according to running(handle).
+	// The returned pointer is valid until the next insertion.
+	template<typename Running>
+	const ProcessImage *find(std::uint32_t pid, Running &&running) const
+	{
+		if (const auto it = m_Entries.find(pid); it != m_Entries.end() && running(it->second.Process))
+		{
+			it->second.LastUsed.store(tick(), std::memory_order_relaxed);
+			m_Hits.fetch_add(1, std::memory_order_relaxed);
+			return &it->second.Image;
+		}
+		else
+		{
+			m_Misses.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+	}
+
+	// Replaces whatever was cached for the process ID, which is an exited process if anything.
+	const ProcessImage &insert(std::uint32_t pid, Handle process, ProcessImage image)
+	{
+		auto [it, inserted] = m_Entries.try_emplace(pid, std::move(process), std::move(image), tick());
+		if (!inserted)
+		{
+			it->second.Process = std::move(process);
+			it->second.Image = std::move(image);
+			it->second.LastUsed.store(tick(), std::memory_order_relaxed);
+		}
+		else
+		{
+			trim();
+		}
+
+		// trimming never evicts the newest entry
+		return m_Entries.at(pid).Image;
+	}
+
+	void set_capacity(std::size_t capacity)
+	{
+		m_Capacity = capacity ? capacity : 1;
+		trim();
+	}
+
+	std::size_t capacity() const noexcept
+	{
+		return m_Capacity;
+	}
+
+	std::size_t size() const noexcept
+	{
+		return m_Entries.size();
+	}
+
+	void clear() noexcept
+	{
+		m_Entries.clear();
+	}
+
+	Stats stats() const noexcept
+	{
+		return {
+			.Hits = m_Hits.load(std::memory_order_relaxed),
+			.Misses = m_Misses.load(std::memory_order_relaxed),
+			.Evictions = m_Evictions
+		};
+	}
+};
@@ -3,6 +3,7 @@
 #include <wil/com.h>
 #include <wil/resource.h>
 
+#include "../ProgramLog/error/std.hpp"
 #include "undoc/winternl.hpp"
 #include "win32.hpp"
 
@@ -126,23 +127,43 @@ std::optional<std::wstring> Window::classname() const
 	}
 }
 
-std::optional<std::filesystem::path> Window::file() const
+wil::srwlock Window::s_ProcessImageLock;
+ProcessImageCache Window::s_ProcessImages(64);
+
+bool Window::IsProcessRunning(const wil::unique_process_handle &process) noexcept
 {
-	const auto pid = process_id();
+	return WaitForSingleObject(process.get(), 0) == WAIT_TIMEOUT;
+}
 
-	if (auto imageName = TryGetNtImageName(pid))
-	{
-		return { std::move(*imageName) };
-	}
-	else
+template<typename T>
+std::optional<T> Window::GetProcessImage(DWORD pid, T ProcessImage:: *member)
+{
 	{
-		const wil::unique_process_handle processHandle(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, false, pid));
-		if (!processHandle)
+		const auto guard = s_ProcessImageLock.lock_shared();
+		if (const auto image = s_ProcessImages.find(pid, IsProcessRunning))
 		{
-			LastErrorHandle(spdlog::level::info, L"Getting process handle of a window failed.");
-			return std::nullopt;
+			return image->*member;
 		}
+	}
+
+	// The cache keeps this handle, which stops the process ID from being reused while it's cached.
+	// Processes we aren't allowed to wait on are still looked up, but can't be cached.
+	wil::unique_process_handle processHandle(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, false, pid));
+	const bool cacheable = processHandle.is_valid();
+	if (!cacheable)
+	{
+		processHandle.reset(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, false, pid));
+	}
+
+	const DWORD openError = processHandle ? NO_ERROR : GetLastError();
 
+	std::filesystem::path location;
+	if (auto imageName = TryGetNtImageName(pid))
+	{
+		location = std::move(*imageName);
+	}
+	else if (processHandle)
+	{
 		auto [loc, hr] = win32::GetProcessFileName(processHandle.get());
 		if (FAILED(hr))
 		{
@@ -150,29 +171,84 @@ std::optional<std::filesystem::path> Window::file() const
 			return std::nullopt;
 		}
 
-		return { std::move(loc) };
+		location = std::move(loc);
+	}
+	else
+	{
+		HresultHandle(HRESULT_FROM_WIN32(openError), spdlog::level::info, L"Getting process handle of a window failed.");
+		return std::nullopt;
 	}
-}
 
-std::optional<bool> Window::on_current_desktop() const
-{
-	static const auto desktop_manager = []() -> wil::com_ptr<IVirtualDesktopManager>
+	try
 	{
-		try
+		ProcessImage image(std::move(location));
+		if (cacheable)
 		{
-			return wil::CoCreateInstance<IVirtualDesktopManager>(CLSID_VirtualDesktopManager);
+			const auto guard = s_ProcessImageLock.lock_exclusive();
+			return s_ProcessImages.insert(pid, std::move(processHandle), std::move(image)).*member;
 		}
-		catch (const wil::ResultException &err)
+		else
 		{
-			ResultExceptionHandle(err, spdlog::level::warn, L"Failed to create virtual desktop manager");
-			return nullptr;
+			return std::move(image.*member);
 		}
-	}();
+	}
+	StdSystemErrorCatch(spdlog::level::warn, L"Failed to get file name of window process");
+
+	return std::nullopt;
+}
 
-	if (desktop_manager)
+std::optional<std::filesystem::path> Window::file() const
+{
+	return GetProcessImage(process_id(), &ProcessImage::Path);
+}
+
+std::optional<std::wstring> Window::filename() const
+{
+	return GetProcessImage(process_id(), &ProcessImage::FileName);
+}
+
+void Window::SetProcessImageCacheCapacity(std::size_t capacity)
+{
+	const auto guard = s_ProcessImageLock.lock_exclusive();
+	s_ProcessImages.set_capacity(capacity);
+}
+
+ProcessImageCache::Stats Window::GetProcessImageCacheStats()
+{
+	const auto guard = s_ProcessImageLock.lock_shared();
+	return s_ProcessImages.stats();
+}
+
+wil::com_ptr<IVirtualDesktopManager> Window::CreateDesktopManager()
+{
+	try
+	{
+		return wil::CoCreateInstance<IVirtualDesktopManager>(CLSID_VirtualDesktopManager);
+	}
+	catch (const wil::ResultException &err)
+	{
+		ResultExceptionHandle(err, spdlog::level::warn, L"Failed to create virtual desktop manager");
+		return nullptr;
+	}
+}
+
+IVirtualDesktopManager *Window::DefaultDesktopManager()
+{
+	static const auto desktop_manager = CreateDesktopManager();
+	return desktop_manager.get();
+}
+
+std::optional<bool> Window::on_current_desktop() const
+{
+	return on_current_desktop(DefaultDesktopManager());
+}
+
+std::optional<bool> Window::on_current_desktop(IVirtualDesktopManager *desktopManager) const
+{
+	if (desktopManager)
 	{
 		BOOL on_current_desktop;
-		if (const HRESULT hr = desktop_manager->IsWindowOnCurrentVirtualDesktop(m_WindowHandle, &on_current_desktop); SUCCEEDED(hr))
+		if (const HRESULT hr = desktopManager->IsWindowOnCurrentVirtualDesktop(m_WindowHandle, &on_current_desktop); SUCCEEDED(hr))
 		{
 			return on_current_desktop;
 		}
@@ -186,6 +262,11 @@ std::optional<bool> Window::on_current_desktop() const
 }
 
 bool Window::is_user_window() const
+{
+	return is_user_window(DefaultDesktopManager());
+}
+
+bool Window::is_user_window(IVirtualDesktopManager *desktopManager) const
 {
 	if (valid())
 	{
@@ -203,7 +284,7 @@ bool Window::is_user_window() const
 
 				// check the window does not have WS_EX_NOACTIVATE (or if it does, it has WS_EX_APPWINDOW)
 				// then check if it's on the current virtual desktop (currently, a cloak check also catches these, but it's an implementation detail)
-				return (!is_no_activate || is_app_window) && on_current_desktop().value_or(false);
+				return (!is_no_activate || is_app_window) && on_current_desktop(desktopManager).value_or(false);
 			}
 		}
 	}
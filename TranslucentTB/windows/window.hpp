@@ -9,11 +9,18 @@
 #include <windef.h>
 #include <winerror.h>
 #include <winuser.h>
+#include <wil/com.h>
+#include <wil/resource.h>
 
 #include "../ProgramLog/error/win32.hpp"
+#include "processimagecache.hpp"
 #include "util/null_terminated_string_view.hpp"
 #include "windowclass.hpp"
 
+using ProcessImageCache = BasicProcessImageCache<wil::unique_process_handle>;
+
+struct IVirtualDesktopManager;
+
 class Window {
 	template<DWMWINDOWATTRIBUTE attrib>
 	struct attrib_return_type;
@@ -55,6 +62,15 @@ class Window {
 	}
 
 	static std::optional<std::filesystem::path> TryGetNtImageName(DWORD pid);
+	static bool IsProcessRunning(const wil::unique_process_handle &process) noexcept;
+
+	static IVirtualDesktopManager *DefaultDesktopManager();
+
+	static wil::srwlock s_ProcessImageLock;
+	static ProcessImageCache s_ProcessImages;
+
+	template<typename T>
+	static std::optional<T> GetProcessImage(DWORD pid, T ProcessImage:: *member);
 
 protected:
 	HWND m_WindowHandle;
@@ -120,9 +136,23 @@ public:
 
 	std::optional<std::filesystem::path> file() const;
 
+	// Only the file name of file(), which is what the window filter and rules match against.
+	std::optional<std::wstring> filename() const;
+
+	// Processes often own many windows, so file() and filename() remember the image of
+	// recently seen processes. This changes how many of them are remembered.
+	static void SetProcessImageCacheCapacity(std::size_t capacity);
+	static ProcessImageCache::Stats GetProcessImageCacheStats();
+
+	// The desktop manager used by the functions below when none is given. It lives in the
+	// apartment of the first thread that needed it, so other threads should bring their own.
+	static wil::com_ptr<IVirtualDesktopManager> CreateDesktopManager();
+
 	std::optional<bool> on_current_desktop() const;
+	std::optional<bool> on_current_desktop(IVirtualDesktopManager *desktopManager) const;
 
 	bool is_user_window() const;
+	bool is_user_window(IVirtualDesktopManager *desktopManager) const;
 
 	inline bool valid() const noexcept
 	{
@@ -0,0 +1,284 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+// Remembers the class name, title and process file name of windows, which are
+// otherwise queried over and over for the same window by the window filter,
+// the appearance rules and the worker.
+//
+// T is the window type. It needs to be hashable and have classname(), title() and
+// filename() members returning a std::optional<std::wstring>.
+//
+// Class names and file names are interned, because a handful of them is shared by
+// most windows. Titles are stored per window since they change all the time.
+// Returned pointers are null when the query failed, and stay valid until the cache
+// is used for another window, or the window is invalidated.
+//
+// Nothing here notices changes on its own: the owner must call erase() when
+// a window gets destroyed and invalidate_title() when its title changes.
+//
+// Not thread-safe. To look windows up on another thread, give that thread its own cache
+// and carry what it found over with snapshot() and prime().
+template<typename T>
+class WindowIdentityCache {
+public:
+	struct Stats {
+		std::uint64_t Hits = 0;
+		std::uint64_t Misses = 0;
+		std::uint64_t Evictions = 0;
+		std::uint64_t Invalidations = 0;
+
+		double hit_rate() const noexcept
+		{
+			const auto total = Hits + Misses;
+			return total ? static_cast<double>(Hits) / total : 0.0;
+		}
+	};
+
+	// A copy of what a cache knows about a window. Each value is only meaningful if the
+	// matching Has member is set, and is nullopt when the query failed.
+	struct Identity {
+		bool HasClassName = false;
+		std::optional<std::wstring> ClassName;
+		bool HasTitle = false;
+		std::optional<std::wstring> Title;
+		bool HasFileName = false;
+		std::optional<std::wstring> FileName;
+	};
+
+	// Drop-in for the window type in the window filter and the appearance rules.
+	class CachedWindow {
+		WindowIdentityCache &m_Cache;
+		T m_Window;
+
+	public:
+		CachedWindow(WindowIdentityCache &cache, T window) noexcept : m_Cache(cache), m_Window(window) { }
+
+		const T &window() const noexcept { return m_Window; }
+		operator T() const noexcept { return m_Window; }
+
+		const std::wstring *classname() const { return m_Cache.classname(m_Window); }
+		const std::wstring *title() const { return m_Cache.title(m_Window); }
+		const std::wstring *filename() const { return m_Cache.filename(m_Window); }
+
+		bool active() const { return m_Window.active(); }
+	};
+
+private:
+	struct Entry {
+		// nullopt when not queried yet, nullptr when the query failed.
+		std::optional<const std::wstring *> ClassName;
+		std::optional<const std::wstring *> FileName;
+
+		bool HasTitle = false;
+		std::optional<std::wstring> Title;
+
+		typename std::list<T>::iterator LruPosition;
+	};
+
+	std::size_t m_Capacity;
+	std::size_t m_InternCapacity;
+	std::unordered_map<T, Entry> m_Entries;
+	std::list<T> m_Lru; // front is the most recently used
+	std::unordered_set<std::wstring> m_Interned;
+	Stats m_Stats;
+
+	Entry &get(const T &window)
+	{
+		if (const auto it = m_Entries.find(window); it != m_Entries.end())
+		{
+			m_Lru.splice(m_Lru.begin(), m_Lru, it->second.LruPosition);
+			return it->second;
+		}
+
+		if (m_Interned.size() >= m_InternCapacity)
+		{
+			// something is generating unique class names, start over
+			m_Stats.Evictions += m_Entries.size();
+			clear();
+		}
+		else if (m_Entries.size() >= m_Capacity)
+		{
+			m_Entries.erase(m_Lru.back());
+			m_Lru.pop_back();
+			++m_Stats.Evictions;
+		}
+
+		m_Lru.push_front(window);
+		auto &entry = m_Entries[window];
+		entry.LruPosition = m_Lru.begin();
+		return entry;
+	}
+
+	const std::wstring *intern(std::optional<std::wstring> str)
+	{
+		return str ? &*m_Interned.insert(std::move(*str)).first : nullptr;
+	}
+
+	template<auto query>
+	const std::wstring *interned(const T &window, std::optional<const std::wstring *> Entry:: *field)
+	{
+		auto &value = get(window).*field;
+		if (value)
+		{
+			++m_Stats.Hits;
+		}
+		else
+		{
+			++m_Stats.Misses;
+
+			// the window query might be slow, but it can't touch the cache.
+			value = intern((window.*query)());
+		}
+
+		return *value;
+	}
+
+public:
+	explicit WindowIdentityCache(std::size_t capacity = 1024, std::size_t internCapacity = 4096) :
+		m_Capacity(capacity ? capacity : 1),
+		m_InternCapacity(internCapacity ? internCapacity : 1)
+	{ }
+
+	WindowIdentityCache(const WindowIdentityCache &) = delete;
+	WindowIdentityCache &operator =(const WindowIdentityCache &) = delete;
+
+	CachedWindow operator [](T window) noexcept
+	{
+		return { *this, window };
+	}
+
+	const std::wstring *classname(const T &window)
+	{
+		return interned<&T::classname>(window, &Entry::ClassName);
+	}
+
+	const std::wstring *filename(const T &window)
+	{
+		return interned<&T::filename>(window, &Entry::FileName);
+	}
+
+	const std::wstring *title(const T &window)
+	{
+		auto &entry = get(window);
+		if (entry.HasTitle)
+		{
+			++m_Stats.Hits;
+		}
+		else
+		{
+			++m_Stats.Misses;
+			entry.Title = window.title();
+			entry.HasTitle = true;
+		}
+
+		return entry.Title ? &*entry.Title : nullptr;
+	}
+
+	// What is known about a window, without querying anything.
+	Identity snapshot(const T &window) const
+	{
+		Identity identity;
+		if (const auto it = m_Entries.find(window); it != m_Entries.end())
+		{
+			const auto &entry = it->second;
+			if (entry.ClassName)
+			{
+				identity.HasClassName = true;
+				if (*entry.ClassName)
+				{
+					identity.ClassName = **entry.ClassName;
+				}
+			}
+
+			identity.HasTitle = entry.HasTitle;
+			identity.Title = entry.Title;
+
+			if (entry.FileName)
+			{
+				identity.HasFileName = true;
+				if (*entry.FileName)
+				{
+					identity.FileName = **entry.FileName;
+				}
+			}
+		}
+
+		return identity;
+	}
+
+	// Takes what another cache knew about a window, as if it had been queried here. Only
+	// fills in what isn't known yet: the owner must invalidate first, like for a query.
+	void prime(const T &window, const Identity &identity)
+	{
+		if (!identity.HasClassName && !identity.HasTitle && !identity.HasFileName)
+		{
+			return;
+		}
+
+		auto &entry = get(window);
+		if (identity.HasClassName && !entry.ClassName)
+		{
+			entry.ClassName = intern(identity.ClassName);
+		}
+
+		if (identity.HasTitle && !entry.HasTitle)
+		{
+			entry.Title = identity.Title;
+			entry.HasTitle = true;
+		}
+
+		if (identity.HasFileName && !entry.FileName)
+		{
+			entry.FileName = intern(identity.FileName);
+		}
+	}
+
+	void invalidate_title(const T &window)
+	{
+		if (const auto it = m_Entries.find(window); it != m_Entries.end() && it->second.HasTitle)
+		{
+			it->second.HasTitle = false;
+			it->second.Title.reset();
+			++m_Stats.Invalidations;
+		}
+	}
+
+	void erase(const T &window)
+	{
+		if (const auto it = m_Entries.find(window); it != m_Entries.end())
+		{
+			m_Lru.erase(it->second.LruPosition);
+			m_Entries.erase(it);
+			++m_Stats.Invalidations;
+		}
+	}
+
+	void clear() noexcept
+	{
+		m_Entries.clear();
+		m_Lru.clear();
+		m_Interned.clear();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return m_Entries.size();
+	}
+
+	std::size_t interned_size() const noexcept
+	{
+		return m_Interned.size();
+	}
+
+	const Stats &stats() const noexcept
+	{
+		return m_Stats;
+	}
+};
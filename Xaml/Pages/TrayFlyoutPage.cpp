@@ -114,6 +114,21 @@ namespace winrt::TranslucentTB::Xaml::Pages::implementation
 		}
 	}
 
+	void TrayFlyoutPage::SetRecordWorkerEvents(const bool &recording)
+	{
+		RecordWorkerEvents().IsChecked(recording);
+	}
+
+	void TrayFlyoutPage::SetCollectWorkerMetrics(const bool &collecting)
+	{
+		CollectWorkerMetrics().IsChecked(collecting);
+	}
+
+	void TrayFlyoutPage::SetRecordPerformanceTrace(const bool &recording)
+	{
+		RecordPerformanceTrace().IsChecked(recording);
+	}
+
 	void TrayFlyoutPage::SetDisableSavingSettings(const bool &disabled)
 	{
 		DisableSavingSettings().IsChecked(disabled);
@@ -186,6 +201,26 @@ namespace winrt::TranslucentTB::Xaml::Pages::implementation
 		m_DumpDynamicStateRequestedDelegate();
 	}
 
+	void TrayFlyoutPage::DumpFlightRecorderClicked(const IInspectable &, const wux::RoutedEventArgs &)
+	{
+		m_DumpFlightRecorderRequestedDelegate();
+	}
+
+	void TrayFlyoutPage::RecordWorkerEventsClicked(const IInspectable &, const wux::RoutedEventArgs &)
+	{
+		m_RecordWorkerEventsChangedDelegate(RecordWorkerEvents().IsChecked());
+	}
+
+	void TrayFlyoutPage::CollectWorkerMetricsClicked(const IInspectable &, const wux::RoutedEventArgs &)
+	{
+		m_CollectWorkerMetricsChangedDelegate(CollectWorkerMetrics().IsChecked());
+	}
+
+	void TrayFlyoutPage::RecordPerformanceTraceClicked(const IInspectable &, const wux::RoutedEventArgs &)
+	{
+		m_RecordPerformanceTraceChangedDelegate(RecordPerformanceTrace().IsChecked());
+	}
+
 	void TrayFlyoutPage::EditSettingsClicked(const IInspectable &, const wux::RoutedEventArgs &)
 	{
 		m_EditSettingsRequestedDelegate();
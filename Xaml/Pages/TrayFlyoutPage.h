@@ -29,6 +29,10 @@ namespace winrt::TranslucentTB::Xaml::Pages::implementation
 		DECL_EVENT(OpenLogFileRequestedDelegate, OpenLogFileRequested, m_OpenLogFileRequestedDelegate);
 		DECL_EVENT(LogLevelChangedDelegate, LogLevelChanged, m_LogLevelChangedDelegate);
 		DECL_EVENT(DumpDynamicStateRequestedDelegate, DumpDynamicStateRequested, m_DumpDynamicStateRequestedDelegate);
+		DECL_EVENT(DumpFlightRecorderRequestedDelegate, DumpFlightRecorderRequested, m_DumpFlightRecorderRequestedDelegate);
+		DECL_EVENT(RecordWorkerEventsChangedDelegate, RecordWorkerEventsChanged, m_RecordWorkerEventsChangedDelegate);
+		DECL_EVENT(CollectWorkerMetricsChangedDelegate, CollectWorkerMetricsChanged, m_CollectWorkerMetricsChangedDelegate);
+		DECL_EVENT(RecordPerformanceTraceChangedDelegate, RecordPerformanceTraceChanged, m_RecordPerformanceTraceChangedDelegate);
 		DECL_EVENT(EditSettingsRequestedDelegate, EditSettingsRequested, m_EditSettingsRequestedDelegate);
 		DECL_EVENT(ResetSettingsRequestedDelegate, ResetSettingsRequested, m_ResetSettingsRequestedDelegate);
 		DECL_EVENT(DisableSavingSettingsChangedDelegate, DisableSavingSettingsChanged, m_DisableSavingSettingsChangedDelegate);
@@ -43,6 +47,9 @@ namespace winrt::TranslucentTB::Xaml::Pages::implementation
 		void SetTaskbarSettings(const txmp::TaskbarState &state, const txmp::TaskbarAppearance &appearance);
 		void SetTaskbarType(const txmp::TaskbarType &type);
 		void SetLogLevel(const txmp::LogLevel &level);
+		void SetRecordWorkerEvents(const bool &recording);
+		void SetCollectWorkerMetrics(const bool &collecting);
+		void SetRecordPerformanceTrace(const bool &recording);
 		void SetDisableSavingSettings(const bool &disabled);
 		void SetStartupState(const wf::IReference<Windows::ApplicationModel::StartupTaskState> &state);
 
@@ -55,6 +62,10 @@ namespace winrt::TranslucentTB::Xaml::Pages::implementation
 		void OpenLogFileClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
 		void LogLevelClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
 		void DumpDynamicStateClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
+		void DumpFlightRecorderClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
+		void RecordWorkerEventsClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
+		void CollectWorkerMetricsClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
+		void RecordPerformanceTraceClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
 		void EditSettingsClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
 		void ResetSettingsClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);
 		void DisableSavingSettingsClicked(const IInspectable &sender, const wux::RoutedEventArgs &args);